@@ -0,0 +1,190 @@
+/**
+ * @file clientDownload.cpp
+ * @brief Unit testing for the downloads of the client against a loopback server on the default port.
+ *
+ * @date October 18, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+#include <gtest/gtest.h>
+#include "tftp_client.hpp"
+#include <thread>
+
+static std::string readTestFile(const std::string& fileName){
+    std::ifstream fd("./testfiles/" + fileName, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(fd)), std::istreambuf_iterator<char>());
+}
+
+static void writeTestFile(const std::string& fileName, const std::string& content){
+    std::ofstream fd("./testfiles/" + fileName, std::ios::binary | std::ios::trunc);
+    fd.write(content.data(), content.size());
+}
+
+/**
+ * @brief Listen socket of the server on the default port and a transfer socket answering the client from another port
+*/
+class ClientDownloadTest : public ::testing::Test {
+    protected:
+        int listenSocket = -1;
+        int transferSocket = -1;
+        struct sockaddr_in clientAddress;
+        TftpOptions request;
+        void SetUp() override {
+            STARK::getInstance().setRootDir("./testfiles/");
+            listenSocket = createUDPSocket("127.0.0.1", TFTP_DEFAULT_PORT, 5);
+            ASSERT_NE(listenSocket, -1);
+            int transferPort = 0;
+            transferSocket = createRandomUDPSocket("127.0.0.1", &transferPort);
+            ASSERT_NE(transferSocket, -1);
+            ASSERT_TRUE(setSocketTimeout(transferSocket, 5));
+            memset(&clientAddress, 0, sizeof(clientAddress));
+            memset(&request, 0, sizeof(request));
+        }
+        void TearDown() override {
+            close(listenSocket);
+            close(transferSocket);
+        }
+        // Reads the RRQ of the client and its options
+        bool receiveRequest(){
+            uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+            int recvLen = getBufferThroughUDP(recvBuffer, sizeof(recvBuffer), listenSocket, clientAddress);
+            uint16_t opcode = 0;
+            uint16_t unused = 0;
+            if(recvLen == -1 || !parsePacketHeader(recvBuffer, recvLen, opcode, unused) || opcode != TFTP_OPCODE_RRQ){
+                return false;
+            }
+            // The file name follows the opcode, the mode follows the file name and the options the mode
+            size_t fileNameEnd = 2 + strnlen((const char*)recvBuffer + 2, recvLen - 2);
+            size_t modeEnd = fileNameEnd + 1 + strnlen((const char*)recvBuffer + fileNameEnd + 1, recvLen - fileNameEnd - 1);
+            return parseOptions(recvBuffer + modeEnd + 1, recvLen - modeEnd - 1, request);
+        }
+        bool sendOACK(const TftpOptions& oack){
+            uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+            int sendPacketSize = makeOACKPacket(sendBuffer, sizeof(sendBuffer), oack);
+            return sendBufferThroughUDP(sendBuffer, sendPacketSize, transferSocket, clientAddress) == sendPacketSize;
+        }
+        // Sends content from offset in lockstep, every DATA waits for the ACK of the one before
+        bool sendFrom(const std::string& content, uint64_t offset, int blockSize){
+            uint8_t packet[TFTP_MAX_PACKET_SIZE];
+            uint16_t blockNum = 0;
+            bool isFinalSent = false;
+            while(true){
+                struct sockaddr_in recvAddress;
+                int recvLen = getBufferThroughUDP(packet, sizeof(packet), transferSocket, recvAddress);
+                uint16_t opcode = 0;
+                uint16_t ackedBlockNum = 0;
+                if(recvLen == -1 || !parsePacketHeader(packet, recvLen, opcode, ackedBlockNum) || opcode != TFTP_OPCODE_ACK){
+                    return false;
+                }
+                if(ackedBlockNum != blockNum){
+                    continue;
+                }
+                if(isFinalSent){
+                    return true;
+                }
+                size_t dataLen = std::min((size_t)blockSize, content.size() - offset);
+                int packetLen = makeDataPacket(packet, sizeof(packet), ++blockNum, (uint8_t*)content.data() + offset, dataLen);
+                if(sendBufferThroughUDP(packet, packetLen, transferSocket, clientAddress) != packetLen){
+                    return false;
+                }
+                offset += dataLen;
+                isFinalSent = (dataLen < (size_t)blockSize);
+            }
+        }
+};
+
+TEST_F(ClientDownloadTest, ResumedAfterPartialFile) {
+    std::string text;
+    for(int i = 0; i < 200; ++i){
+        text += "line " + std::to_string(i) + " of the file resumed by the client\n";
+    }
+    writeTestFile("resume.txt", text);
+    Huffman compressor;
+    compressor.setRootDir("./testfiles/");
+    compressor.setFileName("resume.txt");
+    ASSERT_TRUE(compressor.compressFile());
+    std::string compressed = readTestFile("resume.txt.cmp");
+    ASSERT_GT(compressed.size(), 1500u);
+    // An interrupted download left the first 700 bytes, not a whole number of blocks
+    writeTestFile("resume.txt.cmp", compressed.substr(0, 700));
+    ASSERT_EQ(remove("./testfiles/resume.txt"), 0);
+
+    bool isServed = false;
+    std::thread server([&](){
+        if(!receiveRequest() || !request.hasOffset){
+            return;
+        }
+        TftpOptions oack;
+        memset(&oack, 0, sizeof(oack));
+        oack.blockSize = 512;
+        oack.hasOffset = true;
+        oack.offset = request.offset;
+        isServed = sendOACK(oack) && sendFrom(compressed, request.offset, 512);
+    });
+    clientManager& client = clientManager::getInstance();
+    ASSERT_TRUE(client.commInit("./testfiles/", "resume.txt", "127.0.0.1", TFTP_OPCODE_RRQ, 512, 1, 0, false, false, 0));
+    client.handleTFTPConnection();
+    client.commExit();
+    server.join();
+
+    ASSERT_TRUE(isServed);
+    ASSERT_EQ(request.offset, 700u);
+    ASSERT_EQ(readTestFile("resume.txt"), text);
+    ASSERT_FALSE(STARK::getInstance().isFileAvailable("resume.txt.cmp"));
+    remove("./testfiles/resume.txt");
+}
+
+TEST_F(ClientDownloadTest, FailedMulticastKeepsBlocksInOrder) {
+    std::string content;
+    for(int i = 0; i < 4 * 512; ++i){
+        content += (char)('a' + i / 512);
+    }
+    struct sockaddr_in groupAddress;
+    memset(&groupAddress, 0, sizeof(groupAddress));
+    groupAddress.sin_family = AF_INET;
+    groupAddress.sin_port = htons(1871);
+    inet_pton(AF_INET, "239.255.0.71", &groupAddress.sin_addr);
+    int groupPort = 0;
+    int groupSocket = createRandomUDPSocket("127.0.0.1", &groupPort);
+    ASSERT_NE(groupSocket, -1);
+    ASSERT_TRUE(setMulticastSender(groupSocket, "127.0.0.1", 1));
+
+    bool isServed = false;
+    std::thread server([&](){
+        if(!receiveRequest() || !request.multicast){
+            return;
+        }
+        TftpOptions oack;
+        memset(&oack, 0, sizeof(oack));
+        oack.blockSize = 512;
+        oack.multicast = true;
+        oack.multicastAddress = groupAddress;
+        if(!sendOACK(oack)){
+            return;
+        }
+        // Block 3 is lost on the way to the client, block 4 is written after a hole
+        usleep(200000);
+        uint8_t packet[TFTP_MAX_PACKET_SIZE];
+        for(uint16_t blockNum : {1, 2, 4}){
+            int packetLen = makeDataPacket(packet, sizeof(packet), blockNum, (uint8_t*)content.data() + (blockNum - 1) * 512, 512);
+            sendBufferThroughUDP(packet, packetLen, groupSocket, groupAddress);
+        }
+        usleep(200000);
+        int packetLen = makeErrorPacket(packet, sizeof(packet), TFTP_ERROR_NOT_DEFINED, "server stopped");
+        isServed = (sendBufferThroughUDP(packet, packetLen, transferSocket, clientAddress) == packetLen);
+    });
+    clientManager& client = clientManager::getInstance();
+    ASSERT_TRUE(client.commInit("./testfiles/", "group.txt", "127.0.0.1", TFTP_OPCODE_RRQ, 512, 4, 0, false, true, 0));
+    client.handleTFTPConnection();
+    client.commExit();
+    server.join();
+    close(groupSocket);
+
+    // The next READ resumes after the blocks received in order, the hole and block 4 are dropped
+    ASSERT_TRUE(isServed);
+    ASSERT_EQ(readTestFile("group.txt.cmp"), content.substr(0, 2 * 512));
+    ASSERT_FALSE(STARK::getInstance().isFileAvailable("group.txt"));
+    remove("./testfiles/group.txt.cmp");
+}
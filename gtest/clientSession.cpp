@@ -0,0 +1,420 @@
+/**
+ * @file clientSession.cpp
+ * @brief Unit testing for the ClientHandler state machine driven through a recording SessionIO.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+#include <gtest/gtest.h>
+#include "tftp_server.hpp"
+
+/**
+ * @brief SessionIO completing every operation at once and recording the packets, reads and read-aheads
+*/
+class RecordingSessionIO : public SessionIO {
+    public:
+        std::vector<std::string> packets;
+        std::vector<std::pair<uint64_t, int>> reads;
+        std::vector<std::pair<uint64_t, uint64_t>> readAheads;
+        std::vector<uint64_t> requestedEnds; // end of the read-ahead range at every read
+        int maxBlockSize = TFTP_MAX_BLOCK_SIZE;
+        bool sendPacket(ClientHandler* session, uint8_t* packet, int packetLen) override {
+            packets.push_back(std::string((const char*)packet, packetLen));
+            return true;
+        }
+        bool readAndSend(ClientHandler* session, uint64_t offset, int dataLen) override {
+            reads.push_back(std::make_pair(offset, dataLen));
+            requestedEnds.push_back(readAheads.empty() ? 0 : readAheads.back().first + readAheads.back().second);
+            return true;
+        }
+        bool writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock) override {
+            return true;
+        }
+        void readAhead(ClientHandler* session, uint64_t offset, uint64_t length) override {
+            readAheads.push_back(std::make_pair(offset, length));
+        }
+        int getMaxBlockSize() override {
+            return maxBlockSize;
+        }
+};
+
+static void ackUntilDone(ClientHandler& session){
+    uint8_t ackPacket[TFTP_MAX_HEADER_SIZE];
+    for(int i = 0; i < 100000 && !session.isDone(); ++i){
+        int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), toWireBlockNum(session.blockNum, session.rollover));
+        session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    }
+}
+
+/**
+ * @brief Session of the client on a loopback transfer socket, its packets recorded by io
+*/
+class ClientSessionTest : public ::testing::Test {
+    protected:
+        int clientPort = 0;
+        int transferSocket = -1;
+        struct sockaddr_in clientAddress;
+        RecordingSessionIO io;
+        char fileName[7] = "pi.txt";
+        char mode[6] = "octet";
+        void SetUp() override {
+            STARK::getInstance().setRootDir("./testfiles/");
+            transferSocket = createRandomUDPSocket("127.0.0.1", &clientPort);
+            ASSERT_NE(transferSocket, -1);
+            memset(&clientAddress, 0, sizeof(clientAddress));
+            clientAddress.sin_family = AF_INET;
+            clientAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            clientAddress.sin_port = htons(clientPort);
+        }
+        void TearDown() override {
+            close(transferSocket);
+        }
+};
+
+TEST_F(ClientSessionTest, ReadAheadStaysAheadOfReads) {
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+
+    uint64_t window = (uint64_t)TftpConfig::getInstance().readAheadKB << 10;
+    uint64_t fileSize = session.fileSize;
+    ASSERT_EQ(io.reads.size(), fileSize / TFTP_MAX_DATA_SIZE + 1);
+    // Contiguous ranges of at least half a window, up to the end of the file
+    uint64_t end = 0;
+    for(size_t i = 0; i < io.readAheads.size(); ++i){
+        ASSERT_EQ(io.readAheads[i].first, end);
+        if(i + 1 < io.readAheads.size()){
+            ASSERT_GE(io.readAheads[i].second, window / 2);
+        }
+        end += io.readAheads[i].second;
+    }
+    ASSERT_EQ(end, fileSize);
+    // Every block was requested at least half a window before it was read
+    for(size_t i = 0; i < io.reads.size(); ++i){
+        ASSERT_GE(io.requestedEnds[i], std::min(io.reads[i].first + window / 2, fileSize));
+    }
+}
+
+TEST_F(ClientSessionTest, BlockSizeNegotiatedWithOACK) {
+    io.maxBlockSize = 1000;
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = 1428;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+
+    // The requested block size is lowered to the limit of the SessionIO, DATA 1 waits for ACK 0
+    ASSERT_EQ(session.blockSize, 1000);
+    ASSERT_TRUE(io.reads.empty());
+    ASSERT_EQ(io.packets.size(), 1u);
+    ASSERT_EQ(io.packets[0], std::string("\0\6blksize\0" "1000\0", 15));
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+
+    ASSERT_EQ(io.reads.size(), session.fileSize / 1000 + 1);
+    for(size_t i = 0; i < io.reads.size(); ++i){
+        ASSERT_EQ(io.reads[i].first, i * 1000);
+    }
+    ASSERT_EQ(io.reads.back().second, (int)(session.fileSize % 1000));
+}
+
+TEST_F(ClientSessionTest, RetransmissionTimeoutFollowsRtt) {
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(session.timeoutSec, 0);
+    ASSERT_LE(session.getTimeoutMs(), TFTP_RTO_INITIAL_MS);
+
+    // ACKs answered at once bring the RTO down to its lower limit
+    uint8_t ackPacket[TFTP_MAX_HEADER_SIZE];
+    for(int i = 0; i < 8; ++i){
+        int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), toWireBlockNum(session.blockNum, session.rollover));
+        session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    }
+    ASSERT_EQ(session.rtt.samples, 8u);
+    int rtoMs = session.rtt.getTimeoutMs();
+    ASSERT_EQ(rtoMs, TftpConfig::getInstance().rtoMinMs);
+
+    // A timeout below the largest RTO backs off without counting against the session
+    uint64_t sentBlock = session.blockNum;
+    size_t numPackets = io.packets.size();
+    session.handleTimeout();
+    ASSERT_EQ(session.timeoutCount, 0);
+    ASSERT_EQ(session.rtt.getTimeoutMs(), 2 * rtoMs);
+    ASSERT_EQ(io.packets.size(), numPackets + 1);
+    ASSERT_EQ(session.blockNum, sentBlock);
+    // The ACK of the retransmitted block is not sampled (Karn)
+    int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), toWireBlockNum(session.blockNum, session.rollover));
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(session.rtt.samples, 8u);
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+}
+
+TEST_F(ClientSessionTest, TimeoutAndTransferSizeNegotiated) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.timeout = 2;
+    options.hasTransferSize = true;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+
+    // The OACK answers tsize 0 with the file size, the retransmission deadline follows the timeout
+    std::string expectedOACK = std::string("\0\6timeout\0" "2\0tsize\0", 18) + std::to_string(session.fileSize) + std::string("\0", 1);
+    ASSERT_EQ(io.packets[0], expectedOACK);
+    ASSERT_EQ(session.timeoutSec, 2);
+    ASSERT_LE(session.getTimeoutMs(), 2000);
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    close(transferSocket);
+
+    // An upload larger than the free space is refused before any data moves
+    transferSocket = createRandomUDPSocket("127.0.0.1", &clientPort);
+    ASSERT_NE(transferSocket, -1);
+    char uploadName[] = "huge.bin";
+    options.timeout = 0;
+    options.transferSize = 1ULL << 60;
+    ClientHandler upload(-1, clientAddress, TFTP_OPCODE_WRQ, uploadName, mode, options);
+    upload.setIO(&io, NULL);
+    ASSERT_FALSE(upload.startTransfer(transferSocket));
+    ASSERT_EQ(io.packets.back().substr(0, 4), std::string("\0\5\0\3", 4));
+    upload.finishTransfer();
+    ASSERT_FALSE(STARK::getInstance().isFileAvailable(uploadName));
+}
+
+TEST_F(ClientSessionTest, WindowResentFromGap) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.windowSize = 4;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(session.windowSize, 4);
+    ASSERT_EQ(io.packets[0], std::string("\0\6windowsize\0" "4\0", 15));
+
+    uint8_t ackPacket[TFTP_MAX_HEADER_SIZE];
+    int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), 0);
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    // A whole window is sent without waiting for an ACK
+    ASSERT_EQ(io.reads.size(), 4u);
+    ASSERT_EQ(session.blockNum, 4u);
+
+    // ACK 2 reports the loss of block 3, the congestion window is halved and restarts after it
+    ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), 2);
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(session.cwnd.getWindow(), 2);
+    ASSERT_EQ(session.cwnd.losses, 1u);
+    ASSERT_EQ(io.reads.size(), 6u);
+    for(size_t i = 4; i < 6; ++i){
+        ASSERT_EQ(io.reads[i].first, (i - 2) * TFTP_MAX_DATA_SIZE);
+    }
+    // A duplicate of ACK 2 reports the loss of the resent block 3 as well, the window is cut once per window in flight
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), 8u);
+    ASSERT_EQ(io.reads[6].first, 2u * TFTP_MAX_DATA_SIZE);
+    ASSERT_EQ(session.cwnd.getWindow(), 2);
+    ASSERT_EQ(session.cwnd.losses, 1u);
+
+    // Clean ACKs grow the window back to the negotiated windowsize, one block per window
+    ackUntilDone(session);
+    ASSERT_EQ(session.cwnd.getWindow(), 4);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    ASSERT_EQ(io.reads.back().first + io.reads.back().second, session.fileSize);
+}
+
+TEST_F(ClientSessionTest, AckPastRewoundWindowGoesOn) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.windowSize = 4;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+
+    uint8_t ackPacket[TFTP_MAX_HEADER_SIZE];
+    int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), 0);
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(session.blockNum, 4u);
+    // A duplicate ACK 0 rewinds the window, blocks 1 and 2 are sent again
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(session.blockNum, 2u);
+    ASSERT_EQ(io.reads.size(), 6u);
+
+    // The receiver had blocks 3 and 4 of the first window, the window goes on after them
+    ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), 4);
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_GT(io.reads.size(), 6u);
+    ASSERT_EQ(io.reads[6].first, 4u * TFTP_MAX_DATA_SIZE);
+    // An ACK of a block never sent is ignored
+    size_t numReads = io.reads.size();
+    uint64_t blockNum = session.blockNum;
+    ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), (uint16_t)(blockNum + 1));
+    session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), numReads);
+    ASSERT_EQ(session.blockNum, blockNum);
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    ASSERT_EQ(io.reads.back().first + io.reads.back().second, session.fileSize);
+}
+
+TEST_F(ClientSessionTest, MissingBlocksResentAfterNAK) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.windowSize = 8;
+    options.nak = true;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(io.packets[0], std::string("\0\6windowsize\0" "8\0nak\0" "1\0", 21));
+
+    uint8_t packet[TFTP_MAX_PACKET_SIZE];
+    int packetLen = makeACKPacket(packet, sizeof(packet), 0);
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), 4u);
+    ASSERT_EQ(session.blockNum, 4u);
+
+    // NAK 1 with blocks 3 and 4 held: only block 2 is resent
+    const uint8_t bitmap[] = {0x80};
+    packetLen = makeNAKPacket(packet, sizeof(packet), 1, bitmap, sizeof(bitmap));
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), 5u);
+    ASSERT_EQ(io.reads[4].first, 1u * TFTP_MAX_DATA_SIZE);
+    ASSERT_EQ(session.blockNum, 4u);
+    ASSERT_EQ(session.blocksResent, 1u);
+    ASSERT_EQ(session.cwnd.losses, 1u);
+
+    // The resent block fills the gap, the ACK of block 4 slides the window past it
+    packetLen = makeACKPacket(packet, sizeof(packet), 4);
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_GT(io.reads.size(), 5u);
+    ASSERT_EQ(io.reads[5].first, 4u * TFTP_MAX_DATA_SIZE);
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    ASSERT_EQ(session.blocksResent, 1u);
+    session.finishTransfer();
+}
+
+TEST_F(ClientSessionTest, MulticastGroupHandedOverToMember) {
+    ASSERT_TRUE(MulticastRegistry::getInstance().init("239.255.0.69", 1858, "127.0.0.1"));
+    int memberPort = 0;
+    int memberSocket = createRandomUDPSocket("127.0.0.1", &memberPort);
+    ASSERT_NE(memberSocket, -1);
+    struct sockaddr_in memberAddress = clientAddress;
+    memberAddress.sin_port = htons(memberPort);
+
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = 1000;
+    options.multicast = true;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(io.packets[0], std::string("\0\6blksize\0" "1000\0multicast\0" "239.255.0.69,1858,1\0", 45));
+
+    // A RRQ with a larger block joins the group, a smaller block can not be served by it
+    TftpOptions memberOptions;
+    memset(&memberOptions, 0, sizeof(memberOptions));
+    memberOptions.blockSize = 1428;
+    memberOptions.multicast = true;
+    ASSERT_TRUE(MulticastRegistry::getInstance().join(fileName, memberAddress, memberOptions));
+    uint8_t packet[TFTP_MAX_PACKET_SIZE];
+    int packetLen = recv(memberSocket, packet, sizeof(packet), MSG_DONTWAIT);
+    ASSERT_EQ(std::string((const char*)packet, packetLen), std::string("\0\6blksize\0" "1000\0multicast\0" "239.255.0.69,1858,0\0", 45));
+    memberOptions.blockSize = 512;
+    ASSERT_FALSE(MulticastRegistry::getInstance().join(fileName, memberAddress, memberOptions));
+
+    packetLen = makeACKPacket(packet, sizeof(packet), 0);
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    packetLen = makeACKPacket(packet, sizeof(packet), 1);
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), 2u);
+
+    // The master gives up, the member becomes master and ACK 0 sends the file again from its start
+    packetLen = makeErrorPacket(packet, sizeof(packet), TFTP_ERROR_NOT_DEFINED, "bye");
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_EQ(ntohs(session.clientAddress.sin_port), memberPort);
+    ASSERT_EQ(io.packets.back(), std::string("\0\6multicast\0" "239.255.0.69,1858,1\0", 32));
+    packetLen = makeACKPacket(packet, sizeof(packet), 0);
+    session.handlePacket(packet, packetLen, session.clientAddress);
+    ASSERT_EQ(io.reads.size(), 3u);
+    ASSERT_EQ(io.reads.back().first, 0u);
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    ASSERT_EQ(io.reads.back().first + io.reads.back().second, session.fileSize);
+
+    // The group closed with the session, a new RRQ gets its own transfer
+    memberOptions.blockSize = 1000;
+    ASSERT_FALSE(MulticastRegistry::getInstance().join(fileName, memberAddress, memberOptions));
+    close(memberSocket);
+}
+
+TEST_F(ClientSessionTest, BlockNumbersRollOverToOne) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = TFTP_MIN_BLOCK_SIZE;
+    options.windowSize = 16;
+    options.hasRollover = true;
+    options.rollover = 1;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(io.packets[0], std::string("\0\6blksize\0" "8\0windowsize\0" "16\0rollover\0" "1\0", 37));
+
+    // 125001 blocks of 8 bytes, block 65536 goes out as 1 and the following blocks are ACKed by their wire number
+    uint8_t ackPacket[TFTP_MAX_HEADER_SIZE];
+    bool rolledOver = false;
+    for(int i = 0; i < 100000 && !session.isDone(); ++i){
+        if(!rolledOver && session.blockNum > 65535){
+            uint16_t opcode = 0;
+            uint16_t wireBlockNum = 0;
+            ASSERT_TRUE(parsePacketHeader(session.lastPacket, session.lastPacketLen, opcode, wireBlockNum));
+            ASSERT_EQ(wireBlockNum, session.blockNum - 65535);
+            rolledOver = true;
+        }
+        int ackLen = makeACKPacket(ackPacket, sizeof(ackPacket), toWireBlockNum(session.blockNum, session.rollover));
+        session.handlePacket(ackPacket, ackLen, session.clientAddress);
+    }
+    ASSERT_TRUE(rolledOver);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    ASSERT_EQ(io.reads.size(), session.fileSize / TFTP_MIN_BLOCK_SIZE + 1);
+    ASSERT_EQ(io.reads.back().first, session.fileSize);
+    ASSERT_EQ(session.cwnd.losses, 0u);
+}
+
+TEST_F(ClientSessionTest, RangeSentFromOffset) {
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = TFTP_MIN_BLOCK_SIZE;
+    options.hasOffset = true;
+    options.offset = 1000;
+    options.hasLength = true;
+    options.length = 20;
+    ClientHandler session(-1, clientAddress, TFTP_OPCODE_RRQ, fileName, mode, options);
+    session.setIO(&io, NULL);
+    ASSERT_TRUE(session.startTransfer(transferSocket));
+    ASSERT_EQ(io.packets[0], std::string("\0\6blksize\0" "8\0offset\0" "1000\0length\0" "20\0", 34));
+
+    // Blocks 1 to 3 hold bytes 1000 to 1019 of the file
+    ackUntilDone(session);
+    ASSERT_TRUE(session.transferSuccess);
+    session.finishTransfer();
+    ASSERT_EQ(io.reads.size(), 3u);
+    ASSERT_EQ(io.reads[0], std::make_pair((uint64_t)1000, 8));
+    ASSERT_EQ(io.reads[1], std::make_pair((uint64_t)1008, 8));
+    ASSERT_EQ(io.reads[2], std::make_pair((uint64_t)1016, 4));
+    ASSERT_EQ(session.blockNum, 3u);
+}
@@ -0,0 +1,246 @@
+/**
+ * @file eventLoop.cpp
+ * @brief Unit testing for the event loops of the server, transfers run over loopback through a running loop.
+ * The io_uring loop is skipped where the kernel refuses io_uring_setup.
+ *
+ * @date October 18, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+#include <gtest/gtest.h>
+#include "tftp_engine.hpp"
+#include "tftp_uring.hpp"
+#include <thread>
+
+static std::string readTestFile(const std::string& fileName){
+    std::ifstream fd("./testfiles/" + fileName, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(fd)), std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Request socket of a loop on a random loopback port and the socket of a client talking to it in lockstep
+*/
+class EventLoopTest : public ::testing::Test {
+    protected:
+        int listenSocket = -1;
+        int clientSocket = -1;
+        struct sockaddr_in serverAddress;
+        std::thread loopThread;
+        void SetUp() override {
+            STARK::getInstance().setRootDir("./testfiles/");
+            int listenPort = 0;
+            listenSocket = createRandomUDPSocket("127.0.0.1", &listenPort);
+            ASSERT_NE(listenSocket, -1);
+            ASSERT_TRUE(setSocketNonBlocking(listenSocket));
+            int clientPort = 0;
+            clientSocket = createRandomUDPSocket("127.0.0.1", &clientPort);
+            ASSERT_NE(clientSocket, -1);
+            ASSERT_TRUE(setSocketTimeout(clientSocket, 5));
+            memset(&serverAddress, 0, sizeof(serverAddress));
+            serverAddress.sin_family = AF_INET;
+            serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            serverAddress.sin_port = htons(listenPort);
+        }
+        void TearDown() override {
+            close(listenSocket);
+            close(clientSocket);
+        }
+        void startLoop(EventLoop& loop){
+            loopThread = std::thread([&loop](){
+                loop.run();
+            });
+        }
+        void stopLoop(EventLoop& loop){
+            loop.stop();
+            loopThread.join();
+        }
+        bool sendRequest(TftpOpcode opcode, const char* fileName){
+            uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+            int sendPacketSize = makeComInitPacket(opcode, sendBuffer, sizeof(sendBuffer), fileName, TFTP_MODE_OCTET);
+            return sendBufferThroughUDP(sendBuffer, sendPacketSize, clientSocket, serverAddress) == sendPacketSize;
+        }
+        // Reads a file of the server with 512 byte blocks, every DATA is ACKed to the transfer socket of the session
+        bool download(const char* fileName, std::string& content){
+            if(!sendRequest(TFTP_OPCODE_RRQ, fileName)){
+                return false;
+            }
+            uint8_t packet[TFTP_MAX_PACKET_SIZE];
+            uint16_t blockNum = 0;
+            while(true){
+                struct sockaddr_in transferAddress;
+                int recvLen = getBufferThroughUDP(packet, sizeof(packet), clientSocket, transferAddress);
+                uint16_t opcode = 0;
+                uint16_t recvBlockNum = 0;
+                if(recvLen == -1 || !parsePacketHeader(packet, recvLen, opcode, recvBlockNum) || opcode != TFTP_OPCODE_DATA){
+                    return false;
+                }
+                if(recvBlockNum == (uint16_t)(blockNum + 1)){
+                    blockNum++;
+                    content.append((const char*)packet + TFTP_MAX_HEADER_SIZE, recvLen - TFTP_MAX_HEADER_SIZE);
+                }
+                int ackLen = makeACKPacket(packet, sizeof(packet), blockNum);
+                if(sendBufferThroughUDP(packet, ackLen, clientSocket, transferAddress) != ackLen){
+                    return false;
+                }
+                if(recvLen - TFTP_MAX_HEADER_SIZE < TFTP_MAX_DATA_SIZE){
+                    return true;
+                }
+            }
+        }
+        // Writes a file to the server with 512 byte blocks, every DATA waits for the ACK of the one before
+        bool upload(const char* fileName, const std::string& content){
+            if(!sendRequest(TFTP_OPCODE_WRQ, fileName)){
+                return false;
+            }
+            uint8_t packet[TFTP_MAX_PACKET_SIZE];
+            uint16_t blockNum = 0;
+            size_t offset = 0;
+            bool isFinalSent = false;
+            while(true){
+                struct sockaddr_in transferAddress;
+                int recvLen = getBufferThroughUDP(packet, sizeof(packet), clientSocket, transferAddress);
+                uint16_t opcode = 0;
+                uint16_t ackedBlockNum = 0;
+                if(recvLen == -1 || !parsePacketHeader(packet, recvLen, opcode, ackedBlockNum) || opcode != TFTP_OPCODE_ACK){
+                    return false;
+                }
+                if(ackedBlockNum != blockNum){
+                    continue;
+                }
+                if(isFinalSent){
+                    return true;
+                }
+                size_t dataLen = std::min((size_t)TFTP_MAX_DATA_SIZE, content.size() - offset);
+                int packetLen = makeDataPacket(packet, sizeof(packet), ++blockNum, (uint8_t*)content.data() + offset, dataLen);
+                if(sendBufferThroughUDP(packet, packetLen, clientSocket, transferAddress) != packetLen){
+                    return false;
+                }
+                offset += dataLen;
+                isFinalSent = (dataLen < TFTP_MAX_DATA_SIZE);
+            }
+        }
+        // Sandboxes and older kernels refuse io_uring_setup, the io_uring loop can not run there
+        bool isUringAvailable(){
+            IoUring probe;
+            return probe.init(TFTP_URING_LISTEN_DEPTH);
+        }
+        // The upload is moved into place once the session closes its file, after the final ACK
+        std::string readUpload(const std::string& fileName, size_t expectedSize){
+            std::string content;
+            for(int i = 0; i < 100 && content.size() != expectedSize; ++i){
+                usleep(10000);
+                content = readTestFile(fileName);
+            }
+            return content;
+        }
+};
+
+TEST_F(EventLoopTest, EpollReadRequest) {
+    EpollLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    std::string content;
+    bool isDownloaded = download("asyoulik.txt", content);
+    stopLoop(loop);
+    ASSERT_TRUE(isDownloaded);
+    ASSERT_EQ(content, readTestFile("asyoulik.txt"));
+}
+
+TEST_F(EventLoopTest, EpollWriteRequest) {
+    std::string content = readTestFile("asyoulik.txt");
+    remove("./testfiles/epollUpload.txt");
+    EpollLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    bool isUploaded = upload("epollUpload.txt", content);
+    std::string uploaded = readUpload("epollUpload.txt", content.size());
+    stopLoop(loop);
+    remove("./testfiles/epollUpload.txt");
+    ASSERT_TRUE(isUploaded);
+    ASSERT_EQ(uploaded, content);
+}
+
+TEST_F(EventLoopTest, EpollWriteRequestLargerThanBuffer) {
+    // The chunks of the write-behind buffer are written by the chunk writer and reused many times
+    std::string content = readTestFile("pi.txt");
+    ASSERT_GT(content.size(), (size_t)TftpConfig::getInstance().writeBehindKB << 10);
+    remove("./testfiles/epollLarge.txt");
+    EpollLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    bool isUploaded = upload("epollLarge.txt", content);
+    std::string uploaded = readTestFile("epollLarge.txt");
+    stopLoop(loop);
+    remove("./testfiles/epollLarge.txt");
+    ASSERT_TRUE(isUploaded);
+    ASSERT_EQ(uploaded, content);
+}
+
+TEST_F(EventLoopTest, UringReadRequest) {
+    if(!isUringAvailable()){
+        GTEST_SKIP()<<"io_uring not available";
+    }
+    UringLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    std::string content;
+    bool isDownloaded = download("asyoulik.txt", content);
+    stopLoop(loop);
+    ASSERT_TRUE(isDownloaded);
+    ASSERT_EQ(content, readTestFile("asyoulik.txt"));
+}
+
+TEST_F(EventLoopTest, UringWriteRequest) {
+    if(!isUringAvailable()){
+        GTEST_SKIP()<<"io_uring not available";
+    }
+    std::string content = readTestFile("asyoulik.txt");
+    remove("./testfiles/uringUpload.txt");
+    UringLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    bool isUploaded = upload("uringUpload.txt", content);
+    std::string uploaded = readUpload("uringUpload.txt", content.size());
+    stopLoop(loop);
+    remove("./testfiles/uringUpload.txt");
+    ASSERT_TRUE(isUploaded);
+    ASSERT_EQ(uploaded, content);
+}
+
+TEST_F(EventLoopTest, EpollWriteRequestAckedOnceCommitted) {
+    std::string content = readTestFile("asyoulik.txt");
+    remove("./testfiles/epollCommitted.txt");
+    ASSERT_TRUE(STARK::getInstance().startGroupCommit(100));
+    EpollLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    bool isUploaded = upload("epollCommitted.txt", content);
+    // The final ACK waits for the group commit, the upload is in place when it arrives
+    std::string uploaded = readTestFile("epollCommitted.txt");
+    stopLoop(loop);
+    STARK::getInstance().stopGroupCommit();
+    remove("./testfiles/epollCommitted.txt");
+    ASSERT_TRUE(isUploaded);
+    ASSERT_EQ(uploaded, content);
+}
+
+TEST_F(EventLoopTest, UringWriteRequestAckedOnceCommitted) {
+    if(!isUringAvailable()){
+        GTEST_SKIP()<<"io_uring not available";
+    }
+    std::string content = readTestFile("asyoulik.txt");
+    remove("./testfiles/uringCommitted.txt");
+    ASSERT_TRUE(STARK::getInstance().startGroupCommit(100));
+    UringLoop loop(0, listenSocket);
+    ASSERT_TRUE(loop.init());
+    startLoop(loop);
+    bool isUploaded = upload("uringCommitted.txt", content);
+    std::string uploaded = readTestFile("uringCommitted.txt");
+    stopLoop(loop);
+    STARK::getInstance().stopGroupCommit();
+    remove("./testfiles/uringCommitted.txt");
+    ASSERT_TRUE(isUploaded);
+    ASSERT_EQ(uploaded, content);
+}
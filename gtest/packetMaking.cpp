@@ -11,8 +11,10 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include <fstream>
+#include <sys/stat.h>
 #include "tftp_packets.hpp"
 #include "tftp_stark.hpp"
+#include "tftp_server.hpp"
 
 class TFTPTest : public testing::Test {};
 
@@ -208,6 +210,270 @@ TEST(TFTP_ACK_PACKET_TESTING, ACKPacket){
     ASSERT_EQ(memcmp(expected, ackPacket, ret), 0);
 }
 
+// blksize option of a request and of its OACK
+TEST(TFTP_OACK_PACKET_TESTING, BlockSizeOption){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = 1428;
+
+    int ret = makeComInitPacket(TFTP_OPCODE_WRQ, sendBuffer, sizeof(sendBuffer), "file.bin", "octet", &options);
+    const char expectedRequest[] = "\0\2file.bin\0octet\0blksize\0" "1428";
+    ASSERT_EQ(ret, (int)sizeof(expectedRequest));
+    ASSERT_EQ(memcmp(sendBuffer, expectedRequest, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 17, ret - 17, parsed));
+    ASSERT_EQ(parsed.blockSize, 1428);
+
+    ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6blksize\0" "1428";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+
+    // Names are case insensitive, unknown options are ignored and the block size is kept within RFC 2348
+    const char clamped[] = "utimeout\0" "0\0BLKSIZE\0" "100000";
+    ASSERT_TRUE(parseOptions((const uint8_t*)clamped, sizeof(clamped), parsed));
+    ASSERT_EQ(parsed.blockSize, TFTP_MAX_BLOCK_SIZE);
+    const char tooSmall[] = "blksize\0" "7";
+    ASSERT_FALSE(parseOptions((const uint8_t*)tooSmall, sizeof(tooSmall), parsed));
+    const char unterminated[] = {'b', 'l', 'k', 's', 'i', 'z', 'e', '\0', '5', '1', '2'};
+    ASSERT_FALSE(parseOptions((const uint8_t*)unterminated, sizeof(unterminated), parsed));
+    ASSERT_TRUE(parseOptions(NULL, 0, parsed));
+    ASSERT_EQ(parsed.blockSize, 0);
+}
+
+// windowsize option appended after blksize, and its RFC 7440 range
+TEST(TFTP_OACK_PACKET_TESTING, WindowSizeOption){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = 1468;
+    options.windowSize = 16;
+
+    int ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6blksize\0" "1468\0windowsize\0" "16";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_EQ(parsed.blockSize, 1468);
+    ASSERT_EQ(parsed.windowSize, 16);
+
+    const char largest[] = "WindowSize\0" "65535";
+    ASSERT_TRUE(parseOptions((const uint8_t*)largest, sizeof(largest), parsed));
+    ASSERT_EQ(parsed.windowSize, TFTP_MAX_WINDOW_SIZE);
+    ASSERT_EQ(parsed.blockSize, 0);
+    const char zero[] = "windowsize\0" "0";
+    ASSERT_FALSE(parseOptions((const uint8_t*)zero, sizeof(zero), parsed));
+    const char tooLarge[] = "windowsize\0" "65536";
+    ASSERT_FALSE(parseOptions((const uint8_t*)tooLarge, sizeof(tooLarge), parsed));
+}
+
+TEST(TFTP_OACK_PACKET_TESTING, TimeoutAndTransferSizeOptions){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.timeout = 3;
+    options.hasTransferSize = true;
+    options.transferSize = 5000000000ULL;
+
+    int ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6timeout\0" "3\0tsize\0" "5000000000";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_EQ(parsed.timeout, 3);
+    ASSERT_TRUE(parsed.hasTransferSize);
+    ASSERT_EQ(parsed.transferSize, 5000000000ULL);
+
+    // tsize 0 of a RRQ asks for the file size
+    const char query[] = "TSIZE\0" "0";
+    ASSERT_TRUE(parseOptions((const uint8_t*)query, sizeof(query), parsed));
+    ASSERT_TRUE(parsed.hasTransferSize);
+    ASSERT_EQ(parsed.transferSize, 0u);
+    ASSERT_EQ(parsed.timeout, 0);
+    const char negative[] = "tsize\0" "-1";
+    ASSERT_FALSE(parseOptions((const uint8_t*)negative, sizeof(negative), parsed));
+    const char zero[] = "timeout\0" "0";
+    ASSERT_FALSE(parseOptions((const uint8_t*)zero, sizeof(zero), parsed));
+    const char tooLarge[] = "timeout\0" "256";
+    ASSERT_FALSE(parseOptions((const uint8_t*)tooLarge, sizeof(tooLarge), parsed));
+}
+
+// nak option and the NAK packet of selective repeat
+TEST(TFTP_OACK_PACKET_TESTING, NAKPacketAndOption){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.windowSize = 8;
+    options.nak = true;
+
+    int ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6windowsize\0" "8\0nak\0" "1";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_TRUE(parsed.nak);
+    const char invalid[] = "nak\0" "2";
+    ASSERT_FALSE(parseOptions((const uint8_t*)invalid, sizeof(invalid), parsed));
+
+    // Blocks 11 and 14 missing after block 10
+    const uint8_t bitmap[] = {0x90};
+    ret = makeNAKPacket(sendBuffer, sizeof(sendBuffer), 10, bitmap, sizeof(bitmap));
+    const uint8_t expectedNAK[] = {0, 7, 0, 10, 0x90};
+    ASSERT_EQ(ret, (int)sizeof(expectedNAK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedNAK, ret), 0);
+    ASSERT_EQ(makeNAKPacket(sendBuffer, 4, 10, bitmap, sizeof(bitmap)), -1);
+}
+
+// multicast option, empty in a RRQ and "addr,port,mc" in the OACK (RFC 2090)
+TEST(TFTP_OACK_PACKET_TESTING, MulticastOption){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.multicast = true;
+
+    int ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedRequest[] = "\0\6multicast\0";
+    ASSERT_EQ(ret, (int)sizeof(expectedRequest));
+    ASSERT_EQ(memcmp(sendBuffer, expectedRequest, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_TRUE(parsed.multicast);
+    ASSERT_EQ(parsed.multicastAddress.sin_port, 0);
+
+    options.multicastAddress.sin_family = AF_INET;
+    options.multicastAddress.sin_addr.s_addr = inet_addr("239.255.0.69");
+    options.multicastAddress.sin_port = htons(1758);
+    options.multicastMaster = true;
+    ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6multicast\0" "239.255.0.69,1758,1";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_TRUE(parsed.multicast);
+    ASSERT_TRUE(parsed.multicastMaster);
+    ASSERT_EQ(parsed.multicastAddress.sin_addr.s_addr, inet_addr("239.255.0.69"));
+    ASSERT_EQ(ntohs(parsed.multicastAddress.sin_port), 1758);
+
+    // Address and port left out, the ones of the first OACK still apply
+    const char masterOnly[] = "Multicast\0" ",,1";
+    ASSERT_TRUE(parseOptions((const uint8_t*)masterOnly, sizeof(masterOnly), parsed));
+    ASSERT_TRUE(parsed.multicastMaster);
+    ASSERT_EQ(parsed.multicastAddress.sin_port, 0);
+    const char badFlag[] = "multicast\0" "239.255.0.69,1758,2";
+    ASSERT_FALSE(parseOptions((const uint8_t*)badFlag, sizeof(badFlag), parsed));
+    const char badAddress[] = "multicast\0" "239.255.0,1758,0";
+    ASSERT_FALSE(parseOptions((const uint8_t*)badAddress, sizeof(badAddress), parsed));
+    const char emptyValue[] = "blksize\0";
+    ASSERT_FALSE(parseOptions((const uint8_t*)emptyValue, sizeof(emptyValue), parsed));
+}
+
+// Opcode 6 is DEL from a client and OACK from a server, each side refuses the other meaning
+TEST(TFTP_OACK_PACKET_TESTING, OpcodeSixByDirection){
+    uint8_t packet[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    memset(&options, 0, sizeof(options));
+    options.blockSize = 1428;
+    int oackLen = makeOACKPacket(packet, sizeof(packet), options);
+    ASSERT_GT(oackLen, 0);
+
+    // The client takes it for an OACK, the server refuses it as a DEL request
+    TftpOptions parsed;
+    ASSERT_TRUE(parseOACKPacket(packet, oackLen, parsed));
+    ASSERT_EQ(parsed.blockSize, 1428);
+    uint16_t opcode;
+    char fileName[TFTP_MAX_DATA_SIZE];
+    char mode[TFTP_MAX_MODE_SIZE];
+    TftpErrorCode errorCode;
+    const char* errorMsg = NULL;
+    ASSERT_FALSE(parseConnectionRequest(packet, oackLen, opcode, fileName, mode, parsed, errorCode, errorMsg));
+    ASSERT_EQ(errorCode, TFTP_ERROR_ILLEGAL_OPERATION);
+    // An OACK of octet-like options is refused for carrying options
+    const char octetOACK[] = "\0\6" "file\0octet\0blksize\0" "512";
+    ASSERT_FALSE(parseConnectionRequest((uint8_t*)octetOACK, sizeof(octetOACK), opcode, fileName, mode, parsed, errorCode, errorMsg));
+    ASSERT_STREQ(errorMsg, "options in a delete request");
+
+    // The server takes a DEL for a delete request, the client refuses it as an OACK
+    int delLen = makeComInitPacket(TFTP_OPCODE_DEL, packet, sizeof(packet), "file.bin", "octet");
+    ASSERT_GT(delLen, 0);
+    ASSERT_TRUE(parseConnectionRequest(packet, delLen, opcode, fileName, mode, parsed, errorCode, errorMsg));
+    ASSERT_EQ(opcode, TFTP_OPCODE_DEL);
+    ASSERT_STREQ(fileName, "file.bin");
+    ASSERT_FALSE(parseOACKPacket(packet, delLen, parsed));
+    const char emptyOACK[] = "\0\6";
+    ASSERT_FALSE(parseOACKPacket((const uint8_t*)emptyOACK, sizeof(emptyOACK), parsed));
+}
+
+// offset and length options of a resumed RRQ
+TEST(TFTP_OACK_PACKET_TESTING, OffsetAndLengthOptions){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.hasOffset = true;
+    options.offset = 5000000000ULL;
+
+    int ret = makeComInitPacket(TFTP_OPCODE_RRQ, sendBuffer, sizeof(sendBuffer), "file.bin", "octet", &options);
+    const char expectedRequest[] = "\0\1file.bin\0octet\0offset\0" "5000000000";
+    ASSERT_EQ(ret, (int)sizeof(expectedRequest));
+    ASSERT_EQ(memcmp(sendBuffer, expectedRequest, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 17, ret - 17, parsed));
+    ASSERT_TRUE(parsed.hasOffset);
+    ASSERT_EQ(parsed.offset, 5000000000ULL);
+    ASSERT_FALSE(parsed.hasLength);
+
+    options.hasLength = true;
+    options.length = 0;
+    ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6offset\0" "5000000000\0length\0" "0";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_TRUE(parsed.hasLength);
+    ASSERT_EQ(parsed.length, 0u);
+    const char negative[] = "offset\0" "-1";
+    ASSERT_FALSE(parseOptions((const uint8_t*)negative, sizeof(negative), parsed));
+    const char notNumber[] = "length\0" "10k";
+    ASSERT_FALSE(parseOptions((const uint8_t*)notNumber, sizeof(notNumber), parsed));
+}
+
+// rollover option and the block numbers following 65535
+TEST(TFTP_OACK_PACKET_TESTING, RolloverOptionAndBlockNumbers){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    TftpOptions options;
+    TftpOptions parsed;
+    memset(&options, 0, sizeof(options));
+    options.hasRollover = true;
+    options.rollover = 1;
+
+    int ret = makeOACKPacket(sendBuffer, sizeof(sendBuffer), options);
+    const char expectedOACK[] = "\0\6rollover\0" "1";
+    ASSERT_EQ(ret, (int)sizeof(expectedOACK));
+    ASSERT_EQ(memcmp(sendBuffer, expectedOACK, ret), 0);
+    ASSERT_TRUE(parseOptions(sendBuffer + 2, ret - 2, parsed));
+    ASSERT_TRUE(parsed.hasRollover);
+    ASSERT_EQ(parsed.rollover, 1);
+    const char invalid[] = "rollover\0" "2";
+    ASSERT_FALSE(parseOptions((const uint8_t*)invalid, sizeof(invalid), parsed));
+
+    ASSERT_EQ(toWireBlockNum(65535, 0), 65535);
+    ASSERT_EQ(toWireBlockNum(65536, 0), 0);
+    ASSERT_EQ(toWireBlockNum(65536, 1), 1);
+    ASSERT_EQ(toWireBlockNum(131070, 1), 65535);
+    ASSERT_EQ(toWireBlockNum(131071, 1), 1);
+    ASSERT_EQ(toWireBlockNum(5000000000ULL, 0), (uint16_t)5000000000ULL);
+    // Distances are counted forward across the rollover
+    ASSERT_EQ(wireBlockDistance(65530, 2, 0), 8u);
+    ASSERT_EQ(wireBlockDistance(65530, 2, 1), 7u);
+    ASSERT_EQ(wireBlockDistance(0, 0, 1), 0u);
+    ASSERT_EQ(wireBlockDistance(131070, 65535, 1), 0u);
+    ASSERT_EQ(wireBlockDistance(131070, 3, 1), 3u);
+    ASSERT_EQ(wireBlockDistance(5000000000ULL, toWireBlockNum(5000000016ULL, 1), 1), 16u);
+}
+
 
 // =================================================================================================
 
@@ -280,4 +546,290 @@ TEST(STARKFileDeletableTest, EmptyFileName) {
 
     // Check if the file is not deletable due to an empty file name
     EXPECT_FALSE(result);
+}
+TEST(STARKFileMappingTest, ReadersShareOneMapping) {
+    STARK::getInstance().setRootDir("./testfiles/");
+    const std::string fileName = "asyoulik.txt";
+    TftpErrorCode errorCode;
+    struct stat fileStat;
+    ASSERT_EQ(stat((STARK::getInstance().root_dir + fileName).c_str(), &fileStat), 0);
+    uint64_t fileSize = (uint64_t)fileStat.st_size;
+
+    int firstFD = STARK::getInstance().openReadableFile(fileName, errorCode);
+    int secondFD = STARK::getInstance().openReadableFile(fileName, errorCode);
+    ASSERT_NE(firstFD, -1);
+    ASSERT_NE(secondFD, -1);
+    std::shared_ptr<FileMapping> firstMap = STARK::getInstance().mapReadableFile(fileName, firstFD, fileStat, true);
+    std::shared_ptr<FileMapping> secondMap = STARK::getInstance().mapReadableFile(fileName, secondFD, fileStat, true);
+    ASSERT_TRUE(firstMap != NULL);
+    ASSERT_EQ(firstMap, secondMap);
+
+    // Block views at N * 512 bytes, the last one is short
+    uint64_t lastBlock = (fileSize - 1) / TFTP_MAX_DATA_SIZE;
+    int lastLen = (int)(fileSize - lastBlock * TFTP_MAX_DATA_SIZE);
+    ASSERT_EQ(firstMap->getView(TFTP_MAX_DATA_SIZE, TFTP_MAX_DATA_SIZE), firstMap->getData() + TFTP_MAX_DATA_SIZE);
+    ASSERT_TRUE(firstMap->getView(lastBlock * TFTP_MAX_DATA_SIZE, lastLen) != NULL);
+    ASSERT_TRUE(firstMap->getView(lastBlock * TFTP_MAX_DATA_SIZE, lastLen + 1) == NULL);
+    ASSERT_TRUE(firstMap->getView(fileSize, 0) != NULL);
+
+    // The mapping outlives the readers while a session still holds it
+    ASSERT_TRUE(STARK::getInstance().closeReadableFile(fileName, firstFD));
+    ASSERT_TRUE(STARK::getInstance().closeReadableFile(fileName, secondFD));
+    secondMap.reset();
+    ASSERT_EQ(firstMap.use_count(), 1);
+
+    // A reader opening the file again gets a new mapping
+    int thirdFD = STARK::getInstance().openReadableFile(fileName, errorCode);
+    ASSERT_NE(thirdFD, -1);
+    std::shared_ptr<FileMapping> thirdMap = STARK::getInstance().mapReadableFile(fileName, thirdFD, fileStat, true);
+    ASSERT_TRUE(thirdMap != NULL);
+    ASSERT_NE(thirdMap, firstMap);
+    ASSERT_TRUE(STARK::getInstance().closeReadableFile(fileName, thirdFD));
+    ASSERT_TRUE(STARK::getInstance().mapReadableFile(fileName, thirdFD, fileStat, true) == NULL);
+}
+
+TEST(STARKFileCacheTest, LRUEvictionAndInvalidation) {
+    const char* fileNames[] = {"./testfiles/alice29.txt", "./testfiles/asyoulik.txt", "./testfiles/pi.txt"};
+    struct stat fileStats[3];
+    std::shared_ptr<FileMapping> contents[3];
+    for(int i = 0; i < 3; ++i){
+        int fd = open(fileNames[i], O_RDONLY);
+        ASSERT_NE(fd, -1);
+        ASSERT_EQ(fstat(fd, &fileStats[i]), 0);
+        contents[i] = FileMapping::load(fd, (uint64_t)fileStats[i].st_size);
+        close(fd);
+        ASSERT_TRUE(contents[i] != NULL);
+    }
+    std::ifstream original(fileNames[1], std::ios::binary);
+    std::string originalData((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(std::string((const char*)contents[1]->getData(), contents[1]->getSize()), originalData);
+
+    // Room for pi.txt and one of the other files
+    FileCache cache;
+    uint64_t budget = contents[0]->getSize() + contents[2]->getSize();
+    cache.setLimits(budget, budget);
+    ASSERT_TRUE(cache.lookup("alice29.txt", fileStats[0]) == NULL);
+    cache.insert("alice29.txt", fileStats[0], contents[0]);
+    cache.insert("asyoulik.txt", fileStats[1], contents[1]);
+    ASSERT_EQ(cache.getUsedBytes(), contents[0]->getSize() + contents[1]->getSize());
+    ASSERT_EQ(cache.lookup("alice29.txt", fileStats[0]), contents[0]);
+
+    // asyoulik.txt is the least recently used file
+    cache.insert("pi.txt", fileStats[2], contents[2]);
+    ASSERT_EQ(cache.evictions, 1u);
+    ASSERT_TRUE(cache.lookup("asyoulik.txt", fileStats[1]) == NULL);
+    ASSERT_EQ(cache.lookup("pi.txt", fileStats[2]), contents[2]);
+
+    // A modified file does not hit its stale copy
+    struct stat modifiedStat = fileStats[0];
+    modifiedStat.st_mtim.tv_sec++;
+    ASSERT_TRUE(cache.lookup("alice29.txt", modifiedStat) == NULL);
+    cache.invalidate("pi.txt");
+    ASSERT_EQ(cache.size(), 0u);
+    ASSERT_EQ(cache.getUsedBytes(), 0u);
+    ASSERT_EQ(cache.invalidations, 2u);
+    ASSERT_EQ(cache.hits, 2u);
+    ASSERT_EQ(cache.misses, 3u);
+
+    // Files over the size limit are not cached
+    cache.setLimits(budget, contents[2]->getSize() - 1);
+    cache.insert("pi.txt", fileStats[2], contents[2]);
+    ASSERT_EQ(cache.size(), 0u);
+}
+
+// Builds the image outside of the cache calls, as STARK does outside of its lock
+static std::shared_ptr<PacketImage> getPacketImage(FileCache& cache, const std::string& fileName, const std::shared_ptr<FileMapping>& content, int blockSize){
+    bool buildDue = false;
+    std::shared_ptr<PacketImage> packetImage = cache.findPacketImage(fileName, content, blockSize, buildDue);
+    if(!buildDue){
+        return packetImage;
+    }
+    return cache.addPacketImage(fileName, content, blockSize, PacketImage::build(content->getData(), content->getSize(), blockSize));
+}
+
+TEST(STARKFileCacheTest, PacketImageOfHotFile) {
+    int fd = open("./testfiles/asyoulik.txt", O_RDONLY);
+    ASSERT_NE(fd, -1);
+    struct stat fileStat;
+    ASSERT_EQ(fstat(fd, &fileStat), 0);
+    std::shared_ptr<FileMapping> content = FileMapping::load(fd, (uint64_t)fileStat.st_size);
+    close(fd);
+    ASSERT_TRUE(content != NULL);
+
+    FileCache cache;
+    cache.setLimits(4 * content->getSize(), content->getSize());
+    cache.insert("asyoulik.txt", fileStat, content);
+    // Downloaded once, not hot yet
+    ASSERT_TRUE(getPacketImage(cache, "asyoulik.txt", content, TFTP_MAX_DATA_SIZE) == NULL);
+    ASSERT_EQ(cache.lookup("asyoulik.txt", fileStat), content);
+    std::shared_ptr<PacketImage> packetImage = getPacketImage(cache, "asyoulik.txt", content, TFTP_MAX_DATA_SIZE);
+    ASSERT_TRUE(packetImage != NULL);
+    ASSERT_EQ(getPacketImage(cache, "asyoulik.txt", content, TFTP_MAX_DATA_SIZE), packetImage);
+    ASSERT_EQ(cache.imagesBuilt, 1u);
+    ASSERT_EQ(cache.getUsedBytes(), content->getSize() + packetImage->getBytes());
+
+    // Every packet is the one makeDataPacket builds for the block
+    uint8_t expected[TFTP_MAX_PACKET_SIZE];
+    uint64_t numBlocks = content->getSize() / TFTP_MAX_DATA_SIZE + 1;
+    for(uint64_t blockIndex = 0; blockIndex < numBlocks; ++blockIndex){
+        int packetLen = 0;
+        const uint8_t* packet = packetImage->getPacket(blockIndex, packetLen);
+        ASSERT_TRUE(packet != NULL);
+        uint64_t offset = blockIndex * TFTP_MAX_DATA_SIZE;
+        size_t dataLen = std::min((uint64_t)TFTP_MAX_DATA_SIZE, content->getSize() - offset);
+        int expectedLen = makeDataPacket(expected, sizeof(expected), (uint16_t)(blockIndex + 1), (uint8_t*)content->getData() + offset, dataLen);
+        ASSERT_EQ(packetLen, expectedLen);
+        ASSERT_EQ(memcmp(packet, expected, packetLen), 0);
+    }
+    int packetLen = 0;
+    ASSERT_TRUE(packetImage->getPacket(numBlocks, packetLen) == NULL);
+
+    cache.invalidate("asyoulik.txt");
+    ASSERT_EQ(cache.getUsedBytes(), 0u);
+    ASSERT_TRUE(getPacketImage(cache, "asyoulik.txt", content, TFTP_MAX_DATA_SIZE) == NULL);
+}
+
+TEST(STARKFileCacheTest, PacketImageDroppedWhenInvalidatedWhileBuilt) {
+    int fd = open("./testfiles/asyoulik.txt", O_RDONLY);
+    ASSERT_NE(fd, -1);
+    struct stat fileStat;
+    ASSERT_EQ(fstat(fd, &fileStat), 0);
+    std::shared_ptr<FileMapping> content = FileMapping::load(fd, (uint64_t)fileStat.st_size);
+    close(fd);
+    ASSERT_TRUE(content != NULL);
+
+    FileCache cache;
+    cache.setLimits(4 * content->getSize(), content->getSize());
+    cache.insert("asyoulik.txt", fileStat, content);
+    ASSERT_EQ(cache.lookup("asyoulik.txt", fileStat), content);
+    // The bytes of the image are reserved while it is built, a second caller does not build it again
+    bool buildDue = false;
+    ASSERT_TRUE(cache.findPacketImage("asyoulik.txt", content, TFTP_MAX_DATA_SIZE, buildDue) == NULL);
+    ASSERT_TRUE(buildDue);
+    uint64_t reservedBytes = cache.getUsedBytes() - content->getSize();
+    ASSERT_GT(reservedBytes, content->getSize());
+    ASSERT_TRUE(cache.findPacketImage("asyoulik.txt", content, TFTP_MAX_DATA_SIZE, buildDue) == NULL);
+    ASSERT_FALSE(buildDue);
+    std::shared_ptr<PacketImage> packetImage = PacketImage::build(content->getData(), content->getSize(), TFTP_MAX_DATA_SIZE);
+    ASSERT_EQ(packetImage->getBytes(), reservedBytes);
+
+    // The file changed meanwhile, the image of its old content is not kept
+    cache.invalidate("asyoulik.txt");
+    ASSERT_EQ(cache.getUsedBytes(), 0u);
+    ASSERT_TRUE(cache.addPacketImage("asyoulik.txt", content, TFTP_MAX_DATA_SIZE, packetImage) == NULL);
+    ASSERT_EQ(cache.getUsedBytes(), 0u);
+    ASSERT_EQ(cache.imagesBuilt, 0u);
+}
+
+TEST(STARKWriteBehindTest, BlocksWrittenInChunks) {
+    int sourceFD = open("./testfiles/pi.txt", O_RDONLY);
+    ASSERT_NE(sourceFD, -1);
+    struct stat fileStat;
+    ASSERT_EQ(fstat(sourceFD, &fileStat), 0);
+    std::shared_ptr<FileMapping> source = FileMapping::load(sourceFD, (uint64_t)fileStat.st_size);
+    close(sourceFD);
+    ASSERT_TRUE(source != NULL);
+    const char* copyPath = "./testfiles/writeBehind.bin";
+    int copyFD = open(copyPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(copyFD, -1);
+
+    std::shared_ptr<WriteBehind> writeBehind = WriteBehind::create(2 * TFTP_WRITE_CHUNK_SIZE);
+    ASSERT_TRUE(writeBehind != NULL);
+    uint64_t offset = 0;
+    bool blocked = false;
+    while(offset < source->getSize()){
+        size_t dataLen = std::min((uint64_t)TFTP_MAX_DATA_SIZE, source->getSize() - offset);
+        if(!writeBehind->append(source->getData() + offset, dataLen, offset)){
+            // Both chunks are full: nothing was copied and the block fits once a chunk is written
+            blocked = true;
+            ASSERT_EQ(writeBehind->nextChunk(false), (int)((offset / TFTP_WRITE_CHUNK_SIZE) % 2));
+            ASSERT_TRUE(writeBehind->flush(copyFD, false));
+            ASSERT_TRUE(writeBehind->isEmpty());
+            continue;
+        }
+        offset += dataLen;
+    }
+    ASSERT_TRUE(blocked);
+    ASSERT_FALSE(writeBehind->isEmpty());
+    ASSERT_TRUE(writeBehind->flush(copyFD, true));
+    ASSERT_TRUE(writeBehind->isEmpty());
+    ASSERT_EQ(writeBehind->chunksWritten, (source->getSize() + TFTP_WRITE_CHUNK_SIZE - 1) / TFTP_WRITE_CHUNK_SIZE);
+
+    ASSERT_EQ(fstat(copyFD, &fileStat), 0);
+    ASSERT_EQ((uint64_t)fileStat.st_size, source->getSize());
+    std::shared_ptr<FileMapping> copy = FileMapping::load(copyFD, (uint64_t)fileStat.st_size);
+    close(copyFD);
+    unlink(copyPath);
+    ASSERT_TRUE(copy != NULL);
+    ASSERT_EQ(memcmp(copy->getData(), source->getData(), source->getSize()), 0);
+}
+
+TEST(STARKUploadTest, VisibleOnlyOnceCommitted) {
+    STARK& stark = STARK::getInstance();
+    stark.setRootDir("./testfiles/");
+    TftpErrorCode errorCode;
+    const char content[] = "uploaded content";
+    unlink("./testfiles/upload.txt");
+
+    int fd = stark.openWritableFile("upload.txt", errorCode);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, content, sizeof(content)), (ssize_t)sizeof(content));
+    // Neither readers nor a second upload see the file in progress
+    ASSERT_FALSE(stark.isFileAvailable("upload.txt"));
+    ASSERT_TRUE(stark.isFileAvailable(TFTP_UPLOAD_PREFIX "upload.txt"));
+    ASSERT_EQ(stark.openReadableFile(TFTP_UPLOAD_PREFIX "upload.txt", errorCode), -1);
+    ASSERT_EQ(stark.openWritableFile("upload.txt", errorCode), -1);
+    ASSERT_EQ(stark.openWritableFile(TFTP_UPLOAD_PREFIX "other.txt", errorCode), -1);
+    ASSERT_TRUE(stark.commitWritableFile("upload.txt", fd));
+    ASSERT_FALSE(stark.isFileAvailable(TFTP_UPLOAD_PREFIX "upload.txt"));
+    struct stat fileStat;
+    ASSERT_EQ(stat("./testfiles/upload.txt", &fileStat), 0);
+    ASSERT_EQ(fileStat.st_size, (off_t)sizeof(content));
+    ASSERT_EQ(stark.openWritableFile("upload.txt", errorCode), -1);
+    ASSERT_EQ(errorCode, TFTP_ERROR_FILE_ALREADY_EXISTS);
+
+    // The writer entry follows the rename: the file is readable and deletable right away
+    int readFD = stark.openReadableFile("upload.txt", errorCode);
+    ASSERT_NE(readFD, -1);
+    ASSERT_TRUE(stark.closeReadableFile("upload.txt", readFD));
+    ASSERT_TRUE(stark.isFileDeletable("upload.txt", errorCode));
+
+    // An aborted upload leaves nothing behind
+    fd = stark.openWritableFile("upload.txt", errorCode);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, content, 4), 4);
+    ASSERT_TRUE(stark.closeWritableFile("upload.txt", fd));
+    ASSERT_FALSE(stark.isFileAvailable("upload.txt"));
+    ASSERT_FALSE(stark.isFileAvailable(TFTP_UPLOAD_PREFIX "upload.txt"));
+}
+
+TEST(STARKUploadTest, GroupCommitRenamesOnceSynced) {
+    STARK& stark = STARK::getInstance();
+    stark.setRootDir("./testfiles/");
+    TftpErrorCode errorCode;
+    const char content[] = "uploaded content";
+    unlink("./testfiles/grouped.txt");
+    uint64_t uploadsCommitted = stark.uploadsCommitted;
+    uint64_t groupCommits = stark.groupCommits;
+    ASSERT_TRUE(stark.startGroupCommit(60000));
+
+    int fd = stark.openWritableFile("grouped.txt", errorCode);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, content, sizeof(content)), (ssize_t)sizeof(content));
+    ASSERT_TRUE(stark.commitWritableFile("grouped.txt", fd));
+    // The upload waits for the sync of its window before it is renamed, the name stays reserved meanwhile
+    ASSERT_FALSE(stark.isFileAvailable("grouped.txt"));
+    ASSERT_TRUE(stark.isFileAvailable(TFTP_UPLOAD_PREFIX "grouped.txt"));
+    ASSERT_EQ(stark.openWritableFile("grouped.txt", errorCode), -1);
+    ASSERT_EQ(stark.uploadsCommitted, uploadsCommitted);
+
+    // Stopping runs the last group commit at once
+    stark.stopGroupCommit();
+    ASSERT_EQ(stark.groupCommits, groupCommits + 1);
+    ASSERT_EQ(stark.uploadsCommitted, uploadsCommitted + 1);
+    ASSERT_FALSE(stark.isFileAvailable(TFTP_UPLOAD_PREFIX "grouped.txt"));
+    struct stat fileStat;
+    ASSERT_EQ(stat("./testfiles/grouped.txt", &fileStat), 0);
+    ASSERT_EQ(fileStat.st_size, (off_t)sizeof(content));
+    ASSERT_TRUE(stark.isFileDeletable("grouped.txt", errorCode));
 }
\ No newline at end of file
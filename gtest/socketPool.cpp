@@ -0,0 +1,258 @@
+/**
+ * @file socketPool.cpp
+ * @brief Unit testing for the transfer socket pool, the random port sockets and the DATA send paths.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+#include <gtest/gtest.h>
+#include "tftp_socket.hpp"
+#include "tftp_stark.hpp"
+#include <sys/stat.h>
+
+static int getSocketPort(int socketfd){
+    struct sockaddr_in boundAddress;
+    socklen_t addressLen = sizeof(boundAddress);
+    if(getsockname(socketfd, (struct sockaddr*)&boundAddress, &addressLen) == -1){
+        return -1;
+    }
+    return ntohs(boundAddress.sin_port);
+}
+
+// Takes the free sockets ahead of socketfd and releases them behind it
+static int acquireReleased(UDPSocketPool& pool, int socketfd){
+    std::vector<int> ahead;
+    int acquired = pool.acquire();
+    while(acquired != socketfd && acquired != -1 && ahead.size() < pool.size()){
+        ahead.push_back(acquired);
+        acquired = pool.acquire();
+    }
+    for(int other : ahead){
+        pool.release(other);
+    }
+    return acquired;
+}
+
+TEST(SocketPoolTest, AcquireReleaseAndFallback) {
+    const int firstPort = 42000;
+    const int lastPort = 42003;
+    UDPSocketPool& pool = UDPSocketPool::getInstance();
+    int numBound = pool.init("127.0.0.1", firstPort, lastPort);
+    ASSERT_GT(numBound, 0);
+    ASSERT_EQ(pool.available(), (size_t)numBound);
+
+    std::vector<int> sockets;
+    for(int i = 0; i < numBound; ++i){
+        int socketfd = pool.acquire();
+        ASSERT_NE(socketfd, -1);
+        int port = getSocketPort(socketfd);
+        ASSERT_GE(port, firstPort);
+        ASSERT_LE(port, lastPort);
+        ASSERT_TRUE(fcntl(socketfd, F_GETFL) & O_NONBLOCK);
+        sockets.push_back(socketfd);
+    }
+    ASSERT_EQ(pool.available(), 0u);
+
+    // Exhausted pool binds a kernel chosen port
+    int extraSocket = pool.acquire();
+    ASSERT_NE(extraSocket, -1);
+    int extraPort = getSocketPort(extraSocket);
+    ASSERT_TRUE(extraPort < firstPort || extraPort > lastPort);
+    ASSERT_EQ(pool.fallbacks, 1u);
+    pool.release(extraSocket);
+    ASSERT_EQ(pool.available(), 0u);
+
+    // A datagram left by the previous client is dropped before the socket is reused
+    int peerPort = 0;
+    int peerSocket = createRandomUDPSocket("127.0.0.1", &peerPort);
+    ASSERT_NE(peerSocket, -1);
+    struct sockaddr_in poolAddress;
+    memset(&poolAddress, 0, sizeof(poolAddress));
+    poolAddress.sin_family = AF_INET;
+    poolAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    poolAddress.sin_port = htons(getSocketPort(sockets[0]));
+    uint8_t stale[4] = {0, 3, 0, 1};
+    ASSERT_EQ(sendBufferThroughUDP(stale, sizeof(stale), peerSocket, poolAddress), (int)sizeof(stale));
+    usleep(10000);
+    pool.release(sockets[0]);
+    ASSERT_EQ(pool.acquire(), sockets[0]);
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    ASSERT_EQ(recv(sockets[0], recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT), -1);
+    close(peerSocket);
+
+    for(int socketfd : sockets){
+        pool.release(socketfd);
+    }
+    ASSERT_EQ(pool.available(), (size_t)numBound);
+}
+
+TEST(SocketPoolTest, ReleasedSocketsReusedLast) {
+    UDPSocketPool& pool = UDPSocketPool::getInstance();
+    ASSERT_GE(pool.available(), 2u);
+    std::vector<int> sockets;
+    while(pool.available() > 0){
+        sockets.push_back(pool.acquire());
+    }
+    // Handed out in the order they were released
+    pool.release(sockets[1]);
+    pool.release(sockets[0]);
+    ASSERT_EQ(pool.acquire(), sockets[1]);
+    ASSERT_EQ(pool.acquire(), sockets[0]);
+    for(int socketfd : sockets){
+        pool.release(socketfd);
+    }
+    // A released socket waits behind the free ones
+    int socketfd = pool.acquire();
+    pool.release(socketfd);
+    int nextSocket = pool.acquire();
+    ASSERT_NE(nextSocket, socketfd);
+    ASSERT_EQ(acquireReleased(pool, socketfd), socketfd);
+    pool.release(nextSocket);
+    pool.release(socketfd);
+    ASSERT_EQ(pool.available(), pool.size());
+}
+
+TEST(SocketPoolTest, RandomSocketsGetDistinctPorts) {
+    std::vector<int> sockets;
+    std::vector<int> ports;
+    for(int i = 0; i < 16; ++i){
+        int port = 0;
+        int socketfd = createRandomUDPSocket("127.0.0.1", &port);
+        ASSERT_NE(socketfd, -1);
+        ASSERT_EQ(port, getSocketPort(socketfd));
+        for(int other : ports){
+            ASSERT_NE(port, other);
+        }
+        sockets.push_back(socketfd);
+        ports.push_back(port);
+    }
+    for(int socketfd : sockets){
+        close(socketfd);
+    }
+}
+
+TEST(SocketPoolTest, ConnectedSocketFiltersOtherSources) {
+    UDPSocketPool& pool = UDPSocketPool::getInstance();
+    int socketfd = pool.acquire();
+    ASSERT_NE(socketfd, -1);
+    int clientPort = 0;
+    int strayPort = 0;
+    int clientSocket = createRandomUDPSocket("127.0.0.1", &clientPort);
+    int straySocket = createRandomUDPSocket("127.0.0.1", &strayPort);
+    ASSERT_NE(clientSocket, -1);
+    ASSERT_NE(straySocket, -1);
+
+    struct sockaddr_in clientAddress;
+    memset(&clientAddress, 0, sizeof(clientAddress));
+    clientAddress.sin_family = AF_INET;
+    clientAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    clientAddress.sin_port = htons(clientPort);
+    struct sockaddr_in poolAddress = clientAddress;
+    poolAddress.sin_port = htons(getSocketPort(socketfd));
+    ASSERT_TRUE(connectUDPSocket(socketfd, clientAddress));
+
+    uint8_t packet[4] = {0, 4, 0, 1};
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    ASSERT_EQ(sendBufferThroughUDP(packet, sizeof(packet), straySocket, poolAddress), (int)sizeof(packet));
+    ASSERT_EQ(sendBufferThroughUDP(packet, sizeof(packet), clientSocket, poolAddress), (int)sizeof(packet));
+    usleep(10000);
+    struct sockaddr_in recvAddress;
+    socklen_t addressLen = sizeof(recvAddress);
+    ASSERT_EQ(recvfrom(socketfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT, (struct sockaddr*)&recvAddress, &addressLen), (ssize_t)sizeof(packet));
+    ASSERT_EQ(recvAddress.sin_port, clientAddress.sin_port);
+    ASSERT_EQ(recv(socketfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT), -1);
+
+    // Released sockets accept any source again
+    pool.release(socketfd);
+    ASSERT_EQ(acquireReleased(pool, socketfd), socketfd);
+    ASSERT_EQ(sendBufferThroughUDP(packet, sizeof(packet), straySocket, poolAddress), (int)sizeof(packet));
+    usleep(10000);
+    ASSERT_EQ(recv(socketfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT), (ssize_t)sizeof(packet));
+    pool.release(socketfd);
+    close(clientSocket);
+    close(straySocket);
+}
+
+TEST(SocketPoolTest, DatagramQueuedBeforeConnectDropped) {
+    UDPSocketPool& pool = UDPSocketPool::getInstance();
+    int socketfd = pool.acquire();
+    ASSERT_NE(socketfd, -1);
+    pool.release(socketfd);
+    int clientPort = 0;
+    int clientSocket = createRandomUDPSocket("127.0.0.1", &clientPort);
+    ASSERT_NE(clientSocket, -1);
+    struct sockaddr_in clientAddress;
+    memset(&clientAddress, 0, sizeof(clientAddress));
+    clientAddress.sin_family = AF_INET;
+    clientAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    clientAddress.sin_port = htons(clientPort);
+    struct sockaddr_in poolAddress = clientAddress;
+    poolAddress.sin_port = htons(getSocketPort(socketfd));
+
+    // Sent by the next client itself to the free socket, before its session starts
+    uint8_t packet[4] = {0, 4, 0, 1};
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    ASSERT_EQ(sendBufferThroughUDP(packet, sizeof(packet), clientSocket, poolAddress), (int)sizeof(packet));
+    usleep(10000);
+    ASSERT_EQ(acquireReleased(pool, socketfd), socketfd);
+    ASSERT_TRUE(connectTransferSocket(socketfd, clientAddress));
+    ASSERT_EQ(recv(socketfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT), -1);
+
+    // Datagrams of the client sent after the connect are delivered
+    ASSERT_EQ(sendBufferThroughUDP(packet, sizeof(packet), clientSocket, poolAddress), (int)sizeof(packet));
+    usleep(10000);
+    ASSERT_EQ(recv(socketfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT), (ssize_t)sizeof(packet));
+    pool.release(socketfd);
+    close(clientSocket);
+}
+
+TEST(SocketPoolTest, DataSentFromFileMapping) {
+    int fileFD = open("./testfiles/alice29.txt", O_RDONLY);
+    ASSERT_NE(fileFD, -1);
+    struct stat fileStat;
+    ASSERT_EQ(fstat(fileFD, &fileStat), 0);
+    std::shared_ptr<FileMapping> fileMap = FileMapping::create(fileFD, (uint64_t)fileStat.st_size);
+    close(fileFD);
+    ASSERT_TRUE(fileMap != NULL);
+    ASSERT_EQ(fileMap->getSize(), (uint64_t)fileStat.st_size);
+
+    int senderPort = 0;
+    int receiverPort = 0;
+    int senderSocket = createRandomUDPSocket("127.0.0.1", &senderPort);
+    int receiverSocket = createRandomUDPSocket("127.0.0.1", &receiverPort);
+    ASSERT_NE(senderSocket, -1);
+    ASSERT_NE(receiverSocket, -1);
+    struct sockaddr_in receiverAddress;
+    memset(&receiverAddress, 0, sizeof(receiverAddress));
+    receiverAddress.sin_family = AF_INET;
+    receiverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    receiverAddress.sin_port = htons(receiverPort);
+
+    uint8_t header[TFTP_MAX_HEADER_SIZE];
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    ASSERT_EQ(makeDataHeader(header, sizeof(header), 1), TFTP_MAX_HEADER_SIZE);
+    ASSERT_EQ(sendDataThroughUDP(senderSocket, header, sizeof(header), fileMap->getData(), TFTP_MAX_DATA_SIZE, &receiverAddress), TFTP_MAX_PACKET_SIZE);
+    ASSERT_EQ(recv(receiverSocket, recvBuffer, sizeof(recvBuffer), 0), TFTP_MAX_PACKET_SIZE);
+    ASSERT_EQ(memcmp(recvBuffer, header, sizeof(header)), 0);
+    ASSERT_EQ(memcmp(recvBuffer + TFTP_MAX_HEADER_SIZE, fileMap->getData(), TFTP_MAX_DATA_SIZE), 0);
+
+    // The queued entry keeps the mapping alive after its owner dropped it
+    std::string expected((const char*)fileMap->getData() + TFTP_MAX_DATA_SIZE, 100);
+    UDPSendBatch sendBatch(4);
+    ASSERT_EQ(makeDataHeader(header, sizeof(header), 2), TFTP_MAX_HEADER_SIZE);
+    ASSERT_TRUE(sendBatch.queueData(senderSocket, header, sizeof(header), fileMap->getData() + TFTP_MAX_DATA_SIZE, 100, &receiverAddress, fileMap));
+    header[3] = 0;
+    std::weak_ptr<FileMapping> weakMap = fileMap;
+    fileMap.reset();
+    ASSERT_FALSE(weakMap.expired());
+    ASSERT_EQ(sendBatch.flush(), 1);
+    ASSERT_TRUE(weakMap.expired());
+    ASSERT_EQ(recv(receiverSocket, recvBuffer, sizeof(recvBuffer), 0), TFTP_MAX_HEADER_SIZE + 100);
+    ASSERT_EQ(recvBuffer[3], 2);
+    ASSERT_EQ(std::string((const char*)recvBuffer + TFTP_MAX_HEADER_SIZE, 100), expected);
+    close(senderSocket);
+    close(receiverSocket);
+}
@@ -0,0 +1,238 @@
+/**
+ * @file timerWheel.cpp
+ * @brief Unit testing for the hierarchical timer wheel used by the event loops, the RTT estimator and the congestion window.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+#include <gtest/gtest.h>
+#include "tftp_timer.hpp"
+
+TEST(TimerWheelTest, ExpiresAtDeadline) {
+    TimerWheel wheel(1000);
+    TimerNode timer;
+    std::vector<TimerNode*> expired;
+
+    wheel.schedule(&timer, 1010);
+    ASSERT_TRUE(timer.isScheduled());
+    ASSERT_EQ(wheel.getTimeoutMs(1000), 10);
+
+    ASSERT_EQ(wheel.advance(1009, expired), 0);
+    ASSERT_EQ(wheel.advance(1010, expired), 1);
+    ASSERT_EQ(expired[0], &timer);
+    ASSERT_FALSE(timer.isScheduled());
+    ASSERT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheelTest, CascadesFromHigherLevels) {
+    TimerWheel wheel(5);
+    uint64_t delays[] = {300, 70000, 20000000};
+    TimerNode timers[3];
+    std::vector<TimerNode*> expired;
+
+    for(int i = 0; i < 3; ++i){
+        wheel.schedule(&timers[i], 5 + delays[i]);
+    }
+    for(int i = 0; i < 3; ++i){
+        expired.clear();
+        ASSERT_EQ(wheel.advance(5 + delays[i] - 1, expired), 0);
+        ASSERT_EQ(wheel.advance(5 + delays[i], expired), 1);
+        ASSERT_EQ(expired[0], &timers[i]);
+    }
+}
+
+TEST(TimerWheelTest, RescheduleAndCancel) {
+    TimerWheel wheel(0);
+    TimerNode moved;
+    TimerNode cancelled;
+    std::vector<TimerNode*> expired;
+
+    wheel.schedule(&moved, 100);
+    wheel.schedule(&cancelled, 100);
+    wheel.schedule(&moved, 400);
+    wheel.cancel(&cancelled);
+    ASSERT_EQ(wheel.size(), 1u);
+
+    ASSERT_EQ(wheel.advance(399, expired), 0);
+    ASSERT_EQ(wheel.advance(400, expired), 1);
+    ASSERT_EQ(expired[0], &moved);
+}
+
+TEST(TimerWheelTest, PastDeadlineFiresOnNextAdvance) {
+    TimerWheel wheel(500);
+    TimerNode timer;
+    std::vector<TimerNode*> expired;
+
+    wheel.schedule(&timer, 10);
+    ASSERT_EQ(wheel.getTimeoutMs(500), 0);
+    ASSERT_EQ(wheel.advance(500, expired), 1);
+}
+
+TEST(TimerWheelTest, DestroyedTimerLeavesWheel) {
+    TimerWheel wheel(0);
+    {
+        TimerNode timer;
+        wheel.schedule(&timer, 50);
+        ASSERT_EQ(wheel.size(), 1u);
+    }
+    ASSERT_EQ(wheel.size(), 0u);
+    ASSERT_EQ(wheel.getTimeoutMs(0), -1);
+}
+
+TEST(TimerWheelTest, ManyTimers) {
+    const int numTimers = 100000;
+    TimerWheel wheel(0);
+    std::vector<TimerNode> timers(numTimers);
+    std::vector<TimerNode*> expired;
+
+    for(int i = 0; i < numTimers; ++i){
+        wheel.schedule(&timers[i], 1 + (i * 7919ULL) % 60000);
+    }
+    ASSERT_EQ(wheel.size(), (size_t)numTimers);
+    uint64_t lastExpiry = 0;
+    for(uint64_t now = 0; now <= 60000; now += 250){
+        size_t first = expired.size();
+        wheel.advance(now, expired);
+        for(size_t i = first; i < expired.size(); ++i){
+            ASSERT_LE(expired[i]->getExpiry(), now);
+            ASSERT_GE(expired[i]->getExpiry(), lastExpiry);
+        }
+        lastExpiry = now > 250 ? now - 249 : 0;
+    }
+    ASSERT_EQ(expired.size(), (size_t)numTimers);
+    ASSERT_EQ(wheel.size(), 0u);
+}
+
+TEST(RttEstimatorTest, SamplesSetTheTimeout) {
+    RttEstimator rtt;
+    rtt.setLimits(TFTP_RTO_MIN_MS, TFTP_RTO_MAX_MS);
+    ASSERT_EQ(rtt.getTimeoutMs(), TFTP_RTO_INITIAL_MS);
+    ASSERT_EQ(rtt.getSmoothedUs(), -1);
+
+    // First sample: SRTT = R, RTTVAR = R/2, RTO = SRTT + 4 RTTVAR
+    rtt.sample(100000);
+    ASSERT_EQ(rtt.getSmoothedUs(), 100000);
+    ASSERT_EQ(rtt.getTimeoutMs(), 300);
+    // RTTVAR = (3 * 50000 + 100000) / 4, SRTT = (7 * 100000 + 200000) / 8
+    rtt.sample(200000);
+    ASSERT_EQ(rtt.getSmoothedUs(), 112500);
+    ASSERT_EQ(rtt.getTimeoutMs(), 363);
+    ASSERT_EQ(rtt.samples, 2u);
+
+    // Loopback RTTs are held at the lower limit
+    RttEstimator fast;
+    fast.setLimits(TFTP_RTO_MIN_MS, TFTP_RTO_MAX_MS);
+    for(int i = 0; i < 32; ++i){
+        fast.sample(50);
+    }
+    ASSERT_EQ(fast.getTimeoutMs(), TFTP_RTO_MIN_MS);
+}
+
+TEST(RttEstimatorTest, BackoffDoublesUpToTheLimit) {
+    RttEstimator rtt;
+    rtt.setLimits(TFTP_RTO_MIN_MS, 5000);
+    ASSERT_TRUE(rtt.backoff());
+    ASSERT_EQ(rtt.getTimeoutMs(), 2000);
+    ASSERT_TRUE(rtt.backoff());
+    ASSERT_EQ(rtt.getTimeoutMs(), 4000);
+    ASSERT_TRUE(rtt.backoff());
+    ASSERT_EQ(rtt.getTimeoutMs(), 5000);
+    ASSERT_FALSE(rtt.backoff());
+    // The next sample drops the backed off RTO
+    rtt.sample(10000);
+    ASSERT_EQ(rtt.getTimeoutMs(), 30);
+}
+
+TEST(RttEstimatorTest, RetransmittedPacketIsNotSampled) {
+    RttEstimator rtt;
+    rtt.setLimits(TFTP_RTO_MIN_MS, TFTP_RTO_MAX_MS);
+    auto sendTime = std::chrono::steady_clock::now();
+    rtt.startTiming(5, sendTime);
+    ASSERT_TRUE(rtt.isTiming());
+    // A packet is timed at a time
+    rtt.startTiming(6, sendTime + std::chrono::milliseconds(1));
+    ASSERT_EQ(rtt.getTimedMark(), 5u);
+    rtt.stopTiming(sendTime + std::chrono::milliseconds(40));
+    ASSERT_FALSE(rtt.isTiming());
+    ASSERT_EQ(rtt.samples, 1u);
+    ASSERT_EQ(rtt.getSmoothedUs(), 40000);
+
+    // Karn: the answer of a retransmitted packet is ambiguous
+    rtt.startTiming(7, sendTime);
+    ASSERT_TRUE(rtt.backoff());
+    rtt.stopTiming(sendTime + std::chrono::milliseconds(500));
+    ASSERT_EQ(rtt.samples, 1u);
+    ASSERT_EQ(rtt.getTimeoutMs(), 240);
+}
+
+TEST(CongestionWindowTest, AdditiveIncreaseMultiplicativeDecrease) {
+    CongestionWindow cwnd;
+    cwnd.init(16);
+    ASSERT_EQ(cwnd.getWindow(), TFTP_CWND_INITIAL);
+    // Slow start up to the negotiated window, never beyond it
+    cwnd.onAck(4, 4);
+    ASSERT_EQ(cwnd.getWindow(), 8);
+    cwnd.onAck(8, 12);
+    ASSERT_EQ(cwnd.getWindow(), 16);
+    cwnd.onAck(16, 28);
+    ASSERT_EQ(cwnd.getWindow(), 16);
+
+    // One cut per window in flight
+    cwnd.onLoss(28, 44);
+    ASSERT_EQ(cwnd.getWindow(), 8);
+    cwnd.onLoss(30, 44);
+    ASSERT_EQ(cwnd.getWindow(), 8);
+    ASSERT_EQ(cwnd.losses, 1u);
+    // No growth until the blocks in flight at the cut are ACKed, then one block per window
+    cwnd.onAck(8, 38);
+    ASSERT_EQ(cwnd.getWindow(), 8);
+    cwnd.onAck(6, 44);
+    cwnd.onAck(2, 46);
+    ASSERT_EQ(cwnd.getWindow(), 9);
+
+    // Every timeout halves the window
+    cwnd.onTimeout(55);
+    cwnd.onTimeout(55);
+    cwnd.onTimeout(55);
+    cwnd.onTimeout(55);
+    ASSERT_EQ(cwnd.getWindow(), 1);
+    ASSERT_EQ(cwnd.timeouts, 4u);
+
+    // A receiver ACKing whole windows gets them until the next loss, then again on the next stall
+    cwnd.onStall();
+    ASSERT_EQ(cwnd.getWindow(), 16);
+    cwnd.onAck(16, 71);
+    cwnd.onLoss(71, 87);
+    ASSERT_FALSE(cwnd.wholeWindows);
+    ASSERT_EQ(cwnd.getWindow(), 3);
+    cwnd.onStall();
+    ASSERT_EQ(cwnd.getWindow(), 16);
+}
+
+TEST(CongestionWindowTest, ShortWindowTimedOutTwiceStillShrinks) {
+    CongestionWindow cwnd;
+    cwnd.init(16);
+    cwnd.onAck(4, 4);
+    cwnd.onAck(8, 12);
+    ASSERT_EQ(cwnd.getWindow(), 16);
+    cwnd.onLoss(12, 28);
+    ASSERT_EQ(cwnd.getWindow(), 8);
+
+    // The short window after the cut times out, the rest of the window is sent in case the receiver waits for it
+    cwnd.onStall();
+    ASSERT_EQ(cwnd.getWindow(), 16);
+    // It times out, the window keeps shrinking
+    cwnd.onTimeout(36);
+    ASSERT_FALSE(cwnd.wholeWindows);
+    ASSERT_EQ(cwnd.getWindow(), 4);
+    // The next short window stalls and times out again, whole windows are sent in between
+    cwnd.onStall();
+    ASSERT_EQ(cwnd.getWindow(), 16);
+    cwnd.onTimeout(52);
+    ASSERT_FALSE(cwnd.wholeWindows);
+    ASSERT_EQ(cwnd.getWindow(), 2);
+    ASSERT_EQ(cwnd.timeouts, 2u);
+}
@@ -38,11 +38,24 @@
     #include "huffman.hpp"
 #endif
 
+#ifndef TFTP_TIMER_H
+    #include "tftp_timer.hpp"
+#endif
+
+#include <map>
+
 #define CLIENT_READ "READ"  //RRQ CLI
 #define CLIENT_WRITE "WRITE" //WRQ CLI
 #define CLIENT_DELETE "DELETE" //DEL CLI
 #define TFTP_RECEIVE_TRIES 3
 #define TFTP_CLIENT_SOCKET_TIMEOUT 1800
+#define TFTP_CLIENT_DALLY_MS 2000 // time the final ACK of a download is resent on a retransmitted final DATA
+#define TFTP_CLIENT_BLOCK_SIZE 1468 // blksize requested by default, the largest DATA fitting a 1500 byte Ethernet frame
+#define TFTP_CLIENT_WINDOW_SIZE 16 // windowsize requested by default
+#define TFTP_CLIENT_TIMEOUT 0 // timeout requested by default in seconds, 0 leaves it out and the RTO follows the RTT
+#define TFTP_CLIENT_NAK true // nak option requested by default on windowed downloads
+#define TFTP_CLIENT_MULTICAST false // multicast option requested by default on downloads
+#define TFTP_CLIENT_ROLLOVER 0 // rollover option requested by default, the block number following 65535
 
 static char clientDir[TFTP_MAX_DATA_SIZE] = "/home/swakath/tftpClient/";
 static char clientIP[16] = "127.0.0.7";
@@ -59,13 +72,46 @@ class clientManager : public Singleton<clientManager>{
         TftpOpcode requestType; //RRQ or WRQ
         std::string requestFileName;
         std::string compressedFile;
-        uint16_t blockNum; // Last block number sent or received
+        uint64_t blockNum; // Last block sent or received, counted from the start of the transfer. Its DATA/ACK carry toWireBlockNum()
+        int requestedBlockSize; // blksize option of the request, 0 sends a plain RFC 1350 request
+        int blockSize; // DATA payload size, the blksize acknowledged by the server or TFTP_MAX_DATA_SIZE
+        int requestedWindowSize; // windowsize option of the request, 0 leaves it out
+        int windowSize; // DATA blocks per ACK, the windowsize acknowledged by the server or 1
+        int requestedTimeout; // timeout option of the request in seconds, 0 leaves it out
+        int timeoutSec; // timeout acknowledged by the server, 0 when the retransmission timeout follows the RTT
+        bool requestedNak; // nak option of a windowed RRQ, blocks after a lost one are kept and only the missing ones resent
+        bool nakEnabled; // nak acknowledged by the server
+        bool requestedMulticast; // multicast option of a RRQ, the file may be received from a group shared with other clients
+        bool multicastEnabled; // multicast acknowledged by the server, the DATA arrive on multicastAddress
+        struct sockaddr_in multicastAddress;
+        bool multicastMaster; // the client ACKs the DATA sent to the group
+        int requestedRollover; // rollover option of the request, 0 or 1
+        int rollover; // rollover acknowledged by the server, 0 when it is left out of the OACK
+        uint64_t resumeOffset; // bytes of an interrupted download already in the file, requested with the offset option of the RRQ
+        uint64_t receivedBytes; // bytes of the download written in order after resumeOffset, all a failed download keeps
+        RttEstimator rtt; // Smoothed RTT of the transfer and the retransmission timeout derived from it
+        CongestionWindow cwnd; // DATA blocks of a WRQ in flight, at most windowSize, and its loss counters
         std::string operationMode; // Currently operates only in octate mode
         Huffman compObj;
-        bool commInit(std::string rootDir, std::string fileName, std::string serverIP, TftpOpcode requestType);
+        bool commInit(std::string rootDir, std::string fileName, std::string serverIP, TftpOpcode requestType, int requestedBlockSize = TFTP_CLIENT_BLOCK_SIZE, int requestedWindowSize = TFTP_CLIENT_WINDOW_SIZE, int requestedTimeout = TFTP_CLIENT_TIMEOUT, bool requestedNak = TFTP_CLIENT_NAK, bool requestedMulticast = TFTP_CLIENT_MULTICAST, int requestedRollover = TFTP_CLIENT_ROLLOVER);
         void commExit();
         void handleTFTPConnection();
         bool handleReceiveData(std::ofstream& fd);
+        bool receiveMulticast(std::ofstream& fd, TftpOptions& oack);
+        void dallyFinalACK(uint8_t* ackPacket, int ackPacketLen);
         bool handleSendData(std::ifstream& fd);
+        bool acceptOptions(TftpOptions& oack);
+        bool restartDownload(std::ofstream& fd);
+    private:
+        std::vector<uint8_t> windowPackets; // DATA of the window of a WRQ, kept until they are ACKed
+        std::vector<int> windowPacketLens;
+        int windowPacketSize;
+        bool sendWindowPackets(uint64_t firstBlock, uint64_t endBlock);
+        void dallyMulticastACK(int groupSocket, uint8_t* ackPacket, int ackPacketLen, bool resendOnData);
+        int makeFeedbackPacket(uint8_t* sendBuffer, size_t bufferLen, const std::map<uint64_t, std::vector<uint8_t>>& heldBlocks, uint64_t blocksInOrder);
+        bool waitForPacket(int timeoutMs);
+        int getTimeoutMs();
+        bool handleTimeout();
+        std::chrono::steady_clock::time_point getReceiveTime();
 };
 #endif
\ No newline at end of file
@@ -44,9 +44,16 @@
 #endif
 
 #define TFTP_DEFAULT_PORT 1069
-#define TFTP_MAX_DATA_SIZE 512
+#define TFTP_MAX_DATA_SIZE 512 // RFC 1350 block size, used unless the blksize option is negotiated
 #define TFTP_MAX_HEADER_SIZE 4
 #define TFTP_MAX_PACKET_SIZE (TFTP_MAX_DATA_SIZE + TFTP_MAX_HEADER_SIZE)
+#define TFTP_MIN_BLOCK_SIZE 8 // blksize range of RFC 2348
+#define TFTP_MAX_BLOCK_SIZE 65464
+#define TFTP_BLOCK_PACKET_SIZE(blockSize) ((blockSize) + TFTP_MAX_HEADER_SIZE)
+#define TFTP_MAX_WINDOW_SIZE 65535 // windowsize range of RFC 7440 starts at 1
+#define TFTP_MAX_TIMEOUT 255 // timeout range of RFC 2349 starts at 1 second
+#define TFTP_MAX_BLOCK_NUM 65535 // block numbers are 16 bits, the block after it is 0 or 1 depending on the rollover
+#define TFTP_BLOCK_NUM_PERIOD(rollover) ((rollover) == 0 ? TFTP_MAX_BLOCK_NUM + 1 : TFTP_MAX_BLOCK_NUM) // blocks between two uses of a number
 #define TFTP_MAX_MODE_SIZE 9
 #define TFTP_MIN_CONN_INIT_PACKET_SIZE 8 //8 bytes minimum rrq/wrq packet size
 #define TFTP_MIN_PORT 1024
@@ -56,6 +63,15 @@
 
 static char log_message[LOG_BUFF_SIZE];
 static const char* TFTP_MODE_OCTET = "octet";
+static const char* TFTP_OPTION_BLKSIZE = "blksize";
+static const char* TFTP_OPTION_WINDOWSIZE = "windowsize";
+static const char* TFTP_OPTION_TIMEOUT = "timeout";
+static const char* TFTP_OPTION_TSIZE = "tsize";
+static const char* TFTP_OPTION_NAK = "nak";
+static const char* TFTP_OPTION_MULTICAST = "multicast";
+static const char* TFTP_OPTION_ROLLOVER = "rollover";
+static const char* TFTP_OPTION_OFFSET = "offset";
+static const char* TFTP_OPTION_LENGTH = "length";
 
 
 /**
@@ -69,7 +85,9 @@ typedef enum : uint16_t
     TFTP_OPCODE_DATA  = 3, // Data
     TFTP_OPCODE_ACK   = 4, // Acknowledgment
     TFTP_OPCODE_ERROR = 5, // Error
-    TFTP_OPCODE_DEL  = 6 // Delete Opcode Custom
+    TFTP_OPCODE_DEL  = 6, // Delete Opcode Custom, only sent by the client
+    TFTP_OPCODE_OACK = 6, // Option acknowledgment (RFC 2347), only sent by the server
+    TFTP_OPCODE_NAK  = 7  // Negative acknowledgment of the nak option: last block in order and a bitmap of the missing blocks after it
 } TftpOpcode;
   
   
@@ -85,7 +103,29 @@ typedef enum : uint16_t
     TFTP_ERROR_ILLEGAL_OPERATION   = 4,
     TFTP_ERROR_UNKNOWN_TID         = 5,
     TFTP_ERROR_FILE_ALREADY_EXISTS = 6,
-    TFTP_ERROR_NO_SUCH_USER        = 7
+    TFTP_ERROR_NO_SUCH_USER        = 7,
+    TFTP_ERROR_OPTION_NEGOTIATION  = 8  // RFC 2347
 } TftpErrorCode;
 
+/**
+* @brief Options of a RRQ/WRQ or of an OACK (RFC 2347), 0 when the option is absent
+*/
+struct TftpOptions {
+    int blockSize; // blksize (RFC 2348), payload size of every DATA but the final one
+    int windowSize; // windowsize (RFC 7440), DATA blocks sent before waiting for an ACK
+    int timeout; // timeout (RFC 2349), retransmission timeout in seconds
+    bool hasTransferSize; // tsize (RFC 2349) present, its value is 0 in a RRQ asking for the file size
+    uint64_t transferSize;
+    bool nak; // nak with value 1, the receiver of a window reports the missing blocks with NAK and only they are resent
+    bool multicast; // multicast (RFC 2090), empty in a RRQ, "address,port,master" in the OACK
+    struct sockaddr_in multicastAddress; // group the DATA are sent to, 0 when left out of the OACK
+    bool multicastMaster; // the client ACKs the DATA sent to the group
+    bool hasRollover; // rollover present, not part of any RFC
+    int rollover; // block number following TFTP_MAX_BLOCK_NUM, 0 or 1
+    bool hasOffset; // offset present, not part of any RFC. A RRQ resumes the file from the byte offset
+    uint64_t offset;
+    bool hasLength; // length present with offset, at most length bytes are sent. The OACK gives the bytes that follow
+    uint64_t length;
+};
+
 #endif
\ No newline at end of file
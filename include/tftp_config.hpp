@@ -0,0 +1,124 @@
+/**
+ * @file tftp_config.hpp
+ * @brief TFTP Runtime Configuration.
+ *
+ * Singleton class holding the run time tunables of the TFTP server.
+ * Values are set from the optional "--name=value" command line arguments.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#ifndef TFTP_CONFIG_H
+#define TFTP_CONFIG_H
+
+#ifndef COMM_H
+    #include "tftp_common.hpp"
+#endif
+
+#ifndef TFTP_SOCK
+    #include "tftp_socket.hpp"
+#endif
+
+#ifndef SINGLETON_H
+    #include "singleton.hpp"
+#endif
+
+#ifndef TFTP_STARK_H
+    #include "tftp_stark.hpp"
+#endif
+
+#ifndef TFTP_TIMER_H
+    #include "tftp_timer.hpp"
+#endif
+
+#ifndef TFTP_MULTICAST_H
+    #include "tftp_multicast.hpp"
+#endif
+
+#define TFTP_DEFAULT_EVENT_LOOPS 0 // 0 -> one event loop per online core
+#define TFTP_MAX_EVENT_LOOPS 256
+#define TFTP_DEFAULT_LISTENERS 1 // sockets bound to the request port, 0 -> one per event loop
+#define TFTP_DEFAULT_WORKERS 64 // session threads of the thread engine per request socket
+#define TFTP_DEFAULT_QUEUE_DEPTH 256 // requests waiting for a worker per request socket
+#define TFTP_MAX_WORKERS 4096
+#define TFTP_DEFAULT_DALLY_MS 2000 // lifetime of a finished WRQ session answering a retransmitted final DATA
+#define TFTP_MAX_DALLY_MS 60000
+#define TFTP_DEFAULT_CACHE_MB 256 // memory budget of the hot file cache
+#define TFTP_DEFAULT_CACHE_FILE_MB 32 // largest file held by the hot file cache
+#define TFTP_MAX_CACHE_MB 1048576
+#define TFTP_DEFAULT_READ_AHEAD_KB 128 // file range kept requested ahead of the blocks sent by a RRQ session
+#define TFTP_MAX_READ_AHEAD_KB 65536
+#define TFTP_DEFAULT_WRITE_BEHIND_KB 256 // received blocks an upload holds in memory, written in TFTP_WRITE_CHUNK_SIZE chunks
+#define TFTP_MAX_WRITE_BEHIND_KB 65536
+#define TFTP_DEFAULT_COMMIT_MS 200 // window of uploads made durable together by one group commit
+#define TFTP_MAX_COMMIT_MS 60000
+#define TFTP_MAX_RTO_MS 255000 // bounds of --rto-min/--rto-max, the largest RFC 2349 timeout
+#define TFTP_DEFAULT_MAX_WINDOW_SIZE 64 // largest windowsize granted, a window of 1468 byte blocks fits a default socket receive buffer
+#define TFTP_DEFAULT_ROLLOVER 0 // block number following 65535 when the client sends no rollover option
+#define TFTP_DEFAULT_URING_ENTRIES 4096 // submission queue depth of each io_uring loop
+#define TFTP_DEFAULT_URING_SESSIONS 1024 // sessions (registered buffer slots) per io_uring loop
+
+/**
+* @brief Server engine used to drive client sessions
+*/
+typedef enum : uint8_t
+{
+    TFTP_ENGINE_THREAD = 0, // one blocking thread per transfer
+    TFTP_ENGINE_EPOLL  = 1  // epoll event loops owning all the sockets
+} TftpServerEngine;
+
+/**
+* @brief I/O backend used by the epoll engine loops
+*/
+typedef enum : uint8_t
+{
+    TFTP_IO_SYNC  = 0, // readiness with epoll, one system call per packet and per block
+    TFTP_IO_URING = 1  // io_uring submission rings shared by all the sessions of a loop
+} TftpIoBackend;
+
+class TftpConfig : public Singleton<TftpConfig> {
+    friend class Singleton<TftpConfig>;
+    protected:
+        TftpConfig();
+    public:
+        std::string serverIP;
+        TftpServerEngine serverEngine;
+        int eventLoops; // Number of epoll loops, 0 selects the number of online cores
+        TftpIoBackend ioBackend;
+        int uringEntries;
+        int uringSessions;
+        int batchSize; // Datagrams per recvmmsg/sendmmsg call
+        int listeners; // SO_REUSEPORT sockets on the request port when greater than 1
+        bool pinCpus; // Pin each request shard thread to its own core
+        int workers;
+        int queueDepth;
+        int dallyMs; // 0 closes a WRQ session right after its final ACK
+        int tidFirstPort; // Port range of the transfer socket pool, 0 binds every transfer socket on demand
+        int tidLastPort;
+        int cacheMB; // 0 disables the hot file cache
+        int cacheFileMB;
+        int readAheadKB; // 0 leaves read-ahead to the kernel heuristics
+        int writeBehindKB; // 0 writes every received block before its ACK
+        bool writeDirect; // Write-behind chunks written with O_DIRECT
+        int commitMs; // 0 leaves completed uploads to the kernel writeback
+        int maxBlockSize; // Largest blksize granted to a client, sizes the receive and send buffers of the sessions
+        int maxWindowSize; // Largest windowsize granted to a client, 1 keeps every transfer lock-step
+        int rollover; // Block number following 65535 of the transfers without a rollover option, 0 or 1
+        int rtoMinMs; // Bounds of the retransmission timeout derived from the RTT of a session
+        int rtoMaxMs;
+        bool packetCache; // Hot cached files are also kept as pre-built DATA datagrams
+        bool zeroCopy; // MSG_ZEROCOPY for DATA payloads of at least TFTP_ZEROCOPY_MIN_DATA bytes
+        std::string multicastIP; // Group address of the multicast option, empty refuses the option
+        int multicastPort; // Port of the first multicast group
+        bool parseOptions(int argc, char* argv[], int firstOption);
+        int getEventLoopCount();
+        int getListenerCount();
+        void pinThread(int shardIndex);
+        void printUsage();
+};
+
+#endif
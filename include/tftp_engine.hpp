@@ -0,0 +1,200 @@
+/**
+ * @file tftp_engine.hpp
+ * @brief TFTP Server Event Engine.
+ *
+ * This file contains prototypes and constants for the epoll based server engine.
+ * Each event loop owns an epoll instance watching the default server socket and the
+ * transfer sockets of its sessions, so that a bounded number of threads serves all the transfers.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#ifndef TFTP_ENGINE_H
+#define TFTP_ENGINE_H
+
+#ifndef TFTP_SERVER
+    #include "tftp_server.hpp"
+#endif
+
+#ifndef TFTP_TIMER_H
+    #include "tftp_timer.hpp"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define TFTP_ENGINE_MAX_EVENTS 64
+#define TFTP_ENGINE_MAX_ACCEPT_BURST 64 // requests read from the default socket per wakeup
+#define TFTP_ENGINE_MAX_WAIT_MS 1000 // longest wait for events when no timer is due earlier
+#define TFTP_ENGINE_TICK_MS 100 // io_uring wait bound when the kernel lacks timed waits
+
+/**
+ * @brief Result of work done for a session of an event loop on another thread
+*/
+struct LoopCompletion {
+    int sessionId; // transfer socket, or io_uring slot of the session
+    int chunkIndex; // write-behind chunk written, -1 for the group commit of the upload
+    bool success;
+};
+
+/**
+ * @brief Base class of an event loop: owns the sessions started from the requests it receives
+ * on the default server socket. Subclasses provide the readiness/completion mechanism.
+*/
+class EventLoop {
+    public:
+        EventLoop(int loopId, int listenSocket, int packetSize);
+        virtual ~EventLoop();
+        virtual bool init() = 0;
+        virtual void run() = 0;
+        void stop();
+        // Callback reporting to the loop thread the result of work done for a session on another thread
+        std::function<void(bool)> makeCompletion(int sessionId, int chunkIndex = -1);
+    protected:
+        int loopId;
+        int listenSocket;
+        std::atomic<bool> running;
+        std::unordered_map<int, std::unique_ptr<ClientHandler>> sessions; // transfer socket -> session
+        TimerWheel timers; // retransmission deadlines of the sessions
+        std::vector<TimerNode*> expiredTimers;
+        UDPRecvBatch listenBatch; // requests read from the default server socket
+        UDPRecvBatch sessionBatch; // datagrams read from the transfer sockets
+        UDPSendBatch sendBatch; // packets queued during the current loop iteration
+        std::vector<int> deferredCloses; // sockets closed once their queued packets are flushed
+        std::mutex completionMutex;
+        std::condition_variable completionCond;
+        std::vector<LoopCompletion> completions; // reported by other threads, handled by the loop thread
+        int completionsPending; // callbacks of makeCompletion not called yet
+        void handleCompletions();
+        void waitForCompletions(); // the callbacks must not outlive the loop
+        void handleRequest(uint8_t* recvBuffer, int recvLen, struct sockaddr_in& clientAddress);
+        void armSessionTimer(ClientHandler* session);
+        void checkTimeouts();
+        int getWaitMs();
+        void flushSends();
+        void closeAllSessions();
+        void logBatchStats();
+        virtual bool prepareSession(ClientHandler* session) = 0; // bind the session to the loop I/O before it starts
+        virtual bool watchSession(int socketFD) = 0; // start receiving on the transfer socket
+        virtual void closeSession(int socketFD) = 0;
+        virtual void wakeup() = 0;
+        virtual void completeSession(const LoopCompletion& completion) = 0;
+};
+
+class EpollLoop;
+
+/**
+ * @brief SyncSessionIO queuing the session packets in the send batch of an event loop.
+ * The write-behind chunks and the group commits of the uploads are left to other threads.
+*/
+class BatchSessionIO : public SyncSessionIO {
+    public:
+        BatchSessionIO(UDPSendBatch& sendBatch, EpollLoop& loop);
+        bool sendPacket(ClientHandler* session, uint8_t* packet, int packetLen) override;
+        bool readAndSend(ClientHandler* session, uint64_t offset, int dataLen) override;
+        bool writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock) override;
+        bool commitAndSend(ClientHandler* session) override;
+    protected:
+        bool sendData(ClientHandler* session, uint8_t* packet, int packetLen) override;
+    private:
+        UDPSendBatch& sendBatch;
+        EpollLoop& loop;
+};
+
+/**
+ * @brief Thread writing the write-behind chunks of the uploads of an epoll loop, in the order they are queued,
+ * so that the loop does not wait for the disk. Each write is reported through its callback.
+*/
+class ChunkWriter {
+    public:
+        ChunkWriter();
+        ~ChunkWriter();
+        void start();
+        void stop(); // the chunks already queued are written first
+        void queue(int fileFD, std::shared_ptr<WriteBehind> writeBehind, int chunkIndex, std::function<void(bool)> onWritten);
+    private:
+        struct ChunkWrite {
+            int fileFD;
+            std::shared_ptr<WriteBehind> writeBehind;
+            int chunkIndex;
+            std::function<void(bool)> onWritten;
+        };
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<ChunkWrite> writes;
+        bool stopping;
+        void run();
+};
+
+/**
+ * @brief Per session state of an EpollLoop for the file work done off the loop thread
+*/
+struct EpollSlot {
+    int chunkWrites; // write-behind chunk writes in flight
+    bool finalFlush; // final ACK waits for every chunk to be written
+    bool ackHeld; // ACK of heldBlock waits for room in the write-behind buffer
+    std::vector<uint8_t> heldBlock; // copied, the receive batch is reused by the other sessions
+    uint64_t heldOffset;
+    bool heldFinal;
+    bool commitPending; // final ACK waits for the group commit of the upload
+};
+
+/**
+ * @brief Event loop using epoll readiness notifications and synchronous session I/O.
+ * Packets sent while handling the events of one epoll_wait are flushed together with sendmmsg.
+ * Write-behind chunks are written by a ChunkWriter, a block is ACKed once queued in the buffer.
+*/
+class EpollLoop : public EventLoop {
+    public:
+        EpollLoop(int loopId, int listenSocket);
+        ~EpollLoop();
+        bool init() override;
+        void run() override;
+    protected:
+        friend class BatchSessionIO;
+        int epollFD;
+        int wakeFD; // eventfd used to interrupt epoll_wait on stop and on completions
+        BatchSessionIO batchIO;
+        ChunkWriter chunkWriter;
+        std::unordered_map<int, EpollSlot> slots; // transfer socket -> file work of the session
+        std::unordered_map<int, std::unique_ptr<ClientHandler>> closingSessions; // closed with file work in flight
+        uint64_t acksHeld; // ACKs delayed by a full write-behind buffer
+        void handleListenSocket();
+        void handleSessionEvent(int socketFD);
+        bool prepareSession(ClientHandler* session) override;
+        bool watchSession(int socketFD) override;
+        void closeSession(int socketFD) override;
+        void tryRelease(int socketFD); // releases a closing session once no file work refers to it
+        void wakeup() override;
+        void completeSession(const LoopCompletion& completion) override;
+        bool bufferAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock);
+        bool commitAndSend(ClientHandler* session);
+        void queueChunkWrites(ClientHandler* session, EpollSlot& slot);
+        void handleChunkWritten(int socketFD, int chunkIndex, bool success);
+        void handleSessionState(int socketFD);
+};
+
+class EventEngine {
+    public:
+        EventEngine(const std::vector<int>& listenSockets, int numLoops);
+        ~EventEngine();
+        bool start();
+        void stop();
+    private:
+        std::vector<int> listenSockets; // request port sockets, several with SO_REUSEPORT
+        int numLoops;
+        std::vector<std::unique_ptr<EventLoop>> loops;
+        std::vector<std::thread> loopThreads;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file tftp_multicast.hpp
+ * @brief TFTP Server Multicast Groups.
+ *
+ * This file contains prototypes and constants for the multicast option (RFC 2090). The RRQ session
+ * of the first client sends one copy of the file to a group, RRQs of the same file arriving meanwhile
+ * join it instead of starting their own transfer. One client at a time, the master, ACKs the DATA.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#ifndef TFTP_MULTICAST_H
+#define TFTP_MULTICAST_H
+
+#ifndef COMM_H
+    #include "tftp_common.hpp"
+#endif
+
+#ifndef TFTP_SOCK
+    #include "tftp_socket.hpp"
+#endif
+
+#ifndef SINGLETON_H
+    #include "singleton.hpp"
+#endif
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#define TFTP_MULTICAST_MAX_GROUPS 64 // groups served at the same time, each one on its own port after the configured one
+#define TFTP_MULTICAST_TTL 1 // DATA sent to a group do not leave the local network
+
+/**
+ * @brief File sent to a multicast group and the clients waiting for it
+*/
+struct MulticastGroup {
+    std::string fileName;
+    struct sockaddr_in address;
+    int socketFD; // transfer socket of the session sending to the group, the server TID of every member
+    struct sockaddr_in master; // client ACKing the DATA
+    TftpOptions options; // options acknowledged to the first client
+    uint64_t fileSize;
+    int portIndex; // port of the group is the configured one plus portIndex
+    bool closed; // no longer joinable, the session is ending
+    std::deque<struct sockaddr_in> members; // clients waiting to become master, in the order they joined
+    uint64_t joined; // clients that joined after the first one
+};
+
+/**
+ * @brief Registry of the open multicast groups shared by every request thread and event loop
+*/
+class MulticastRegistry : public Singleton<MulticastRegistry> {
+    friend class Singleton<MulticastRegistry>;
+    protected:
+        MulticastRegistry();
+    public:
+        bool init(const std::string& groupIP, int firstPort, const std::string& interfaceIP);
+        bool isEnabled();
+        std::shared_ptr<MulticastGroup> create(const std::string& fileName, int socketFD, struct sockaddr_in& master, const TftpOptions& options, uint64_t fileSize); // NULL when disabled or every port is in use
+        bool join(const std::string& fileName, struct sockaddr_in& clientAddress, const TftpOptions& requestOptions); // true when the OACK of an open group was sent
+        bool nextMaster(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& master); // false, and the group is closed, when no member is left
+        bool isMember(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& clientAddress);
+        void leave(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& clientAddress);
+        void close(std::shared_ptr<MulticastGroup>& group);
+    private:
+        bool enabled;
+        struct in_addr groupAddress;
+        int firstPort;
+        std::string interfaceIP;
+        std::mutex groupMutex;
+        std::vector<std::shared_ptr<MulticastGroup>> groups; // open groups, indexed by portIndex
+        bool isCompatible(MulticastGroup& group, const TftpOptions& requestOptions);
+        void unregister(MulticastGroup& group);
+};
+
+#endif
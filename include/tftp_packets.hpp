@@ -16,9 +16,17 @@
 #endif
 
 int makeErrorPacket(uint8_t* sendBuffer, size_t bufferLen, TftpErrorCode errorCode, const char* msgError);
-int makeComInitPacket(TftpOpcode opcode,uint8_t* sendBuffer, size_t bufferLen, const char* fileName, const char* mode);
+int makeComInitPacket(TftpOpcode opcode,uint8_t* sendBuffer, size_t bufferLen, const char* fileName, const char* mode, const TftpOptions* options = NULL);
 int makeACKPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum);
+int makeNAKPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum, const uint8_t* bitmap, size_t bitmapLen);
+int makeOACKPacket(uint8_t* sendBuffer, size_t bufferLen, const TftpOptions& options);
+int makeDataHeader(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum);
 int makeDataPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum, uint8_t* data, size_t dataLen);
-int readData512(uint8_t* dataBuffer, size_t bufferLen, std::ifstream& fd);
-int writeData512(uint8_t* dataBuffer, size_t bufferLen, std::ofstream& fd);
+int readDataBlock(uint8_t* dataBuffer, size_t bufferLen, int blockSize, std::ifstream& fd);
+int writeDataBlock(uint8_t* dataBuffer, size_t bufferLen, int blockSize, std::ofstream& fd);
+bool parsePacketHeader(const uint8_t* packet, size_t packetLen, uint16_t& opcode, uint16_t& blockNum);
+bool parseOptions(const uint8_t* optionsBuffer, size_t optionsLen, TftpOptions& options);
+bool parseOACKPacket(const uint8_t* packet, size_t packetLen, TftpOptions& options);
+uint16_t toWireBlockNum(uint64_t blockNum, int rollover);
+uint64_t wireBlockDistance(uint64_t blockNum, uint16_t wireBlockNum, int rollover);
 #endif
@@ -30,32 +30,250 @@
     #include "tftp_stark.hpp"
 #endif
 
+#ifndef TFTP_CONFIG_H
+    #include "tftp_config.hpp"
+#endif
+
+#ifndef TFTP_TIMER_H
+    #include "tftp_timer.hpp"
+#endif
+
+#ifndef TFTP_MULTICAST_H
+    #include "tftp_multicast.hpp"
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+
 #define TFTP_RECEIVE_TRIES 3
 #define TFTP_SERVER_SOCKET_TIMEOUT 1800
+#define TFTP_DALLY_MAX_EVENTS 64
 static char serverIP[16] = "127.0.0.1";
 static char serverDir[TFTP_MAX_DATA_SIZE] = "/home/swakath/tftpRoot/";
 static const char* END_SERVER_MSG = "END_SERVER";
 static bool END_SERVER_PROCESS = false;
 
+/**
+* @brief States of a client session state machine
+*/
+typedef enum : uint8_t
+{
+    TFTP_SESSION_INIT    = 0, // Session created, transfer not started
+    TFTP_SESSION_SEND    = 1, // RRQ, DATA sent and waiting for its ACK
+    TFTP_SESSION_RECEIVE = 2, // WRQ, ACK sent and waiting for the next DATA
+    TFTP_SESSION_DALLY   = 3, // WRQ complete, final ACK resent if the client retransmits the final DATA
+    TFTP_SESSION_DONE    = 4  // Transfer completed or failed, session can be reclaimed
+} TftpSessionState;
+
+class ClientHandler;
+
+/**
+ * @brief I/O operations issued by a ClientHandler on its transfer socket and file.
+ * The synchronous implementation completes them inside the call, asynchronous ones
+ * set ioPending and report the result later through ClientHandler::handleIOComplete().
+*/
+class SessionIO {
+    public:
+        virtual ~SessionIO(){}
+        // Sends a packet to the client of the session
+        virtual bool sendPacket(ClientHandler* session, uint8_t* packet, int packetLen) = 0;
+        // Reads dataLen bytes at offset into the payload of lastPacket and sends lastPacket.
+        // With a file mapping the header of lastPacket is sent followed by the mapped payload.
+        virtual bool readAndSend(ClientHandler* session, uint64_t offset, int dataLen) = 0;
+        // Writes dataLen bytes at offset to the session file and then sends lastPacket with sendAck(). With a write-behind
+        // buffer the block is only queued before lastPacket is sent, the final block flushes the whole buffer.
+        // The final block is followed by commitAndSend().
+        virtual bool writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock) = 0;
+        // Moves the complete upload into place with ClientHandler::commitUpload() and sends the final ACK once it is durable.
+        // Waits for the group commit of the upload, the event loops set ioPending and send the ACK when it is reported.
+        virtual bool commitAndSend(ClientHandler* session);
+        // Starts reading length bytes at offset of the session file into the page cache, without waiting for them
+        virtual void readAhead(ClientHandler* session, uint64_t offset, uint64_t length) = 0;
+        // True when readAndSend can send the payload straight from ClientHandler::fileMap.
+        // Every SessionIO sends the pre-built packets of ClientHandler::packetImage.
+        virtual bool sendsFromMapping(){ return false; }
+        // Largest blksize granted to the sessions, bounded by the packet buffers of the SessionIO
+        virtual int getMaxBlockSize(){ return TftpConfig::getInstance().maxBlockSize; }
+        // True when the DATA of a session can be sent to its multicast group, ClientHandler::getDataAddress()
+        virtual bool sendsToGroup(){ return true; }
+        // Sends lastPacket, the ACK of the block just written, unless ClientHandler::ackDue defers it to the end of the window
+        bool sendAck(ClientHandler* session);
+};
+
+/**
+ * @brief SessionIO implementation using blocking pread/pwrite and sendto system calls.
+ * DATA of a mapped file is sent with sendmsg from the mapping, without pread.
+*/
+class SyncSessionIO : public SessionIO {
+    public:
+        static SyncSessionIO& getInstance();
+        bool sendPacket(ClientHandler* session, uint8_t* packet, int packetLen) override;
+        bool readAndSend(ClientHandler* session, uint64_t offset, int dataLen) override;
+        bool writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock) override;
+        void readAhead(ClientHandler* session, uint64_t offset, uint64_t length) override;
+        bool sendsFromMapping() override;
+    protected:
+        int getDataFlags(ClientHandler* session, int dataLen);
+        // Sends a whole DATA packet to ClientHandler::getDataAddress()
+        virtual bool sendData(ClientHandler* session, uint8_t* packet, int packetLen);
+};
+
+/**
+ * @brief Non-blocking state machine of a single RRQ/WRQ/DEL transfer.
+ * The owner (a blocking thread or an event loop) feeds it with received packets
+ * and timeouts; the handler never waits on the socket itself.
+*/
 class ClientHandler {     
     public:
         int defaultServerSocket;
         int clientSocket;
+        bool connected; // clientSocket is connected to the client TID
         struct sockaddr_in clientAddress;
         uint16_t requestType; //RRQ or WRQ
         std::string requestFileName;
-        uint16_t blockNum; // Last block number sent or received
+        uint64_t blockNum; // Last block sent or received, counted from the start of the transfer. Its DATA/ACK carry toWireBlockNum()
         char operationMode[TFTP_MAX_MODE_SIZE]; // Currently operates only in octate mode
+        TftpOptions options; // Options of the request, the negotiated ones once the transfer started
+        int blockSize; // DATA payload size, TFTP_MAX_DATA_SIZE unless blksize was negotiated
+        int windowSize; // DATA blocks sent or received per ACK, 1 unless windowsize was negotiated
+        int rollover; // Block number following TFTP_MAX_BLOCK_NUM, the negotiated rollover or the configured one
+        bool ackDue; // The ACK in lastPacket is sent once the block is written, false inside a window of a WRQ.
+                     // The deadline is then the ACK delay, the received part of a window stalled by the client is ACKed on it
+        TftpSessionState state;
+        bool transferSuccess;
+        int timeoutCount; // Consecutive timeouts of the last sent packet
+        int timeoutSec; // Retransmission timeout of the timeout option, 0 when it is derived from the RTT
+        RttEstimator rtt; // Smoothed RTT of the session and the retransmission timeout derived from it
+        CongestionWindow cwnd; // DATA blocks of a RRQ in flight, at most windowSize, and its loss counters
+        uint64_t blocksResent; // DATA resent after a NAK reported them missing
+        std::chrono::steady_clock::time_point deadline; // Retransmission or dally deadline
+        TimerNode timer; // Deadline entry in the timer wheel of an event loop
+        int fileFD; // File opened through STARK
+        uint64_t fileSize; // End of the file range served by a RRQ, the file size unless the offset and length options narrow it
+        uint64_t fileOffset; // Offset of the next block to be read or written
+        uint64_t readAheadOffset; // End of the file range already requested ahead of fileOffset
+        std::shared_ptr<FileMapping> fileMap; // Cached copy or mapping of the RRQ file, NULL when read with pread or READ_FIXED
+        std::shared_ptr<PacketImage> packetImage; // Pre-built DATA packets of a hot cached file
+        std::shared_ptr<WriteBehind> writeBehind; // Received blocks of a WRQ not written yet, NULL when every block is written before its ACK
+        std::shared_ptr<MulticastGroup> multicastGroup; // Group the DATA of a multicast RRQ are sent to, clientAddress is then its master
+        bool zeroCopy; // SO_ZEROCOPY enabled on clientSocket
+        SessionIO* io;
+        bool ioPending; // An asynchronous readAndSend/writeAndSend is in flight
+        int ioSlot; // Index of the session inside its SessionIO, -1 when unused
+        uint8_t* lastPacket; // Last DATA/ACK sent, kept for retransmission
+        int lastPacketLen;
+        int lastDataLen; // Payload length of the last DATA sent or received
+        uint64_t lastDataOffset; // File offset of the payload of the last DATA sent
         ClientHandler();
-        ClientHandler(int defaultServerSocket, sockaddr_in clientAddress, uint16_t requestType, char* requestFileName, char* operationMode);
+        ClientHandler(int defaultServerSocket, sockaddr_in clientAddress, uint16_t requestType, char* requestFileName, char* operationMode, const TftpOptions& options = TftpOptions());
+        ClientHandler(const ClientHandler& other);
+        ClientHandler& operator=(const ClientHandler& other) = delete;
         void printVals();
+        void setIO(SessionIO* io, uint8_t* packetBuffer);
+        bool startTransfer(int transferSocket);
+        void handleReadable(UDPRecvBatch& recvBatch);
+        void handlePacket(uint8_t* packet, int packetLen, struct sockaddr_in& recvAddress, int64_t recvAgeUs = 0); // recvAgeUs since the kernel received it
+        void handleTimeout();
+        void handleReceiveError(int error);
+        void handleIOComplete(bool success);
+        void finishTransfer();
+        bool isDone();
+        bool isDallying();
+        int getTimeoutMs();
+        const uint8_t* getImagePacket(uint64_t offset, int dataLen); // Pre-built lastPacket, NULL without a matching packet image
+        struct sockaddr_in* getDataAddress(); // Destination of the DATA, NULL on a connected socket
+        bool commitUpload(std::function<void(bool)> onDurable); // Moves the complete upload into place, fileFD is closed
+    private:
+        std::vector<uint8_t> packetStore; // lastPacket storage unless provided by the SessionIO, grown to the negotiated block size
+        bool finalBlockPending; // Final DATA written asynchronously, transfer ends on its completion
+        bool oackPending; // OACK of a RRQ sent, the first DATA waits for ACK 0
+        uint64_t ackedBlockNum; // Last block ACKed by the client of a RRQ, or to the client of a WRQ
+        uint64_t ackedOffset; // File offset following ackedBlockNum
+        int outOfOrder; // DATA out of order received by a WRQ since the last block in order
+        uint64_t sentEndOffset; // End of the file range of a RRQ sent at least once, only blocks past it are timed (Karn)
+        std::deque<uint64_t> nakBlocks; // Blocks of a RRQ reported missing by a NAK, resent before the next new block
+        void initSession();
+        bool negotiateOptions();
+        bool sendPacket(uint8_t* packet, int packetLen);
+        bool sendLastPacket();
+        void armDeadline();
+        void sendError(TftpErrorCode errorCode, const char* msgError);
+        bool sendNextData();
+        bool resendData(uint64_t dataBlockNum);
+        bool fillWindow();
+        void rewindWindow();
+        void readAhead();
+        void handleACKPacket(uint16_t recvBlockNum, std::chrono::steady_clock::time_point recvTime);
+        void handleMasterACK(uint16_t recvBlockNum, std::chrono::steady_clock::time_point recvTime);
+        void nextMaster(bool masterDone);
+        void handleNAKPacket(uint16_t recvBlockNum, const uint8_t* bitmap, int bitmapLen, std::chrono::steady_clock::time_point recvTime);
+        void handleDataPacket(uint16_t recvBlockNum, uint8_t* data, int dataLen, std::chrono::steady_clock::time_point recvTime);
+        void enterDally();
+        void releaseFile();
+        void endTransfer(bool success);
+};
+
+/**
+ * @brief Thread holding the dallying upload sessions of the thread engine, so that the worker
+ * of a finished upload is released right after the final ACK. One epoll instance watches the
+ * transfer sockets and a timer wheel ends each session at its dally deadline.
+*/
+class DallyLoop {
+    public:
+        DallyLoop();
+        ~DallyLoop();
+        bool start();
+        void add(std::unique_ptr<ClientHandler> session); // takes over a session in its dally state
+        void stop(); // closes the sessions still dallying
+        uint64_t dallied; // sessions taken over
+    private:
+        int epollFD;
+        int wakeFD;
+        bool stopping;
+        std::mutex addMutex;
+        std::vector<std::unique_ptr<ClientHandler>> added; // handed over by the workers, not yet watched
+        std::unordered_map<int, std::unique_ptr<ClientHandler>> sessions; // transfer socket -> session
+        TimerWheel timers;
+        std::vector<TimerNode*> expiredTimers;
+        UDPRecvBatch recvBatch;
+        std::thread loopThread;
+        void run();
+        void watchAdded();
+        void closeSession(int socketFD);
+};
+
+/**
+ * @brief Fixed set of threads serving the sessions of the thread engine from a bounded queue.
+ * A worker picks the next session as soon as its transfer ends, so threads and sessions
+ * are reclaimed promptly instead of accumulating until shutdown.
+*/
+class WorkerPool {
+    public:
+        WorkerPool(int numWorkers, int queueDepth);
+        ~WorkerPool();
+        bool submit(std::unique_ptr<ClientHandler> session); // false when the queue is full
+        void stop(); // serves the queued sessions and joins the workers
+        uint64_t accepted;
+        uint64_t rejected;
+        DallyLoop dallyLoop;
+    private:
+        int queueDepth;
+        int idleWorkers;
+        bool stopping;
+        std::mutex queueMutex;
+        std::condition_variable queueCond;
+        std::deque<std::unique_ptr<ClientHandler>> queue;
+        std::vector<std::thread> workers;
+        void workerLoop();
 };
 
-void handleClient(ClientHandler curClient);
+bool parseConnectionRequest(uint8_t* recvBuffer, int recvLen, uint16_t& opcode, char* fileName, char* mode, TftpOptions& options, TftpErrorCode& errorCode, const char*& errorMsg);
+void handleClient(ClientHandler& curClient);
 void handleIncommingRequests(int serverSock);
 void handleServerTermination();
-bool handleSendData(ClientHandler curClient, std::ifstream& fd);
-bool handleReceiveData(ClientHandler curClient, std::ofstream& fd);
 void closeSocket(int socketFD); 
 bool list_dir(std::string dir, std::string&  fname);
 #endif
\ No newline at end of file
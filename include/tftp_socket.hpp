@@ -22,15 +22,123 @@
     #include "tftp_packets.hpp"
 #endif
 
+#ifndef SINGLETON_H
+    #include "singleton.hpp"
+#endif
+
+#include <deque>
+#include <memory>
+#include <sys/uio.h>
+
 #define TFTP_UDP_TIMEOUT 10 //10 seconds
 #define TFTP_MAX_TIMEOUT_TRIES 3
-#define MAX_RANDOM_TRIES 3
+#define TFTP_DEFAULT_TID_FIRST_PORT 20000 // port range pre-bound by the transfer socket pool
+#define TFTP_DEFAULT_TID_LAST_PORT 21023
+#define TFTP_DEFAULT_BATCH_SIZE 32 // datagrams per recvmmsg/sendmmsg call
+#define TFTP_MAX_BATCH_SIZE 1024
+#define TFTP_ZEROCOPY_MIN_DATA 8192 // smaller payloads are cheaper to copy than to pin and complete
+#define TFTP_TIMESTAMP_CONTROL_SIZE CMSG_SPACE(sizeof(struct timespec)) // control buffer of one SCM_TIMESTAMPNS
+
+/**
+ * @brief Receive buffers for reading up to batchSize datagrams with one recvmmsg call
+*/
+class UDPRecvBatch {
+    public:
+        UDPRecvBatch(int batchSize, int packetSize = TFTP_MAX_PACKET_SIZE); // Longer datagrams are truncated to packetSize
+        int receive(int socketfd, int flags); // Number of datagrams read, -1 on error
+        int getBatchSize();
+        uint8_t* getPacket(int index);
+        int getPacketLen(int index);
+        struct sockaddr_in& getAddress(int index);
+        int64_t getReceiveAgeUs(int index); // time since the kernel received the datagram, 0 without a timestamp
+        double getAverageFill();
+        uint64_t calls; // recvmmsg calls made
+        uint64_t packets; // datagrams received
+    private:
+        int batchSize;
+        int packetSize;
+        std::vector<uint8_t> buffers;
+        std::vector<struct mmsghdr> headers;
+        std::vector<struct iovec> iovecs;
+        std::vector<struct sockaddr_in> addresses;
+        std::vector<uint8_t> controls; // SCM_TIMESTAMPNS of each datagram
+};
+
+/**
+ * @brief Packets queued for sending, flushed with one sendmmsg call per run of packets on the same socket
+*/
+class UDPSendBatch {
+    public:
+        UDPSendBatch(int batchSize, int packetSize = TFTP_MAX_PACKET_SIZE); // packetSize bounds the packets copied by queue
+        bool queue(int socketfd, uint8_t* packet, size_t packetLen, struct sockaddr_in& address); // Flushes first when full
+        bool queue(int socketfd, uint8_t* packet, size_t packetLen); // Connected socket, no destination address
+        // Copies only the header (optional), the payload is sent from where it lives and payloadOwner keeps it alive until the flush
+        bool queueData(int socketfd, uint8_t* header, size_t headerLen, const uint8_t* payload, size_t payloadLen,
+            struct sockaddr_in* address, std::shared_ptr<const void> payloadOwner, int flags = 0);
+        int flush(); // Number of packets sent
+        bool isEmpty();
+        double getAverageFill();
+        uint64_t calls; // sendmmsg calls made
+        uint64_t packets; // packets sent
+    private:
+        int batchSize;
+        int packetSize;
+        int count;
+        std::vector<uint8_t> buffers;
+        std::vector<int> sockets;
+        std::vector<struct mmsghdr> headers;
+        std::vector<struct iovec> iovecs; // header and payload of every packet
+        std::vector<struct sockaddr_in> addresses;
+        std::vector<int> flags; // sendmmsg flags, runs are split where they change
+        std::vector<std::shared_ptr<const void>> payloadOwners;
+        bool queuePacket(int socketfd, uint8_t* packet, size_t packetLen, struct sockaddr_in* address);
+        int nextEntry(int socketfd, struct sockaddr_in* address, int sendFlags);
+};
 
+/**
+ * @brief Transfer sockets (server TIDs) bound to a range of ports at startup and handed out in O(1).
+ * Released sockets are drained of stale datagrams and reused after all the other free ones. When the pool is exhausted
+ * a socket is bound to a port chosen by the kernel instead.
+*/
+class UDPSocketPool : public Singleton<UDPSocketPool> {
+    friend class Singleton<UDPSocketPool>;
+    protected:
+        UDPSocketPool();
+        ~UDPSocketPool();
+    public:
+        int init(const char* socketIP, int firstPort, int lastPort); // Number of sockets bound
+        int acquire(); // Non-blocking socket, -1 on error
+        void release(int socketfd); // Returns a pooled socket to the pool, closes any other socket
+        void discard(int socketfd); // Replaces a pooled socket that can not be reused
+        size_t size();
+        size_t available();
+        uint64_t fallbacks; // sockets bound outside the pool
+    private:
+        std::string socketIP;
+        std::mutex poolMutex;
+        std::deque<int> freeSockets; // handed out from the front, released sockets queue at the back
+        std::unordered_map<int, int> socketPorts; // pooled socket -> port
+};
 
-int createUDPSocket(const char* socketIP, int socketPORT, int timeOut = TFTP_UDP_TIMEOUT);
+int createUDPSocket(const char* socketIP, int socketPORT, int timeOut = TFTP_UDP_TIMEOUT, bool reusePort = false);
 int createRandomUDPSocket(const char* socketIP, int* randomPort);
+bool setSocketTimeout(int socketfd, int timeOut);
+bool setSocketNonBlocking(int socketfd);
+bool connectUDPSocket(int socketfd, struct sockaddr_in& peerAddress);
+bool connectTransferSocket(int socketfd, struct sockaddr_in& peerAddress); // connects and drops the datagrams queued before
+int drainUDPSocket(int socketfd);
+bool disconnectUDPSocket(int socketfd);
+bool setSocketZeroCopy(int socketfd, bool enable);
+bool growSocketReceiveBuffer(int socketfd, int bufferSize);
+bool enableReceiveTimestamps(int socketfd);
+bool setMulticastSender(int socketfd, const char* interfaceIP, int ttl);
+int createMulticastReceiver(struct sockaddr_in& groupAddress, const char* interfaceIP);
+int64_t getReceiveAgeUs(struct msghdr* msg);
+int64_t getLastReceiveAgeUs(int socketfd);
+int drainZeroCopyCompletions(int socketfd);
+int sendDataThroughUDP(int socketfd, uint8_t* header, size_t headerLen, const uint8_t* payload, size_t payloadLen, struct sockaddr_in* address, int flags = 0);
 int sendBufferThroughUDP(uint8_t* sendBuffer, size_t bufferLen, int socketfd, struct sockaddr_in clientAddress);
 int getBufferThroughUDP(uint8_t* recvBuffer, size_t bufferLen, int socketfd, struct sockaddr_in& clientAddress);
-bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, bool& recvError, bool ignoreAddress=false);
-bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, uint8_t* recvDataBuffer, size_t bufferSize, int& dataLen, bool& recvError, bool ignoreAddress=false);
+bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, bool& recvError, bool ignoreAddress=false, TftpOptions* oack=NULL, uint16_t* ackedBlockNum=NULL);
+bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, uint8_t* recvDataBuffer, size_t bufferSize, int& dataLen, bool& recvError, bool ignoreAddress=false, TftpOptions* oack=NULL, bool* outOfOrder=NULL, uint16_t* outOfOrderBlockNum=NULL);
 #endif
\ No newline at end of file
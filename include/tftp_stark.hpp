@@ -23,11 +23,169 @@
     #include "singleton.hpp"
 #endif
 
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <sys/stat.h>
+
+/**
+ * @brief Read only mapping of a whole file, or a copy of it loaded in memory. DATA payloads are sent
+ * straight from it, the memory is released when its last reference (STARK, session or queued packet) is dropped.
+*/
+class FileMapping {
+    public:
+        static std::shared_ptr<FileMapping> create(int fileFD, uint64_t fileSize); // NULL when the file can not be mapped
+        static std::shared_ptr<FileMapping> load(int fileFD, uint64_t fileSize); // NULL when the file can not be read
+        ~FileMapping();
+        const uint8_t* getData();
+        uint64_t getSize();
+        bool isResident(); // loaded copy, never waits on the disk
+        const uint8_t* getView(uint64_t offset, int length); // NULL when the range is outside of the file
+    private:
+        FileMapping(void* data, uint64_t size, bool resident);
+        void* data;
+        uint64_t size;
+        bool resident;
+};
+
+/**
+ * @brief Every DATA datagram of a file pre-built for one block size, stored back to back in one buffer.
+ * Block numbers are part of the datagrams, so the same image serves every client of the file.
+*/
+class PacketImage {
+    public:
+        static std::shared_ptr<PacketImage> build(const uint8_t* data, uint64_t dataSize, int blockSize);
+        const uint8_t* getPacket(uint64_t blockIndex, int& packetLen); // Block blockIndex+1, NULL past the final block
+        int getBlockSize();
+        uint64_t getBytes();
+    private:
+        PacketImage(uint64_t dataSize, int blockSize);
+        std::vector<uint8_t> buffer;
+        uint64_t dataSize;
+        uint64_t numBlocks; // including the final short, possibly empty, block
+        int blockSize;
+};
+
+#define TFTP_UPLOAD_PREFIX ".tftp-upload." // uploads in progress are written to this hidden name, next to the file
+
+#define TFTP_WRITE_CHUNK_SIZE 65536 // bytes written to the file at once by a write-behind buffer, holds the largest DATA block
+#define TFTP_WRITE_ALIGN 4096 // O_DIRECT alignment of the chunk addresses, offsets and lengths
+
+/**
+ * @brief Chunk of a write-behind buffer
+*/
+struct WriteChunk {
+    uint8_t* data;
+    size_t len; // bytes held
+    uint64_t offset; // file offset of data[0]
+    bool writing; // write in flight
+    bool written;
+};
+
+/**
+ * @brief Write-behind buffer of an upload. Received blocks are copied into chunks written to the file
+ * with one large write each, in any order. At most numChunks chunks are held: a block that does not fit
+ * has to wait for a chunk write. Not thread safe, used by the owner of the session only.
+*/
+class WriteBehind {
+    public:
+        static std::shared_ptr<WriteBehind> create(size_t bufferBytes); // NULL when the buffer can not be allocated
+        ~WriteBehind();
+        bool enableDirectIO(int fileFD); // O_DIRECT on the file, false when the file system does not support it
+        bool append(const uint8_t* data, size_t dataLen, uint64_t offset); // false, nothing copied, when the block does not fit
+        int nextChunk(bool partial); // chunk to write next, full chunks only unless partial. -1 when there is none
+        WriteChunk* getChunk(int chunkIndex);
+        void startWrite(int fileFD, int chunkIndex);
+        void chunkWritten(int chunkIndex);
+        bool flush(int fileFD, bool partial); // writes the chunks ready to be written synchronously
+        bool isEmpty(); // every block appended is written
+        uint64_t chunksWritten;
+    private:
+        WriteBehind(uint8_t* buffer, int numChunks);
+        uint8_t* buffer;
+        std::vector<WriteChunk> chunks; // ring, the chunks in use follow head
+        int head;
+        int used;
+        bool directIO;
+};
+
+/**
+ * @brief Whole files held in memory, evicted in LRU order to stay within a byte budget.
+ * Entries are validated against the inode, size and mtime of the file on every lookup.
+ * Not thread safe, STARK serializes the calls.
+*/
+class FileCache {
+    public:
+        FileCache();
+        void setLimits(uint64_t budgetBytes, uint64_t maxFileBytes); // a budget of 0 disables the cache
+        bool isCacheable(uint64_t fileSize);
+        std::shared_ptr<FileMapping> lookup(const std::string& fileName, const struct stat& fileStat); // NULL on a miss
+        void insert(const std::string& fileName, const struct stat& fileStat, std::shared_ptr<FileMapping> content);
+        void invalidate(const std::string& fileName);
+        // Packet image of a cached file requested again. NULL with buildDue set when the caller is to build it,
+        // its bytes are reserved until addPacketImage. NULL for other files and while another caller builds it.
+        std::shared_ptr<PacketImage> findPacketImage(const std::string& fileName, const std::shared_ptr<FileMapping>& content, int blockSize, bool& buildDue);
+        // Releases the reservation of findPacketImage and keeps the image, NULL when the entry was dropped meanwhile
+        std::shared_ptr<PacketImage> addPacketImage(const std::string& fileName, const std::shared_ptr<FileMapping>& content, int blockSize, std::shared_ptr<PacketImage> packetImage);
+        uint64_t getUsedBytes();
+        size_t size();
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t invalidations;
+        uint64_t imagesBuilt;
+    private:
+        struct CacheEntry {
+            std::string fileName;
+            dev_t device;
+            ino_t inode;
+            uint64_t size;
+            struct timespec mtime;
+            std::shared_ptr<FileMapping> content;
+            std::vector<std::shared_ptr<PacketImage>> packetImages; // one per block size
+            std::vector<int> pendingImages; // block sizes of the images being built
+            uint64_t bytes; // content, packet images and the bytes reserved for the pending ones
+            uint64_t hits;
+        };
+        uint64_t budgetBytes;
+        uint64_t maxFileBytes;
+        uint64_t usedBytes;
+        std::list<CacheEntry> lruList; // most recently used first
+        std::unordered_map<std::string, std::list<CacheEntry>::iterator> entries;
+        void erase(std::list<CacheEntry>::iterator entryIt);
+        bool makeRoom(uint64_t bytes, std::list<CacheEntry>::iterator keepIt);
+};
+
 class STARK : public Singleton<STARK> {
     friend class Singleton<STARK>;
     protected:
         STARK();
         std::mutex mutexObj;
+        bool addReader(std::string fileName, TftpErrorCode& errorCode);
+        bool addWriter(std::string fileName, TftpErrorCode& errorCode);
+        bool removeReader(std::string fileName);
+        bool removeWriter(std::string fileName);
+        std::unordered_map<std::string, std::shared_ptr<FileMapping>> fileMaps; // mapping shared by the current readers of a file
+        FileCache fileCache;
+        void invalidateCachedFile(std::string fileName);
+        std::unordered_map<std::string, std::string> uploadPaths; // file name -> temporary path of its upload in progress
+        bool isUploadName(const std::string& fileName);
+        std::string getUploadPath(const std::string& fileName);
+        std::mutex commitMutex;
+        std::condition_variable commitCond;
+        std::thread commitThread;
+        bool commitStopping;
+        int commitIntervalMs;
+        int rootFD; // synced by the group commits
+        struct PendingCommit {
+            std::string fileName;
+            std::string uploadPath;
+            std::function<void(bool)> onDurable;
+        };
+        std::vector<PendingCommit> commitsPending; // uploads waiting for the next group commit
+        bool moveUploadIntoPlace(const std::string& fileName, const std::string& uploadPath);
+        void groupCommitLoop();
     public:
         std::string root_dir;
         std::unordered_map<std::string, std::pair<int, bool>> fileData;
@@ -36,9 +194,32 @@ class STARK : public Singleton<STARK> {
         bool isFileDeletable(std::string fileName, TftpErrorCode& errorCode);
         std::ifstream isFileReadable(std::string fileName, TftpErrorCode& errorCode);
         std::ofstream isFileWritable(std::string fileName, TftpErrorCode& errorCode);
+        std::ofstream isFileAppendable(std::string fileName, uint64_t& fileSize, TftpErrorCode& errorCode); // keeps the bytes already in the file
         bool closeReadableFile(std::string fileName, std::ifstream& fd);
         bool closeWritableFile(std::string fileName, std::ofstream& fd);
-        
+        int openReadableFile(std::string fileName, TftpErrorCode& errorCode);
+        int openWritableFile(std::string fileName, TftpErrorCode& errorCode);
+        bool reserveFileSpace(int fd, uint64_t size, TftpErrorCode& errorCode); // allocates the extents of a file of size bytes
+        bool reserveFileSpace(std::string fileName, uint64_t size, TftpErrorCode& errorCode);
+        bool closeReadableFile(std::string fileName, int fd);
+        bool closeWritableFile(std::string fileName, int fd); // drops an incomplete upload
+        // Moves a complete upload into place, or queues it for the next group commit. onDurable, when given, is called
+        // once with the result, by the commit thread for a queued upload
+        bool commitWritableFile(std::string fileName, int fd, std::function<void(bool)> onDurable = nullptr);
+        int removeStaleUploads(); // uploads left by a previous run
+        bool startGroupCommit(int intervalMs);
+        void stopGroupCommit(); // runs a last group commit for the pending uploads
+        // Cached copy of the file, or its mapping when mapUncached is set. NULL when the file is read with pread/READ_FIXED
+        std::shared_ptr<FileMapping> mapReadableFile(std::string fileName, int fd, const struct stat& fileStat, bool mapUncached);
+        void setCacheLimits(uint64_t budgetBytes, uint64_t maxFileBytes);
+        void getCacheStats(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& invalidations, uint64_t& usedBytes);
+        std::shared_ptr<PacketImage> getPacketImage(std::string fileName, const std::shared_ptr<FileMapping>& content, int blockSize);
+        uint64_t getImagesBuilt();
+        uint64_t mapsCreated; // files mapped
+        uint64_t mapsShared; // readers served by the mapping of an earlier reader
+        uint64_t uploadsCommitted; // uploads moved into place
+        uint64_t groupCommits; // file system syncs, each one covering the batch of uploads moved into place after it
+
 };
 
 #endif
\ No newline at end of file
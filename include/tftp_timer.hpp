@@ -0,0 +1,146 @@
+/**
+ * @file tftp_timer.hpp
+ * @brief TFTP Timer Wheel.
+ *
+ * This file contains prototypes and constants for the hierarchical timer wheel tracking the
+ * retransmission, dally and expiry deadlines of the sessions of an event loop.
+ * Scheduling and cancelling a timer are O(1), expiring timers costs O(1) per timer plus
+ * one cascade per level boundary crossed. The retransmission timeout of each session is
+ * derived from its measured round trip time, and the blocks a windowed sender keeps in flight
+ * from its congestion window.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#ifndef TFTP_TIMER_H
+#define TFTP_TIMER_H
+
+#ifndef COMM_H
+    #include "tftp_common.hpp"
+#endif
+
+#include <chrono>
+
+#define TFTP_TIMER_LEVELS 4
+#define TFTP_TIMER_SLOT_BITS 8
+#define TFTP_TIMER_SLOTS (1 << TFTP_TIMER_SLOT_BITS) // slots per level, level n slots span 256^n ms
+#define TFTP_TIMER_MAX_DELAY ((1ULL << (TFTP_TIMER_LEVELS * TFTP_TIMER_SLOT_BITS)) - 1) // ~49 days
+#define TFTP_RTO_INITIAL_MS 1000 // retransmission timeout until the first RTT sample (RFC 6298)
+#define TFTP_RTO_MIN_MS 20 // default bounds of the retransmission timeout
+#define TFTP_RTO_MAX_MS 10000
+#define TFTP_RTO_GRANULARITY_US 1000 // clock granularity of the timers, lower bound of the variance term
+#define TFTP_ACK_DELAY_MIN_MS 5 // shortest wait for the rest of a window before its received part is ACKed
+#define TFTP_ACK_DELAY_MAX_MS 200
+#define TFTP_CWND_INITIAL 4 // blocks in flight at the start of a windowed transfer
+
+class TimerWheel;
+
+/**
+ * @brief Timer embedded in its owner, unlinked automatically when the owner is destroyed
+*/
+class TimerNode {
+    friend class TimerWheel;
+    public:
+        TimerNode();
+        TimerNode(const TimerNode& other); // copies are not scheduled
+        TimerNode& operator=(const TimerNode& other) = delete;
+        ~TimerNode();
+        bool isScheduled();
+        uint64_t getExpiry();
+        void* owner;
+    private:
+        uint64_t expiry; // milliseconds on the steady clock
+        TimerNode* prev;
+        TimerNode* next;
+        TimerWheel* wheel;
+};
+
+/**
+ * @brief Hierarchical timer wheel with millisecond resolution
+*/
+class TimerWheel {
+    friend class TimerNode;
+    public:
+        TimerWheel(uint64_t nowMs);
+        ~TimerWheel();
+        void schedule(TimerNode* timer, uint64_t expiryMs); // (re)arms the timer
+        void cancel(TimerNode* timer);
+        int advance(uint64_t nowMs, std::vector<TimerNode*>& expired); // collects the timers due at nowMs
+        int getTimeoutMs(uint64_t nowMs); // wait until the next expiry or cascade, -1 when empty
+        size_t size();
+        static uint64_t nowMs();
+        static uint64_t toMs(std::chrono::steady_clock::time_point timePoint);
+    private:
+        uint64_t current; // next millisecond to be expired
+        size_t count;
+        TimerNode slots[TFTP_TIMER_LEVELS][TFTP_TIMER_SLOTS]; // list heads
+        void link(TimerNode* timer);
+        void unlink(TimerNode* timer);
+        void cascade(int level);
+};
+
+/**
+ * @brief Retransmission timeout of a session: smoothed RTT plus four times its mean deviation
+ * (Jacobson/Karels, RFC 6298). One packet at a time is timed, and per Karn's rule the timing is
+ * cancelled when it is retransmitted. A timeout doubles the RTO until the next sample.
+*/
+class RttEstimator {
+    public:
+        RttEstimator();
+        void setLimits(int minMs, int maxMs);
+        void startTiming(uint64_t mark, std::chrono::steady_clock::time_point sendTime); // ignored while a packet is timed
+        void cancelTiming();
+        bool isTiming();
+        uint64_t getTimedMark(); // block number, or count, whose answer ends the timing
+        void stopTiming(std::chrono::steady_clock::time_point recvTime); // takes the sample of the timed packet
+        void sample(int64_t rttUs);
+        bool backoff(); // false when the RTO is already at its maximum
+        int getTimeoutMs();
+        int getAckDelayMs(); // wait of a receiver for the rest of a window, about one smoothed RTT
+        int64_t getSmoothedUs(); // -1 before the first sample
+        uint64_t samples;
+    private:
+        int64_t srttUs;
+        int64_t rttvarUs;
+        int64_t rtoUs;
+        int64_t minUs;
+        int64_t maxUs;
+        bool timing;
+        uint64_t timedMark;
+        std::chrono::steady_clock::time_point timedSince;
+};
+
+/**
+ * @brief AIMD congestion window of a windowed sender, in blocks. It starts at TFTP_CWND_INITIAL and doubles
+ * per round trip up to the slow start threshold, then grows by one block per window ACKed. A duplicate ACK
+ * or a gap halves it once per window of blocks in flight, a timeout halves it each time. It never exceeds
+ * the negotiated windowsize. Marks count the blocks, or bytes, sent and ACKed since the start of the transfer.
+ * RFC 7440 only asks the receiver to ACK whole windows: when a window smaller than the windowsize times out,
+ * whole windows are sent until the next loss or timeout, which cuts the window again.
+*/
+class CongestionWindow {
+    public:
+        CongestionWindow();
+        void init(int maxWindow);
+        int getWindow();
+        void onAck(int newlyAcked, uint64_t ackedMark);
+        void onLoss(uint64_t ackedMark, uint64_t sentMark); // ignored until the blocks in flight at the last cut are ACKed
+        void onTimeout(uint64_t sentMark);
+        void onStall(); // the receiver waits for whole windows
+        uint64_t losses; // duplicate ACKs and gaps that cut the window
+        uint64_t timeouts;
+        bool wholeWindows; // the window is held at the windowsize until the next loss or timeout
+    private:
+        int window;
+        int threshold; // slow start threshold
+        int maxWindow;
+        int ackedInWindow; // blocks ACKed towards the next increase
+        uint64_t recoveryMark; // sentMark of the last cut
+        void cut();
+};
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file tftp_uring.hpp
+ * @brief TFTP Server io_uring Backend.
+ *
+ * This file contains prototypes and constants for the io_uring I/O backend of the event engine.
+ * Each loop owns a submission ring shared by all of its sessions: socket receives/sends and
+ * file reads/writes are queued as SQEs and submitted together with a single io_uring_enter
+ * call per loop iteration. File I/O uses registered buffers and registered files.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#ifndef TFTP_URING_H
+#define TFTP_URING_H
+
+#ifndef TFTP_ENGINE_H
+    #include "tftp_engine.hpp"
+#endif
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#define TFTP_URING_LISTEN_DEPTH 8 // receives kept armed on the default server socket per loop
+#define TFTP_URING_CONTROL_PACKETS 256 // in flight ERROR/DEL ACK packets per loop
+#define TFTP_URING_MAX_BLOCK_SIZE 8192 // largest blksize granted by an io_uring loop, bounds the pinned slot buffers
+
+/**
+ * @brief Minimal io_uring wrapper over the raw system calls
+*/
+class IoUring {
+    public:
+        IoUring();
+        ~IoUring();
+        bool init(unsigned entries);
+        void exit();
+        struct io_uring_sqe* getSqe(); // NULL when the submission queue is full
+        bool reserve(unsigned count); // flushes the queue if less than count SQEs are free
+        int submit(bool wait, int timeoutMs = -1); // submits the queued SQEs, waits up to timeoutMs for one CQE when wait is set
+        bool supportsTimedWait();
+        struct io_uring_cqe* peekCqe();
+        void cqeSeen();
+        bool registerBuffers(struct iovec* iovecs, unsigned count);
+        bool registerFiles(int* fds, unsigned count);
+        bool updateFiles(unsigned offset, int* fds, unsigned count);
+        uint64_t enterCalls; // io_uring_enter system calls made
+    private:
+        int ringFD;
+        uint32_t features;
+        void* sqRingPtr;
+        size_t sqRingSize;
+        void* cqRingPtr;
+        size_t cqRingSize;
+        struct io_uring_sqe* sqes;
+        size_t sqesSize;
+        unsigned* sqHead;
+        unsigned* sqTail;
+        unsigned* sqArray;
+        unsigned sqMask;
+        unsigned sqEntries;
+        unsigned sqeTail; // local tail, published to the kernel on submit
+        unsigned* cqHead;
+        unsigned* cqTail;
+        unsigned cqMask;
+        struct io_uring_cqe* cqes;
+};
+
+/**
+ * @brief Per session state of a UringLoop. The send and receive buffers live in the registered region.
+*/
+struct UringSlot {
+    ClientHandler* session; // NULL once the session is closed
+    int socketFD;
+    bool inUse;
+    bool closing; // session closed, slot is released when pendingOps drops to zero
+    bool recvArmed;
+    bool recvBusy; // receive buffer holds a block being written to the file
+    bool socketShutdown; // receive ended by shutdown, the socket is not returned to the pool
+    bool filesRegistered;
+    int pendingOps; // SQEs of the slot not completed yet
+    int ioOpsLeft; // CQEs left for the current readAndSend/writeAndSend
+    bool ioFailed;
+    int ioLen; // expected result of the file read/write
+    uint8_t* sendBuffer;
+    uint8_t* recvBuffer;
+    struct msghdr sendMsg;
+    struct iovec sendIov; // points to sendBuffer, or to a packet image slice
+    std::shared_ptr<const void> sendOwner; // packet image sent from, kept until the slot is released
+    struct sockaddr_in sendAddress;
+    struct msghdr recvMsg;
+    struct iovec recvIov;
+    struct sockaddr_in recvAddress;
+    uint8_t recvControl[TFTP_TIMESTAMP_CONTROL_SIZE]; // receive timestamp of the packet, for the RTT samples
+    int fileUpdate[2]; // fds passed to the asynchronous FILES_UPDATE
+    std::shared_ptr<WriteBehind> writeBehind; // write-behind buffer of the session, kept until the slot is released
+    int chunkWrites; // write-behind chunk writes in flight
+    bool finalFlush; // final ACK waits for every chunk to be written
+    bool commitPending; // final ACK waits for the group commit of the upload, the slot is kept until it is reported
+    bool ackHeld; // ACK of the block in the receive buffer waits for room in the write-behind buffer
+    uint8_t* heldData; // block of the held ACK, inside recvBuffer
+    int heldLen;
+    uint64_t heldOffset;
+    bool heldFinal;
+};
+
+/**
+ * @brief ERROR/DEL ACK packet copied out of the session while its send is in flight
+*/
+struct UringControlPacket {
+    uint8_t buffer[TFTP_MAX_PACKET_SIZE];
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in address;
+    int slot;
+};
+
+/**
+ * @brief Receive posted on the default server socket
+*/
+struct UringListenBuffer {
+    uint8_t buffer[TFTP_MAX_PACKET_SIZE];
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in address;
+};
+
+/**
+ * @brief Event loop driven by io_uring completions. It is also the SessionIO of its sessions:
+ * DATA blocks are read with READ_FIXED linked to their send, received blocks are written with
+ * WRITE_FIXED linked to their ACK, or queued in a write-behind buffer written in chunks. Pre-built packets of a packet image are sent in place. Read-ahead
+ * is queued as FADVISE, run by the io_uring workers. The DATA of a window are sent one send completion after the other.
+*/
+class UringLoop : public EventLoop, public SessionIO {
+    public:
+        UringLoop(int loopId, int listenSocket);
+        ~UringLoop();
+        bool init() override;
+        void run() override;
+        bool sendPacket(ClientHandler* session, uint8_t* packet, int packetLen) override;
+        bool readAndSend(ClientHandler* session, uint64_t offset, int dataLen) override;
+        bool writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock) override;
+        bool commitAndSend(ClientHandler* session) override;
+        void readAhead(ClientHandler* session, uint64_t offset, uint64_t length) override;
+        int getMaxBlockSize() override;
+        bool sendsToGroup() override { return false; } // OACK and DATA of a slot share its sendMsg
+    protected:
+        bool prepareSession(ClientHandler* session) override;
+        bool watchSession(int socketFD) override;
+        void closeSession(int socketFD) override;
+        void wakeup() override;
+        void completeSession(const LoopCompletion& completion) override;
+    private:
+        IoUring ring;
+        int numSlots;
+        uint8_t* bufferRegion; // registered buffer 0, two packet buffers per slot
+        size_t bufferRegionSize;
+        int slotPacketSize; // size of each packet buffer of a slot, holds a DATA of the largest blksize granted
+        std::vector<UringSlot> slots;
+        std::vector<int> freeSlots;
+        std::vector<UringControlPacket> controlPackets;
+        std::vector<int> freeControlPackets;
+        std::vector<UringListenBuffer> listenBuffers;
+        int wakeFD;
+        uint64_t wakeCounter;
+        struct __kernel_timespec tickTimeout; // bounds the wait when io_uring_enter cannot time out itself
+        uint64_t blocksTransferred; // DATA blocks sent and received by the loop
+        uint64_t acksHeld; // ACKs delayed by a full write-behind buffer
+        bool armListen(int index);
+        bool armWakeup();
+        bool armTick();
+        bool armRecv(int slotIndex);
+        bool registerSessionFiles(int slotIndex);
+        bool queueSend(int slotIndex, struct msghdr* msg, uint64_t userData, int socketFD, uint8_t sqeFlags);
+        bool queueDataSend(int slotIndex, const uint8_t* packet, int packetLen);
+        void handleCompletion(uint64_t userData, int res);
+        void handleRecvComplete(int slotIndex, int res);
+        void handleDataIOComplete(int slotIndex, bool success);
+        bool bufferAndSend(int slotIndex, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock);
+        bool queueChunkWrites(int slotIndex);
+        void handleChunkWritten(int slotIndex, int chunkIndex, int res);
+        void handleSessionState(int slotIndex);
+        void tryRelease(int slotIndex);
+};
+
+#endif
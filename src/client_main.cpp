@@ -18,14 +18,77 @@ INITIALIZE_EASYLOGGINGPP
 
 int main(int argc, char* argv[]){
 
-    if(argc!=4){
-        std::cout<<"Invalid number of input arguments. Usage: "<<argv[0]<<" <TFTP_OPERATION> <FILE_NAME> <SERVER_IP>";
+    if(argc < 4 || argc > 10){
+        std::cout<<"Invalid number of input arguments. Usage: "<<argv[0]<<" <TFTP_OPERATION> <FILE_NAME> <SERVER_IP> [BLKSIZE] [WINDOWSIZE] [TIMEOUT] [NAK] [MULTICAST] [ROLLOVER]";
         return(EXIT_FAILURE);
     }
 
     std::string tftpMode(argv[1]);
     std::string requestFileName(argv[2]);
     std::string serverIP(argv[3]);
+    int requestedBlockSize = TFTP_CLIENT_BLOCK_SIZE;
+    int requestedWindowSize = TFTP_CLIENT_WINDOW_SIZE;
+    int requestedTimeout = TFTP_CLIENT_TIMEOUT;
+    bool requestedNak = TFTP_CLIENT_NAK;
+    bool requestedMulticast = TFTP_CLIENT_MULTICAST;
+    int requestedRollover = TFTP_CLIENT_ROLLOVER;
+    if(argc >= 5){
+        // 0 sends a plain RFC 1350 request without the blksize option
+        char* endPtr = NULL;
+        long blockSize = strtol(argv[4], &endPtr, 10);
+        if(*endPtr != '\0' || (blockSize != 0 && (blockSize < TFTP_MIN_BLOCK_SIZE || blockSize > TFTP_MAX_BLOCK_SIZE))){
+            std::cout<<"Invalid block size. Usage: [BLKSIZE] = 0 or "<<TFTP_MIN_BLOCK_SIZE<<"-"<<TFTP_MAX_BLOCK_SIZE;
+            return(EXIT_FAILURE);
+        }
+        requestedBlockSize = (int)blockSize;
+    }
+    if(argc >= 6){
+        // 0 sends the request without the windowsize option
+        char* endPtr = NULL;
+        long windowSize = strtol(argv[5], &endPtr, 10);
+        if(*endPtr != '\0' || windowSize < 0 || windowSize > TFTP_MAX_WINDOW_SIZE){
+            std::cout<<"Invalid window size. Usage: [WINDOWSIZE] = 0 or 1-"<<TFTP_MAX_WINDOW_SIZE;
+            return(EXIT_FAILURE);
+        }
+        requestedWindowSize = (int)windowSize;
+    }
+    if(argc >= 7){
+        // 0 sends the request without the timeout option
+        char* endPtr = NULL;
+        long timeout = strtol(argv[6], &endPtr, 10);
+        if(*endPtr != '\0' || timeout < 0 || timeout > TFTP_MAX_TIMEOUT){
+            std::cout<<"Invalid timeout. Usage: [TIMEOUT] = 0 or 1-"<<TFTP_MAX_TIMEOUT;
+            return(EXIT_FAILURE);
+        }
+        requestedTimeout = (int)timeout;
+    }
+    if(argc >= 8){
+        // 0 leaves the nak option out, downloads fall back to go-back-N after a loss
+        std::string nak(argv[7]);
+        if(nak != "0" && nak != "1"){
+            std::cout<<"Invalid nak. Usage: [NAK] = 0|1";
+            return(EXIT_FAILURE);
+        }
+        requestedNak = (nak == "1");
+    }
+    if(argc >= 9){
+        // 1 asks for the multicast option, a download of a file already being sent joins its group
+        std::string multicast(argv[8]);
+        if(multicast != "0" && multicast != "1"){
+            std::cout<<"Invalid multicast. Usage: [MULTICAST] = 0|1";
+            return(EXIT_FAILURE);
+        }
+        requestedMulticast = (multicast == "1");
+    }
+    if(argc == 10){
+        // Block number following 65535 in transfers of more than 65535 blocks
+        std::string rollover(argv[9]);
+        if(rollover != "0" && rollover != "1"){
+            std::cout<<"Invalid rollover. Usage: [ROLLOVER] = 0|1";
+            return(EXIT_FAILURE);
+        }
+        requestedRollover = (rollover == "1") ? 1 : 0;
+    }
 
     const char *homeDir = std::getenv("HOME");   
     std::string rootArgDir(homeDir);
@@ -75,7 +138,7 @@ int main(int argc, char* argv[]){
         exit(EXIT_FAILURE);
     }
     STARK::getInstance().setRootDir(rootArgDir.c_str());
-    ret = clientManager::getInstance().commInit(rootArgDir,requestFileName, serverIP, requestType);
+    ret = clientManager::getInstance().commInit(rootArgDir,requestFileName, serverIP, requestType, requestedBlockSize, requestedWindowSize, requestedTimeout, requestedNak, requestedMulticast, requestedRollover);
 	
     if(!ret){
         LOG(FATAL) <<"Unable to open socket in default port "<<TFTP_DEFAULT_PORT;
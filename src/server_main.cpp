@@ -12,17 +12,25 @@
 */
 
 #include "tftp_server.hpp"
+#include "tftp_engine.hpp"
+#include <sys/resource.h>
 #define DEBUG 0
 #define TOSTDOUT 1
 INITIALIZE_EASYLOGGINGPP
 
 int main(int argc, char* argv[]){
     START_EASYLOGGINGPP(argc, argv);
-    if(argc!=2){
-        std::cout<<"Invalid number of input arguments. Usage: "<<argv[0]<<" <SERVER_IPv4>";
+    if(argc<2){
+        std::cout<<"Invalid number of input arguments. Usage: "<<argv[0]<<" <SERVER_IPv4> [--option=value ...]"<<std::endl;
+        TftpConfig::getInstance().printUsage();
         return(EXIT_FAILURE);
     }
     std::string serverArgIP(argv[1]);
+    if(!TftpConfig::getInstance().parseOptions(argc, argv, 2)){
+        TftpConfig::getInstance().printUsage();
+        return(EXIT_FAILURE);
+    }
+    TftpConfig::getInstance().serverIP = serverArgIP;
     std::cout<<"Server IP Set to: "<<serverArgIP<<std::endl;
     const char *homeDir = std::getenv("HOME");   
     std::string rootArgDir(homeDir);
@@ -47,20 +55,82 @@ int main(int argc, char* argv[]){
     
     el::Loggers::reconfigureLogger("default", defaultConf);
 
-    int defaultServerSock;
-	defaultServerSock = createUDPSocket(serverArgIP.c_str(), TFTP_DEFAULT_PORT, TFTP_SERVER_SOCKET_TIMEOUT);
-    if(defaultServerSock == -1){
-        LOG(FATAL) <<"Unable to open socket in default port "<<TFTP_DEFAULT_PORT;
-        exit(EXIT_FAILURE);
+    // One socket on the request port, or one SO_REUSEPORT socket per request shard
+    TftpConfig& config = TftpConfig::getInstance();
+    int numListeners = config.getListenerCount();
+    if(config.serverEngine == TFTP_ENGINE_EPOLL){
+        numListeners = std::min(numListeners, config.getEventLoopCount());
+    }
+    std::vector<int> listenSockets;
+    for(int i = 0; i < numListeners; ++i){
+        int defaultServerSock = createUDPSocket(serverArgIP.c_str(), TFTP_DEFAULT_PORT, TFTP_SERVER_SOCKET_TIMEOUT, numListeners > 1);
+        if(defaultServerSock == -1){
+            LOG(FATAL) <<"Unable to open socket in default port "<<TFTP_DEFAULT_PORT;
+            exit(EXIT_FAILURE);
+        }
+        listenSockets.push_back(defaultServerSock);
     }
     END_SERVER_PROCESS = false;
+    // Every session holds a socket and a file, io_uring loops also register them as fixed files
+    struct rlimit fileLimit;
+    if(getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 && fileLimit.rlim_cur < fileLimit.rlim_max){
+        fileLimit.rlim_cur = fileLimit.rlim_max;
+        if(setrlimit(RLIMIT_NOFILE, &fileLimit) == -1){
+            LOG(ERROR) <<"Unable to raise open file limit: "<<strerror(errno);
+        }
+    }
+    if(config.tidFirstPort != 0){
+        int numPooled = UDPSocketPool::getInstance().init(serverArgIP.c_str(), config.tidFirstPort, config.tidLastPort);
+        LOG(INFO) <<"Transfer socket pool: "<<numPooled<<" sockets bound in ports "<<config.tidFirstPort<<"-"<<config.tidLastPort;
+    }
+    if(!config.multicastIP.empty() && MulticastRegistry::getInstance().init(config.multicastIP, config.multicastPort, serverArgIP)){
+        LOG(INFO) <<"Multicast groups sent to "<<config.multicastIP<<" in ports "<<config.multicastPort<<"-"<<config.multicastPort + TFTP_MULTICAST_MAX_GROUPS - 1;
+    }
     STARK::getInstance().setRootDir(rootArgDir.c_str());
-	std::thread incommingThread(handleIncommingRequests, defaultServerSock);
-	std::thread terminationThread(handleServerTermination);
+    STARK::getInstance().setCacheLimits((uint64_t)config.cacheMB << 20, (uint64_t)config.cacheFileMB << 20);
+    int staleUploads = STARK::getInstance().removeStaleUploads();
+    if(staleUploads > 0){
+        LOG(INFO) <<staleUploads<<" incomplete uploads of a previous run removed";
+    }
+    if(config.commitMs > 0){
+        STARK::getInstance().startGroupCommit(config.commitMs);
+    }
+    if(config.serverEngine == TFTP_ENGINE_EPOLL){
+        EventEngine engine(listenSockets, config.getEventLoopCount());
+        if(!engine.start()){
+            LOG(FATAL) <<"Unable to start the event engine";
+            exit(EXIT_FAILURE);
+        }
+        handleServerTermination();
+        engine.stop();
+    }
+    else{
+        // Sessions spawned by a pinned request thread inherit its core
+        std::vector<std::thread> incommingThreads;
+        for(int i = 0; i < numListeners; ++i){
+            int defaultServerSock = listenSockets[i];
+            incommingThreads.push_back(std::thread([defaultServerSock, i](){
+                TftpConfig::getInstance().pinThread(i);
+                handleIncommingRequests(defaultServerSock);
+            }));
+        }
+        std::thread terminationThread(handleServerTermination);
 
-	incommingThread.join();
-	terminationThread.join();
+        for(auto& incommingThread : incommingThreads){
+            incommingThread.join();
+        }
+        terminationThread.join();
+    }
 
-	close(defaultServerSock);
+    for(int defaultServerSock : listenSockets){
+        close(defaultServerSock);
+    }
+    STARK::getInstance().stopGroupCommit();
+    LOG(INFO) <<"Transfer socket pool: "<<UDPSocketPool::getInstance().fallbacks<<" sockets bound outside the pool";
+    LOG(INFO) <<"File mappings: "<<STARK::getInstance().mapsCreated<<" created, "<<STARK::getInstance().mapsShared<<" shared by concurrent readers";
+    uint64_t cacheHits, cacheMisses, cacheEvictions, cacheInvalidations, cacheBytes;
+    STARK::getInstance().getCacheStats(cacheHits, cacheMisses, cacheEvictions, cacheInvalidations, cacheBytes);
+    LOG(INFO) <<"File cache: "<<cacheHits<<" hits, "<<cacheMisses<<" misses, "<<cacheEvictions<<" evictions, "<<cacheInvalidations<<" invalidations, "<<cacheBytes<<" bytes held, "<<STARK::getInstance().getImagesBuilt()<<" packet images built";
+    LOG(INFO) <<"Uploads: "<<STARK::getInstance().uploadsCommitted<<" moved into place, "<<STARK::getInstance().groupCommits<<" group commits";
 	return 0;
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 */ 
 
 #include "tftp_client.hpp"
+#include <poll.h>
 
 /**
  * @brief Construct a new client Manager::client Manager object 
@@ -27,15 +28,40 @@ clientManager::clientManager(){
  * @param fileName 
  * @param serverIP 
  * @param requestType 
+ * @param requestedBlockSize 
+ * @param requestedWindowSize 
+ * @param requestedTimeout 
+ * @param requestedNak 
+ * @param requestedMulticast 
+ * @param requestedRollover 
  * @return true 
  * @return false 
  */
-bool clientManager::commInit(std::string rootDir, std::string fileName, std::string serverIP, TftpOpcode requestType){
+bool clientManager::commInit(std::string rootDir, std::string fileName, std::string serverIP, TftpOpcode requestType, int requestedBlockSize, int requestedWindowSize, int requestedTimeout, bool requestedNak, bool requestedMulticast, int requestedRollover){
     if(requestType==TFTP_OPCODE_RRQ || requestType == TFTP_OPCODE_WRQ || requestType == TFTP_OPCODE_DEL){
         this->root_dir = rootDir;
         this->requestFileName = fileName;
         this->requestType = requestType;
         this->blockNum = 0;
+        this->requestedBlockSize = requestedBlockSize;
+        this->blockSize = TFTP_MAX_DATA_SIZE;
+        this->requestedWindowSize = requestedWindowSize;
+        this->windowSize = 1;
+        this->requestedTimeout = requestedTimeout;
+        this->timeoutSec = 0;
+        // Selective repeat only applies to a window of blocks
+        this->requestedNak = requestedNak && requestedWindowSize > 1;
+        this->nakEnabled = false;
+        this->requestedMulticast = requestedMulticast && requestType == TFTP_OPCODE_RRQ;
+        this->multicastEnabled = false;
+        this->multicastMaster = false;
+        memset(&this->multicastAddress, 0, sizeof(this->multicastAddress));
+        this->requestedRollover = requestedRollover;
+        this->rollover = 0;
+        this->resumeOffset = 0;
+        this->receivedBytes = 0;
+        this->rtt = RttEstimator();
+        this->cwnd = CongestionWindow();
         this->operationMode = "octet"; // Currently only octet is supported
         this->compObj.setRootDir(rootDir);
         this->compObj.setFileName(fileName);
@@ -44,6 +70,8 @@ bool clientManager::commInit(std::string rootDir, std::string fileName, std::str
             LOG(FATAL)<<"Error opening client side default socket";
             return false;
         }
+        // RTT samples end when the kernel received the answer
+        enableReceiveTimestamps(this->defaultSocket);
 
         memset(&this->serverAddress, 0, sizeof(this->serverAddress));
         this->serverAddress.sin_family = AF_INET;  // using IPv4 address family
@@ -67,8 +95,6 @@ bool clientManager::commInit(std::string rootDir, std::string fileName, std::str
  * 
  */
 void clientManager::commExit(){
-    std::chrono::seconds duration(2);
-    std::this_thread::sleep_for(duration);
     close(this->defaultSocket);
     return;
 }
@@ -90,7 +116,14 @@ void clientManager::handleTFTPConnection(){
         }
         // Remove to integrate compression.
 		//fd = STARK::getInstance().isFileWritable(this->requestFileName, errorCode);
-		fd = STARK::getInstance().isFileWritable(this->compObj.compressFileName, errorCode);
+        if(STARK::getInstance().isFileAvailable(this->compObj.compressFileName)){
+            // A download interrupted before goes on after the bytes already received
+            fd = STARK::getInstance().isFileAppendable(this->compObj.compressFileName, this->resumeOffset, errorCode);
+            LOG(INFO)<<"Resuming download after "<<this->resumeOffset<<" bytes";
+        }
+        else{
+            fd = STARK::getInstance().isFileWritable(this->compObj.compressFileName, errorCode);
+        }
         if(fd.is_open()){
             LOG(INFO)<<"Raw rile open success";
             bool isDataReceived  = false;
@@ -117,9 +150,24 @@ void clientManager::handleTFTPConnection(){
                 }
                 else{
                     LOG(ERROR)<<"Error decompressing the received file";
+                    // A complete but corrupt file would be resumed from its end by every next READ, it is dropped instead
+                    TftpErrorCode dummy;
+                    if(!STARK::getInstance().isFileDeletable(this->compObj.compressFileName, dummy)){
+                        LOG(ERROR)<<"Error while deleting temp files";
+                    }
                     return;
                 }
             }
+            else if(this->resumeOffset + this->receivedBytes > 0){
+                // Only the bytes received in order are kept, a multicast download leaves holes after them.
+                // The next READ of the file resumes the download
+                uint64_t keptBytes = this->resumeOffset + this->receivedBytes;
+                if(truncate((this->root_dir + this->compObj.compressFileName).c_str(), (off_t)keptBytes) == 0){
+                    LOG(INFO)<<keptBytes<<" bytes kept in "<<this->compObj.compressFileName;
+                    return;
+                }
+                LOG(ERROR)<<"unable to cut "<<this->compObj.compressFileName<<" back to "<<keptBytes<<" bytes";
+            }
             TftpErrorCode dummy;
             ret = STARK::getInstance().isFileDeletable(this->compObj.compressFileName, dummy);
             if(ret){
@@ -241,8 +289,22 @@ void clientManager::handleTFTPConnection(){
 
 bool clientManager::handleReceiveData(std::ofstream& fd){
     uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
-	uint8_t recvData[TFTP_MAX_DATA_SIZE];
+	std::vector<uint8_t> recvData(std::max(this->requestedBlockSize, TFTP_MAX_DATA_SIZE));
 	uint16_t recvBlockNum = 0;
+	TftpOptions requestOptions;
+	TftpOptions oack;
+	memset(&requestOptions, 0, sizeof(requestOptions));
+	memset(&oack, 0, sizeof(oack));
+	requestOptions.blockSize = this->requestedBlockSize;
+	requestOptions.windowSize = this->requestedWindowSize;
+	requestOptions.timeout = this->requestedTimeout;
+	requestOptions.hasTransferSize = true; // tsize 0 asks for the file size
+	requestOptions.nak = this->requestedNak;
+	requestOptions.multicast = this->requestedMulticast;
+	requestOptions.hasRollover = true;
+	requestOptions.rollover = this->requestedRollover;
+	requestOptions.hasOffset = (this->resumeOffset > 0);
+	requestOptions.offset = this->resumeOffset;
     
     if(fd.is_open()){
         bool allDataReceived = false;
@@ -253,12 +315,19 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
 		int inValidTries = 0;
 		bool isErrorPktReceived = false;
         bool isFirstPacket = true;
+        bool isOutOfOrder = false;
+        bool isACKDue = true;
+        uint64_t ackedBlockNum = 0; // last block ACKed to the server
+        int outOfOrder = 0; // blocks out of order since the last block in order
+        uint64_t blocksInOrder = 0; // blocks written to the file
+        std::map<uint64_t, std::vector<uint8_t>> heldBlocks; // blocks received after a lost one with nak, by block index
 
-        sendPacketSize = makeComInitPacket(TFTP_OPCODE_RRQ,sendBuffer,sizeof(sendBuffer),this->requestFileName.c_str(),TFTP_MODE_OCTET);
+        sendPacketSize = makeComInitPacket(TFTP_OPCODE_RRQ,sendBuffer,sizeof(sendBuffer),this->requestFileName.c_str(),TFTP_MODE_OCTET, &requestOptions);
         if(sendPacketSize == -1){
             LOG(ERROR)<<"unable to make data packet";
             return false;
         }
+        this->rtt.startTiming(1, std::chrono::steady_clock::now());
         ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
         if(ret != sendPacketSize){
             LOG(ERROR)<<"packet send error";
@@ -271,15 +340,62 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
 			dataRecvStatus = false;
 			recvDataLen = 0;
 			isErrorPktReceived = false;
+			isACKDue = true;
+			recvBlockNum = toWireBlockNum(this->blockNum + 1, this->rollover);
 
             if(inValidTries > TFTP_RECEIVE_TRIES){
 				LOG(ERROR)<<"lost connection";
 				return false;
 			}
-            dataRecvStatus = getData(this->defaultSocket,this->serverAddress, this->blockNum+1, recvData, sizeof(recvData), recvDataLen, isErrorPktReceived, isFirstPacket);
-
-			if(dataRecvStatus){
-				ret = writeData512(recvData, recvDataLen, fd);
+            // Blocks received inside a window are ACKed when the rest of the window does not follow within the ACK delay,
+            // the server may be held back by its congestion window
+            bool isWindowOpen = (ackedBlockNum != this->blockNum);
+            if(!waitForPacket(isWindowOpen ? this->rtt.getAckDelayMs() : getTimeoutMs())){
+                if(isWindowOpen){
+                    LOG(DEBUG)<<"Window stalled after block "<<this->blockNum<<", sending its ACK";
+                }
+                else{
+                    if(!handleTimeout()){
+                        inValidTries++;
+                    }
+                    // Before the first answer the server TID is unknown, nothing is sent
+                    isACKDue = !isFirstPacket;
+                    LOG(ERROR)<<"Timeout, resending ACK "<<this->blockNum;
+                }
+            }
+            else if((dataRecvStatus = getData(this->defaultSocket,this->serverAddress, toWireBlockNum(this->blockNum + 1, this->rollover), recvData.data(), this->blockSize, recvDataLen, isErrorPktReceived, isFirstPacket, isFirstPacket ? &oack : NULL, &isOutOfOrder, this->nakEnabled ? &recvBlockNum : NULL)) && recvDataLen == -1){
+				// The OACK is timed from the request, the ACK 0 answering it is timed to DATA 1
+				if(this->rtt.getTimedMark() == 1){
+					this->rtt.stopTiming(getReceiveTime());
+				}
+				// The server answered with an OACK, the options are confirmed with ACK 0
+				if(!acceptOptions(oack)){
+					return false;
+				}
+				if(this->resumeOffset > 0 && !oack.hasOffset && !restartDownload(fd)){
+					return false;
+				}
+				// The download is refused before any data moves when it does not fit
+				TftpErrorCode errorCode;
+				if(oack.hasTransferSize && !STARK::getInstance().reserveFileSpace(this->compObj.compressFileName, oack.transferSize, errorCode)){
+					sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_DISK_FULL, "not enough space in client");
+					sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+					return false;
+				}
+				isFirstPacket = false;
+				connectUDPSocket(this->defaultSocket, this->serverAddress);
+				inValidTries = 0;
+				if(this->multicastEnabled){
+					// The DATA are sent to the group, ACK 0 is only sent by the master
+					return receiveMulticast(fd, oack);
+				}
+			}
+			else if(dataRecvStatus){
+				// A server without options sends the file from its start
+				if(isFirstPacket && this->resumeOffset > 0 && !restartDownload(fd)){
+					return false;
+				}
+				ret = writeDataBlock(recvData.data(), recvDataLen, this->blockSize, fd);
 				if(ret < 0){
 					LOG(ERROR)<<"file write error";
                     sendPacketSize = 0;
@@ -289,13 +405,54 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
 				}
                 if(isFirstPacket == true){
                     isFirstPacket = false;
+                    // Server TID learned, the kernel filters the datagrams of other sources
+                    connectUDPSocket(this->defaultSocket, this->serverAddress);
                 }
 				this->blockNum++;
+				blocksInOrder++;
+				this->receivedBytes += recvDataLen;
 				inValidTries = 0;
-				LOG(DEBUG)<< "receive data len: "<<recvDataLen<<" max:"<< TFTP_MAX_DATA_SIZE;
-				if(recvDataLen < TFTP_MAX_DATA_SIZE){
+				outOfOrder = 0;
+				if(this->rtt.isTiming() && this->rtt.getTimedMark() == this->blockNum){
+					this->rtt.stopTiming(getReceiveTime());
+				}
+				LOG(DEBUG)<< "receive data len: "<<recvDataLen<<" max:"<< this->blockSize;
+				if(recvDataLen < this->blockSize){
 					allDataReceived = true;
 				}
+				// The missing block is in, the blocks held after it follow in order
+				bool isGapFilled = false;
+				while(!allDataReceived && !heldBlocks.empty() && heldBlocks.begin()->first == blocksInOrder + 1){
+					std::vector<uint8_t>& heldData = heldBlocks.begin()->second;
+					if(writeDataBlock(heldData.data(), heldData.size(), this->blockSize, fd) < 0){
+						LOG(ERROR)<<"file write error";
+						sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "Server side data write error");
+						sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+						return false;
+					}
+					this->blockNum++;
+					blocksInOrder++;
+					this->receivedBytes += heldData.size();
+					allDataReceived = ((int)heldData.size() < this->blockSize);
+					heldBlocks.erase(heldBlocks.begin());
+					isGapFilled = heldBlocks.empty();
+				}
+				if(allDataReceived){
+					heldBlocks.clear();
+				}
+				// Inside a window only its last block and the final block are acknowledged, and with nak the block filling
+				// the last gap as the server may have halved its congestion window
+				isACKDue = allDataReceived || isGapFilled || this->blockNum - ackedBlockNum >= (uint64_t)this->windowSize;
+			}
+			else if(isOutOfOrder){
+				// A block after a lost one is held with nak, retransmitted blocks are behind blockNum and wrap around
+				uint64_t ahead = wireBlockDistance(this->blockNum, recvBlockNum, this->rollover);
+				if(this->nakEnabled && ahead > 1 && ahead <= (uint64_t)this->windowSize){
+					heldBlocks[blocksInOrder + ahead].assign(recvData.begin(), recvData.begin() + recvDataLen);
+				}
+				// The last block in order is ACKed, or the missing blocks NAKed, once per window of them
+				isACKDue = (outOfOrder++ % this->windowSize == 0);
+				this->rtt.cancelTiming();
 			}
 			else{
 				if(!isErrorPktReceived){
@@ -304,15 +461,27 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
 				}
 				else{
 					LOG(ERROR)<<"Error received from client. Terminating transfer";
+					// A refused resume is started over by the next READ
+					if(isFirstPacket && this->resumeOffset > 0){
+						restartDownload(fd);
+					}
 					return false;
 				}
 			}
 
-            sendPacketSize = makeACKPacket(sendBuffer, sizeof(sendBuffer), this->blockNum);
+            if(!isACKDue){
+                continue;
+            }
+            ackedBlockNum = this->blockNum;
+            sendPacketSize = makeFeedbackPacket(sendBuffer, sizeof(sendBuffer), heldBlocks, blocksInOrder);
 			if(sendPacketSize == -1){
 				LOG(ERROR)<<"unable to make data packet";
 				return false;
 			}
+			// The ACK is timed to the first block of the next window, the blocks answering a NAK are resent ones
+			if(heldBlocks.empty()){
+				this->rtt.startTiming(this->blockNum + 1, std::chrono::steady_clock::now());
+			}
 			ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
 			if(ret != sendPacketSize){
 				LOG(ERROR)<<"packet send error";
@@ -322,6 +491,7 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
         }
         if(allDataReceived){
             LOG(INFO)<<"All data received";
+            dallyFinalACK(sendBuffer, sendPacketSize);
             return true;
         }else{
             LOG(ERROR)<<"Unexpected error";
@@ -337,7 +507,299 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
 }
 
 /**
- * @brief Function to send data for TFTP Client
+ * @brief Function to receive a download sent to a multicast group (RFC 2090). Each block is written at its offset when it
+ * first arrives, a client joining late gets the blocks before it once it is the master. Only the master ACKs, the ACK
+ * tells the server the first block missing. Once every block is in, the final block is ACKed to leave the group.
+ * 
+ * @param fd 
+ * @param oack 
+ * @return true 
+ * @return false 
+ */
+bool clientManager::receiveMulticast(std::ofstream& fd, TftpOptions& oack){
+    uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+    std::vector<uint8_t> recvBuffer(TFTP_BLOCK_PACKET_SIZE(this->blockSize) + 1);
+    int sendPacketSize = 0;
+    int groupSocket = createMulticastReceiver(this->multicastAddress, clientIP);
+    if(groupSocket == -1){
+        sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "unable to join multicast group");
+        sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+        return false;
+    }
+    growSocketReceiveBuffer(groupSocket, 2 * this->windowSize * TFTP_BLOCK_PACKET_SIZE(this->blockSize));
+    std::vector<bool> received(1, true); // by block index, index 0 is unused
+    uint64_t firstMissing = 1;
+    uint64_t highestBlock = 0;
+    uint64_t lastBlock = oack.hasTransferSize ? oack.transferSize / this->blockSize + 1 : 0; // 0 until the final block arrives
+    int blocksSinceAck = 0;
+    int inValidTries = 0;
+    bool isACKDue = this->multicastMaster;
+    bool wasMaster = this->multicastMaster;
+    bool isComplete = false;
+    bool isFailed = false;
+    while(!isComplete && !isFailed){
+        if(isACKDue){
+            sendPacketSize = makeACKPacket(sendBuffer, sizeof(sendBuffer), toWireBlockNum(firstMissing - 1, this->rollover));
+            if(sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress) != sendPacketSize){
+                LOG(ERROR)<<"packet send error";
+                isFailed = true;
+                break;
+            }
+            LOG(DEBUG)<<"ACK "<<firstMissing - 1<<" sent as master";
+            blocksSinceAck = 0;
+            isACKDue = false;
+        }
+        if(inValidTries > TFTP_RECEIVE_TRIES){
+            LOG(ERROR)<<"lost connection";
+            sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "no data received. time out error");
+            sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+            isFailed = true;
+            break;
+        }
+        // A master ACKs the received part of a window within the ACK delay, then on the retransmission timeout
+        bool isWindowOpen = this->multicastMaster && blocksSinceAck > 0;
+        struct pollfd pollFDs[2];
+        pollFDs[0].fd = groupSocket;
+        pollFDs[1].fd = this->defaultSocket;
+        pollFDs[0].events = pollFDs[1].events = POLLIN;
+        pollFDs[0].revents = pollFDs[1].revents = 0;
+        int ret = poll(pollFDs, 2, isWindowOpen ? this->rtt.getAckDelayMs() : getTimeoutMs());
+        if(ret == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            LOG(ERROR)<<"poll error "<<strerror(errno);
+            isFailed = true;
+            break;
+        }
+        if(ret == 0){
+            if(!isWindowOpen && !handleTimeout()){
+                inValidTries++;
+            }
+            isACKDue = this->multicastMaster;
+            continue;
+        }
+        if(pollFDs[1].revents & POLLIN){
+            // The server TID only sends the OACK making the client master, or an ERROR
+            struct sockaddr_in recvAddress;
+            int recvLen = getBufferThroughUDP(recvBuffer.data(), recvBuffer.size(), this->defaultSocket, recvAddress);
+            uint16_t opcode;
+            uint16_t errorCode;
+            TftpOptions masterOptions;
+            memset(&masterOptions, 0, sizeof(masterOptions));
+            if(recvLen != -1 && parsePacketHeader(recvBuffer.data(), recvLen, opcode, errorCode)){
+                if(opcode == TFTP_OPCODE_ERROR){
+                    LOG(ERROR)<<"Received Error from server error code:"<<errorCode;
+                    isFailed = true;
+                    break;
+                }
+                if(parseOACKPacket(recvBuffer.data(), recvLen, masterOptions) && masterOptions.multicast && masterOptions.multicastMaster){
+                    if(!this->multicastMaster){
+                        LOG(INFO)<<"Client is the master of the multicast group, "<<firstMissing - 1<<" blocks received in order";
+                    }
+                    this->multicastMaster = true;
+                    wasMaster = true;
+                    isACKDue = true;
+                    inValidTries = 0;
+                }
+            }
+        }
+        if(pollFDs[0].revents & POLLIN){
+            int recvLen = recv(groupSocket, recvBuffer.data(), recvBuffer.size(), MSG_DONTWAIT);
+            uint16_t opcode;
+            uint16_t recvBlockNum;
+            if(recvLen == -1 || !parsePacketHeader(recvBuffer.data(), recvLen, opcode, recvBlockNum) || opcode != TFTP_OPCODE_DATA ||
+                recvLen - TFTP_MAX_HEADER_SIZE > this->blockSize){
+                continue;
+            }
+            // Block of the file nearest to the blocks expected next: the gap a master ACKed, or the block after the last one received
+            uint64_t reference = this->multicastMaster ? firstMissing : highestBlock;
+            int64_t block = (int64_t)reference + (int64_t)wireBlockDistance(reference, recvBlockNum, this->rollover);
+            if(block - (int64_t)reference > TFTP_BLOCK_NUM_PERIOD(this->rollover) / 2){
+                block -= TFTP_BLOCK_NUM_PERIOD(this->rollover);
+            }
+            if(block < 1){
+                block += TFTP_BLOCK_NUM_PERIOD(this->rollover);
+            }
+            if(lastBlock > 0 && (uint64_t)block > lastBlock){
+                continue;
+            }
+            int dataLen = recvLen - TFTP_MAX_HEADER_SIZE;
+            if(dataLen < this->blockSize){
+                lastBlock = (uint64_t)block;
+            }
+            inValidTries = 0;
+            if((uint64_t)block >= received.size()){
+                received.resize(block + 1, false);
+            }
+            if(!received[block]){
+                fd.seekp((std::streamoff)(block - 1) * this->blockSize);
+                if(dataLen > 0 && writeDataBlock(recvBuffer.data() + TFTP_MAX_HEADER_SIZE, dataLen, this->blockSize, fd) < 0){
+                    LOG(ERROR)<<"file write error";
+                    sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "Client side data write error");
+                    sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+                    isFailed = true;
+                    break;
+                }
+                received[block] = true;
+                highestBlock = std::max(highestBlock, (uint64_t)block);
+                while(firstMissing < received.size() && received[firstMissing]){
+                    firstMissing++;
+                }
+                // Before the final block all blocks are full, those before the first missing one are kept on a failure
+                this->receivedBytes = (firstMissing - 1) * this->blockSize;
+            }
+            blocksSinceAck++;
+            // Inside a window only its last block and the final block are acknowledged
+            isACKDue = this->multicastMaster && (blocksSinceAck >= this->windowSize || (uint64_t)block == lastBlock);
+        }
+        isComplete = (lastBlock > 0 && firstMissing > lastBlock);
+    }
+    if(isFailed){
+        close(groupSocket);
+        return false;
+    }
+    // The ACK of the final block hands the group over, or leaves it before the turn of the client as master
+    this->blockNum = lastBlock;
+    sendPacketSize = makeACKPacket(sendBuffer, sizeof(sendBuffer), toWireBlockNum(this->blockNum, this->rollover));
+    if(sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress) != sendPacketSize){
+        LOG(ERROR)<<"packet send error";
+    }
+    LOG(INFO)<<"All "<<lastBlock<<" blocks received from the multicast group"<<(wasMaster ? " as master" : "");
+    dallyMulticastACK(groupSocket, sendBuffer, sendPacketSize, wasMaster);
+    close(groupSocket);
+    return true;
+}
+
+/**
+ * @brief Function to wait after the final ACK of a multicast download. The ACK is resent when the server makes the client
+ * master again as the ACK was lost, or to a master when the server retransmits the final DATA to the group.
+ * 
+ * @param groupSocket 
+ * @param ackPacket 
+ * @param ackPacketLen 
+ * @param resendOnData 
+ */
+void clientManager::dallyMulticastACK(int groupSocket, uint8_t* ackPacket, int ackPacketLen, bool resendOnData){
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TFTP_CLIENT_DALLY_MS);
+    while(true){
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if(remaining.count() <= 0){
+            return;
+        }
+        struct pollfd pollFDs[2];
+        pollFDs[0].fd = groupSocket;
+        pollFDs[1].fd = this->defaultSocket;
+        pollFDs[0].events = pollFDs[1].events = POLLIN;
+        pollFDs[0].revents = pollFDs[1].revents = 0;
+        int ret = poll(pollFDs, 2, (int)remaining.count());
+        if(ret == 0){
+            return;
+        }
+        if(ret == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            LOG(ERROR)<<"poll error "<<strerror(errno);
+            return;
+        }
+        uint16_t opcode;
+        uint16_t recvBlockNum;
+        bool isResendDue = false;
+        if(pollFDs[1].revents & POLLIN){
+            int recvLen = recv(this->defaultSocket, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT);
+            TftpOptions resentOptions;
+            isResendDue = (recvLen != -1 && parseOACKPacket(recvBuffer, recvLen, resentOptions));
+        }
+        if(pollFDs[0].revents & POLLIN){
+            int recvLen = recv(groupSocket, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT);
+            isResendDue = isResendDue || (resendOnData && recvLen != -1 && parsePacketHeader(recvBuffer, recvLen, opcode, recvBlockNum) &&
+                opcode == TFTP_OPCODE_DATA && recvBlockNum == toWireBlockNum(this->blockNum, this->rollover));
+        }
+        if(isResendDue){
+            LOG(DEBUG)<<"Final ACK "<<this->blockNum<<" resent";
+            sendBufferThroughUDP(ackPacket, ackPacketLen, this->defaultSocket, this->serverAddress);
+        }
+    }
+}
+
+/**
+ * @brief Function to make the feedback of a download: the ACK of the last block in order, or with blocks held
+ * a NAK reporting the blocks missing before the last one held
+ * 
+ * @param sendBuffer 
+ * @param bufferLen 
+ * @param heldBlocks 
+ * @param blocksInOrder 
+ * @return int packet length, -1 on error
+ */
+int clientManager::makeFeedbackPacket(uint8_t* sendBuffer, size_t bufferLen, const std::map<uint64_t, std::vector<uint8_t>>& heldBlocks, uint64_t blocksInOrder){
+    if(heldBlocks.empty()){
+        return makeACKPacket(sendBuffer, bufferLen, toWireBlockNum(this->blockNum, this->rollover));
+    }
+    uint8_t bitmap[TFTP_MAX_DATA_SIZE];
+    uint64_t numBits = heldBlocks.rbegin()->first - blocksInOrder - 1;
+    size_t bitmapLen = std::min((size_t)((numBits + 7) / 8), sizeof(bitmap));
+    memset(bitmap, 0, bitmapLen);
+    int numMissing = 0;
+    for(uint64_t i = 0; i < numBits && i < bitmapLen * 8; ++i){
+        if(heldBlocks.count(blocksInOrder + 1 + i) == 0){
+            bitmap[i / 8] |= (0x80 >> (i % 8));
+            numMissing++;
+        }
+    }
+    LOG(DEBUG)<<"NAK "<<this->blockNum<<", "<<numMissing<<" blocks missing, "<<heldBlocks.size()<<" held";
+    return makeNAKPacket(sendBuffer, bufferLen, toWireBlockNum(this->blockNum, this->rollover), bitmap, bitmapLen);
+}
+
+/**
+ * @brief Function to wait after the final ACK of a download, the ACK is resent when the server
+ * retransmits the final DATA because the ACK was lost
+ * 
+ * @param ackPacket 
+ * @param ackPacketLen 
+ */
+void clientManager::dallyFinalACK(uint8_t* ackPacket, int ackPacketLen){
+    uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TFTP_CLIENT_DALLY_MS);
+    while(true){
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if(remaining.count() <= 0){
+            return;
+        }
+        struct pollfd pollFD;
+        pollFD.fd = this->defaultSocket;
+        pollFD.events = POLLIN;
+        pollFD.revents = 0;
+        int ret = poll(&pollFD, 1, (int)remaining.count());
+        if(ret == 0){
+            return;
+        }
+        if(ret == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            LOG(ERROR)<<"poll error "<<strerror(errno);
+            return;
+        }
+        struct sockaddr_in recvAddress;
+        int recvLen = getBufferThroughUDP(recvBuffer, sizeof(recvBuffer), this->defaultSocket, recvAddress);
+        uint16_t opcode;
+        uint16_t recvBlockNum;
+        if(recvLen == -1 || recvAddress.sin_addr.s_addr != this->serverAddress.sin_addr.s_addr || recvAddress.sin_port != this->serverAddress.sin_port){
+            continue;
+        }
+        if(parsePacketHeader(recvBuffer, recvLen, opcode, recvBlockNum) && opcode == TFTP_OPCODE_DATA && recvBlockNum == toWireBlockNum(this->blockNum, this->rollover)){
+            LOG(DEBUG)<<"Final data block "<<recvBlockNum<<" retransmitted, resending ACK";
+            sendBufferThroughUDP(ackPacket, ackPacketLen, this->defaultSocket, this->serverAddress);
+        }
+    }
+}
+
+/**
+ * @brief Function to send data for TFTP Client. Up to the congestion window, at most windowSize blocks, are sent before waiting for
+ * their ACK, an ACK short of the last block sent or a timeout sends the blocks after the last ACK again
  * 
  * @param fd 
  * @return true 
@@ -345,103 +807,181 @@ bool clientManager::handleReceiveData(std::ofstream& fd){
  */
 bool clientManager::handleSendData(std::ifstream& fd){
     uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
-	uint8_t dataBuffer[TFTP_MAX_DATA_SIZE];
+	TftpOptions requestOptions;
+	TftpOptions oack;
+	memset(&requestOptions, 0, sizeof(requestOptions));
+	memset(&oack, 0, sizeof(oack));
+	requestOptions.blockSize = this->requestedBlockSize;
+	requestOptions.windowSize = this->requestedWindowSize;
+	requestOptions.timeout = this->requestedTimeout;
+	requestOptions.hasRollover = true;
+	requestOptions.rollover = this->requestedRollover;
 	if(fd.is_open()){
-		bool allDataSent = false;
-		int bytesRead = 0;
+        // tsize announces the upload size, the server refuses it when it does not fit
+        fd.seekg(0, std::ios::end);
+        std::streamoff uploadSize = fd.tellg();
+        fd.seekg(0, std::ios::beg);
+        if(uploadSize >= 0){
+            requestOptions.hasTransferSize = true;
+            requestOptions.transferSize = (uint64_t)uploadSize;
+        }
 		int sendPacketSize = 0;
 		int ret = 0;
 		bool ackStatus = false;
 		int inValidTries = 0;
-		int getNewPacket = true;
 		bool isErrorPktReceived = false;
         bool isFirstACKReceived = false;
-        sendPacketSize = makeComInitPacket(TFTP_OPCODE_WRQ,sendBuffer,sizeof(sendBuffer),this->requestFileName.c_str(),TFTP_MODE_OCTET);
+        sendPacketSize = makeComInitPacket(TFTP_OPCODE_WRQ,sendBuffer,sizeof(sendBuffer),this->requestFileName.c_str(),TFTP_MODE_OCTET, &requestOptions);
         if(sendPacketSize == -1){
             LOG(ERROR)<<"unable to make data packet";
             return false;
         }
+        this->rtt.startTiming(0, std::chrono::steady_clock::now());
         ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
         if(ret != sendPacketSize){
             LOG(ERROR)<<"packet send error";
             return false;
         }
 
-        while(!allDataSent){
+        // The first answer is ACK 0, or an OACK when the server accepted options
+        while(!isFirstACKReceived){
 			if(inValidTries > TFTP_RECEIVE_TRIES){
 				LOG(ERROR)<<"lost connection";
 				return false;
 			}
-			ret = 0;
-			sendPacketSize = 0;
-			ackStatus = false;
-			isErrorPktReceived = false;
-            
-            ackStatus = getACK(this->defaultSocket, this->serverAddress, this->blockNum, isErrorPktReceived, !isFirstACKReceived);
-			if(ackStatus){
-				LOG(DEBUG)<<"Valid ACK received";
-				inValidTries = 0;
-				getNewPacket = true;
-				LOG(DEBUG)<<"Bytes read and sent: "<<bytesRead;
-				if(bytesRead < TFTP_MAX_DATA_SIZE && isFirstACKReceived){
-					LOG(DEBUG)<<"All data sent";
-					allDataSent = true;
-                    break;
-				}
-                if(isFirstACKReceived == false){
-                    isFirstACKReceived = true;
+            if(!waitForPacket(getTimeoutMs())){
+                if(!handleTimeout()){
+                    inValidTries++;
                 }
+                LOG(ERROR)<<"First ACK not received. Soft continue.";
+                continue;
+            }
+            ackStatus = getACK(this->defaultSocket, this->serverAddress, 0, isErrorPktReceived, true, &oack);
+            if(ackStatus){
+                this->rtt.stopTiming(getReceiveTime());
+                if(!acceptOptions(oack)){
+                    return false;
+                }
+                isFirstACKReceived = true;
+                // Server TID learned, the kernel filters the datagrams of other sources
+                connectUDPSocket(this->defaultSocket, this->serverAddress);
+            }
+            else if(isErrorPktReceived){
+                LOG(ERROR)<<"Error received from client. Terminating transfer";
+                return false;
+            }
+            else{
+                LOG(ERROR)<<"First ACK not received. Soft continue.";
+                inValidTries++;
+            }
+        }
+
+        // Blocks are counted from the start of the file, the block number wraps around to the rollover
+        this->windowPacketSize = TFTP_BLOCK_PACKET_SIZE(this->blockSize);
+        this->windowPackets.assign((size_t)this->windowPacketSize * this->windowSize, 0);
+        this->windowPacketLens.assign(this->windowSize, 0);
+        uint64_t sentBlocks = 0;
+        uint64_t ackedBlocks = 0;
+        bool finalBlockRead = false;
+        inValidTries = 0;
+        while(true){
+            // Blocks are read straight behind their DATA header, a retransmission sends them again as they are
+            while(!finalBlockRead && sentBlocks - ackedBlocks < (uint64_t)std::min(this->windowSize, this->cwnd.getWindow())){
+                int slot = (int)(sentBlocks % this->windowSize);
+                uint8_t* packet = this->windowPackets.data() + (size_t)slot * this->windowPacketSize;
+                int bytesRead = readDataBlock(packet + TFTP_MAX_HEADER_SIZE, this->blockSize, this->blockSize, fd);
+                if(bytesRead == -1){
+                    LOG(ERROR)<<"file read error";
+                    sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "Server side data read error");
+			        sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+                    return false;
+                }
+                if(makeDataHeader(packet, this->windowPacketSize, toWireBlockNum(sentBlocks + 1, this->rollover)) == -1){
+                    LOG(ERROR)<<"unable to make data packet";
+                    return false;
+                }
+                this->windowPacketLens[slot] = TFTP_MAX_HEADER_SIZE + bytesRead;
+                finalBlockRead = (bytesRead < this->blockSize);
+                sentBlocks++;
+                if(!sendWindowPackets(sentBlocks - 1, sentBlocks)){
+                    return false;
+                }
+                // First transmission of the block, timed until an ACK covers it
+                this->rtt.startTiming(sentBlocks, std::chrono::steady_clock::now());
+            }
+            this->blockNum = sentBlocks;
+
+			if(inValidTries > TFTP_RECEIVE_TRIES){
+				LOG(ERROR)<<"lost connection";
+				return false;
 			}
-			else{
-				if(!isErrorPktReceived){
-					LOG(ERROR)<<"Invalid ack, soft continue";
-					getNewPacket = false;
-					inValidTries++;
-				}
-				else{
+            uint16_t recvBlockNum = 0;
+            if(!waitForPacket(getTimeoutMs())){
+                int stalledWindow = this->cwnd.getWindow();
+                if(!finalBlockRead && sentBlocks - ackedBlocks == (uint64_t)stalledWindow && stalledWindow < this->windowSize){
+                    // The server may only ACK whole windows, the rest of the window is sent until the next loss or timeout
+                    LOG(INFO)<<"Window of "<<stalledWindow<<" blocks not ACKed, sending whole windows of "<<this->windowSize;
+                    this->cwnd.onStall();
+                    this->rtt.cancelTiming();
+                    continue;
+                }
+                if(!handleTimeout()){
+                    inValidTries++;
+                }
+                this->cwnd.onTimeout(sentBlocks);
+                LOG(ERROR)<<"Timeout, resending blocks "<<ackedBlocks + 1<<" to "<<sentBlocks;
+                if(!sendWindowPackets(ackedBlocks, sentBlocks)){
+                    return false;
+                }
+                continue;
+            }
+            ackStatus = getACK(this->defaultSocket, this->serverAddress, toWireBlockNum(this->blockNum, this->rollover), isErrorPktReceived, false, NULL, &recvBlockNum);
+			if(!ackStatus){
+				if(isErrorPktReceived){
 					LOG(ERROR)<<"Error received from client. Terminating transfer";
 					return false;
 				}
+				LOG(ERROR)<<"Invalid ack, soft continue";
+				inValidTries++;
+                if(!sendWindowPackets(ackedBlocks, sentBlocks)){
+                    return false;
+                }
+                continue;
 			}
-
-            if(isFirstACKReceived){
-                if(getNewPacket){
-                    bytesRead = 0;
-                    bytesRead = readData512(dataBuffer, sizeof(dataBuffer), fd);
-                    if(bytesRead == -1){
-                        LOG(ERROR)<<"file read error";
-                        sendPacketSize = 0;
-                        sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "Server side data read error");
-			            sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+            uint64_t newlyAcked = wireBlockDistance(ackedBlocks, recvBlockNum, this->rollover);
+            if(newlyAcked > sentBlocks - ackedBlocks){
+                LOG(DEBUG)<<"ACK "<<recvBlockNum<<" outside of the window";
+                continue;
+            }
+            if(newlyAcked == 0){
+                // Duplicate ACK, in a window it reports the loss of the block following it
+                if(this->windowSize > 1){
+                    this->cwnd.onLoss(ackedBlocks, sentBlocks);
+                    if(!sendWindowPackets(ackedBlocks, sentBlocks)){
                         return false;
                     }
-                    this->blockNum++;
                 }
-                sendPacketSize = makeDataPacket(sendBuffer, sizeof(sendBuffer), this->blockNum, dataBuffer, bytesRead);
-                if(sendPacketSize == -1){
-                    LOG(ERROR)<<"unable to make data packet";
-                    return false;
-                }
-                LOG(DEBUG)<<"Data packet generated successfully";
-                ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
-                if(ret != sendPacketSize){
-                    LOG(ERROR)<<"packet send error";
+                continue;
+            }
+            LOG(DEBUG)<<"Valid ACK received";
+            if(this->rtt.isTiming() && this->rtt.getTimedMark() > ackedBlocks && this->rtt.getTimedMark() <= ackedBlocks + newlyAcked){
+                this->rtt.stopTiming(getReceiveTime());
+            }
+            ackedBlocks += newlyAcked;
+            inValidTries = 0;
+            this->cwnd.onAck((int)newlyAcked, ackedBlocks);
+            if(finalBlockRead && ackedBlocks == sentBlocks){
+                LOG(INFO)<<"All data sent, cwnd "<<this->cwnd.getWindow()<<" of "<<this->windowSize<<", losses "<<this->cwnd.losses<<", window timeouts "<<this->cwnd.timeouts;
+                return true;
+            }
+            if(ackedBlocks != sentBlocks){
+                // Gap in the window, the blocks after the ACK are sent again
+                this->cwnd.onLoss(ackedBlocks, sentBlocks);
+                if(!sendWindowPackets(ackedBlocks, sentBlocks)){
                     return false;
                 }
-                LOG(DEBUG)<<"Data packet sent successfully";
-            }
-            else{
-                LOG(ERROR)<<"First ACK not received. Soft continue.";
             }
         }
-        if(allDataSent){
-            LOG(INFO)<<"All data sent";
-            return true;
-        }
-        else{
-            LOG(ERROR)<<"Unexpected error";
-            return false;
-        }
     }
     else{
         LOG(ERROR)<<"File open error";
@@ -449,4 +989,182 @@ bool clientManager::handleSendData(std::ifstream& fd){
     }
     LOG(ERROR)<<"Open Condition";
     return false;
+}
+
+/**
+ * @brief Function to send the DATA of the window from firstBlock up to endBlock, counted from the start of the file
+ * 
+ * @param firstBlock 
+ * @param endBlock 
+ * @return true 
+ * @return false 
+ */
+bool clientManager::sendWindowPackets(uint64_t firstBlock, uint64_t endBlock){
+    // A block sent again no longer gives a valid sample (Karn), a new block is timed once it is sent
+    this->rtt.cancelTiming();
+    for(uint64_t block = firstBlock; block < endBlock; ++block){
+        int slot = (int)(block % this->windowSize);
+        uint8_t* packet = this->windowPackets.data() + (size_t)slot * this->windowPacketSize;
+        int ret = sendBufferThroughUDP(packet, this->windowPacketLens[slot], this->defaultSocket, this->serverAddress);
+        if(ret != this->windowPacketLens[slot]){
+            LOG(ERROR)<<"packet send error";
+            return false;
+        }
+    }
+    LOG(DEBUG)<<"Data packets "<<firstBlock + 1<<" to "<<endBlock<<" sent";
+    return true;
+}
+
+/**
+ * @brief Function to check the options acknowledged by the server. An option missing from the OACK falls
+ * back to RFC 1350 behaviour, a value larger than the one requested, or another timeout, is refused with an ERROR
+ * 
+ * @param oack 
+ * @return true 
+ * @return false 
+ */
+bool clientManager::acceptOptions(TftpOptions& oack){
+    const char* refused = NULL;
+    if(oack.blockSize > this->requestedBlockSize){
+        LOG(ERROR)<<"blksize "<<oack.blockSize<<" acknowledged, "<<this->requestedBlockSize<<" requested";
+        refused = "blksize larger than requested";
+    }
+    else if(oack.windowSize > this->requestedWindowSize){
+        LOG(ERROR)<<"windowsize "<<oack.windowSize<<" acknowledged, "<<this->requestedWindowSize<<" requested";
+        refused = "windowsize larger than requested";
+    }
+    else if(oack.timeout > 0 && oack.timeout != this->requestedTimeout){
+        LOG(ERROR)<<"timeout "<<oack.timeout<<" acknowledged, "<<this->requestedTimeout<<" requested";
+        refused = "timeout not as requested";
+    }
+    else if(oack.nak && (this->requestType != TFTP_OPCODE_RRQ || !this->requestedNak)){
+        LOG(ERROR)<<"nak acknowledged without being requested";
+        refused = "nak not requested";
+    }
+    else if(oack.multicast && !this->requestedMulticast){
+        LOG(ERROR)<<"multicast acknowledged without being requested";
+        refused = "multicast not requested";
+    }
+    else if(oack.hasRollover && oack.rollover != this->requestedRollover){
+        LOG(ERROR)<<"rollover "<<oack.rollover<<" acknowledged, "<<this->requestedRollover<<" requested";
+        refused = "rollover not as requested";
+    }
+    else if(oack.hasOffset && oack.offset != this->resumeOffset){
+        LOG(ERROR)<<"offset "<<oack.offset<<" acknowledged, "<<this->resumeOffset<<" requested";
+        refused = "offset not as requested";
+    }
+    else if(oack.hasOffset && oack.multicast){
+        // The group sends the file from its start, it can not be appended after the bytes already received
+        LOG(ERROR)<<"multicast acknowledged with an offset";
+        refused = "multicast with offset";
+    }
+    else if(oack.multicast && (oack.multicastAddress.sin_port == 0 || oack.multicastAddress.sin_addr.s_addr == htonl(INADDR_ANY))){
+        LOG(ERROR)<<"multicast acknowledged without its group";
+        refused = "multicast group missing";
+    }
+    if(refused != NULL){
+        uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+        int sendPacketSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_OPTION_NEGOTIATION, refused);
+        sendBufferThroughUDP(sendBuffer, sendPacketSize, this->defaultSocket, this->serverAddress);
+        return false;
+    }
+    this->blockSize = (oack.blockSize > 0) ? oack.blockSize : TFTP_MAX_DATA_SIZE;
+    this->windowSize = (oack.windowSize > 0) ? oack.windowSize : 1;
+    this->cwnd.init(this->windowSize);
+    this->timeoutSec = oack.timeout;
+    this->nakEnabled = oack.nak;
+    this->rollover = oack.hasRollover ? oack.rollover : 0;
+    this->multicastEnabled = oack.multicast;
+    if(oack.multicast){
+        this->multicastAddress = oack.multicastAddress;
+        this->multicastMaster = oack.multicastMaster;
+        LOG(INFO)<<"multicast group "<<inet_ntoa(oack.multicastAddress.sin_addr)<<":"<<ntohs(oack.multicastAddress.sin_port)<<(oack.multicastMaster ? " master" : "");
+    }
+    int timeout = (oack.timeout > 0) ? oack.timeout : TFTP_UDP_TIMEOUT;
+    setSocketTimeout(this->defaultSocket, timeout);
+    LOG(INFO)<<"blksize "<<this->blockSize<<" windowsize "<<this->windowSize<<" timeout "<<this->timeoutSec<<(this->nakEnabled ? " nak" : "")<<" negotiated";
+    if(oack.hasTransferSize){
+        LOG(INFO)<<"tsize "<<oack.transferSize;
+    }
+    if(oack.hasOffset){
+        LOG(INFO)<<"offset "<<oack.offset<<", "<<oack.length<<" bytes follow";
+    }
+    if(this->windowSize > 1){
+        // Room for the window being received and the next one
+        growSocketReceiveBuffer(this->defaultSocket, 2 * this->windowSize * TFTP_BLOCK_PACKET_SIZE(this->blockSize));
+    }
+    return true;
+}
+
+/**
+ * @brief Function to empty the file of a resumed download when the server sends the file from its start
+ * 
+ * @param fd 
+ * @return true 
+ * @return false when the file can not be opened again
+ */
+bool clientManager::restartDownload(std::ofstream& fd){
+    LOG(INFO)<<"offset not acknowledged, the "<<this->resumeOffset<<" bytes received before are dropped";
+    fd.close();
+    fd.open(this->root_dir + this->compObj.compressFileName, std::ios::binary | std::ios::trunc);
+    this->resumeOffset = 0;
+    this->receivedBytes = 0;
+    if(!fd.is_open()){
+        LOG(ERROR)<<"unable to open "<<this->compObj.compressFileName<<" again";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Function to wait up to timeoutMs for the next packet of the server
+ * 
+ * @param timeoutMs 
+ * @return true 
+ * @return false on a timeout
+ */
+bool clientManager::waitForPacket(int timeoutMs){
+    struct pollfd pollFD;
+    pollFD.fd = this->defaultSocket;
+    pollFD.events = POLLIN;
+    pollFD.revents = 0;
+    int ret = poll(&pollFD, 1, timeoutMs);
+    while(ret == -1 && errno == EINTR){
+        ret = poll(&pollFD, 1, timeoutMs);
+    }
+    if(ret == -1){
+        LOG(ERROR)<<"poll error "<<strerror(errno);
+    }
+    // A poll error is left to the receive call
+    return ret != 0;
+}
+
+/**
+ * @brief Function to get the retransmission timeout, the negotiated timeout or the RTO of the transfer
+ * 
+ * @return int 
+ */
+int clientManager::getTimeoutMs(){
+    return (this->timeoutSec > 0) ? this->timeoutSec * 1000 : this->rtt.getTimeoutMs();
+}
+
+/**
+ * @brief Function to back the RTO off after a timeout. Below the largest RTO the timeout is not counted
+ * as a failed try, the transfer gives up after TFTP_RECEIVE_TRIES timeouts of the largest one
+ * 
+ * @return true when the timeout is not counted
+ * @return false 
+ */
+bool clientManager::handleTimeout(){
+    this->rtt.cancelTiming();
+    return this->timeoutSec == 0 && this->rtt.backoff();
+}
+
+/**
+ * @brief Function to get the time the kernel received the last packet read from the socket
+ * 
+ * @return std::chrono::steady_clock::time_point 
+ */
+std::chrono::steady_clock::time_point clientManager::getReceiveTime(){
+    return std::chrono::steady_clock::now() - std::chrono::microseconds(getLastReceiveAgeUs(this->defaultSocket));
 }
\ No newline at end of file
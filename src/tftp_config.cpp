@@ -0,0 +1,379 @@
+/**
+ * @file tftp_config.cpp
+ * @brief TFTP Runtime Configuration.
+ *
+ * This file contains definations of function for TftpConfig Class
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#include "tftp_config.hpp"
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ * @brief converts an option value to an integer within [minVal, maxVal]
+*/
+static bool parseIntOption(const std::string& name, const std::string& value, long minVal, long maxVal, long& result){
+	char* endPtr = NULL;
+	errno = 0;
+	long parsed = strtol(value.c_str(), &endPtr, 10);
+	if(value.empty() || errno != 0 || *endPtr != '\0' || parsed < minVal || parsed > maxVal){
+		std::cout<<"Invalid value for option --"<<name<<": "<<value<<" (expected "<<minVal<<"-"<<maxVal<<")"<<std::endl;
+		return false;
+	}
+	result = parsed;
+	return true;
+}
+
+TftpConfig::TftpConfig(){
+	serverIP = "127.0.0.1";
+	serverEngine = TFTP_ENGINE_THREAD;
+	eventLoops = TFTP_DEFAULT_EVENT_LOOPS;
+	ioBackend = TFTP_IO_SYNC;
+	uringEntries = TFTP_DEFAULT_URING_ENTRIES;
+	uringSessions = TFTP_DEFAULT_URING_SESSIONS;
+	batchSize = TFTP_DEFAULT_BATCH_SIZE;
+	listeners = TFTP_DEFAULT_LISTENERS;
+	pinCpus = false;
+	workers = TFTP_DEFAULT_WORKERS;
+	queueDepth = TFTP_DEFAULT_QUEUE_DEPTH;
+	dallyMs = TFTP_DEFAULT_DALLY_MS;
+	tidFirstPort = TFTP_DEFAULT_TID_FIRST_PORT;
+	tidLastPort = TFTP_DEFAULT_TID_LAST_PORT;
+	cacheMB = TFTP_DEFAULT_CACHE_MB;
+	cacheFileMB = TFTP_DEFAULT_CACHE_FILE_MB;
+	packetCache = false;
+	readAheadKB = TFTP_DEFAULT_READ_AHEAD_KB;
+	zeroCopy = false;
+	writeBehindKB = TFTP_DEFAULT_WRITE_BEHIND_KB;
+	writeDirect = false;
+	commitMs = TFTP_DEFAULT_COMMIT_MS;
+	maxBlockSize = TFTP_MAX_BLOCK_SIZE;
+	maxWindowSize = TFTP_DEFAULT_MAX_WINDOW_SIZE;
+	rollover = TFTP_DEFAULT_ROLLOVER;
+	rtoMinMs = TFTP_RTO_MIN_MS;
+	rtoMaxMs = TFTP_RTO_MAX_MS;
+	multicastIP = "";
+	multicastPort = 0;
+}
+
+/**
+ * @brief function to parse the optional "--name=value" arguments starting at argv[firstOption]
+*/
+bool TftpConfig::parseOptions(int argc, char* argv[], int firstOption){
+	for(int i = firstOption; i < argc; ++i){
+		std::string arg(argv[i]);
+		if(arg.compare(0, 2, "--") != 0){
+			std::cout<<"Invalid option: "<<arg<<std::endl;
+			return false;
+		}
+		size_t eqPos = arg.find('=');
+		std::string name = arg.substr(2, eqPos == std::string::npos ? std::string::npos : eqPos - 2);
+		std::string value = (eqPos == std::string::npos) ? "" : arg.substr(eqPos + 1);
+		long num = 0;
+
+		if(name == "engine"){
+			if(value == "thread"){
+				serverEngine = TFTP_ENGINE_THREAD;
+			}
+			else if(value == "epoll"){
+				serverEngine = TFTP_ENGINE_EPOLL;
+			}
+			else{
+				std::cout<<"Invalid value for option --engine: "<<value<<" (expected thread|epoll)"<<std::endl;
+				return false;
+			}
+		}
+		else if(name == "loops"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_EVENT_LOOPS, num)){
+				return false;
+			}
+			eventLoops = (int)num;
+		}
+		else if(name == "io"){
+			if(value == "sync"){
+				ioBackend = TFTP_IO_SYNC;
+			}
+			else if(value == "uring"){
+				ioBackend = TFTP_IO_URING;
+			}
+			else{
+				std::cout<<"Invalid value for option --io: "<<value<<" (expected sync|uring)"<<std::endl;
+				return false;
+			}
+		}
+		else if(name == "uring-entries"){
+			if(!parseIntOption(name, value, 64, 32768, num)){
+				return false;
+			}
+			uringEntries = (int)num;
+		}
+		else if(name == "uring-sessions"){
+			if(!parseIntOption(name, value, 1, 65536, num)){
+				return false;
+			}
+			uringSessions = (int)num;
+		}
+		else if(name == "batch"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_BATCH_SIZE, num)){
+				return false;
+			}
+			batchSize = (int)num;
+		}
+		else if(name == "listeners"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_EVENT_LOOPS, num)){
+				return false;
+			}
+			listeners = (int)num;
+		}
+		else if(name == "workers"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_WORKERS, num)){
+				return false;
+			}
+			workers = (int)num;
+		}
+		else if(name == "queue-depth"){
+			if(!parseIntOption(name, value, 0, 1000000, num)){
+				return false;
+			}
+			queueDepth = (int)num;
+		}
+		else if(name == "dally"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_DALLY_MS, num)){
+				return false;
+			}
+			dallyMs = (int)num;
+		}
+		else if(name == "tid-ports"){
+			size_t dashPos = value.find('-');
+			if(value == "0"){
+				tidFirstPort = 0;
+				tidLastPort = 0;
+			}
+			else if(dashPos == std::string::npos){
+				std::cout<<"Invalid value for option --tid-ports: "<<value<<" (expected FIRST-LAST or 0)"<<std::endl;
+				return false;
+			}
+			else{
+				long lastPort = 0;
+				if(!parseIntOption(name, value.substr(0, dashPos), TFTP_MIN_PORT, TFTP_MAX_PORT, num) ||
+					!parseIntOption(name, value.substr(dashPos + 1), num, TFTP_MAX_PORT, lastPort)){
+					return false;
+				}
+				tidFirstPort = (int)num;
+				tidLastPort = (int)lastPort;
+			}
+		}
+		else if(name == "pin-cpus"){
+			if(!value.empty()){
+				std::cout<<"Option --pin-cpus takes no value"<<std::endl;
+				return false;
+			}
+			pinCpus = true;
+		}
+		else if(name == "cache"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_CACHE_MB, num)){
+				return false;
+			}
+			cacheMB = (int)num;
+		}
+		else if(name == "cache-file-max"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_CACHE_MB, num)){
+				return false;
+			}
+			cacheFileMB = (int)num;
+		}
+		else if(name == "read-ahead"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_READ_AHEAD_KB, num)){
+				return false;
+			}
+			readAheadKB = (int)num;
+		}
+		else if(name == "write-behind"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_WRITE_BEHIND_KB, num)){
+				return false;
+			}
+			if(num != 0 && num < 2 * TFTP_WRITE_CHUNK_SIZE / 1024){
+				std::cout<<"Option --write-behind needs at least "<<2 * TFTP_WRITE_CHUNK_SIZE / 1024<<" KB, or 0"<<std::endl;
+				return false;
+			}
+			writeBehindKB = (int)num;
+		}
+		else if(name == "write-direct"){
+			if(!value.empty()){
+				std::cout<<"Option --write-direct takes no value"<<std::endl;
+				return false;
+			}
+			writeDirect = true;
+		}
+		else if(name == "commit-interval"){
+			if(!parseIntOption(name, value, 0, TFTP_MAX_COMMIT_MS, num)){
+				return false;
+			}
+			commitMs = (int)num;
+		}
+		else if(name == "max-blksize"){
+			if(!parseIntOption(name, value, TFTP_MIN_BLOCK_SIZE, TFTP_MAX_BLOCK_SIZE, num)){
+				return false;
+			}
+			maxBlockSize = (int)num;
+		}
+		else if(name == "max-windowsize"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_WINDOW_SIZE, num)){
+				return false;
+			}
+			maxWindowSize = (int)num;
+		}
+		else if(name == "rollover"){
+			if(!parseIntOption(name, value, 0, 1, num)){
+				return false;
+			}
+			rollover = (int)num;
+		}
+		else if(name == "rto-min"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_RTO_MS, num)){
+				return false;
+			}
+			rtoMinMs = (int)num;
+		}
+		else if(name == "rto-max"){
+			if(!parseIntOption(name, value, 1, TFTP_MAX_RTO_MS, num)){
+				return false;
+			}
+			rtoMaxMs = (int)num;
+		}
+		else if(name == "packet-cache"){
+			if(!value.empty()){
+				std::cout<<"Option --packet-cache takes no value"<<std::endl;
+				return false;
+			}
+			packetCache = true;
+		}
+		else if(name == "multicast"){
+			size_t colonPos = value.find(':');
+			struct in_addr groupAddress;
+			if(colonPos == std::string::npos || inet_pton(AF_INET, value.substr(0, colonPos).c_str(), &groupAddress) != 1 ||
+				!IN_MULTICAST(ntohl(groupAddress.s_addr))){
+				std::cout<<"Invalid value for option --multicast: "<<value<<" (expected MULTICAST_IPv4:PORT)"<<std::endl;
+				return false;
+			}
+			if(!parseIntOption(name, value.substr(colonPos + 1), TFTP_MIN_PORT, TFTP_MAX_PORT - TFTP_MULTICAST_MAX_GROUPS + 1, num)){
+				return false;
+			}
+			multicastIP = value.substr(0, colonPos);
+			multicastPort = (int)num;
+		}
+		else if(name == "zerocopy"){
+			if(!value.empty()){
+				std::cout<<"Option --zerocopy takes no value"<<std::endl;
+				return false;
+			}
+			zeroCopy = true;
+		}
+		else{
+			std::cout<<"Unknown option: --"<<name<<std::endl;
+			return false;
+		}
+	}
+	if(ioBackend == TFTP_IO_URING && serverEngine != TFTP_ENGINE_EPOLL){
+		std::cout<<"--io=uring requires --engine=epoll"<<std::endl;
+		return false;
+	}
+	if(rtoMinMs > rtoMaxMs){
+		std::cout<<"--rto-min is larger than --rto-max"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function returns the number of event loops to be started by the epoll engine
+*/
+int TftpConfig::getEventLoopCount(){
+	if(eventLoops > 0){
+		return eventLoops;
+	}
+	long onlineCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(onlineCores < 1){
+		return 1;
+	}
+	return (int)std::min(onlineCores, (long)TFTP_MAX_EVENT_LOOPS);
+}
+
+/**
+ * @brief function returns the number of sockets to be bound to the request port
+*/
+int TftpConfig::getListenerCount(){
+	if(listeners > 0){
+		return listeners;
+	}
+	if(serverEngine == TFTP_ENGINE_EPOLL){
+		return getEventLoopCount();
+	}
+	long onlineCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(onlineCores < 1){
+		return 1;
+	}
+	return (int)std::min(onlineCores, (long)TFTP_MAX_EVENT_LOOPS);
+}
+
+/**
+ * @brief function pins the calling request shard thread to core (shardIndex % online cores) when --pin-cpus is set
+*/
+void TftpConfig::pinThread(int shardIndex){
+	if(!pinCpus){
+		return;
+	}
+	long onlineCores = sysconf(_SC_NPROCESSORS_ONLN);
+	if(onlineCores < 1){
+		return;
+	}
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(shardIndex % onlineCores, &cpuSet);
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+	if(ret != 0){
+		LOG(ERROR)<<"Unable to pin shard "<<shardIndex<<" to cpu "<<shardIndex % onlineCores<<": "<<strerror(ret);
+		return;
+	}
+	LOG(INFO)<<"Shard "<<shardIndex<<" pinned to cpu "<<shardIndex % onlineCores;
+	return;
+}
+
+/**
+ * @brief function prints the supported server options
+*/
+void TftpConfig::printUsage(){
+	std::cout<<"Server options:"<<std::endl;
+	std::cout<<"  --engine=thread|epoll   session engine, default thread"<<std::endl;
+	std::cout<<"  --loops=N               epoll event loops, default one per core"<<std::endl;
+	std::cout<<"  --workers=N             thread engine session threads per request socket, default "<<TFTP_DEFAULT_WORKERS<<std::endl;
+	std::cout<<"  --queue-depth=N         thread engine requests waiting for a worker, default "<<TFTP_DEFAULT_QUEUE_DEPTH<<std::endl;
+	std::cout<<"  --dally=MS              milliseconds a finished upload re-ACKs a retransmitted final DATA, default "<<TFTP_DEFAULT_DALLY_MS<<std::endl;
+	std::cout<<"  --tid-ports=FIRST-LAST  ports pre-bound as transfer sockets, 0 binds them on demand, default "<<TFTP_DEFAULT_TID_FIRST_PORT<<"-"<<TFTP_DEFAULT_TID_LAST_PORT<<std::endl;
+	std::cout<<"  --cache=MB              memory budget of the hot file cache, 0 disables it, default "<<TFTP_DEFAULT_CACHE_MB<<std::endl;
+	std::cout<<"  --cache-file-max=MB     largest file held by the hot file cache, default "<<TFTP_DEFAULT_CACHE_FILE_MB<<std::endl;
+	std::cout<<"  --read-ahead=KB         file range requested ahead of a download, 0 disables it, default "<<TFTP_DEFAULT_READ_AHEAD_KB<<std::endl;
+	std::cout<<"  --write-behind=KB       received blocks buffered per upload and written in large chunks, 0 disables it, default "<<TFTP_DEFAULT_WRITE_BEHIND_KB<<std::endl;
+	std::cout<<"  --write-direct          write the buffered upload chunks with O_DIRECT"<<std::endl;
+	std::cout<<"  --commit-interval=MS    completed uploads synced together within MS, 0 leaves them to the kernel, default "<<TFTP_DEFAULT_COMMIT_MS<<std::endl;
+	std::cout<<"  --max-blksize=N         largest block granted to a blksize option, default "<<TFTP_MAX_BLOCK_SIZE<<std::endl;
+	std::cout<<"  --max-windowsize=N      largest window granted to a windowsize option, 1 disables windows, default "<<TFTP_DEFAULT_MAX_WINDOW_SIZE<<std::endl;
+	std::cout<<"  --rollover=0|1          block number following 65535 unless the client sends a rollover option, default "<<TFTP_DEFAULT_ROLLOVER<<std::endl;
+	std::cout<<"  --rto-min=MS            lower bound of the retransmission timeout derived from the RTT, default "<<TFTP_RTO_MIN_MS<<std::endl;
+	std::cout<<"  --rto-max=MS            upper bound of the retransmission timeout, default "<<TFTP_RTO_MAX_MS<<std::endl;
+	std::cout<<"  --packet-cache          keep the DATA packets of hot cached files pre-built, sent without copying"<<std::endl;
+	std::cout<<"  --multicast=ADDR:PORT   accept the multicast option, files are sent to ADDR on PORT and the "<<TFTP_MULTICAST_MAX_GROUPS - 1<<" ports after it"<<std::endl;
+	std::cout<<"  --zerocopy              send DATA payloads of "<<TFTP_ZEROCOPY_MIN_DATA<<" bytes or more with MSG_ZEROCOPY"<<std::endl;
+	std::cout<<"  --listeners=N           SO_REUSEPORT sockets on the request port, 0 one per loop/core, default 1"<<std::endl;
+	std::cout<<"  --pin-cpus              pin each request shard thread to its own core"<<std::endl;
+	std::cout<<"  --batch=N               datagrams per recvmmsg/sendmmsg call, default "<<TFTP_DEFAULT_BATCH_SIZE<<std::endl;
+	std::cout<<"  --io=sync|uring         I/O backend of the event loops, default sync"<<std::endl;
+	std::cout<<"  --uring-entries=N       io_uring submission queue depth, default "<<TFTP_DEFAULT_URING_ENTRIES<<std::endl;
+	std::cout<<"  --uring-sessions=N      io_uring sessions per loop, default "<<TFTP_DEFAULT_URING_SESSIONS<<std::endl;
+}
@@ -0,0 +1,786 @@
+/**
+ * @file tftp_engine.cpp
+ * @brief TFTP Server Event Engine.
+ *
+ * This file contains definations of function for the epoll based server engine
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#include "tftp_engine.hpp"
+#include "tftp_uring.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+/**
+ * @brief constructor for EventLoop Class, the session batches hold packets of up to packetSize bytes
+*/
+EventLoop::EventLoop(int loopId, int listenSocket, int packetSize) :
+	timers(TimerWheel::nowMs()),
+	listenBatch(TftpConfig::getInstance().batchSize),
+	sessionBatch(TftpConfig::getInstance().batchSize, packetSize),
+	sendBatch(TftpConfig::getInstance().batchSize, packetSize){
+	this->loopId = loopId;
+	this->listenSocket = listenSocket;
+	running = false;
+	completionsPending = 0;
+}
+
+EventLoop::~EventLoop(){
+	//
+}
+
+void EventLoop::stop(){
+	running = false;
+	wakeup();
+	return;
+}
+
+/**
+ * @brief function returns the callback reporting the result of work done for a session on another thread,
+ * the loop thread passes it to completeSession after its next wakeup
+*/
+std::function<void(bool)> EventLoop::makeCompletion(int sessionId, int chunkIndex){
+	{
+		std::lock_guard<std::mutex> lock(completionMutex);
+		completionsPending++;
+	}
+	return [this, sessionId, chunkIndex](bool success){
+		// The loop is woken under the lock, waitForCompletions keeps it alive until then
+		std::lock_guard<std::mutex> lock(completionMutex);
+		completions.push_back({sessionId, chunkIndex, success});
+		completionsPending--;
+		wakeup();
+		completionCond.notify_all();
+	};
+}
+
+void EventLoop::handleCompletions(){
+	std::vector<LoopCompletion> reported;
+	{
+		std::lock_guard<std::mutex> lock(completionMutex);
+		if(completions.empty()){
+			return;
+		}
+		reported.swap(completions);
+	}
+	for(const LoopCompletion& completion : reported){
+		completeSession(completion);
+	}
+	return;
+}
+
+void EventLoop::waitForCompletions(){
+	std::unique_lock<std::mutex> lock(completionMutex);
+	completionCond.wait(lock, [this]{ return completionsPending == 0; });
+	completions.clear();
+	return;
+}
+
+/**
+ * @brief function validates a connection request and registers the new session in this loop
+*/
+void EventLoop::handleRequest(uint8_t* recvBuffer, int recvLen, struct sockaddr_in& clientAddress){
+	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+	int packetSize = 0;
+	uint16_t opcode;
+	char fileName[TFTP_MAX_DATA_SIZE];
+	char mode[TFTP_MAX_MODE_SIZE];
+	TftpOptions options;
+	TftpErrorCode errorCode;
+	const char* errorMsg;
+
+	if(!parseConnectionRequest(recvBuffer, recvLen, opcode, fileName, mode, options, errorCode, errorMsg)){
+		LOG(ERROR)<< "Incompatable request received from "<< inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port)<<", "<<errorMsg;
+		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), errorCode, errorMsg);
+		sendBatch.queue(listenSocket, sendBuffer, packetSize, clientAddress);
+		return;
+	}
+
+	memset(log_message,0,sizeof(log_message));
+	sprintf(log_message, "Connection request received: loop[%d] IP[%s] Port[%d] fileName[%s] mode[%s]", loopId, inet_ntoa(clientAddress.sin_addr), ntohs(clientAddress.sin_port), fileName, mode);
+	LOG(INFO)<<log_message;
+
+	// A multicast RRQ of a file already sent to a group joins it (RFC 2090), the group may belong to another loop
+	if(opcode == TFTP_OPCODE_RRQ && MulticastRegistry::getInstance().join(fileName, clientAddress, options)){
+		return;
+	}
+
+	// The server TID is a pre-bound non-blocking socket of the pool
+	int clientSocketFD = UDPSocketPool::getInstance().acquire();
+	if(clientSocketFD == -1){
+		LOG(ERROR)<<"Unable to create UPD Socket for client: IP"<<inet_ntoa(clientAddress.sin_addr) << ": PORT" << ntohs(clientAddress.sin_port);
+		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "unable to create new socket");
+		sendBatch.queue(listenSocket, sendBuffer, packetSize, clientAddress);
+		return;
+	}
+
+	std::unique_ptr<ClientHandler> session(new ClientHandler(listenSocket, clientAddress, opcode, fileName, mode, options));
+	session->printVals();
+	session->clientSocket = clientSocketFD;
+	if(!prepareSession(session.get())){
+		LOG(ERROR)<<"Loop "<<loopId<<" has no room for a new session";
+		UDPSocketPool::getInstance().release(clientSocketFD);
+		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "server busy");
+		sendBatch.queue(listenSocket, sendBuffer, packetSize, clientAddress);
+		return;
+	}
+	ClientHandler* sessionPtr = session.get();
+	sessions[clientSocketFD] = std::move(session);
+	sessionPtr->startTransfer(clientSocketFD);
+	if(sessionPtr->isDone() || !watchSession(clientSocketFD)){
+		closeSession(clientSocketFD);
+		return;
+	}
+	armSessionTimer(sessionPtr);
+	return;
+}
+
+/**
+ * @brief function (re)arms the timer of the session at its current deadline, called after every session event
+*/
+void EventLoop::armSessionTimer(ClientHandler* session){
+	session->timer.owner = session;
+	timers.schedule(&session->timer, TimerWheel::toMs(session->deadline));
+	return;
+}
+
+/**
+ * @brief function handles the sessions whose timer expired
+*/
+void EventLoop::checkTimeouts(){
+	expiredTimers.clear();
+	if(timers.advance(TimerWheel::nowMs(), expiredTimers) == 0){
+		return;
+	}
+	std::vector<int> doneSessions;
+	for(TimerNode* timer : expiredTimers){
+		ClientHandler* session = (ClientHandler*)timer->owner;
+		if(session->isDone()){
+			continue;
+		}
+		if(session->getTimeoutMs() == 0){
+			session->handleTimeout();
+		}
+		if(session->isDone()){
+			doneSessions.push_back(session->clientSocket);
+		}
+		else{
+			armSessionTimer(session);
+		}
+	}
+	for(int socketFD : doneSessions){
+		closeSession(socketFD);
+	}
+	return;
+}
+
+/**
+ * @brief function returns how long the loop may wait for events before the next timer is due
+*/
+int EventLoop::getWaitMs(){
+	int waitMs = timers.getTimeoutMs(TimerWheel::nowMs());
+	if(waitMs == -1 || waitMs > TFTP_ENGINE_MAX_WAIT_MS){
+		return TFTP_ENGINE_MAX_WAIT_MS;
+	}
+	return waitMs;
+}
+
+/**
+ * @brief function sends the packets queued during the loop iteration and returns the sockets
+ * of the sessions closed meanwhile to the pool
+*/
+void EventLoop::flushSends(){
+	if(!sendBatch.isEmpty()){
+		sendBatch.flush();
+	}
+	for(int socketFD : deferredCloses){
+		UDPSocketPool::getInstance().release(socketFD);
+	}
+	deferredCloses.clear();
+	return;
+}
+
+/**
+ * @brief function releases all the sessions still owned by the loop on shutdown
+*/
+void EventLoop::closeAllSessions(){
+	waitForCompletions();
+	flushSends();
+	for(auto& session : sessions){
+		session.second->finishTransfer();
+		UDPSocketPool::getInstance().release(session.first);
+	}
+	sessions.clear();
+	return;
+}
+
+/**
+ * @brief function logs the average number of datagrams moved per recvmmsg/sendmmsg call
+*/
+void EventLoop::logBatchStats(){
+	memset(log_message,0,sizeof(log_message));
+	sprintf(log_message, "Loop %d batches: request recvmmsg calls[%llu] average fill[%.2f/%d], transfer recvmmsg calls[%llu] average fill[%.2f/%d], sendmmsg calls[%llu] average fill[%.2f]",
+		loopId, (unsigned long long)listenBatch.calls, listenBatch.getAverageFill(), listenBatch.getBatchSize(),
+		(unsigned long long)sessionBatch.calls, sessionBatch.getAverageFill(), sessionBatch.getBatchSize(),
+		(unsigned long long)sendBatch.calls, sendBatch.getAverageFill());
+	LOG(INFO)<<log_message;
+	return;
+}
+
+/**
+ * @brief constructor for BatchSessionIO Class
+*/
+BatchSessionIO::BatchSessionIO(UDPSendBatch& sendBatch, EpollLoop& loop) : sendBatch(sendBatch), loop(loop){
+	//
+}
+
+bool BatchSessionIO::sendPacket(ClientHandler* session, uint8_t* packet, int packetLen){
+	if(session->connected){
+		return sendBatch.queue(session->clientSocket, packet, packetLen);
+	}
+	return sendBatch.queue(session->clientSocket, packet, packetLen, session->clientAddress);
+}
+
+/**
+ * @brief function queues the pre-built packet, or the header of lastPacket and the mapped payload.
+ * The queued entry keeps the image or the mapping alive until the batch is flushed even if the session is closed first.
+*/
+bool BatchSessionIO::readAndSend(ClientHandler* session, uint64_t offset, int dataLen){
+	const uint8_t* imagePacket = session->getImagePacket(offset, dataLen);
+	if(imagePacket != NULL){
+		return sendBatch.queueData(session->clientSocket, NULL, 0, imagePacket, session->lastPacketLen,
+			session->getDataAddress(), session->packetImage);
+	}
+	if(!session->fileMap){
+		return SyncSessionIO::readAndSend(session, offset, dataLen);
+	}
+	const uint8_t* payload = session->fileMap->getView(offset, dataLen);
+	if(payload == NULL){
+		LOG(ERROR)<<"block at "<<offset<<" outside of the mapped file";
+		return false;
+	}
+	return sendBatch.queueData(session->clientSocket, session->lastPacket, TFTP_MAX_HEADER_SIZE,
+		payload, dataLen, session->getDataAddress(), session->fileMap, getDataFlags(session, dataLen));
+}
+
+/**
+ * @brief function queues the block in the write-behind buffer of the session, see EpollLoop::bufferAndSend.
+ * Without a buffer the block is written before its ACK.
+*/
+bool BatchSessionIO::writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock){
+	if(!session->writeBehind){
+		return SyncSessionIO::writeAndSend(session, data, dataLen, offset, finalBlock);
+	}
+	return loop.bufferAndSend(session, data, dataLen, offset, finalBlock);
+}
+
+bool BatchSessionIO::commitAndSend(ClientHandler* session){
+	return loop.commitAndSend(session);
+}
+
+bool BatchSessionIO::sendData(ClientHandler* session, uint8_t* packet, int packetLen){
+	struct sockaddr_in* address = session->getDataAddress();
+	if(address == NULL){
+		return sendBatch.queue(session->clientSocket, packet, packetLen);
+	}
+	return sendBatch.queue(session->clientSocket, packet, packetLen, *address);
+}
+
+/**
+ * @brief constructor for EpollLoop Class
+*/
+EpollLoop::EpollLoop(int loopId, int listenSocket) :
+	EventLoop(loopId, listenSocket, TFTP_BLOCK_PACKET_SIZE(TftpConfig::getInstance().maxBlockSize)), batchIO(sendBatch, *this){
+	epollFD = -1;
+	wakeFD = -1;
+	acksHeld = 0;
+}
+
+EpollLoop::~EpollLoop(){
+	// Every chunk queued is written before the sessions close their files
+	closeAllSessions();
+	chunkWriter.stop();
+	for(auto& session : closingSessions){
+		session.second->finishTransfer();
+		UDPSocketPool::getInstance().release(session.first);
+	}
+	closingSessions.clear();
+	slots.clear();
+	if(wakeFD != -1){
+		close(wakeFD);
+	}
+	if(epollFD != -1){
+		close(epollFD);
+	}
+}
+
+/**
+ * @brief function creates the epoll instance and registers the default server socket
+*/
+bool EpollLoop::init(){
+	epollFD = epoll_create1(EPOLL_CLOEXEC);
+	if(epollFD == -1){
+		LOG(ERROR)<<"Unable to create epoll instance: "<<strerror(errno);
+		return false;
+	}
+	wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wakeFD == -1){
+		LOG(ERROR)<<"Unable to create eventfd: "<<strerror(errno);
+		return false;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = wakeFD;
+	if(epoll_ctl(epollFD, EPOLL_CTL_ADD, wakeFD, &event) == -1){
+		LOG(ERROR)<<"Unable to register eventfd: "<<strerror(errno);
+		return false;
+	}
+
+	// EPOLLEXCLUSIVE wakes only one of the loops sharing the default server socket
+	event.events = EPOLLIN | EPOLLEXCLUSIVE;
+	event.data.fd = listenSocket;
+	if(epoll_ctl(epollFD, EPOLL_CTL_ADD, listenSocket, &event) == -1){
+		LOG(ERROR)<<"Unable to register server socket: "<<strerror(errno);
+		return false;
+	}
+	if(TftpConfig::getInstance().writeBehindKB > 0){
+		chunkWriter.start();
+	}
+	running = true;
+	return true;
+}
+
+/**
+ * @brief event loop thread function
+*/
+void EpollLoop::run(){
+	struct epoll_event events[TFTP_ENGINE_MAX_EVENTS];
+	LOG(INFO)<<"Event loop "<<loopId<<" started";
+	while(running){
+		int numEvents = epoll_wait(epollFD, events, TFTP_ENGINE_MAX_EVENTS, getWaitMs());
+		if(numEvents == -1){
+			if(errno == EINTR){
+				continue;
+			}
+			LOG(ERROR)<<"epoll wait error: "<<strerror(errno);
+			break;
+		}
+		for(int i = 0; i < numEvents; ++i){
+			int eventFD = events[i].data.fd;
+			if(eventFD == wakeFD){
+				uint64_t counter;
+				if(read(wakeFD, &counter, sizeof(counter)) == -1){
+					LOG(DEBUG)<<"eventfd read "<<strerror(errno);
+				}
+			}
+			else if(eventFD == listenSocket){
+				handleListenSocket();
+			}
+			else{
+				handleSessionEvent(eventFD);
+			}
+		}
+		handleCompletions();
+		checkTimeouts();
+		flushSends();
+	}
+	LOG(INFO)<<"Event loop "<<loopId<<" stopped with "<<sessions.size()<<" active sessions, "<<acksHeld<<" ACKs held";
+	logBatchStats();
+	return;
+}
+
+void EpollLoop::wakeup(){
+	uint64_t counter = 1;
+	if(wakeFD != -1 && write(wakeFD, &counter, sizeof(counter)) == -1){
+		LOG(ERROR)<<"Unable to wake event loop: "<<strerror(errno);
+	}
+	return;
+}
+
+/**
+ * @brief function reads the pending connection requests from the default server socket,
+ * a batch of them per recvmmsg call
+*/
+void EpollLoop::handleListenSocket(){
+	int numRequests = 0;
+	while(numRequests < TFTP_ENGINE_MAX_ACCEPT_BURST){
+		int numReceived = listenBatch.receive(listenSocket, MSG_DONTWAIT);
+		if(numReceived == -1){
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+				LOG(ERROR)<<"Error receiving data: "<<strerror(errno);
+			}
+			return;
+		}
+		for(int i = 0; i < numReceived; ++i){
+			handleRequest(listenBatch.getPacket(i), listenBatch.getPacketLen(i), listenBatch.getAddress(i));
+		}
+		numRequests += numReceived;
+		if(numReceived < listenBatch.getBatchSize()){
+			return;
+		}
+	}
+	return;
+}
+
+void EpollLoop::handleSessionEvent(int socketFD){
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		LOG(ERROR)<<"Event for unknown socket "<<socketFD;
+		return;
+	}
+	it->second->handleReadable(sessionBatch);
+	if(it->second->isDone()){
+		closeSession(socketFD);
+		return;
+	}
+	armSessionTimer(it->second.get());
+	return;
+}
+
+bool EpollLoop::prepareSession(ClientHandler* session){
+	// File I/O stays synchronous, packets are queued until the end of the loop iteration
+	session->setIO(&batchIO, NULL);
+	return true;
+}
+
+bool EpollLoop::watchSession(int socketFD){
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = socketFD;
+	if(epoll_ctl(epollFD, EPOLL_CTL_ADD, socketFD, &event) == -1){
+		LOG(ERROR)<<"Unable to register transfer socket: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+void EpollLoop::closeSession(int socketFD){
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		return;
+	}
+	epoll_ctl(epollFD, EPOLL_CTL_DEL, socketFD, NULL);
+	// The socket is not reused before the file work in flight is reported for it
+	closingSessions[socketFD] = std::move(it->second);
+	sessions.erase(it);
+	tryRelease(socketFD);
+	return;
+}
+
+void EpollLoop::tryRelease(int socketFD){
+	auto slotIt = slots.find(socketFD);
+	if(slotIt != slots.end() && (slotIt->second.chunkWrites > 0 || slotIt->second.commitPending)){
+		return;
+	}
+	auto it = closingSessions.find(socketFD);
+	if(it == closingSessions.end()){
+		return;
+	}
+	it->second->finishTransfer();
+	LOG(INFO)<<"Session closed: fileName["<<it->second->requestFileName<<"] success["<<it->second->transferSuccess<<"]";
+	closingSessions.erase(it);
+	if(slotIt != slots.end()){
+		slots.erase(slotIt);
+	}
+	// The last ACK or ERROR of the session may still be queued in the send batch
+	deferredCloses.push_back(socketFD);
+	return;
+}
+
+/**
+ * @brief function queues the block in the write-behind buffer of the session and ACKs it at once, the full chunks
+ * are written by the chunk writer. Without room for the block its ACK is held and the block is kept until a chunk
+ * write completes. The final ACK waits for every chunk to be written and for the commit of the upload.
+*/
+bool EpollLoop::bufferAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock){
+	EpollSlot& slot = slots[session->clientSocket];
+	if(!session->writeBehind->append(data, dataLen, offset)){
+		if(slot.chunkWrites == 0){
+			return batchIO.SyncSessionIO::writeAndSend(session, data, dataLen, offset, finalBlock);
+		}
+		slot.ackHeld = true;
+		slot.heldBlock.assign(data, data + dataLen);
+		slot.heldOffset = offset;
+		slot.heldFinal = finalBlock;
+		session->ioPending = true;
+		acksHeld++;
+		return true;
+	}
+	slot.finalFlush = finalBlock;
+	queueChunkWrites(session, slot);
+	if(slot.finalFlush){
+		if(!session->writeBehind->isEmpty()){
+			session->ioPending = true;
+			return true;
+		}
+		slot.finalFlush = false;
+		return commitAndSend(session);
+	}
+	return batchIO.sendAck(session);
+}
+
+/**
+ * @brief function hands the upload to STARK without waiting for its group commit, the final ACK is sent
+ * once the commit is reported
+*/
+bool EpollLoop::commitAndSend(ClientHandler* session){
+	slots[session->clientSocket].commitPending = true;
+	session->ioPending = true;
+	session->commitUpload(makeCompletion(session->clientSocket));
+	return true;
+}
+
+void EpollLoop::queueChunkWrites(ClientHandler* session, EpollSlot& slot){
+	WriteBehind* writeBehind = session->writeBehind.get();
+	int chunkIndex;
+	while((chunkIndex = writeBehind->nextChunk(slot.finalFlush)) != -1){
+		writeBehind->startWrite(session->fileFD, chunkIndex);
+		slot.chunkWrites++;
+		chunkWriter.queue(session->fileFD, session->writeBehind, chunkIndex, makeCompletion(session->clientSocket, chunkIndex));
+	}
+	return;
+}
+
+/**
+ * @brief function handles the result of a chunk write or of the commit of an upload
+*/
+void EpollLoop::completeSession(const LoopCompletion& completion){
+	int socketFD = completion.sessionId;
+	if(completion.chunkIndex != -1){
+		handleChunkWritten(socketFD, completion.chunkIndex, completion.success);
+		return;
+	}
+	slots[socketFD].commitPending = false;
+	if(closingSessions.count(socketFD) > 0){
+		tryRelease(socketFD);
+		return;
+	}
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		return;
+	}
+	ClientHandler* session = it->second.get();
+	session->handleIOComplete(completion.success && batchIO.sendAck(session));
+	handleSessionState(socketFD);
+	return;
+}
+
+/**
+ * @brief function completes a chunk write. A held ACK is sent once its block fits in the buffer, the final ACK
+ * once every chunk is written and the upload committed. A failed write ends the session with an ERROR.
+*/
+void EpollLoop::handleChunkWritten(int socketFD, int chunkIndex, bool success){
+	EpollSlot& slot = slots[socketFD];
+	slot.chunkWrites--;
+	if(closingSessions.count(socketFD) > 0){
+		tryRelease(socketFD);
+		return;
+	}
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		return;
+	}
+	ClientHandler* session = it->second.get();
+	session->writeBehind->chunkWritten(chunkIndex);
+	bool ackReady = false;
+	if(success && slot.ackHeld){
+		if(!session->writeBehind->append(slot.heldBlock.data(), slot.heldBlock.size(), slot.heldOffset)){
+			// The freed chunk is not at the head of the ring, another write is still in flight
+			return;
+		}
+		slot.ackHeld = false;
+		slot.finalFlush = slot.heldFinal;
+		ackReady = true;
+	}
+	if(success){
+		queueChunkWrites(session, slot);
+	}
+	if(success && slot.finalFlush){
+		if(!session->writeBehind->isEmpty()){
+			return;
+		}
+		slot.finalFlush = false;
+		commitAndSend(session);
+		return;
+	}
+	if(!success){
+		slot.ackHeld = false;
+		slot.finalFlush = false;
+		session->handleIOComplete(false);
+	}
+	else if(ackReady){
+		session->handleIOComplete(batchIO.sendAck(session));
+	}
+	handleSessionState(socketFD);
+	return;
+}
+
+/**
+ * @brief function closes a finished session or re-arms its timer
+*/
+void EpollLoop::handleSessionState(int socketFD){
+	ClientHandler* session = sessions.at(socketFD).get();
+	if(session->isDone()){
+		closeSession(socketFD);
+		return;
+	}
+	armSessionTimer(session);
+	return;
+}
+
+/**
+ * @brief constructor for ChunkWriter Class
+*/
+ChunkWriter::ChunkWriter(){
+	stopping = false;
+}
+
+ChunkWriter::~ChunkWriter(){
+	stop();
+}
+
+void ChunkWriter::start(){
+	stopping = false;
+	thread = std::thread(&ChunkWriter::run, this);
+	return;
+}
+
+void ChunkWriter::stop(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	cond.notify_all();
+	if(thread.joinable()){
+		thread.join();
+	}
+	return;
+}
+
+void ChunkWriter::queue(int fileFD, std::shared_ptr<WriteBehind> writeBehind, int chunkIndex, std::function<void(bool)> onWritten){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		writes.push_back({fileFD, writeBehind, chunkIndex, onWritten});
+	}
+	cond.notify_one();
+	return;
+}
+
+/**
+ * @brief chunk writer thread function
+*/
+void ChunkWriter::run(){
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		cond.wait(lock, [this]{ return stopping || !writes.empty(); });
+		if(writes.empty()){
+			break;
+		}
+		ChunkWrite write = std::move(writes.front());
+		writes.pop_front();
+		lock.unlock();
+		// The loop thread leaves a chunk in flight alone until its write is reported
+		WriteChunk* chunk = write.writeBehind->getChunk(write.chunkIndex);
+		size_t bytesWritten = 0;
+		while(bytesWritten < chunk->len){
+			ssize_t ret = pwrite(write.fileFD, chunk->data + bytesWritten, chunk->len - bytesWritten, (off_t)(chunk->offset + bytesWritten));
+			if(ret <= 0){
+				if(ret == -1 && errno == EINTR){
+					continue;
+				}
+				LOG(ERROR)<<"write-behind chunk at "<<chunk->offset<<" not written, "<<strerror(errno);
+				break;
+			}
+			bytesWritten += (size_t)ret;
+		}
+		write.onWritten(bytesWritten == chunk->len);
+		lock.lock();
+	}
+	return;
+}
+
+/**
+ * @brief constructor for EventEngine Class
+*/
+EventEngine::EventEngine(const std::vector<int>& listenSockets, int numLoops){
+	this->listenSockets = listenSockets;
+	this->numLoops = numLoops;
+}
+
+EventEngine::~EventEngine(){
+	stop();
+}
+
+/**
+ * @brief function creates the loop for the configured I/O backend, the io_uring loop
+ * falls back to epoll when the kernel does not support it
+*/
+static std::unique_ptr<EventLoop> createEventLoop(int loopId, int listenSocket){
+	if(TftpConfig::getInstance().ioBackend == TFTP_IO_URING){
+		std::unique_ptr<EventLoop> loop(new UringLoop(loopId, listenSocket));
+		if(loop->init()){
+			return loop;
+		}
+		LOG(WARNING)<<"io_uring backend unavailable for loop "<<loopId<<", using epoll";
+	}
+	std::unique_ptr<EventLoop> loop(new EpollLoop(loopId, listenSocket));
+	if(loop->init()){
+		return loop;
+	}
+	return std::unique_ptr<EventLoop>();
+}
+
+/**
+ * @brief function starts one thread per event loop. Loop i serves the request socket
+ * i % listenSockets.size(), loops sharing a socket are woken exclusively.
+*/
+bool EventEngine::start(){
+	if(listenSockets.empty()){
+		return false;
+	}
+	for(int listenSocket : listenSockets){
+		if(!setSocketNonBlocking(listenSocket)){
+			return false;
+		}
+	}
+	for(int i = 0; i < numLoops; ++i){
+		std::unique_ptr<EventLoop> loop = createEventLoop(i, listenSockets[i % listenSockets.size()]);
+		if(!loop){
+			LOG(ERROR)<<"Unable to initialize event loop "<<i;
+			stop();
+			return false;
+		}
+		loops.push_back(std::move(loop));
+	}
+	for(int i = 0; i < numLoops; ++i){
+		EventLoop* loop = loops[i].get();
+		loopThreads.push_back(std::thread([loop, i](){
+			TftpConfig::getInstance().pinThread(i);
+			loop->run();
+		}));
+	}
+	LOG(INFO)<<"Event engine started with "<<numLoops<<" loops on "<<listenSockets.size()<<" request sockets";
+	return true;
+}
+
+void EventEngine::stop(){
+	for(auto& loop : loops){
+		loop->stop();
+	}
+	for(auto& loopThread : loopThreads){
+		if(loopThread.joinable()){
+			loopThread.join();
+		}
+	}
+	loopThreads.clear();
+	loops.clear();
+	return;
+}
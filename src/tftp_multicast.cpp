@@ -0,0 +1,220 @@
+/**
+ * @file tftp_multicast.cpp
+ * @brief TFTP Server Multicast Groups.
+ *
+ * This file contains definations of function for MulticastRegistry Class
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#include "tftp_multicast.hpp"
+#include "tftp_config.hpp"
+
+static bool isSameAddress(const struct sockaddr_in& first, const struct sockaddr_in& second){
+	return first.sin_addr.s_addr == second.sin_addr.s_addr && first.sin_port == second.sin_port;
+}
+
+/**
+ * @brief constructor for MulticastRegistry Class, multicast stays disabled until init()
+*/
+MulticastRegistry::MulticastRegistry(){
+	enabled = false;
+	groupAddress.s_addr = htonl(INADDR_ANY);
+	firstPort = 0;
+}
+
+/**
+ * @brief function enables the multicast option. Groups are sent to groupIP, on firstPort and the
+ * TFTP_MULTICAST_MAX_GROUPS - 1 ports after it, through the interface of interfaceIP.
+*/
+bool MulticastRegistry::init(const std::string& groupIP, int firstPort, const std::string& interfaceIP){
+	std::lock_guard<std::mutex> lock(groupMutex);
+	if(inet_pton(AF_INET, groupIP.c_str(), &groupAddress) != 1 || !IN_MULTICAST(ntohl(groupAddress.s_addr))){
+		LOG(ERROR)<<"Invalid multicast group address "<<groupIP;
+		return false;
+	}
+	this->firstPort = firstPort;
+	this->interfaceIP = interfaceIP;
+	groups.assign(TFTP_MULTICAST_MAX_GROUPS, std::shared_ptr<MulticastGroup>());
+	enabled = true;
+	return true;
+}
+
+bool MulticastRegistry::isEnabled(){
+	return enabled;
+}
+
+/**
+ * @brief function opens a group for the file of a RRQ session, on the first free port. The DATA of the
+ * session are sent to the group from socketFD, its client is the first master.
+*/
+std::shared_ptr<MulticastGroup> MulticastRegistry::create(const std::string& fileName, int socketFD, struct sockaddr_in& master, const TftpOptions& options, uint64_t fileSize){
+	if(!enabled){
+		return NULL;
+	}
+	std::lock_guard<std::mutex> lock(groupMutex);
+	int portIndex = 0;
+	while(portIndex < TFTP_MULTICAST_MAX_GROUPS && groups[portIndex]){
+		portIndex++;
+	}
+	if(portIndex == TFTP_MULTICAST_MAX_GROUPS){
+		LOG(ERROR)<<"No free multicast group for "<<fileName;
+		return NULL;
+	}
+	if(!setMulticastSender(socketFD, interfaceIP.c_str(), TFTP_MULTICAST_TTL)){
+		return NULL;
+	}
+	std::shared_ptr<MulticastGroup> group = std::make_shared<MulticastGroup>();
+	group->fileName = fileName;
+	memset(&group->address, 0, sizeof(group->address));
+	group->address.sin_family = AF_INET;
+	group->address.sin_addr = groupAddress;
+	group->address.sin_port = htons(firstPort + portIndex);
+	group->master = master;
+	group->socketFD = socketFD;
+	group->options = options;
+	group->fileSize = fileSize;
+	group->portIndex = portIndex;
+	group->closed = false;
+	group->joined = 0;
+	groups[portIndex] = group;
+	LOG(INFO)<<"Multicast group "<<inet_ntoa(group->address.sin_addr)<<":"<<firstPort + portIndex<<" opened for "<<fileName;
+	return group;
+}
+
+/**
+ * @brief function adds the client of a RRQ to an open group of the same file and sends it the OACK of the group,
+ * it is not the master. Returns false when no group can serve the request, a session is then started for it.
+*/
+bool MulticastRegistry::join(const std::string& fileName, struct sockaddr_in& clientAddress, const TftpOptions& requestOptions){
+	// A range of the file is sent to the client alone
+	if(!enabled || !requestOptions.multicast || requestOptions.hasOffset){
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(groupMutex);
+	for(auto& group : groups){
+		if(!group || group->closed || group->fileName != fileName || !isCompatible(*group, requestOptions)){
+			continue;
+		}
+		if(isSameAddress(group->master, clientAddress)){
+			// Retransmitted RRQ of the master, the session resends its OACK
+			return true;
+		}
+		// Only the options of the request are acknowledged, with the values of the group
+		TftpOptions reply;
+		memset(&reply, 0, sizeof(reply));
+		if(requestOptions.blockSize > 0){
+			reply.blockSize = (group->options.blockSize > 0) ? group->options.blockSize : TFTP_MAX_DATA_SIZE;
+		}
+		if(requestOptions.windowSize > 0){
+			reply.windowSize = (group->options.windowSize > 0) ? group->options.windowSize : 1;
+		}
+		if(requestOptions.timeout > 0 && requestOptions.timeout == group->options.timeout){
+			reply.timeout = requestOptions.timeout;
+		}
+		if(requestOptions.hasTransferSize){
+			reply.hasTransferSize = true;
+			reply.transferSize = group->fileSize;
+		}
+		if(requestOptions.hasRollover){
+			reply.hasRollover = true;
+			reply.rollover = requestOptions.rollover;
+		}
+		reply.multicast = true;
+		reply.multicastAddress = group->address;
+		reply.multicastMaster = false;
+		uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+		int packetSize = makeOACKPacket(sendBuffer, sizeof(sendBuffer), reply);
+		if(packetSize == -1 || sendBufferThroughUDP(sendBuffer, packetSize, group->socketFD, clientAddress) != packetSize){
+			LOG(ERROR)<<"OACK of multicast group not sent";
+			return false;
+		}
+		bool isMember = false;
+		for(auto& member : group->members){
+			isMember = isMember || isSameAddress(member, clientAddress);
+		}
+		if(!isMember){
+			group->members.push_back(clientAddress);
+			group->joined++;
+		}
+		LOG(INFO)<<"Client "<<inet_ntoa(clientAddress.sin_addr)<<":"<<ntohs(clientAddress.sin_port)<<" joined multicast group of "<<fileName<<", "<<group->members.size()<<" waiting";
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief function picks the member that joined first as the next master. Without members the group is closed.
+*/
+bool MulticastRegistry::nextMaster(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& master){
+	std::lock_guard<std::mutex> lock(groupMutex);
+	if(group->members.empty()){
+		group->closed = true;
+		unregister(*group);
+		return false;
+	}
+	master = group->members.front();
+	group->members.pop_front();
+	group->master = master;
+	return true;
+}
+
+bool MulticastRegistry::isMember(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& clientAddress){
+	std::lock_guard<std::mutex> lock(groupMutex);
+	for(auto& member : group->members){
+		if(isSameAddress(member, clientAddress)){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief function removes a member that received the whole file, or gave up, before its turn as master
+*/
+void MulticastRegistry::leave(std::shared_ptr<MulticastGroup>& group, struct sockaddr_in& clientAddress){
+	std::lock_guard<std::mutex> lock(groupMutex);
+	for(auto it = group->members.begin(); it != group->members.end(); ++it){
+		if(isSameAddress(*it, clientAddress)){
+			group->members.erase(it);
+			return;
+		}
+	}
+	return;
+}
+
+/**
+ * @brief function closes the group, its port is free for the next one once the call returns
+*/
+void MulticastRegistry::close(std::shared_ptr<MulticastGroup>& group){
+	std::lock_guard<std::mutex> lock(groupMutex);
+	group->closed = true;
+	unregister(*group);
+	return;
+}
+
+/**
+ * @brief function checks that the group can serve the request: the block and window of the group must not be
+ * larger than the requested ones, as they may only be lowered by the server (RFC 2348, RFC 7440), and its
+ * block numbers must follow 65535 with the rollover of the request
+*/
+bool MulticastRegistry::isCompatible(MulticastGroup& group, const TftpOptions& requestOptions){
+	int blockSize = (requestOptions.blockSize > 0) ? requestOptions.blockSize : TFTP_MAX_DATA_SIZE;
+	int groupBlockSize = (group.options.blockSize > 0) ? group.options.blockSize : TFTP_MAX_DATA_SIZE;
+	int windowSize = (requestOptions.windowSize > 0) ? requestOptions.windowSize : 1;
+	int groupWindowSize = (group.options.windowSize > 0) ? group.options.windowSize : 1;
+	int rollover = requestOptions.hasRollover ? requestOptions.rollover : TftpConfig::getInstance().rollover;
+	int groupRollover = group.options.hasRollover ? group.options.rollover : TftpConfig::getInstance().rollover;
+	return blockSize >= groupBlockSize && windowSize >= groupWindowSize && rollover == groupRollover;
+}
+
+void MulticastRegistry::unregister(MulticastGroup& group){
+	if(groups[group.portIndex].get() == &group){
+		groups[group.portIndex].reset();
+	}
+	return;
+}
@@ -10,6 +10,7 @@
 */ 
 
 #include "tftp_packets.hpp"
+#include <strings.h>
 
 /**
  * @brief function accepts TFTP error codes and generates the corresponding error packet.
@@ -43,13 +44,113 @@ int makeErrorPacket(uint8_t* sendBuffer, size_t bufferLen, TftpErrorCode errorCo
 }
 
 /**
- * @brief function accept RRQ or WRQ opcode, file name, and operation mode. It generates RRQ/WRQ packet for TFTP as per RFC 1350
+ * @brief function appends one option as name and value strings, returns the bytes appended or -1 when it does not fit
 */
-int makeComInitPacket(TftpOpcode opcode, uint8_t* sendBuffer, size_t bufferLen, const char* fileName, const char* mode){
+static int appendOption(uint8_t* sendBuffer, size_t bufferLen, const char* name, const char* value){
+    size_t nameLen = strlen(name);
+    size_t valueLen = strlen(value);
+    if(bufferLen < nameLen + valueLen + 2){
+        return -1;
+    }
+    memcpy(sendBuffer, name, nameLen + 1);
+    memcpy(sendBuffer + nameLen + 1, value, valueLen + 1);
+    return nameLen + valueLen + 2;
+}
+
+static int appendOption(uint8_t* sendBuffer, size_t bufferLen, const char* name, uint64_t optionValue){
+    char value[24];
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)optionValue);
+    return appendOption(sendBuffer, bufferLen, name, value);
+}
+
+/**
+ * @brief function appends the options that are set, returns the bytes appended or -1 when they do not fit
+*/
+static int appendOptions(uint8_t* sendBuffer, size_t bufferLen, const TftpOptions& options){
+    int indx = 0;
+    int optionLen = 0;
+    if(options.blockSize > 0){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_BLKSIZE, options.blockSize);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.windowSize > 0){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_WINDOWSIZE, options.windowSize);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.timeout > 0){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_TIMEOUT, options.timeout);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.hasTransferSize){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_TSIZE, options.transferSize);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.nak){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_NAK, 1);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.multicast){
+        // Empty in a request, the group and the master flag in an OACK
+        char value[32] = "";
+        if(options.multicastAddress.sin_port != 0){
+            char address[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &options.multicastAddress.sin_addr, address, sizeof(address));
+            snprintf(value, sizeof(value), "%s,%d,%d", address, ntohs(options.multicastAddress.sin_port), options.multicastMaster ? 1 : 0);
+        }
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_MULTICAST, value);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.hasRollover){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_ROLLOVER, options.rollover);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.hasOffset){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_OFFSET, options.offset);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    if(options.hasLength){
+        optionLen = appendOption(sendBuffer + indx, bufferLen - indx, TFTP_OPTION_LENGTH, options.length);
+        if(optionLen == -1){
+            return -1;
+        }
+        indx += optionLen;
+    }
+    return indx;
+}
+
+/**
+ * @brief function accept RRQ or WRQ opcode, file name, and operation mode. It generates RRQ/WRQ packet for TFTP as per RFC 1350.
+ * The options set in options, when not NULL, are appended as per RFC 2347.
+*/
+int makeComInitPacket(TftpOpcode opcode, uint8_t* sendBuffer, size_t bufferLen, const char* fileName, const char* mode, const TftpOptions* options){
     int indx = 0;
     if((sendBuffer != NULL) && (fileName != NULL) && (mode != NULL) && (opcode == TFTP_OPCODE_RRQ || opcode == TFTP_OPCODE_WRQ || opcode == TFTP_OPCODE_DEL)){
         size_t fileNameLen = strlen(fileName);
-        size_t modeLen = strlen(fileName);
+        size_t modeLen = strlen(mode);
         // Send Buffer underflow condition verification
         if(bufferLen < 4 + fileNameLen + modeLen){
             return -1;
@@ -72,6 +173,13 @@ int makeComInitPacket(TftpOpcode opcode, uint8_t* sendBuffer, size_t bufferLen,
         //Including mode name termination byte
         sendBuffer[indx] = 0x00;
         indx++;
+        if(options != NULL){
+            int optionsLen = appendOptions(sendBuffer + indx, bufferLen - indx, *options);
+            if(optionsLen == -1){
+                return -1;
+            }
+            indx += optionsLen;
+        }
         return indx;
     }
     else{
@@ -80,6 +188,24 @@ int makeComInitPacket(TftpOpcode opcode, uint8_t* sendBuffer, size_t bufferLen,
     return -1;
 }
 
+/**
+ * @brief function generates a NAK packet: the last block received in order followed by bitmapLen bytes, where
+ * bit i (most significant bit first) set reports block blockNum + 1 + i missing
+*/
+int makeNAKPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum, const uint8_t* bitmap, size_t bitmapLen){
+    if(sendBuffer == NULL || bufferLen < TFTP_MAX_HEADER_SIZE + bitmapLen || (bitmap == NULL && bitmapLen > 0)){
+        return -1;
+    }
+    uint16_t networkOpcode = htons(TFTP_OPCODE_NAK);
+    memcpy(sendBuffer, &networkOpcode, 2);
+    uint16_t networkBlockNum = htons(blockNum);
+    memcpy(sendBuffer + 2, &networkBlockNum, 2);
+    if(bitmapLen > 0){
+        memcpy(sendBuffer + TFTP_MAX_HEADER_SIZE, bitmap, bitmapLen);
+    }
+    return TFTP_MAX_HEADER_SIZE + bitmapLen;
+}
+
 /**
  * @brief function accepts Block number and generates a TFTP ACK packet
 */
@@ -105,13 +231,31 @@ int makeACKPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum){
     return -1;
 }
 
+/**
+ * @brief function generates the OACK packet acknowledging the negotiated options (RFC 2347)
+*/
+int makeOACKPacket(uint8_t* sendBuffer, size_t bufferLen, const TftpOptions& options){
+    if(sendBuffer == NULL || bufferLen < 2){
+        return -1;
+    }
+    // Copying opcode to the OACK packet
+    uint16_t networkOpcode = htons(TFTP_OPCODE_OACK);
+    sendBuffer[0] = (uint8_t)(networkOpcode & 0xFF);
+    sendBuffer[1] = (uint8_t)(networkOpcode>>8 & 0xFF);
+    int optionsLen = appendOptions(sendBuffer + 2, bufferLen - 2, options);
+    if(optionsLen == -1){
+        return -1;
+    }
+    return 2 + optionsLen;
+}
+
 /**
  * @brief function accepts Block number and Data buffer and generates a TFTP Data packet
 */
 int makeDataPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum, uint8_t* data, size_t dataLen){
     int indx = 0;
     if(sendBuffer!=NULL && data!=NULL){
-        if(dataLen > TFTP_MAX_DATA_SIZE){
+        if(dataLen > TFTP_MAX_BLOCK_SIZE){
             return -1;
         }
         if(bufferLen < dataLen + 4){
@@ -142,17 +286,35 @@ int makeDataPacket(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum, uin
 }
 
 /**
- * @brief function reads maximum 512 bytes of data from a ifstream file are copies the data into a buffer 
+ * @brief function generates only the 4 byte header of a TFTP Data packet, the payload is filled by the caller
+*/
+int makeDataHeader(uint8_t* sendBuffer, size_t bufferLen, uint16_t blockNum){
+    if(sendBuffer == NULL || bufferLen < TFTP_MAX_HEADER_SIZE){
+        return -1;
+    }
+    // Copying opcode to the DATA Packet
+    uint16_t networkOpcode = htons(TFTP_OPCODE_DATA);
+    sendBuffer[0] = (uint8_t)(networkOpcode & 0xFF);
+    sendBuffer[1] = (uint8_t)(networkOpcode>>8 & 0xFF);
+    // Copying Block number to Data packet
+    uint16_t networkBlockNum = htons(blockNum);
+    sendBuffer[2] = (uint8_t)(networkBlockNum & 0xFF);
+    sendBuffer[3] = (uint8_t)((networkBlockNum>>8) & 0xFF);
+    return TFTP_MAX_HEADER_SIZE;
+}
+
+/**
+ * @brief function reads maximum blockSize bytes of data from a ifstream file are copies the data into a buffer 
 */
 
-int readData512(uint8_t* dataBuffer, size_t bufferLen, std::ifstream& fd){
-    if(dataBuffer!=NULL && bufferLen >= TFTP_MAX_DATA_SIZE && fd.is_open()){
-        memset(dataBuffer, 0, bufferLen);
+int readDataBlock(uint8_t* dataBuffer, size_t bufferLen, int blockSize, std::ifstream& fd){
+    if(dataBuffer!=NULL && blockSize > 0 && bufferLen >= (size_t)blockSize && fd.is_open()){
+        // Only the first bytesRead bytes are valid, the rest of the buffer is left untouched
         int bytesRead = 0;
         // Checking if fd had not reached end of file
         if(!fd.eof()){
-            // Try reading TFTP_MAX_DATA_SIZE bytes from the buffer
-            fd.read(reinterpret_cast<char*>(dataBuffer), bufferLen);
+            // Try reading blockSize bytes from the buffer
+            fd.read(reinterpret_cast<char*>(dataBuffer), blockSize);
             bytesRead = static_cast<int>(fd.gcount());
             if(fd.fail()){
                 if(fd.eof()){
@@ -182,10 +344,10 @@ int readData512(uint8_t* dataBuffer, size_t bufferLen, std::ifstream& fd){
 }
 
 /**
- * @brief function writes maximum 512 bytes from a data buffer to a ofstream file 
+ * @brief function writes maximum blockSize bytes from a data buffer to a ofstream file 
 */
-int writeData512(uint8_t* dataBuffer, size_t bufferLen, std::ofstream& fd){
-    if(dataBuffer!=NULL && bufferLen <= TFTP_MAX_DATA_SIZE && fd.is_open()){
+int writeDataBlock(uint8_t* dataBuffer, size_t bufferLen, int blockSize, std::ofstream& fd){
+    if(dataBuffer!=NULL && bufferLen <= (size_t)blockSize && fd.is_open()){
         fd.write(reinterpret_cast<char*>(dataBuffer), bufferLen);
         if(fd.fail()){
             LOG(ERROR)<<"file write error";
@@ -199,4 +361,210 @@ int writeData512(uint8_t* dataBuffer, size_t bufferLen, std::ofstream& fd){
         return -1;
     }
     return -1;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief function retrieves the opcode and the block number (error code for ERROR packets) of a received packet
+*/
+bool parsePacketHeader(const uint8_t* packet, size_t packetLen, uint16_t& opcode, uint16_t& blockNum){
+    opcode = TFTP_OPCODE_ND;
+    blockNum = 0;
+    if(packet == NULL || packetLen < TFTP_MAX_HEADER_SIZE){
+        return false;
+    }
+    // retriving opcode
+    opcode = (uint16_t)(((packet[1] & 0xFF) << 8) | (packet[0] & 0XFF));
+    opcode = ntohs(opcode);
+    // retriving block number
+    blockNum = (uint16_t)(((packet[3] & 0xFF) << 8) | (packet[2] & 0XFF));
+    blockNum = ntohs(blockNum);
+    return true;
+}
+
+/**
+ * @brief function converts a decimal option value, false when it is not a number
+*/
+static bool parseOptionValue(const char* value, long& number){
+    char* endPtr = NULL;
+    errno = 0;
+    number = strtol(value, &endPtr, 10);
+    return errno == 0 && *endPtr == '\0';
+}
+
+/**
+ * @brief function converts a decimal tsize value, false when it is not an unsigned number
+*/
+static bool parseSizeValue(const char* value, uint64_t& number){
+    char* endPtr = NULL;
+    errno = 0;
+    number = strtoull(value, &endPtr, 10);
+    return errno == 0 && *endPtr == '\0' && value[0] >= '0' && value[0] <= '9';
+}
+
+/**
+ * @brief function converts the "address,port,master" value of a multicast option, address and port may be empty
+*/
+static bool parseMulticastValue(const char* value, TftpOptions& options){
+    const char* portField = strchr(value, ',');
+    const char* masterField = (portField != NULL) ? strchr(portField + 1, ',') : NULL;
+    if(masterField == NULL || (strcmp(masterField + 1, "0") != 0 && strcmp(masterField + 1, "1") != 0)){
+        return false;
+    }
+    memset(&options.multicastAddress, 0, sizeof(options.multicastAddress));
+    options.multicastAddress.sin_family = AF_INET;
+    std::string address(value, portField - value);
+    if(!address.empty() && inet_pton(AF_INET, address.c_str(), &options.multicastAddress.sin_addr) != 1){
+        return false;
+    }
+    std::string port(portField + 1, masterField - portField - 1);
+    long portNum = 0;
+    if(!port.empty() && (!parseOptionValue(port.c_str(), portNum) || portNum < 1 || portNum > TFTP_MAX_PORT)){
+        return false;
+    }
+    options.multicastAddress.sin_port = htons((uint16_t)portNum);
+    options.multicastMaster = (masterField[1] == '1');
+    return true;
+}
+
+/**
+ * @brief function retrieves the options of a RRQ/WRQ or an OACK, given as name and value strings after the mode or the opcode.
+ * Unknown options are ignored as per RFC 2347, a blksize above the RFC 2348 range is lowered to its maximum.
+ * A windowsize outside the RFC 7440 range, a timeout outside the RFC 2349 range, a nak other than 1, a rollover
+ * other than 0 and 1, or a tsize, offset or length that is not a number, is refused.
+ * Only multicast may have an empty value (RFC 2090), its address and port may be left out of an OACK.
+*/
+bool parseOptions(const uint8_t* optionsBuffer, size_t optionsLen, TftpOptions& options){
+    memset(&options, 0, sizeof(options));
+    size_t indx = 0;
+    while(indx < optionsLen){
+        const char* name = (const char*)optionsBuffer + indx;
+        size_t nameLen = strnlen(name, optionsLen - indx);
+        if(nameLen == 0 || indx + nameLen + 1 >= optionsLen){
+            LOG(ERROR)<<"option without value";
+            return false;
+        }
+        indx += nameLen + 1;
+        const char* value = (const char*)optionsBuffer + indx;
+        size_t valueLen = strnlen(value, optionsLen - indx);
+        if(indx + valueLen >= optionsLen){
+            LOG(ERROR)<<"option value not terminated";
+            return false;
+        }
+        indx += valueLen + 1;
+        if(strcasecmp(name, TFTP_OPTION_BLKSIZE) == 0){
+            long blockSize = 0;
+            if(!parseOptionValue(value, blockSize) || blockSize < TFTP_MIN_BLOCK_SIZE){
+                LOG(ERROR)<<"invalid blksize "<<value;
+                return false;
+            }
+            options.blockSize = (int)std::min(blockSize, (long)TFTP_MAX_BLOCK_SIZE);
+        }
+        else if(strcasecmp(name, TFTP_OPTION_WINDOWSIZE) == 0){
+            long windowSize = 0;
+            if(!parseOptionValue(value, windowSize) || windowSize < 1 || windowSize > TFTP_MAX_WINDOW_SIZE){
+                LOG(ERROR)<<"invalid windowsize "<<value;
+                return false;
+            }
+            options.windowSize = (int)windowSize;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_TIMEOUT) == 0){
+            long timeout = 0;
+            if(!parseOptionValue(value, timeout) || timeout < 1 || timeout > TFTP_MAX_TIMEOUT){
+                LOG(ERROR)<<"invalid timeout "<<value;
+                return false;
+            }
+            options.timeout = (int)timeout;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_NAK) == 0){
+            long nak = 0;
+            if(!parseOptionValue(value, nak) || nak != 1){
+                LOG(ERROR)<<"invalid nak "<<value;
+                return false;
+            }
+            options.nak = true;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_MULTICAST) == 0){
+            if(valueLen > 0 && !parseMulticastValue(value, options)){
+                LOG(ERROR)<<"invalid multicast "<<value;
+                return false;
+            }
+            options.multicast = true;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_ROLLOVER) == 0){
+            long rollover = 0;
+            if(!parseOptionValue(value, rollover) || (rollover != 0 && rollover != 1)){
+                LOG(ERROR)<<"invalid rollover "<<value;
+                return false;
+            }
+            options.hasRollover = true;
+            options.rollover = (int)rollover;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_TSIZE) == 0){
+            if(!parseSizeValue(value, options.transferSize)){
+                LOG(ERROR)<<"invalid tsize "<<value;
+                return false;
+            }
+            options.hasTransferSize = true;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_OFFSET) == 0){
+            if(!parseSizeValue(value, options.offset)){
+                LOG(ERROR)<<"invalid offset "<<value;
+                return false;
+            }
+            options.hasOffset = true;
+        }
+        else if(strcasecmp(name, TFTP_OPTION_LENGTH) == 0){
+            if(!parseSizeValue(value, options.length)){
+                LOG(ERROR)<<"invalid length "<<value;
+                return false;
+            }
+            options.hasLength = true;
+        }
+        else{
+            LOG(DEBUG)<<"option "<<name<<" ignored";
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief function retrieves the options of an OACK received by a client. Opcode 6 is also the DEL of a client, a packet
+ * acknowledging none of the known options is not taken for an OACK (RFC 2347 servers leave the OACK out instead).
+*/
+bool parseOACKPacket(const uint8_t* packet, size_t packetLen, TftpOptions& options){
+    uint16_t opcode = TFTP_OPCODE_ND;
+    uint16_t unused = 0;
+    if(!parsePacketHeader(packet, packetLen, opcode, unused) || opcode != TFTP_OPCODE_OACK){
+        return false;
+    }
+    if(!parseOptions(packet + 2, packetLen - 2, options)){
+        return false;
+    }
+    bool acknowledged = options.blockSize > 0 || options.windowSize > 0 || options.timeout > 0 || options.hasTransferSize ||
+        options.nak || options.multicast || options.hasRollover || options.hasOffset || options.hasLength;
+    if(!acknowledged){
+        LOG(ERROR)<<"opcode 6 without any known option, not an OACK";
+    }
+    return acknowledged;
+}
+
+/**
+ * @brief function returns the 16 bit block number of the blockNum-th block of a transfer. After TFTP_MAX_BLOCK_NUM the
+ * numbers start again from the rollover, 0 or 1. Block 0 is only the ACK of a WRQ or an OACK.
+*/
+uint16_t toWireBlockNum(uint64_t blockNum, int rollover){
+    if(rollover == 0 || blockNum <= TFTP_MAX_BLOCK_NUM){
+        return (uint16_t)blockNum;
+    }
+    return (uint16_t)((blockNum - 1) % TFTP_MAX_BLOCK_NUM + 1);
+}
+
+/**
+ * @brief function returns how many blocks the block numbered wireBlockNum is after the blockNum-th block of the transfer,
+ * the distance wraps around like the block numbers: every 65536 blocks with rollover 0, every 65535 with rollover 1
+*/
+uint64_t wireBlockDistance(uint64_t blockNum, uint16_t wireBlockNum, int rollover){
+    uint64_t period = TFTP_BLOCK_NUM_PERIOD(rollover);
+    // With rollover 1 each number n is the block n modulo 65535, the first block 0 included
+    return (wireBlockNum % period + period - blockNum % period) % period;
+}
@@ -12,6 +12,12 @@
 */ 
 
 #include "tftp_server.hpp"
+#include <algorithm>
+#include <future>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
 
 /**
  * @brief constructor for ClientHandler Class
@@ -24,20 +30,131 @@ ClientHandler::ClientHandler(){
 	blockNum = 0;
 	//Currently only OCTET mode is supported
 	strcpy(operationMode, TFTP_MODE_OCTET);
+	memset(&options, 0, sizeof(options));
+	initSession();
 }
 
 /**
  * @brief parameterized constructor for ClientHandler Class
 */
 
-ClientHandler::ClientHandler(int defaultServerSocket, sockaddr_in clientAddress, uint16_t requestType, char* requestFileName, char* operationMode){
+ClientHandler::ClientHandler(int defaultServerSocket, sockaddr_in clientAddress, uint16_t requestType, char* requestFileName, char* operationMode, const TftpOptions& options){
 	this->defaultServerSocket = defaultServerSocket;
+	this->clientSocket = 0;
 	this->clientAddress = clientAddress;
 	this->requestType = requestType;
 	this->requestFileName.assign(requestFileName);
 	// Currently only OCTET mode is supported
 	strcpy(this->operationMode , operationMode);
+	this->options = options;
 	blockNum = 0;
+	initSession();
+}
+
+/**
+ * @brief copy constructor for ClientHandler Class, lastPacket is rebased when it points to the own storage
+*/
+ClientHandler::ClientHandler(const ClientHandler& other){
+	defaultServerSocket = other.defaultServerSocket;
+	clientSocket = other.clientSocket;
+	connected = other.connected;
+	clientAddress = other.clientAddress;
+	requestType = other.requestType;
+	requestFileName = other.requestFileName;
+	blockNum = other.blockNum;
+	strcpy(operationMode, other.operationMode);
+	options = other.options;
+	blockSize = other.blockSize;
+	windowSize = other.windowSize;
+	rollover = other.rollover;
+	ackDue = other.ackDue;
+	state = other.state;
+	transferSuccess = other.transferSuccess;
+	timeoutCount = other.timeoutCount;
+	timeoutSec = other.timeoutSec;
+	rtt = other.rtt;
+	cwnd = other.cwnd;
+	blocksResent = other.blocksResent;
+	deadline = other.deadline;
+	fileFD = other.fileFD;
+	fileSize = other.fileSize;
+	fileOffset = other.fileOffset;
+	readAheadOffset = other.readAheadOffset;
+	fileMap = other.fileMap;
+	packetImage = other.packetImage;
+	writeBehind = other.writeBehind;
+	multicastGroup = other.multicastGroup;
+	zeroCopy = other.zeroCopy;
+	io = other.io;
+	ioPending = other.ioPending;
+	ioSlot = other.ioSlot;
+	lastPacketLen = other.lastPacketLen;
+	lastDataLen = other.lastDataLen;
+	lastDataOffset = other.lastDataOffset;
+	finalBlockPending = other.finalBlockPending;
+	oackPending = other.oackPending;
+	ackedBlockNum = other.ackedBlockNum;
+	ackedOffset = other.ackedOffset;
+	outOfOrder = other.outOfOrder;
+	sentEndOffset = other.sentEndOffset;
+	nakBlocks = other.nakBlocks;
+	packetStore = other.packetStore;
+	lastPacket = (other.lastPacket == other.packetStore.data()) ? packetStore.data() : other.lastPacket;
+}
+
+/**
+ * @brief function resets the state machine fields of a new session
+*/
+void ClientHandler::initSession(){
+	state = TFTP_SESSION_INIT;
+	connected = false;
+	transferSuccess = false;
+	timeoutCount = 0;
+	timeoutSec = 0;
+	rtt = RttEstimator();
+	cwnd = CongestionWindow();
+	blocksResent = 0;
+	rtt.setLimits(TftpConfig::getInstance().rtoMinMs, TftpConfig::getInstance().rtoMaxMs);
+	fileFD = -1;
+	fileSize = 0;
+	fileOffset = 0;
+	readAheadOffset = 0;
+	fileMap.reset();
+	packetImage.reset();
+	writeBehind.reset();
+	multicastGroup.reset();
+	zeroCopy = false;
+	io = &SyncSessionIO::getInstance();
+	ioPending = false;
+	ioSlot = -1;
+	finalBlockPending = false;
+	oackPending = false;
+	blockSize = TFTP_MAX_DATA_SIZE;
+	windowSize = 1;
+	rollover = TftpConfig::getInstance().rollover;
+	ackDue = true;
+	ackedBlockNum = 0;
+	ackedOffset = 0;
+	outOfOrder = 0;
+	sentEndOffset = 0;
+	nakBlocks.clear();
+	packetStore.resize(TFTP_MAX_PACKET_SIZE);
+	lastPacket = packetStore.data();
+	lastPacketLen = 0;
+	lastDataLen = 0;
+	lastDataOffset = 0;
+}
+
+/**
+ * @brief function selects the SessionIO of the session. packetBuffer, when not NULL, replaces
+ * the own lastPacket storage and must hold a DATA packet of io->getMaxBlockSize() bytes.
+*/
+void ClientHandler::setIO(SessionIO* io, uint8_t* packetBuffer){
+	this->io = io;
+	if(packetBuffer != NULL){
+		lastPacket = packetBuffer;
+	}
+	return;
 }
 
 /**
@@ -50,94 +167,147 @@ void ClientHandler::printVals(){
 	return;
 }
 
+/**
+ * @brief function to validate a RRQ/WRQ/DEL packet received in the default TFTP server port.
+ * The options following the mode are stored in options (RFC 2347), a DEL with options is an OACK and is refused.
+ * On failure errorCode and errorMsg hold the ERROR packet to be sent back to the client.
+*/
+bool parseConnectionRequest(uint8_t* recvBuffer, int recvLen, uint16_t& opcode, char* fileName, char* mode, TftpOptions& options, TftpErrorCode& errorCode, const char*& errorMsg){
+	errorCode = TFTP_ERROR_ILLEGAL_OPERATION;
+	errorMsg = "invalid request";
+	opcode = TFTP_OPCODE_ND;
+	memset(fileName, 0, TFTP_MAX_DATA_SIZE);
+	memset(mode, 0, TFTP_MAX_MODE_SIZE);
+	memset(&options, 0, sizeof(options));
+
+	// Checking sanity of recvBuffer
+	if(recvBuffer == NULL || recvLen < TFTP_MIN_CONN_INIT_PACKET_SIZE){
+		LOG(ERROR) << "Invalid request in port: "<<TFTP_DEFAULT_PORT;
+		return false;
+	}
+
+	// retriving opcode
+	opcode = (uint16_t)(((recvBuffer[1] & 0xFF) << 8) | (recvBuffer[0] & 0XFF));
+	sprintf(log_message, "recv [%X][%X] raw opcode [%X]", recvBuffer[0], recvBuffer[1], opcode);
+	LOG(DEBUG)<<log_message;	
+	opcode = ntohs(opcode);
+
+	if(opcode!=TFTP_OPCODE_RRQ && opcode!=TFTP_OPCODE_WRQ && opcode!=TFTP_OPCODE_DEL){
+		LOG(ERROR)<< "Recv"<<opcode<<", Comp"<<TFTP_OPCODE_RRQ<<":"<<TFTP_OPCODE_WRQ;
+		errorMsg = "opcode invalid";
+		return false;
+	}
+
+	// retriving file name, it has to be null terminated inside the received packet
+	size_t fileNameLen = strnlen((char*)(recvBuffer + 2), recvLen - 2);
+	if(fileNameLen == 0 || fileNameLen >= TFTP_MAX_DATA_SIZE || 2 + fileNameLen >= (size_t)recvLen){
+		errorMsg = "invalid file name";
+		return false;
+	}
+	memcpy(fileName, recvBuffer + 2, fileNameLen);
+
+	// retriving communication mode
+	size_t modeOffset = 2 + fileNameLen + 1;
+	size_t modeLen = strnlen((char*)(recvBuffer + modeOffset), recvLen - modeOffset);
+	if(modeLen >= TFTP_MAX_MODE_SIZE || modeOffset + modeLen >= (size_t)recvLen){
+		LOG(ERROR)<< "Offset value" << modeOffset;
+		errorMsg = "incompatable mode";
+		return false;
+	}
+	memcpy(mode, recvBuffer + modeOffset, modeLen);
+	
+	for (int i = 0; mode[i] != '\0'; i++) {
+		mode[i] = std::tolower(mode[i]);
+	}
+
+	if(std::strcmp(TFTP_MODE_OCTET, mode)!=0){
+		LOG(ERROR)<< "Offset value" << modeOffset;
+		errorMsg = "incompatable mode";
+		return false;
+	}
+
+	// retriving the options
+	size_t optionsOffset = modeOffset + modeLen + 1;
+	if(opcode == TFTP_OPCODE_DEL && optionsOffset < (size_t)recvLen){
+		// Opcode 6 is the OACK of a server as well, a DEL never carries options
+		errorMsg = "options in a delete request";
+		return false;
+	}
+	if(!parseOptions(recvBuffer + optionsOffset, recvLen - optionsOffset, options)){
+		errorCode = TFTP_ERROR_OPTION_NEGOTIATION;
+		errorMsg = "invalid option";
+		return false;
+	}
+	return true;
+}
+
 /**
  * @brief function to handle incomming client request to default TFTP server port
 */
 void handleIncommingRequests(int serverSock){
 	
-	char recvBuffer[TFTP_MAX_PACKET_SIZE];
 	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
 	int packetSize;
     uint16_t opcode;
 	char fileName[TFTP_MAX_DATA_SIZE];
 	char mode[TFTP_MAX_MODE_SIZE];
-	std::vector<ClientHandler> clientObjects;
-	std::vector<std::thread> clientThreads;
+	TftpOptions options;
+	// Created by the request thread so that the workers inherit its core when --pin-cpus is set
+	WorkerPool workerPool(TftpConfig::getInstance().workers, TftpConfig::getInstance().queueDepth);
+	UDPRecvBatch recvBatch(TftpConfig::getInstance().batchSize);
+	UDPSendBatch replyBatch(TftpConfig::getInstance().batchSize);
 
 	while (!END_SERVER_PROCESS) {
-        struct sockaddr_in clientAddress;
-        socklen_t clientAddressLength = sizeof(clientAddress);
-		memset(recvBuffer, 0, sizeof(recvBuffer));
-
-        ssize_t bytesReceived = recvfrom(serverSock, recvBuffer, sizeof(recvBuffer), 0, (struct sockaddr*)&clientAddress, &clientAddressLength);
+		// Blocks for the first request and drains the ones queued behind it in the same call
+		int numReceived = recvBatch.receive(serverSock, MSG_WAITFORONE);
 
-        if (bytesReceived == -1) {
+        if (numReceived == -1) {
             LOG(ERROR) <<"Error receiving data: "<< strerror(errno);
             continue;
         }
 
-		LOG(DEBUG)<<"Received " << bytesReceived << " bytes from " << inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port) << " - Data:" << recvBuffer ;
-		
-		// Checking sanity of recvBuffer
-		if(sizeof(recvBuffer) <= TFTP_MIN_CONN_INIT_PACKET_SIZE*sizeof(uint8_t)){
-			LOG(ERROR) << "Invalid request in port: "<<TFTP_DEFAULT_PORT;
-			continue;
-		}
-
-		opcode = TFTP_OPCODE_ND;
-		memset(fileName, 0, sizeof(fileName));
-		memset(mode, 0, sizeof(mode));
-
-		// retriving opcode
-		opcode = (uint16_t)(((recvBuffer[1] & 0xFF) << 8) | (recvBuffer[0] & 0XFF));
-		sprintf(log_message, "recv [%X][%X] raw opcode [%X]", recvBuffer[0], recvBuffer[1], opcode);
-		LOG(DEBUG)<<log_message;	
-		opcode = ntohs(opcode);
+		for(int i = 0; i < numReceived; ++i){
+			uint8_t* recvBuffer = recvBatch.getPacket(i);
+			int bytesReceived = recvBatch.getPacketLen(i);
+			struct sockaddr_in& clientAddress = recvBatch.getAddress(i);
+			LOG(DEBUG)<<"Received " << bytesReceived << " bytes from " << inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port);
+			
+			TftpErrorCode errorCode;
+			const char* errorMsg;
+			if(!parseConnectionRequest(recvBuffer, bytesReceived, opcode, fileName, mode, options, errorCode, errorMsg)){
+				packetSize = 0;
+				LOG(ERROR)<< "Incompatable request received from "<< inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port)<<", "<<errorMsg;
+				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), errorCode, errorMsg);
+				replyBatch.queue(serverSock, sendBuffer, packetSize, clientAddress);
+				continue;
+			}
 
-		if(opcode!=TFTP_OPCODE_RRQ && opcode!=TFTP_OPCODE_WRQ && opcode!=TFTP_OPCODE_DEL){
-			packetSize = 0;
-			LOG(ERROR)<< "Recv"<<opcode<<", Comp"<<TFTP_OPCODE_RRQ<<":"<<TFTP_OPCODE_WRQ;
-			LOG(ERROR)<< "Incompatable OPCODE received from "<< inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port);
-			packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_ILLEGAL_OPERATION, "opcode invalid");
-			sendBufferThroughUDP(sendBuffer, packetSize, serverSock, clientAddress);
-			continue;
-		}
-		
-		// retriving file name
-		strcpy(fileName, (char*)(recvBuffer+2));
+			memset(log_message,0,sizeof(log_message));
+			sprintf(log_message, "Connection request received: IP[%s] Port[%d] fileName[%s] mode[%s]", inet_ntoa(clientAddress.sin_addr), ntohs(clientAddress.sin_port), fileName, mode);
+			LOG(INFO)<<log_message;
 
-		// retriving communication mode
-		strcpy(mode,(char*)(recvBuffer + 2 + strlen(fileName) + 1));
-		
-		for (int i = 0; mode[i] != '\0'; i++) {
-        	mode[i] = std::tolower(mode[i]);
-		}
+			// A multicast RRQ of a file already sent to a group joins it (RFC 2090)
+			if(opcode == TFTP_OPCODE_RRQ && MulticastRegistry::getInstance().join(fileName, clientAddress, options)){
+				continue;
+			}
 
-		if(std::strcmp(TFTP_MODE_OCTET, mode)!=0){
-			packetSize = 0;
-			LOG(ERROR)<< "Offset value" << 2+strlen(fileName)+1;
-			LOG(ERROR)<< "Incompatable MODE received from "<< inet_ntoa(clientAddress.sin_addr) << ":" << ntohs(clientAddress.sin_port)<<"mode: "<<mode;
-			packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_ILLEGAL_OPERATION, "incompatable mode");
-			sendBufferThroughUDP(sendBuffer, packetSize, serverSock, clientAddress);
-			continue;
+			std::unique_ptr<ClientHandler> curClientHandlerObj(new ClientHandler(serverSock ,clientAddress, opcode, fileName, mode, options));
+			curClientHandlerObj->printVals();
+			if(!workerPool.submit(std::move(curClientHandlerObj))){
+				LOG(ERROR)<<"Request queue full, request from "<<inet_ntoa(clientAddress.sin_addr)<<":"<<ntohs(clientAddress.sin_port)<<" rejected";
+				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "server busy");
+				replyBatch.queue(serverSock, sendBuffer, packetSize, clientAddress);
+			}
 		}
-
-		memset(log_message,0,sizeof(log_message));
-		sprintf(log_message, "Connection request received: IP[%s] Port[%d] fileName[%s] mode[%s]", inet_ntoa(clientAddress.sin_addr), ntohs(clientAddress.sin_port), fileName, mode);
-		LOG(INFO)<<log_message;
-
-		ClientHandler curClientHandlerObj(serverSock ,clientAddress, opcode, fileName, mode);
-		clientObjects.push_back(curClientHandlerObj);
-		curClientHandlerObj.printVals();
-		std::thread curClientHandle(handleClient, curClientHandlerObj);
-		int a = 10;
-		//std::thread curClientHandle(test, a);
-		clientThreads.push_back(std::move(curClientHandle));
+		replyBatch.flush();
 	}
 
-	for(int i = 0 ; i<clientThreads.size(); ++i){
-		clientThreads[i].join();
-	}
+	workerPool.stop();
+	LOG(INFO)<<"Worker pool stopped: sessions accepted["<<workerPool.accepted<<"] rejected["<<workerPool.rejected<<"] dallied["<<workerPool.dallyLoop.dallied<<"]";
+	memset(log_message,0,sizeof(log_message));
+	sprintf(log_message, "Request batches: recvmmsg calls[%llu] average fill[%.2f/%d], sendmmsg calls[%llu] average fill[%.2f]",
+		(unsigned long long)recvBatch.calls, recvBatch.getAverageFill(), recvBatch.getBatchSize(), (unsigned long long)replyBatch.calls, replyBatch.getAverageFill());
+	LOG(INFO)<<log_message;
 	return;
 }
 
@@ -159,12 +329,280 @@ void handleServerTermination(){
 	return;
 }
 
-void handleClient(ClientHandler curClient){
+
+/**
+ * @brief constructor for WorkerPool Class, starts numWorkers threads
+*/
+WorkerPool::WorkerPool(int numWorkers, int queueDepth){
+	this->queueDepth = queueDepth;
+	idleWorkers = 0;
+	stopping = false;
+	accepted = 0;
+	rejected = 0;
+	if(TftpConfig::getInstance().dallyMs > 0){
+		dallyLoop.start();
+	}
+	for(int i = 0; i < numWorkers; ++i){
+		workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+WorkerPool::~WorkerPool(){
+	stop();
+}
+
+/**
+ * @brief function hands a session to an idle worker or queues it, up to queueDepth sessions wait
+*/
+bool WorkerPool::submit(std::unique_ptr<ClientHandler> session){
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if(stopping || (int)queue.size() >= queueDepth + idleWorkers){
+			rejected++;
+			return false;
+		}
+		queue.push_back(std::move(session));
+		accepted++;
+	}
+	queueCond.notify_one();
+	return true;
+}
+
+void WorkerPool::stop(){
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCond.notify_all();
+	for(auto& worker : workers){
+		if(worker.joinable()){
+			worker.join();
+		}
+	}
+	workers.clear();
+	dallyLoop.stop();
+	return;
+}
+
+/**
+ * @brief worker thread function, the session is released as soon as its transfer ends
+*/
+void WorkerPool::workerLoop(){
+	while(true){
+		std::unique_ptr<ClientHandler> session;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			idleWorkers++;
+			queueCond.wait(lock, [this](){ return stopping || !queue.empty(); });
+			idleWorkers--;
+			if(queue.empty()){
+				return;
+			}
+			session = std::move(queue.front());
+			queue.pop_front();
+		}
+		handleClient(*session);
+		if(session->isDallying()){
+			dallyLoop.add(std::move(session));
+		}
+	}
+}
+
+/**
+ * @brief constructor for DallyLoop Class
+*/
+DallyLoop::DallyLoop() : timers(TimerWheel::nowMs()), recvBatch(TFTP_DEFAULT_BATCH_SIZE){
+	dallied = 0;
+	epollFD = -1;
+	wakeFD = -1;
+	stopping = false;
+}
+
+DallyLoop::~DallyLoop(){
+	stop();
+	if(wakeFD != -1){
+		close(wakeFD);
+	}
+	if(epollFD != -1){
+		close(epollFD);
+	}
+}
+
+/**
+ * @brief function creates the epoll instance and starts the dally thread. Without it the
+ * sessions handed over are closed right away.
+*/
+bool DallyLoop::start(){
+	epollFD = epoll_create1(EPOLL_CLOEXEC);
+	if(epollFD == -1){
+		LOG(ERROR)<<"Unable to create dally epoll instance: "<<strerror(errno);
+		return false;
+	}
+	wakeFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(wakeFD == -1){
+		LOG(ERROR)<<"Unable to create dally eventfd: "<<strerror(errno);
+		close(epollFD);
+		epollFD = -1;
+		return false;
+	}
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = wakeFD;
+	if(epoll_ctl(epollFD, EPOLL_CTL_ADD, wakeFD, &event) == -1){
+		LOG(ERROR)<<"Unable to register dally eventfd: "<<strerror(errno);
+		close(wakeFD);
+		close(epollFD);
+		wakeFD = -1;
+		epollFD = -1;
+		return false;
+	}
+	loopThread = std::thread(&DallyLoop::run, this);
+	return true;
+}
+
+void DallyLoop::add(std::unique_ptr<ClientHandler> session){
+	{
+		std::lock_guard<std::mutex> lock(addMutex);
+		if(!stopping && loopThread.joinable()){
+			added.push_back(std::move(session));
+			dallied++;
+		}
+	}
+	if(session){
+		session->finishTransfer();
+		closeSocket(session->clientSocket);
+		return;
+	}
+	uint64_t counter = 1;
+	if(write(wakeFD, &counter, sizeof(counter)) == -1){
+		LOG(ERROR)<<"Unable to wake dally loop: "<<strerror(errno);
+	}
+	return;
+}
+
+void DallyLoop::stop(){
+	{
+		std::lock_guard<std::mutex> lock(addMutex);
+		stopping = true;
+	}
+	if(loopThread.joinable()){
+		uint64_t counter = 1;
+		if(write(wakeFD, &counter, sizeof(counter)) == -1){
+			LOG(ERROR)<<"Unable to wake dally loop: "<<strerror(errno);
+		}
+		loopThread.join();
+	}
+	return;
+}
+
+/**
+ * @brief dally thread function, sleeps until a retransmitted final DATA arrives or the next dally deadline
+*/
+void DallyLoop::run(){
+	struct epoll_event events[TFTP_DALLY_MAX_EVENTS];
+	while(true){
+		int numEvents = epoll_wait(epollFD, events, TFTP_DALLY_MAX_EVENTS, timers.getTimeoutMs(TimerWheel::nowMs()));
+		if(numEvents == -1 && errno != EINTR){
+			LOG(ERROR)<<"dally epoll wait error: "<<strerror(errno);
+			break;
+		}
+		for(int i = 0; i < numEvents; ++i){
+			int eventFD = events[i].data.fd;
+			if(eventFD == wakeFD){
+				uint64_t counter;
+				if(read(wakeFD, &counter, sizeof(counter)) == -1){
+					LOG(DEBUG)<<"eventfd read "<<strerror(errno);
+				}
+				continue;
+			}
+			auto it = sessions.find(eventFD);
+			if(it == sessions.end()){
+				continue;
+			}
+			it->second->handleReadable(recvBatch);
+			if(it->second->isDone()){
+				closeSession(eventFD);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(addMutex);
+			if(stopping){
+				break;
+			}
+		}
+		watchAdded();
+		expiredTimers.clear();
+		timers.advance(TimerWheel::nowMs(), expiredTimers);
+		for(TimerNode* timer : expiredTimers){
+			ClientHandler* session = (ClientHandler*)timer->owner;
+			if(session->getTimeoutMs() == 0){
+				session->handleTimeout();
+			}
+			if(session->isDone()){
+				closeSession(session->clientSocket);
+			}
+			else{
+				timers.schedule(&session->timer, TimerWheel::toMs(session->deadline));
+			}
+		}
+	}
+	watchAdded();
+	while(!sessions.empty()){
+		closeSession(sessions.begin()->first);
+	}
+	return;
+}
+
+/**
+ * @brief function starts watching the sessions handed over since the last iteration
+*/
+void DallyLoop::watchAdded(){
+	std::vector<std::unique_ptr<ClientHandler>> newSessions;
+	{
+		std::lock_guard<std::mutex> lock(addMutex);
+		newSessions.swap(added);
+	}
+	for(auto& session : newSessions){
+		int socketFD = session->clientSocket;
+		struct epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = socketFD;
+		if(epoll_ctl(epollFD, EPOLL_CTL_ADD, socketFD, &event) == -1){
+			LOG(ERROR)<<"Unable to register dallying socket: "<<strerror(errno);
+			session->finishTransfer();
+			closeSocket(socketFD);
+			continue;
+		}
+		session->timer.owner = session.get();
+		timers.schedule(&session->timer, TimerWheel::toMs(session->deadline));
+		sessions[socketFD] = std::move(session);
+	}
+	return;
+}
+
+void DallyLoop::closeSession(int socketFD){
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		return;
+	}
+	epoll_ctl(epollFD, EPOLL_CTL_DEL, socketFD, NULL);
+	it->second->finishTransfer();
+	LOG(INFO)<<"Session closed: fileName["<<it->second->requestFileName<<"] success["<<it->second->transferSuccess<<"]";
+	sessions.erase(it);
+	closeSocket(socketFD);
+	return;
+}
+
+/**
+ * @brief function driving a single client session with blocking waits on its transfer socket
+*/
+void handleClient(ClientHandler& curClient){
 	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
 	int packetSize;
-	int clientPort = 0;
 	int clientSocketFD = 0;
-	clientSocketFD = createRandomUDPSocket(serverIP, &clientPort);
+	clientSocketFD = UDPSocketPool::getInstance().acquire();
 	
 	if(clientSocketFD == -1){
 		packetSize = 0;
@@ -173,336 +611,1189 @@ void handleClient(ClientHandler curClient){
 		sendBufferThroughUDP(sendBuffer, packetSize, curClient.defaultServerSocket, curClient.clientAddress);
 		return;
 	}
-	curClient.clientSocket = clientSocketFD;
-    LOG(INFO)<<"new port"<<clientPort<<" new fd:"<<clientSocketFD<<"default fd: "<<curClient.defaultServerSocket;
-	if(curClient.requestType == TFTP_OPCODE_RRQ){
-		LOG(INFO)<<"Read request process initiated";
-		std::ifstream fd;
-		TftpErrorCode errorCode; 
-		fd = STARK::getInstance().isFileReadable(curClient.requestFileName, errorCode);
-		if(fd.is_open()){
-			LOG(DEBUG)<<"File Open Success";
-			bool ret;
-			ret = handleSendData(curClient, fd);
-			if(ret){
-				LOG(INFO)<<"All data sent";
-			}
-			else{
-				packetSize = 0;
-				LOG(ERROR)<<"Data not sent";
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "error connection terminating");
-				sendBufferThroughUDP(sendBuffer, packetSize, curClient.clientSocket, curClient.clientAddress);
-			}
-			ret = STARK::getInstance().closeReadableFile(curClient.requestFileName, fd);
-			if(ret){
-				LOG(INFO)<<"File Close Success";
-			}
-			else{
-				LOG(ERROR)<<"File Close Error";
-			}
-			closeSocket(clientSocketFD);
-			return;
+    LOG(INFO)<<"new fd:"<<clientSocketFD<<"default fd: "<<curClient.defaultServerSocket;
+
+	curClient.startTransfer(clientSocketFD);
+	// Sized for the DATA of the negotiated block size. A download only receives ACKs, an upload at most a window
+	// of DATA per ACK, the socket of one session gains nothing from a deeper batch
+	int batchSize = (curClient.requestType == TFTP_OPCODE_WRQ) ? std::min(TftpConfig::getInstance().batchSize, curClient.windowSize) : 1;
+	UDPRecvBatch recvBatch(batchSize, TFTP_BLOCK_PACKET_SIZE(curClient.blockSize));
+	while(!curClient.isDone() && !curClient.isDallying()){
+		struct pollfd pollFD;
+		pollFD.fd = clientSocketFD;
+		pollFD.events = POLLIN;
+		pollFD.revents = 0;
+		int ret = poll(&pollFD, 1, curClient.getTimeoutMs());
+		if(ret > 0){
+			curClient.handleReadable(recvBatch);
 		}
-		else{
-			packetSize = 0;
+		else if(ret == 0){
+			curClient.handleTimeout();
+		}
+		else if(errno != EINTR){
+			LOG(ERROR)<<"poll error "<<strerror(errno);
+			break;
+		}
+	}
+	if(curClient.isDallying()){
+		// The transfer socket is handed to the dally loop together with the session
+		LOG(INFO)<<"Transfer of "<<curClient.requestFileName<<" complete, session dallying";
+		return;
+	}
+	curClient.finishTransfer();
+	closeSocket(clientSocketFD);
+	return;
+}
+
+/**
+ * @brief function opens the requested file and sends the first packet of the transfer.
+ * DEL requests are completed inside this call.
+*/
+bool ClientHandler::startTransfer(int transferSocket){
+	clientSocket = transferSocket;
+	// Datagrams of other sources are filtered by the kernel from now on, the ones queued before are dropped.
+	// The members of a multicast group send to the same socket, it is left unconnected for them.
+	bool multicastPossible = (requestType == TFTP_OPCODE_RRQ && options.multicast && io->sendsToGroup() && MulticastRegistry::getInstance().isEnabled());
+	connected = !multicastPossible && connectTransferSocket(transferSocket, clientAddress);
+	if(!connected){
+		drainUDPSocket(transferSocket);
+	}
+	enableReceiveTimestamps(transferSocket);
+	blockNum = 0;
+	timeoutCount = 0;
+	transferSuccess = false;
+	TftpErrorCode errorCode;
+
+	if(requestType == TFTP_OPCODE_RRQ){
+		LOG(INFO)<<"Read request process initiated";
+		fileFD = STARK::getInstance().openReadableFile(requestFileName, errorCode);
+		if(fileFD == -1){
 			if(errorCode == TFTP_ERROR_ACCESS_VIOLATION){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_ACCESS_VIOLATION, "file opened in write mode by another client");
+				sendError(TFTP_ERROR_ACCESS_VIOLATION, "file opened in write mode by another client");
 				LOG(ERROR)<<"file opened in write mode by another client";
 			}
 			else if(errorCode == TFTP_ERROR_FILE_NOT_FOUND){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_FILE_NOT_FOUND, "file not found in server");
+				sendError(TFTP_ERROR_FILE_NOT_FOUND, "file not found in server");
 				LOG(ERROR)<<"file not found in server";
 			}
 			else{
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "unknown error from server");
+				sendError(TFTP_ERROR_NOT_DEFINED, "unknown error from server");
 				LOG(ERROR)<<"unknown error from server";
 			}
-			sendBufferThroughUDP(sendBuffer, packetSize, curClient.defaultServerSocket, curClient.clientAddress);
-			closeSocket(clientSocketFD);
-			return;
+			endTransfer(false);
+			return false;
 		}
-	}
-	else if(curClient.requestType == TFTP_OPCODE_WRQ){
-		LOG(INFO)<<"Write request process initiated";
-		std::ofstream fd;
-		TftpErrorCode errorCode;
-		fd = STARK::getInstance().isFileWritable(curClient.requestFileName, errorCode);
-		if(fd.is_open()){
-			LOG(INFO)<<"File Open Success";
-			bool ret;
-			ret = handleReceiveData(curClient, fd);
-			if(ret){
-				LOG(INFO)<<"All data received";
-			}
-			else{
-				packetSize = 0;
-				LOG(ERROR)<<"File not received";
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "error connection terminating");
-				sendBufferThroughUDP(sendBuffer, packetSize, curClient.clientSocket, curClient.clientAddress);
+		struct stat fileStat;
+		if(fstat(fileFD, &fileStat) == -1){
+			LOG(ERROR)<<"unable to stat file "<<strerror(errno);
+			sendError(TFTP_ERROR_NOT_DEFINED, "unknown error from server");
+			endTransfer(false);
+			return false;
+		}
+		fileSize = (uint64_t)fileStat.st_size;
+		if(options.hasOffset && options.offset > fileSize){
+			LOG(ERROR)<<"offset "<<options.offset<<" past the end of "<<requestFileName;
+			sendError(TFTP_ERROR_OPTION_NEGOTIATION, "offset past the end of file");
+			endTransfer(false);
+			return false;
+		}
+		bool sendOACK = negotiateOptions();
+		if(fileSize > 0){
+			// Hot files are served from the cache, the others from a mapping when the SessionIO sends from one.
+			// Without either of them the blocks are read from the file.
+			fileMap = STARK::getInstance().mapReadableFile(requestFileName, fileFD, fileStat, io->sendsFromMapping());
+			if(fileMap && io->sendsFromMapping() && TftpConfig::getInstance().zeroCopy && !multicastGroup){
+				zeroCopy = setSocketZeroCopy(clientSocket, true);
 			}
-			ret = STARK::getInstance().closeWritableFile(curClient.requestFileName, fd);
-			if(ret){
-				LOG(INFO)<<"File Close Success";
+			if(fileMap && TftpConfig::getInstance().packetCache){
+				packetImage = STARK::getInstance().getPacketImage(requestFileName, fileMap, blockSize);
 			}
-			else{
-				LOG(ERROR)<<"File Close Error";
+		}
+		LOG(DEBUG)<<"File Open Success";
+		state = TFTP_SESSION_SEND;
+		if(sendOACK){
+			// DATA 1 is sent once the client confirms the options with ACK 0
+			oackPending = true;
+			lastPacketLen = makeOACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, options);
+			rtt.startTiming(0, std::chrono::steady_clock::now());
+			if(!sendLastPacket()){
+				endTransfer(false);
+				return false;
 			}
-			closeSocket(clientSocketFD);
-			return;
+			return true;
 		}
-		else{
-			packetSize = 0;
+		return fillWindow();
+	}
+	else if(requestType == TFTP_OPCODE_WRQ){
+		LOG(INFO)<<"Write request process initiated";
+		fileFD = STARK::getInstance().openWritableFile(requestFileName, errorCode);
+		if(fileFD == -1){
 			if(errorCode == TFTP_ERROR_FILE_ALREADY_EXISTS){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_FILE_ALREADY_EXISTS, "file already exists in server");
+				sendError(TFTP_ERROR_FILE_ALREADY_EXISTS, "file already exists in server");
 				LOG(ERROR)<<"file already exists in server";
 			}
 			else if(errorCode == TFTP_ERROR_ACCESS_VIOLATION){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_ACCESS_VIOLATION, "file access denied in server");
+				sendError(TFTP_ERROR_ACCESS_VIOLATION, "file access denied in server");
 				LOG(ERROR)<<"file access denied in server";
 			}
 			else{
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "unknown error from server");
+				sendError(TFTP_ERROR_NOT_DEFINED, "unknown error from server");
 				LOG(ERROR)<<"unknown error from server";
 			}
-			sendBufferThroughUDP(sendBuffer, packetSize, curClient.defaultServerSocket, curClient.clientAddress);
-			closeSocket(clientSocketFD);
-			return;
+			endTransfer(false);
+			return false;
 		}
-	}
-	else if(curClient.requestType == TFTP_OPCODE_DEL){
-		int sendPacketSize;
-		LOG(INFO)<<"Delete request process initiated";
-		TftpErrorCode errorCode;
-		if(STARK::getInstance().isFileDeletable(curClient.requestFileName,errorCode)){
-			packetSize = makeACKPacket(sendBuffer,sizeof(sendBuffer),TFTP_VALID_DELETE_ACK);
-			sendPacketSize = sendBufferThroughUDP(sendBuffer, packetSize, curClient.defaultServerSocket, curClient.clientAddress);
-			if(sendPacketSize!=packetSize){
-				LOG(ERROR)<<"Delete valid ACK not sent completely";
-				closeSocket(clientSocketFD);
-				return;
+		LOG(INFO)<<"File Open Success";
+		bool sendOACK = negotiateOptions();
+		// An upload of a known size is refused before any data moves when it does not fit
+		if(options.hasTransferSize && !STARK::getInstance().reserveFileSpace(fileFD, options.transferSize, errorCode)){
+			sendError(TFTP_ERROR_DISK_FULL, "not enough space in server");
+			endTransfer(false);
+			return false;
+		}
+		int writeBehindKB = TftpConfig::getInstance().writeBehindKB;
+		if(writeBehindKB > 0){
+			writeBehind = WriteBehind::create((size_t)writeBehindKB << 10);
+			if(writeBehind && TftpConfig::getInstance().writeDirect){
+				writeBehind->enableDirectIO(fileFD);
 			}
-			LOG(INFO)<<"File: "<<curClient.requestFileName<<", deletion success";
-			closeSocket(clientSocketFD);
-			return;
+		}
+		state = TFTP_SESSION_RECEIVE;
+		// The OACK takes the place of ACK 0
+		if(sendOACK){
+			lastPacketLen = makeOACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, options);
 		}
 		else{
-			packetSize = 0;
-			if(errorCode == TFTP_ERROR_FILE_NOT_FOUND){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_FILE_NOT_FOUND, "file not found in server");
-				LOG(ERROR)<<"file not found in server";
-			}
-			else if(errorCode == TFTP_ERROR_ACCESS_VIOLATION){
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_ACCESS_VIOLATION, "file access denied in server");
-				LOG(ERROR)<<"file access denied in server";
-			}
-			else{
-				packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "unknown error from server, file not deleted");
-				LOG(ERROR)<<"unknown error from server, file not deleted";
-			}
-			sendPacketSize = sendBufferThroughUDP(sendBuffer, packetSize, clientSocketFD, curClient.clientAddress);
-			if(sendPacketSize!=packetSize){
-				LOG(ERROR)<<"Error packet not sent completely";	
-			}
-			closeSocket(clientSocketFD);
-			return;
+			lastPacketLen = makeACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, toWireBlockNum(blockNum, rollover));
 		}
+		rtt.startTiming(1, std::chrono::steady_clock::now());
+		if(!sendLastPacket()){
+			endTransfer(false);
+			return false;
+		}
+		return true;
 	}
-	else{
-		LOG(ERROR)<<"invalid opcode";
-		packetSize  = 0;
-		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NOT_DEFINED, "invalid opcode during internal processing");
-		sendBufferThroughUDP(sendBuffer, packetSize, clientSocketFD, curClient.clientAddress);
-		closeSocket(clientSocketFD);
-		return;
-	}
-	closeSocket(clientSocketFD);
-	return;
-}
-
-/**
- * @brief function to handle RRQ task for a specific TFTP client.
-*/
-bool handleSendData(ClientHandler curClient, std::ifstream& fd){
-	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
-	uint8_t dataBuffer[TFTP_MAX_DATA_SIZE];
-	if(fd.is_open()){
-		bool allDataSent = false;
-		int bytesRead = 0;
-		int sendPacketSize = 0;
-		int ret = 0;
-		bool ackStatus = false;
-		int inValidTries = 0;
-		int getNewPacket = true;
-		bool isErrorPktReceived = false;
-		while(!allDataSent){
-			if(inValidTries > TFTP_RECEIVE_TRIES){
-				LOG(ERROR)<<"lost connection";
-				return false;
-			}
-			ret = 0;
-			sendPacketSize = 0;
-			ackStatus = false;
-			isErrorPktReceived = false;
-			if(getNewPacket){
-				bytesRead = 0;
-				bytesRead = readData512(dataBuffer, sizeof(dataBuffer), fd);
-				if(bytesRead == -1){
-					LOG(ERROR)<<"file read error";
-					return false;
-				}
-				curClient.blockNum++;
-			}
-			sendPacketSize = makeDataPacket(sendBuffer, sizeof(sendBuffer), curClient.blockNum, dataBuffer, bytesRead);
-			if(sendPacketSize == -1){
-				LOG(ERROR)<<"unable to make data packet";
-				return false;
-			}
-			LOG(DEBUG)<<"Data packet generated successfully";
-			ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, curClient.clientSocket, curClient.clientAddress);
-			if(ret != sendPacketSize){
-				LOG(ERROR)<<"packet send error";
+	else if(requestType == TFTP_OPCODE_DEL){
+		LOG(INFO)<<"Delete request process initiated";
+		if(STARK::getInstance().isFileDeletable(requestFileName,errorCode)){
+			lastPacketLen = makeACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, TFTP_VALID_DELETE_ACK);
+			if(!sendPacket(lastPacket, lastPacketLen)){
+				LOG(ERROR)<<"Delete valid ACK not sent completely";
+				endTransfer(false);
 				return false;
 			}
-			LOG(DEBUG)<<"Data packet sent successfully";
-			ackStatus = getACK(curClient.clientSocket, curClient.clientAddress, curClient.blockNum, isErrorPktReceived);
-			if(ackStatus){
-				LOG(DEBUG)<<"Valid ACK received";
-				inValidTries = 0;
-				getNewPacket = true;
-				LOG(DEBUG)<<"Bytes read and sent: "<<bytesRead;
-				if(bytesRead < TFTP_MAX_DATA_SIZE){
-					LOG(DEBUG)<<"All data sent";
-					allDataSent = true;
-				}
-			}
-			else{
-				if(!isErrorPktReceived){
-					LOG(ERROR)<<"Invalid ack, soft continue";
-					getNewPacket = false;
-					inValidTries++;
-				}
-				else{
-					LOG(ERROR)<<"Error received from client. Terminating transfer";
-					return false;
-				}
-			}	
-		}
-		if(allDataSent){
-			LOG(INFO)<<"all data sent to client";
+			LOG(INFO)<<"File: "<<requestFileName<<", deletion success";
+			endTransfer(true);
 			return true;
 		}
+		if(errorCode == TFTP_ERROR_FILE_NOT_FOUND){
+			sendError(TFTP_ERROR_FILE_NOT_FOUND, "file not found in server");
+			LOG(ERROR)<<"file not found in server";
+		}
+		else if(errorCode == TFTP_ERROR_ACCESS_VIOLATION){
+			sendError(TFTP_ERROR_ACCESS_VIOLATION, "file access denied in server");
+			LOG(ERROR)<<"file access denied in server";
+		}
+		else{
+			sendError(TFTP_ERROR_NOT_DEFINED, "unknown error from server, file not deleted");
+			LOG(ERROR)<<"unknown error from server, file not deleted";
+		}
+		endTransfer(false);
 		return false;
 	}
-	else{
-		LOG(ERROR)<<"file open error";
-		return false;
-	}
+	LOG(ERROR)<<"invalid opcode";
+	sendError(TFTP_ERROR_NOT_DEFINED, "invalid opcode during internal processing");
+	endTransfer(false);
 	return false;
 }
 
 /**
- * @brief function to handle WRQ task for a specific TFTP client.
+ * @brief function drains all the datagrams queued in the transfer socket without blocking,
+ * reading up to a batch of them per recvmmsg call
 */
-bool handleReceiveData(ClientHandler curClient, std::ofstream& fd){
-	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
-	uint8_t recvData[TFTP_MAX_DATA_SIZE];
-	uint16_t recvBlockNum = 0;
-	
-	if(fd.is_open()){
-		bool allDataReceived = false;
-		int sendPacketSize = 0;
-		int ret = 0;
-		bool dataRecvStatus = false;
-		int recvDataLen = 0;
-		int inValidTries = 0;
-		bool isErrorPktReceived;
-		while(!allDataReceived){
-			sendPacketSize = 0;
-			ret = 0;
-			dataRecvStatus = false;
-			recvDataLen = 0;
-			isErrorPktReceived = false;
-
-			if(inValidTries > TFTP_RECEIVE_TRIES){
-				LOG(ERROR)<<"lost connection";
-				return false;
-			}
-			sendPacketSize = makeACKPacket(sendBuffer, sizeof(sendBuffer), curClient.blockNum);
-			if(sendPacketSize == -1){
-				LOG(ERROR)<<"unable to make data packet";
-				return false;
-			}
-			ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, curClient.clientSocket, curClient.clientAddress);
-			if(ret != sendPacketSize){
-				LOG(ERROR)<<"packet send error";
-				return false;
+void ClientHandler::handleReadable(UDPRecvBatch& recvBatch){
+	if(zeroCopy){
+		// Completions of MSG_ZEROCOPY sends keep the socket readable until they are read
+		drainZeroCopyCompletions(clientSocket);
+	}
+	while(!isDone()){
+		int numReceived = recvBatch.receive(clientSocket, MSG_DONTWAIT);
+		if(numReceived == -1){
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+				handleReceiveError(errno);
 			}
-			LOG(DEBUG)<<"ACK "<<curClient.blockNum<<" sent to client";
-	
-			dataRecvStatus = getData(curClient.clientSocket,curClient.clientAddress, curClient.blockNum+1, recvData, sizeof(recvData), recvDataLen, isErrorPktReceived);
+			return;
+		}
+		for(int i = 0; i < numReceived && !isDone(); ++i){
+			handlePacket(recvBatch.getPacket(i), recvBatch.getPacketLen(i), recvBatch.getAddress(i), recvBatch.getReceiveAgeUs(i));
+		}
+		if(numReceived < recvBatch.getBatchSize()){
+			return;
+		}
+	}
+	return;
+}
 
-			if(dataRecvStatus){
-				ret = writeData512(recvData, recvDataLen, fd);
-				if(ret < 0){
-					LOG(ERROR)<<"file write error";
-					return false;
-				}
-				curClient.blockNum++;
-				inValidTries = 0;
-				LOG(DEBUG)<< "receive data len: "<<recvDataLen<<" max:"<< TFTP_MAX_DATA_SIZE;
-				if(recvDataLen < TFTP_MAX_DATA_SIZE){
-					allDataReceived = true;
-				}
+/**
+ * @brief function processes one datagram received on the transfer socket
+*/
+void ClientHandler::handlePacket(uint8_t* packet, int packetLen, struct sockaddr_in& recvAddress, int64_t recvAgeUs){
+	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+	int packetSize = 0;
+	if(isDone()){
+		return;
+	}
+	bool fromClient = (recvAddress.sin_addr.s_addr == clientAddress.sin_addr.s_addr && recvAddress.sin_port == clientAddress.sin_port);
+	if(multicastGroup && !fromClient && MulticastRegistry::getInstance().isMember(multicastGroup, recvAddress)){
+		// A member only ACKs the final block before its turn as master, it has the whole file. Or it gave up with an ERROR.
+		LOG(INFO)<<"Client "<<inet_ntoa(recvAddress.sin_addr)<<":"<<ntohs(recvAddress.sin_port)<<" left multicast group of "<<requestFileName;
+		MulticastRegistry::getInstance().leave(multicastGroup, recvAddress);
+		return;
+	}
+	// A connected transfer socket only receives the datagrams of the client TID
+	if(!connected && recvAddress.sin_addr.s_addr != clientAddress.sin_addr.s_addr){
+		LOG(ERROR)<<"packet from unknown host";
+		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_NO_SUCH_USER, "you are a unknow user");
+		sendBufferThroughUDP(sendBuffer, packetSize, clientSocket, recvAddress);
+		return;
+	}
+	if(!connected && recvAddress.sin_port != clientAddress.sin_port){
+		LOG(ERROR)<<"invalid TID";
+		packetSize = makeErrorPacket(sendBuffer,sizeof(sendBuffer), TFTP_ERROR_UNKNOWN_TID, "you are a unknow user");
+		sendBufferThroughUDP(sendBuffer, packetSize, clientSocket, recvAddress);
+		return;
+	}
+
+	uint16_t opcode;
+	uint16_t recvBlockNum;
+	if(!parsePacketHeader(packet, packetLen, opcode, recvBlockNum)){
+		LOG(ERROR)<<"invalid packet expected 4 bytes or greater";
+		return;
+	}
+	if(opcode == TFTP_OPCODE_ERROR){
+		char errMsg[TFTP_MAX_PACKET_SIZE];
+		memset(errMsg, 0, sizeof(errMsg));
+		memcpy(errMsg, packet + TFTP_MAX_HEADER_SIZE, std::min((size_t)(packetLen - TFTP_MAX_HEADER_SIZE), sizeof(errMsg) - 1));
+		LOG(ERROR)<<"Received Error from client error code:"<<recvBlockNum<<", error message:"<<errMsg;
+		if(multicastGroup && state == TFTP_SESSION_SEND){
+			// The master gave up, the members still receive the group
+			nextMaster(false);
+			return;
+		}
+		LOG(ERROR)<<"Error received from client. Terminating transfer";
+		// A dallying upload has already been stored completely
+		endTransfer(state == TFTP_SESSION_DALLY);
+		return;
+	}
+	if(state == TFTP_SESSION_DALLY){
+		if(opcode == TFTP_OPCODE_DATA && recvBlockNum == toWireBlockNum(blockNum, rollover)){
+			// The final ACK was lost, the dally deadline is not extended
+			LOG(DEBUG)<<"Final data block "<<recvBlockNum<<" retransmitted, resending ACK";
+			sendPacket(lastPacket, lastPacketLen);
+		}
+		return;
+	}
+	// The RTT samples end when the kernel received the packet, not when it was read
+	auto recvTime = std::chrono::steady_clock::now() - std::chrono::microseconds(recvAgeUs);
+	if(state == TFTP_SESSION_SEND && opcode == TFTP_OPCODE_ACK && multicastGroup){
+		handleMasterACK(recvBlockNum, recvTime);
+	}
+	else if(state == TFTP_SESSION_SEND && opcode == TFTP_OPCODE_ACK){
+		handleACKPacket(recvBlockNum, recvTime);
+	}
+	else if(state == TFTP_SESSION_SEND && opcode == TFTP_OPCODE_NAK && options.nak){
+		handleNAKPacket(recvBlockNum, packet + TFTP_MAX_HEADER_SIZE, packetLen - TFTP_MAX_HEADER_SIZE, recvTime);
+	}
+	else if(state == TFTP_SESSION_RECEIVE && opcode == TFTP_OPCODE_DATA){
+		handleDataPacket(recvBlockNum, packet + TFTP_MAX_HEADER_SIZE, packetLen - TFTP_MAX_HEADER_SIZE, recvTime);
+	}
+	else{
+		LOG(ERROR)<<"invalid opcode "<<opcode<<" in session state "<<(int)state;
+	}
+	return;
+}
+
+/**
+ * @brief function handles an ACK of a RRQ session and sends the next DATA blocks of the window.
+ * An ACK short of the last block sent reports a gap, the blocks after it are sent again (RFC 7440). With nak
+ * gaps are reported by NAKs and such an ACK is a cumulative one.
+*/
+void ClientHandler::handleACKPacket(uint16_t recvBlockNum, std::chrono::steady_clock::time_point recvTime){
+	if(oackPending && recvBlockNum == 0){
+		LOG(DEBUG)<<"Options acknowledged, blksize "<<blockSize<<", windowsize "<<windowSize;
+		oackPending = false;
+		timeoutCount = 0;
+		rtt.stopTiming(recvTime);
+		fillWindow();
+		return;
+	}
+	uint64_t newlyAcked = wireBlockDistance(ackedBlockNum, recvBlockNum, rollover);
+	uint64_t inFlight = blockNum - ackedBlockNum;
+	// Blocks sent before the window was rewound may be ACKed before they are sent again
+	uint64_t sentAhead = (sentEndOffset > fileOffset) ? (sentEndOffset - fileOffset + blockSize - 1) / blockSize : 0;
+	if(newlyAcked > inFlight + sentAhead || (newlyAcked == 0 && windowSize == 1)){
+		// Duplicate ACKs are not answered to avoid the Sorcerer's Apprentice problem
+		LOG(DEBUG)<<"invalid block number"<<", received:"<<recvBlockNum<<", expected:"<<blockNum;
+		return;
+	}
+	if(newlyAcked == 0){
+		// The block after the last ACK was lost. The receiver sends one duplicate per window of blocks out of order,
+		// so each of them is answered with the window.
+		if(inFlight == 0){
+			return;
+		}
+		LOG(DEBUG)<<"Duplicate ACK "<<recvBlockNum<<", resending window";
+		cwnd.onLoss(ackedOffset, sentEndOffset);
+		rewindWindow();
+		fillWindow();
+		return;
+	}
+	LOG(DEBUG)<<"Valid ACK received";
+	if(rtt.isTiming() && rtt.getTimedMark() > ackedBlockNum && rtt.getTimedMark() <= ackedBlockNum + newlyAcked){
+		rtt.stopTiming(recvTime);
+	}
+	uint64_t lastAckedOffset = std::min(ackedOffset + (newlyAcked - 1) * blockSize, fileSize);
+	ackedBlockNum += newlyAcked;
+	ackedOffset = std::min(ackedOffset + newlyAcked * blockSize, fileSize);
+	if(ackedBlockNum > blockNum){
+		// The window goes on after the blocks ACKed
+		LOG(DEBUG)<<"ACK "<<recvBlockNum<<" past the rewound window, going on from block "<<ackedBlockNum + 1;
+		blockNum = ackedBlockNum;
+		fileOffset = ackedOffset;
+		lastDataOffset = lastAckedOffset;
+		lastDataLen = (int)(ackedOffset - lastAckedOffset);
+	}
+	timeoutCount = 0;
+	cwnd.onAck((int)newlyAcked, ackedOffset);
+	if(ackedBlockNum == blockNum && lastDataLen < blockSize){
+		LOG(INFO)<<"all data sent to client";
+		endTransfer(true);
+		return;
+	}
+	// With nak a gap is reported by a NAK, an ACK of part of the blocks in flight only slides the window
+	if(ackedBlockNum != blockNum && !options.nak){
+		LOG(DEBUG)<<"Gap after block "<<ackedBlockNum<<", resending from block "<<ackedBlockNum + 1;
+		cwnd.onLoss(ackedOffset, sentEndOffset);
+		rewindWindow();
+	}
+	fillWindow();
+	return;
+}
+
+/**
+ * @brief function handles an ACK of the master of a multicast RRQ. The ACK tells the first block the master is missing,
+ * the DATA sent to the group go on from there: blocks ahead of the window are skipped, blocks behind it are sent again.
+ * The first ACK after an OACK places a new master, which may be anywhere in the file.
+*/
+void ClientHandler::handleMasterACK(uint16_t recvBlockNum, std::chrono::steady_clock::time_point recvTime){
+	// The final block is shorter than blksize, possibly empty
+	uint64_t numBlocks = fileSize / blockSize + 1;
+	// Block of the file nearest to the last ACK with this number
+	int64_t acked = (int64_t)ackedBlockNum + (int64_t)wireBlockDistance(ackedBlockNum, recvBlockNum, rollover);
+	if(acked - (int64_t)ackedBlockNum > TFTP_BLOCK_NUM_PERIOD(rollover) / 2){
+		acked -= TFTP_BLOCK_NUM_PERIOD(rollover);
+	}
+	if(acked < 0 || acked > (int64_t)numBlocks){
+		LOG(DEBUG)<<"ACK "<<recvBlockNum<<" outside of the file";
+		return;
+	}
+	uint64_t newlyAcked = (uint64_t)acked - ackedBlockNum;
+	uint64_t inFlight = blockNum - ackedBlockNum;
+	bool inWindow = (!oackPending && acked >= (int64_t)ackedBlockNum && newlyAcked <= inFlight);
+	if(oackPending){
+		LOG(DEBUG)<<"Master placed after block "<<acked<<", blksize "<<blockSize<<", windowsize "<<windowSize;
+		oackPending = false;
+		rtt.stopTiming(recvTime);
+	}
+	else if(inWindow && newlyAcked == 0 && (windowSize == 1 || inFlight == 0)){
+		// Duplicate ACKs are not answered to avoid the Sorcerer's Apprentice problem
+		LOG(DEBUG)<<"Duplicate ACK "<<recvBlockNum;
+		return;
+	}
+	else if(inWindow && newlyAcked > 0){
+		if(rtt.isTiming() && rtt.getTimedMark() > ackedBlockNum && rtt.getTimedMark() <= (uint64_t)acked){
+			rtt.stopTiming(recvTime);
+		}
+		cwnd.onAck((int)newlyAcked, (uint64_t)acked * blockSize);
+	}
+	ackedBlockNum = (uint64_t)acked;
+	ackedOffset = (uint64_t)acked * blockSize;
+	timeoutCount = 0;
+	if((uint64_t)acked == numBlocks){
+		nextMaster(true);
+		return;
+	}
+	if(!inWindow || ackedBlockNum != blockNum){
+		if(inWindow){
+			cwnd.onLoss(ackedOffset, sentEndOffset);
+		}
+		rewindWindow();
+	}
+	fillWindow();
+	return;
+}
+
+/**
+ * @brief function hands the multicast group over to the member that joined first, once the master has the whole file or is lost.
+ * The OACK makes the member master, its first ACK tells where it is missing blocks. Without members the transfer ends.
+*/
+void ClientHandler::nextMaster(bool masterDone){
+	if(!MulticastRegistry::getInstance().nextMaster(multicastGroup, clientAddress)){
+		LOG(INFO)<<"all data sent to the multicast group";
+		endTransfer(masterDone);
+		return;
+	}
+	LOG(INFO)<<"Client "<<inet_ntoa(clientAddress.sin_addr)<<":"<<ntohs(clientAddress.sin_port)<<" is the master of the multicast group of "<<requestFileName;
+	TftpOptions masterOptions;
+	memset(&masterOptions, 0, sizeof(masterOptions));
+	masterOptions.multicast = true;
+	masterOptions.multicastAddress = multicastGroup->address;
+	masterOptions.multicastMaster = true;
+	oackPending = true;
+	timeoutCount = 0;
+	lastPacketLen = makeOACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, masterOptions);
+	rtt.startTiming(0, std::chrono::steady_clock::now());
+	if(!sendLastPacket()){
+		endTransfer(false);
+	}
+	return;
+}
+
+/**
+ * @brief function handles a NAK of a RRQ session with the nak option. The NAK acknowledges the blocks up to
+ * recvBlockNum like an ACK, only the blocks its bitmap reports missing are sent again.
+*/
+void ClientHandler::handleNAKPacket(uint16_t recvBlockNum, const uint8_t* bitmap, int bitmapLen, std::chrono::steady_clock::time_point recvTime){
+	uint64_t newlyAcked = wireBlockDistance(ackedBlockNum, recvBlockNum, rollover);
+	uint64_t inFlight = blockNum - ackedBlockNum;
+	if(oackPending || newlyAcked > inFlight){
+		LOG(DEBUG)<<"NAK "<<recvBlockNum<<" outside of the window";
+		return;
+	}
+	if(newlyAcked > 0){
+		if(rtt.isTiming() && rtt.getTimedMark() > ackedBlockNum && rtt.getTimedMark() <= ackedBlockNum + newlyAcked){
+			rtt.stopTiming(recvTime);
+		}
+		ackedBlockNum += newlyAcked;
+		ackedOffset = std::min(ackedOffset + newlyAcked * blockSize, fileSize);
+		timeoutCount = 0;
+		cwnd.onAck((int)newlyAcked, ackedOffset);
+		inFlight -= newlyAcked;
+	}
+	int numMissing = 0;
+	for(int i = 0; i < bitmapLen * 8 && (uint64_t)i < inFlight; ++i){
+		if((bitmap[i / 8] & (0x80 >> (i % 8))) == 0){
+			continue;
+		}
+		uint64_t missing = ackedBlockNum + 1 + i;
+		if(std::find(nakBlocks.begin(), nakBlocks.end(), missing) == nakBlocks.end()){
+			nakBlocks.push_back(missing);
+		}
+		numMissing++;
+	}
+	if(numMissing > 0){
+		LOG(DEBUG)<<"NAK "<<recvBlockNum<<", resending "<<numMissing<<" missing blocks";
+		cwnd.onLoss(ackedOffset, sentEndOffset);
+		// A resent block may be the timed one (Karn)
+		rtt.cancelTiming();
+	}
+	fillWindow();
+	return;
+}
+
+/**
+ * @brief function handles a DATA packet of a WRQ session. Inside a window only the last block of the window
+ * and the final block are acknowledged, a block out of order is answered with the ACK of the last block in order.
+*/
+void ClientHandler::handleDataPacket(uint16_t recvBlockNum, uint8_t* data, int dataLen, std::chrono::steady_clock::time_point recvTime){
+	if(ioPending){
+		LOG(DEBUG)<<"previous block still being written, data block "<<recvBlockNum<<" ignored";
+		return;
+	}
+	if(dataLen > blockSize){
+		LOG(ERROR)<<"data block "<<recvBlockNum<<" of "<<dataLen<<" bytes exceeds blksize "<<blockSize;
+		return;
+	}
+	if(recvBlockNum == toWireBlockNum(blockNum + 1, rollover)){
+		blockNum++;
+		lastDataLen = dataLen;
+		timeoutCount = 0;
+		outOfOrder = 0;
+		LOG(DEBUG)<< "receive data len: "<<dataLen<<" max:"<< blockSize;
+		if(rtt.isTiming() && rtt.getTimedMark() == blockNum){
+			rtt.stopTiming(recvTime);
+		}
+		ackDue = (dataLen < blockSize || blockNum - ackedBlockNum >= (uint64_t)windowSize);
+		if(ackDue){
+			// The RTT runs from this ACK to the first block of the next window
+			ackedBlockNum = blockNum;
+			rtt.startTiming(blockNum + 1, std::chrono::steady_clock::now());
+		}
+		lastPacketLen = makeACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, toWireBlockNum(blockNum, rollover));
+		if(ackDue){
+			armDeadline();
+		}
+		else{
+			deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(rtt.getAckDelayMs());
+		}
+		uint64_t offset = fileOffset;
+		fileOffset += dataLen;
+		// The ACK is sent only after the block is written, or queued in the write-behind buffer
+		if(!io->writeAndSend(this, data, dataLen, offset, dataLen < blockSize)){
+			LOG(ERROR)<<"file write error";
+			sendError(TFTP_ERROR_NOT_DEFINED, "error connection terminating");
+			endTransfer(false);
+			return;
+		}
+		if(dataLen < blockSize){
+			if(ioPending){
+				finalBlockPending = true;
 			}
 			else{
-				if(!isErrorPktReceived){
-					inValidTries++;
-					LOG(ERROR)<<"Invalid data, soft continue";
-				}
-				else{
-					LOG(ERROR)<<"Error received from client. Terminating transfer";
-					return false;
-				}
+				LOG(INFO)<<"All data received";
+				enterDally();
 			}
 		}
-		if(allDataReceived){
-			sendPacketSize = 0;
-			sendPacketSize = makeACKPacket(sendBuffer, sizeof(sendBuffer), curClient.blockNum);
-			if(sendPacketSize == -1){
-				LOG(ERROR)<<"unable to make data packet";
-				return false;
-			}
-			ret = sendBufferThroughUDP(sendBuffer, sendPacketSize, curClient.clientSocket, curClient.clientAddress);
-			if(ret != sendPacketSize){
-				LOG(ERROR)<<"packet send error";
-				return false;
-			}
-			std::chrono::seconds duration(2);
-    		std::this_thread::sleep_for(duration);
-			LOG(DEBUG)<<"Sending file block ACK";
-			return true;
+	}
+	else if(recvBlockNum == toWireBlockNum(blockNum, rollover) || windowSize > 1){
+		// Our previous ACK was lost and the client retransmitted the block, or a block of the window was lost.
+		// The ACK is resent once per window of such blocks.
+		if(outOfOrder++ % windowSize != 0){
+			return;
+		}
+		LOG(DEBUG)<<"Data block "<<recvBlockNum<<" out of order, resending ACK "<<blockNum;
+		ackedBlockNum = blockNum;
+		ackDue = true;
+		rtt.cancelTiming();
+		lastPacketLen = makeACKPacket(lastPacket, TFTP_MAX_PACKET_SIZE, toWireBlockNum(blockNum, rollover));
+		sendLastPacket();
+	}
+	else{
+		LOG(ERROR)<<"invalid block number"<<", received:"<<recvBlockNum<<", expected:"<<toWireBlockNum(blockNum + 1, rollover);
+	}
+	return;
+}
+
+/**
+ * @brief function retransmits the last packet when its deadline expires
+*/
+void ClientHandler::handleTimeout(){
+	if(isDone()){
+		return;
+	}
+	if(state == TFTP_SESSION_DALLY){
+		LOG(DEBUG)<<"Dally of "<<requestFileName<<" ended";
+		endTransfer(true);
+		return;
+	}
+	if(ioPending){
+		// Retransmission waits for the outstanding file I/O
+		armDeadline();
+		return;
+	}
+	if(state == TFTP_SESSION_RECEIVE && !ackDue){
+		// The client stopped inside a window, held back by its congestion window or by a loss.
+		// The ACK of the last block in order tells it where to resume.
+		LOG(DEBUG)<<"Window stalled after block "<<blockNum<<", sending its ACK";
+		ackedBlockNum = blockNum;
+		ackDue = true;
+		rtt.startTiming(blockNum + 1, std::chrono::steady_clock::now());
+		if(!sendLastPacket()){
+			endTransfer(false);
+		}
+		return;
+	}
+	int inFlight = (int)(blockNum - ackedBlockNum);
+	if(state == TFTP_SESSION_SEND && !oackPending && inFlight == cwnd.getWindow() && inFlight < windowSize && lastDataLen == blockSize){
+		// The client may only ACK whole windows, the rest of the window is sent until the next loss or timeout
+		LOG(INFO)<<"Window of "<<inFlight<<" blocks not ACKed, sending whole windows of "<<windowSize;
+		cwnd.onStall();
+		rtt.cancelTiming();
+		if(!fillWindow()){
+			endTransfer(false);
+		}
+		return;
+	}
+	// Below the largest RTO a timeout only backs the timer off, the session gives up after
+	// TFTP_RECEIVE_TRIES timeouts of the largest one
+	rtt.cancelTiming();
+	if(timeoutSec > 0 || !rtt.backoff()){
+		timeoutCount++;
+	}
+	if(timeoutCount > TFTP_RECEIVE_TRIES){
+		LOG(ERROR)<<"lost connection";
+		sendError(TFTP_ERROR_NOT_DEFINED, "error connection terminating");
+		if(multicastGroup){
+			// The members still receive the group
+			nextMaster(false);
+			return;
+		}
+		endTransfer(false);
+		return;
+	}
+	LOG(ERROR)<<"timout occured count: "<<timeoutCount<<", retransmitting block "<<blockNum<<", next timeout "<<(timeoutSec > 0 ? timeoutSec * 1000 : rtt.getTimeoutMs())<<" ms";
+	if(state == TFTP_SESSION_SEND && windowSize > 1 && !oackPending){
+		// The whole window after the last ACK is sent again
+		cwnd.onTimeout(sentEndOffset);
+		rewindWindow();
+		fillWindow();
+		return;
+	}
+	if(!sendLastPacket()){
+		endTransfer(false);
+	}
+	return;
+}
+
+/**
+ * @brief function handles a receive error of the transfer socket. On a connected socket
+ * ECONNREFUSED reports an ICMP port unreachable: the client is gone and the session ends.
+*/
+void ClientHandler::handleReceiveError(int error){
+	if(error != ECONNREFUSED || !connected){
+		LOG(ERROR)<<"Error receiving data "<<strerror(error);
+		return;
+	}
+	if(isDone()){
+		return;
+	}
+	if(state == TFTP_SESSION_DALLY){
+		LOG(DEBUG)<<"Client of "<<requestFileName<<" closed its port, dally ended";
+		endTransfer(true);
+		return;
+	}
+	LOG(ERROR)<<"Client port unreachable, terminating transfer";
+	endTransfer(false);
+	return;
+}
+
+/**
+ * @brief function receives the result of an asynchronous readAndSend/writeAndSend
+*/
+void ClientHandler::handleIOComplete(bool success){
+	ioPending = false;
+	if(isDone()){
+		return;
+	}
+	if(!success){
+		LOG(ERROR)<<"file I/O error";
+		sendError(TFTP_ERROR_NOT_DEFINED, "error connection terminating");
+		endTransfer(false);
+		return;
+	}
+	if(finalBlockPending){
+		finalBlockPending = false;
+		LOG(INFO)<<"All data received";
+		enterDally();
+	}
+	else if(state == TFTP_SESSION_SEND){
+		fillWindow();
+	}
+	return;
+}
+
+/**
+ * @brief function releases the file held by the session. Transfer socket is owned by the caller
+*/
+void ClientHandler::finishTransfer(){
+	if(!isDone()){
+		endTransfer(state == TFTP_SESSION_DALLY);
+	}
+	releaseFile();
+	if(zeroCopy){
+		setSocketZeroCopy(clientSocket, false);
+		zeroCopy = false;
+	}
+	return;
+}
+
+/**
+ * @brief function closes the file of a completed upload and keeps only the transfer socket
+ * open to answer a retransmitted final DATA until the dally deadline
+*/
+void ClientHandler::enterDally(){
+	transferSuccess = true;
+	releaseFile();
+	int dallyMs = TftpConfig::getInstance().dallyMs;
+	if(dallyMs == 0){
+		endTransfer(true);
+		return;
+	}
+	state = TFTP_SESSION_DALLY;
+	timeoutCount = 0;
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(dallyMs);
+	return;
+}
+
+/**
+ * @brief function moves the upload into place once its final block is written, onDurable is called once with the
+ * result. With group commits that happens on the commit thread, after the sync of the upload.
+*/
+bool ClientHandler::commitUpload(std::function<void(bool)> onDurable){
+	if(fileFD == -1){
+		onDurable(false);
+		return false;
+	}
+	bool ret = STARK::getInstance().commitWritableFile(requestFileName, fileFD, onDurable);
+	fileFD = -1;
+	if(ret){
+		LOG(INFO)<<"Upload of "<<requestFileName<<" complete, moving it into place";
+	}
+	return ret;
+}
+
+void ClientHandler::releaseFile(){
+	bool ret;
+	writeBehind.reset();
+	if(fileFD != -1){
+		if(requestType == TFTP_OPCODE_RRQ){
+			ret = STARK::getInstance().closeReadableFile(requestFileName, fileFD);
 		}
 		else{
-			LOG(ERROR)<<"Unexpected error";
-			return false;
+			ret = STARK::getInstance().closeWritableFile(requestFileName, fileFD);
+		}
+		fileFD = -1;
+		if(ret){
+			LOG(INFO)<<"File Close Success";
 		}
+		else{
+			LOG(ERROR)<<"File Close Error";
+		}
+	}
+	return;
+}
+
+bool ClientHandler::isDone(){
+	return state == TFTP_SESSION_DONE;
+}
+
+bool ClientHandler::isDallying(){
+	return state == TFTP_SESSION_DALLY;
+}
+
+/**
+ * @brief function returns the milliseconds left until the retransmission deadline
+*/
+int ClientHandler::getTimeoutMs(){
+	// Rounded up, so that the deadline has passed when the wait ends
+	auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+	if(remaining.count() < 0){
+		return 0;
+	}
+	return (int)remaining.count();
+}
+
+/**
+ * @brief function returns the pre-built DATA packet holding dataLen bytes at offset, it must match the header of lastPacket
+*/
+const uint8_t* ClientHandler::getImagePacket(uint64_t offset, int dataLen){
+	if(!packetImage){
+		return NULL;
+	}
+	int packetLen = 0;
+	const uint8_t* packet = packetImage->getPacket(offset / packetImage->getBlockSize(), packetLen);
+	if(packet == NULL || offset % packetImage->getBlockSize() != 0 || packetLen != TFTP_MAX_HEADER_SIZE + dataLen ||
+		memcmp(packet, lastPacket, TFTP_MAX_HEADER_SIZE) != 0){
+		return NULL;
+	}
+	return packet;
+}
+
+struct sockaddr_in* ClientHandler::getDataAddress(){
+	if(multicastGroup){
+		return &multicastGroup->address;
+	}
+	return connected ? NULL : &clientAddress;
+}
+
+bool ClientHandler::sendPacket(uint8_t* packet, int packetLen){
+	if(!io->sendPacket(this, packet, packetLen)){
+		LOG(ERROR)<<"packet send error";
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function (re)sends the last DATA/ACK packet and arms the retransmission deadline
+*/
+bool ClientHandler::sendLastPacket(){
+	armDeadline();
+	if(state == TFTP_SESSION_SEND && (fileMap || multicastGroup) && !oackPending){
+		// lastPacket holds only the header, the payload is sent again from the mapping. DATA of a multicast RRQ go to the group.
+		return io->readAndSend(this, lastDataOffset, lastDataLen);
+	}
+	return sendPacket(lastPacket, lastPacketLen);
+}
+
+/**
+ * @brief function arms the retransmission deadline with the negotiated timeout, or the RTO of the session
+*/
+void ClientHandler::armDeadline(){
+	if(timeoutSec > 0){
+		deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeoutSec);
 	}
 	else{
-		LOG(ERROR)<<"file open error";
+		deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(rtt.getTimeoutMs());
+	}
+	return;
+}
+
+void ClientHandler::sendError(TftpErrorCode errorCode, const char* msgError){
+	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+	int packetSize = makeErrorPacket(sendBuffer, sizeof(sendBuffer), errorCode, msgError);
+	if(packetSize > 0){
+		sendPacket(sendBuffer, packetSize);
+	}
+	return;
+}
+
+/**
+ * @brief function sends the next block of the file as a DATA packet
+*/
+bool ClientHandler::sendNextData(){
+	readAhead();
+	uint64_t remaining = (fileSize > fileOffset) ? fileSize - fileOffset : 0;
+	int dataLen = (int)std::min(remaining, (uint64_t)blockSize);
+	blockNum++;
+	lastDataLen = dataLen;
+	// Only the header is built here, the SessionIO reads the payload right behind it
+	if(makeDataHeader(lastPacket, TFTP_MAX_PACKET_SIZE, toWireBlockNum(blockNum, rollover)) == -1){
+		LOG(ERROR)<<"unable to make data packet";
+		endTransfer(false);
 		return false;
 	}
-	return false;
+	lastPacketLen = TFTP_MAX_HEADER_SIZE + dataLen;
+	armDeadline();
+	uint64_t offset = fileOffset;
+	lastDataOffset = offset;
+	if(dataLen > 0 && offset >= sentEndOffset){
+		// First transmission of the block
+		rtt.startTiming(blockNum, std::chrono::steady_clock::now());
+		sentEndOffset = offset + dataLen;
+	}
+	fileOffset += dataLen;
+	if(!io->readAndSend(this, offset, dataLen)){
+		LOG(ERROR)<<"file read error";
+		sendError(TFTP_ERROR_NOT_DEFINED, "error connection terminating");
+		endTransfer(false);
+		return false;
+	}
+	LOG(DEBUG)<<"Data packet "<<blockNum<<" sent";
+	return true;
+}
+
+/**
+ * @brief function sends a block already sent again, after a NAK reported it missing. Blocks ACKed in the
+ * meantime are skipped. The block of the last new DATA, blockNum, is left as it is.
+*/
+bool ClientHandler::resendData(uint64_t dataBlockNum){
+	if(dataBlockNum <= ackedBlockNum || dataBlockNum > blockNum){
+		return true;
+	}
+	uint64_t offset = ackedOffset + (dataBlockNum - ackedBlockNum - 1) * blockSize;
+	int dataLen = (int)std::min(fileSize - std::min(offset, fileSize), (uint64_t)blockSize);
+	if(makeDataHeader(lastPacket, TFTP_MAX_PACKET_SIZE, toWireBlockNum(dataBlockNum, rollover)) == -1){
+		LOG(ERROR)<<"unable to make data packet";
+		endTransfer(false);
+		return false;
+	}
+	lastPacketLen = TFTP_MAX_HEADER_SIZE + dataLen;
+	armDeadline();
+	blocksResent++;
+	if(!io->readAndSend(this, offset, dataLen)){
+		LOG(ERROR)<<"file read error";
+		sendError(TFTP_ERROR_NOT_DEFINED, "error connection terminating");
+		endTransfer(false);
+		return false;
+	}
+	LOG(DEBUG)<<"Data packet "<<dataBlockNum<<" resent";
+	return true;
+}
+
+/**
+ * @brief function sends the blocks reported missing by a NAK, then DATA blocks until the congestion window, at most windowSize blocks,
+ * waits for their ACK or the final block is sent.
+ * An asynchronous SessionIO sends them one at a time, the window is filled again from handleIOComplete().
+*/
+bool ClientHandler::fillWindow(){
+	while(!isDone() && !ioPending && !nakBlocks.empty()){
+		uint64_t missing = nakBlocks.front();
+		nakBlocks.pop_front();
+		if(!resendData(missing)){
+			return false;
+		}
+	}
+	int sendWindow = std::min(windowSize, cwnd.getWindow());
+	while(!isDone() && !ioPending && blockNum - ackedBlockNum < (uint64_t)sendWindow){
+		if(blockNum != ackedBlockNum && lastDataLen < blockSize){
+			break;
+		}
+		if(!sendNextData()){
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief function goes back to the block following the last ACK, the next fillWindow() sends the window again
+*/
+void ClientHandler::rewindWindow(){
+	// The timed block may be sent again (Karn)
+	rtt.cancelTiming();
+	nakBlocks.clear();
+	blockNum = ackedBlockNum;
+	fileOffset = ackedOffset;
+	return;
+}
+
+/**
+ * @brief function keeps the file range of the next read-ahead window requested from the kernel. The range is
+ * extended by at least half a window at a time, so the reads stay large and sequential and the blocks are in
+ * the page cache before they are sent.
+*/
+void ClientHandler::readAhead(){
+	uint64_t window = (uint64_t)TftpConfig::getInstance().readAheadKB << 10;
+	if(window == 0 || readAheadOffset >= fileSize || (fileMap && fileMap->isResident())){
+		return;
+	}
+	uint64_t target = std::min(fileOffset + window, fileSize);
+	if(target < readAheadOffset + window / 2 && target < fileSize){
+		return;
+	}
+	io->readAhead(this, readAheadOffset, target - readAheadOffset);
+	readAheadOffset = target;
+	return;
+}
+
+/**
+ * @brief function settles the options of the request and returns true when they are acknowledged with an OACK.
+ * A blksize above the limit of the SessionIO is lowered to it as per RFC 2348, a windowsize to --max-windowsize.
+ * The timeout is used as requested and the tsize of a RRQ is answered with the file size (RFC 2349).
+ * The offset of a RRQ, with its optional length, limits the transfer to that range of the file. Such a RRQ is never multicast.
+*/
+bool ClientHandler::negotiateOptions(){
+	bool acknowledged = false;
+	if(options.blockSize > 0){
+		blockSize = std::min(options.blockSize, io->getMaxBlockSize());
+		options.blockSize = blockSize;
+		acknowledged = true;
+	}
+	if(options.windowSize > 0){
+		windowSize = std::min(options.windowSize, TftpConfig::getInstance().maxWindowSize);
+		options.windowSize = windowSize;
+		cwnd.init(windowSize);
+		acknowledged = true;
+		if(requestType == TFTP_OPCODE_WRQ && windowSize > 1){
+			// Room for the window being received and the next one
+			growSocketReceiveBuffer(clientSocket, 2 * windowSize * TFTP_BLOCK_PACKET_SIZE(blockSize));
+		}
+	}
+	if(options.timeout > 0){
+		timeoutSec = options.timeout;
+		acknowledged = true;
+	}
+	if(options.nak){
+		// Missing blocks are only reported by the client of a windowed RRQ
+		options.nak = (requestType == TFTP_OPCODE_RRQ && windowSize > 1);
+		acknowledged = acknowledged || options.nak;
+	}
+	if(options.hasRollover){
+		// Block numbers of the transfer follow 65535 with the rollover of the client
+		rollover = options.rollover;
+		acknowledged = true;
+	}
+	if(options.multicast){
+		// One copy of the file is sent to a group, the client is its first master (RFC 2090)
+		if(requestType == TFTP_OPCODE_RRQ && !connected && io->sendsToGroup() && !options.hasOffset){
+			multicastGroup = MulticastRegistry::getInstance().create(requestFileName, clientSocket, clientAddress, options, fileSize);
+		}
+		options.multicast = (multicastGroup != NULL);
+		if(multicastGroup){
+			options.multicastAddress = multicastGroup->address;
+			options.multicastMaster = true;
+			// The master reports the gaps of every member with its ACKs
+			options.nak = false;
+		}
+		acknowledged = acknowledged || options.multicast;
+	}
+	if(options.hasTransferSize){
+		// A RRQ asks for the file size, a WRQ announces the upload size
+		if(requestType == TFTP_OPCODE_RRQ){
+			options.transferSize = fileSize;
+		}
+		acknowledged = true;
+	}
+	if(options.hasOffset && requestType == TFTP_OPCODE_RRQ){
+		// The blocks are numbered from 1 again and hold the file from the offset, up to the length when it is given
+		uint64_t rangeLength = fileSize - options.offset;
+		if(options.hasLength){
+			rangeLength = std::min(options.length, rangeLength);
+		}
+		fileOffset = options.offset;
+		readAheadOffset = options.offset;
+		ackedOffset = options.offset;
+		sentEndOffset = options.offset;
+		fileSize = options.offset + rangeLength;
+		options.hasLength = true;
+		options.length = rangeLength;
+		acknowledged = true;
+		LOG(INFO)<<"Range of "<<rangeLength<<" bytes from offset "<<options.offset;
+	}
+	else{
+		options.hasOffset = false;
+		options.hasLength = false;
+	}
+	if(lastPacket == packetStore.data() && packetStore.size() < (size_t)TFTP_BLOCK_PACKET_SIZE(blockSize)){
+		packetStore.resize(TFTP_BLOCK_PACKET_SIZE(blockSize));
+		lastPacket = packetStore.data();
+	}
+	return acknowledged;
+}
+
+void ClientHandler::endTransfer(bool success){
+	if(requestType == TFTP_OPCODE_RRQ && windowSize > 1){
+		LOG(INFO)<<"cwnd "<<cwnd.getWindow()<<" of "<<windowSize<<", losses "<<cwnd.losses<<", window timeouts "<<cwnd.timeouts<<", blocks resent after NAK "<<blocksResent;
+	}
+	if(multicastGroup){
+		// The transfer socket must not be used by a join once it is released
+		MulticastRegistry::getInstance().close(multicastGroup);
+		LOG(INFO)<<"Multicast group of "<<requestFileName<<" closed, "<<multicastGroup->joined<<" clients joined the first one";
+	}
+	state = TFTP_SESSION_DONE;
+	transferSuccess = success;
+	return;
+}
+
+bool SessionIO::sendAck(ClientHandler* session){
+	if(!session->ackDue){
+		return true;
+	}
+	return sendPacket(session, session->lastPacket, session->lastPacketLen);
+}
+
+bool SessionIO::commitAndSend(ClientHandler* session){
+	std::promise<bool> durable;
+	std::future<bool> result = durable.get_future();
+	session->commitUpload([&durable](bool success){
+		durable.set_value(success);
+	});
+	return result.get() && sendAck(session);
+}
+
+SyncSessionIO& SyncSessionIO::getInstance(){
+	static SyncSessionIO instance;
+	return instance;
+}
+
+bool SyncSessionIO::sendPacket(ClientHandler* session, uint8_t* packet, int packetLen){
+	if(session->connected){
+		ssize_t sendLen = send(session->clientSocket, packet, packetLen, 0);
+		if(sendLen == -1){
+			LOG(ERROR)<<"Data not send, "<<strerror(errno);
+		}
+		return sendLen == packetLen;
+	}
+	return sendBufferThroughUDP(packet, packetLen, session->clientSocket, session->clientAddress) == packetLen;
+}
+
+bool SyncSessionIO::readAndSend(ClientHandler* session, uint64_t offset, int dataLen){
+	const uint8_t* imagePacket = session->getImagePacket(offset, dataLen);
+	if(imagePacket != NULL){
+		return SyncSessionIO::sendData(session, (uint8_t*)imagePacket, session->lastPacketLen);
+	}
+	if(session->fileMap){
+		const uint8_t* payload = session->fileMap->getView(offset, dataLen);
+		if(payload == NULL){
+			LOG(ERROR)<<"block at "<<offset<<" outside of the mapped file";
+			return false;
+		}
+		int sendLen = sendDataThroughUDP(session->clientSocket, session->lastPacket, TFTP_MAX_HEADER_SIZE,
+			payload, dataLen, session->getDataAddress(), getDataFlags(session, dataLen));
+		return sendLen == session->lastPacketLen;
+	}
+	if(dataLen > 0){
+		ssize_t bytesRead = pread(session->fileFD, session->lastPacket + TFTP_MAX_HEADER_SIZE, dataLen, offset);
+		if(bytesRead != dataLen){
+			LOG(ERROR)<<"file read error, read "<<bytesRead<<" of "<<dataLen<<" bytes "<<strerror(errno);
+			return false;
+		}
+	}
+	return sendData(session, session->lastPacket, session->lastPacketLen);
+}
+
+/**
+ * @brief function writes the block, or queues it in the write-behind buffer of the session. A queued block is ACKed
+ * before the full chunks are written, so the client sends the next block while the disk is busy.
+*/
+bool SyncSessionIO::writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock){
+	WriteBehind* writeBehind = session->writeBehind.get();
+	if(writeBehind != NULL){
+		// With the full chunks written the buffer always has room for a block
+		if(!writeBehind->append(data, dataLen, offset) &&
+			!(writeBehind->flush(session->fileFD, false) && writeBehind->append(data, dataLen, offset))){
+			LOG(ERROR)<<"no room for block at "<<offset<<" in the write-behind buffer";
+			return false;
+		}
+		if(finalBlock){
+			// The final ACK confirms that the whole file is written
+			return writeBehind->flush(session->fileFD, true) && session->io->commitAndSend(session);
+		}
+		if(!sendAck(session)){
+			return false;
+		}
+		return writeBehind->flush(session->fileFD, false);
+	}
+	if(dataLen > 0){
+		ssize_t bytesWritten = pwrite(session->fileFD, data, dataLen, offset);
+		if(bytesWritten != dataLen){
+			LOG(ERROR)<<"file write error, wrote "<<bytesWritten<<" of "<<dataLen<<" bytes "<<strerror(errno);
+			return false;
+		}
+	}
+	if(finalBlock){
+		return session->io->commitAndSend(session);
+	}
+	return sendAck(session);
+}
+
+/**
+ * @brief function starts the kernel read-ahead of the range, the pages are read by the block layer while the session goes on
+*/
+void SyncSessionIO::readAhead(ClientHandler* session, uint64_t offset, uint64_t length){
+	int ret = posix_fadvise(session->fileFD, (off_t)offset, (off_t)length, POSIX_FADV_WILLNEED);
+	if(ret != 0){
+		LOG(DEBUG)<<"read-ahead not started: "<<strerror(ret);
+	}
+	return;
+}
+
+bool SyncSessionIO::sendsFromMapping(){
+	return true;
+}
+
+bool SyncSessionIO::sendData(ClientHandler* session, uint8_t* packet, int packetLen){
+	if(!session->multicastGroup){
+		return SyncSessionIO::sendPacket(session, packet, packetLen);
+	}
+	return sendBufferThroughUDP(packet, packetLen, session->clientSocket, session->multicastGroup->address) == packetLen;
+}
+
+/**
+ * @brief function returns the send flags of a DATA payload, only large payloads are worth MSG_ZEROCOPY
+*/
+int SyncSessionIO::getDataFlags(ClientHandler* session, int dataLen){
+	return (session->zeroCopy && dataLen >= TFTP_ZEROCOPY_MIN_DATA) ? MSG_ZEROCOPY : 0;
 }
 
 /**
- * @brief Function to close socket and wait for 2 seconds.
+ * @brief Function to close a transfer socket, pooled sockets are recycled.
  * 
  * @param socketFD 
  */
 void closeSocket(int socketFD){
-	std::chrono::seconds duration(2);
-    std::this_thread::sleep_for(duration);
-    close(socketFD);
+    UDPSocketPool::getInstance().release(socketFD);
     return;
 }
 
@@ -12,10 +12,14 @@
 */ 
 
 #include "tftp_socket.hpp"
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
 /**
- * @brief function to create socket for the specified IP and PORT
+ * @brief function to create socket for the specified IP and PORT.
+ * With reusePort set several sockets can be bound to the same PORT, the kernel spreads the clients across them.
 */
-int createUDPSocket(const char* socketIP, int socketPORT, int timeOut){
+int createUDPSocket(const char* socketIP, int socketPORT, int timeOut, bool reusePort){
     // socket file discriptor to be returned
 	int sockfd;
 	struct sockaddr_in serv_addr;
@@ -28,11 +32,15 @@ int createUDPSocket(const char* socketIP, int socketPORT, int timeOut){
 		return -1;
     }
 
-	struct timeval timeout;
-    timeout.tv_sec = timeOut; // 5 seconds
-    timeout.tv_usec = 0;
-    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
-        LOG(ERROR)<<"Failed to set read timeout." << std::endl;
+    if (!setSocketTimeout(sockfd, timeOut)) {
+        close(sockfd);
+        return -1;
+    }
+
+    int enable = 1;
+    if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+        LOG(ERROR)<<"Failed to set SO_REUSEPORT: "<< strerror(errno);
+        close(sockfd);
         return -1;
     }
 
@@ -70,23 +78,37 @@ int createUDPSocket(const char* socketIP, int socketPORT, int timeOut){
 }
 
 /**
- * @brief creating udp socket with random available port 
+ * @brief function sets the receive timeout of a blocking socket, in seconds
+*/
+bool setSocketTimeout(int socketfd, int timeOut){
+	struct timeval timeout;
+	timeout.tv_sec = timeOut;
+	timeout.tv_usec = 0;
+	if(setsockopt(socketfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1){
+		LOG(ERROR)<<"Failed to set read timeout "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief creating udp socket with random available port, the port is picked by the kernel
 */
 int createRandomUDPSocket(const char* socketIP, int* randomPort){
 	if(socketIP != NULL && randomPort != NULL){
-		int numTries = 0;
-		int randomSocketFD;
-		while(numTries < MAX_RANDOM_TRIES){
-			srand(static_cast<unsigned int>(time(nullptr)));
-			int curRandomPort = TFTP_MIN_PORT + (rand() % (TFTP_MAX_PORT - TFTP_MIN_PORT + 1));
-			randomSocketFD = createUDPSocket(socketIP, curRandomPort+numTries);
-			if(randomSocketFD != -1){
-				*randomPort = curRandomPort;
-				return randomSocketFD; 
-			}
-			numTries++;
+		int randomSocketFD = createUDPSocket(socketIP, 0);
+		if(randomSocketFD == -1){
+			return -1;
 		}
-		return -1;
+		struct sockaddr_in boundAddress;
+		socklen_t addressLen = sizeof(boundAddress);
+		if(getsockname(randomSocketFD, (struct sockaddr*)&boundAddress, &addressLen) == -1){
+			LOG(ERROR)<<"Unable to get socket port: "<<strerror(errno);
+			close(randomSocketFD);
+			return -1;
+		}
+		*randomPort = ntohs(boundAddress.sin_port);
+		return randomSocketFD;
 	}
 	else {
 		LOG(ERROR)<<"Input parameter error";
@@ -94,6 +116,262 @@ int createRandomUDPSocket(const char* socketIP, int* randomPort){
 	}
 }
 
+/**
+ * @brief function to switch a socket to non-blocking mode, used by the event loop engine
+*/
+bool setSocketNonBlocking(int socketfd){
+	int flags = fcntl(socketfd, F_GETFL, 0);
+	if(flags == -1 || fcntl(socketfd, F_SETFL, flags | O_NONBLOCK) == -1){
+		LOG(ERROR)<<"Unable to set socket non-blocking: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function connects a udp socket to the TID of its peer, the kernel then drops the datagrams
+ * of any other source and the socket can be used with send/recv
+*/
+bool connectUDPSocket(int socketfd, struct sockaddr_in& peerAddress){
+	if(connect(socketfd, (struct sockaddr*)&peerAddress, sizeof(peerAddress)) == -1){
+		LOG(ERROR)<<"Unable to connect socket to "<<inet_ntoa(peerAddress.sin_addr)<<":"<<ntohs(peerAddress.sin_port)<<" "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function connects the transfer socket of a new session to its client. The datagrams queued while the socket
+ * was unconnected, late packets of the previous client or packets of any other source, are dropped so that none of them
+ * is taken for a packet of the client.
+*/
+bool connectTransferSocket(int socketfd, struct sockaddr_in& peerAddress){
+	if(!connectUDPSocket(socketfd, peerAddress)){
+		return false;
+	}
+	int dropped = drainUDPSocket(socketfd);
+	if(dropped > 0){
+		LOG(DEBUG)<<dropped<<" datagrams queued before the connect dropped";
+	}
+	return true;
+}
+
+/**
+ * @brief function reads and drops the datagrams queued on a udp socket without blocking, returns how many were dropped
+*/
+int drainUDPSocket(int socketfd){
+	uint8_t drainBuffer[TFTP_MAX_PACKET_SIZE];
+	int dropped = 0;
+	while(recv(socketfd, drainBuffer, sizeof(drainBuffer), MSG_DONTWAIT) >= 0){
+		dropped++;
+	}
+	return dropped;
+}
+
+/**
+ * @brief function dissolves the association of a connected udp socket and clears its pending error
+*/
+bool disconnectUDPSocket(int socketfd){
+	struct sockaddr unspecAddress;
+	memset(&unspecAddress, 0, sizeof(unspecAddress));
+	unspecAddress.sa_family = AF_UNSPEC;
+	if(connect(socketfd, &unspecAddress, sizeof(unspecAddress)) == -1){
+		LOG(ERROR)<<"Unable to disconnect socket "<<strerror(errno);
+		return false;
+	}
+	int socketError = 0;
+	socklen_t errorLen = sizeof(socketError);
+	getsockopt(socketfd, SOL_SOCKET, SO_ERROR, &socketError, &errorLen);
+	return true;
+}
+
+/**
+ * @brief function toggles SO_ZEROCOPY, required before sending with MSG_ZEROCOPY
+*/
+bool setSocketZeroCopy(int socketfd, bool enable){
+	int optionValue = enable ? 1 : 0;
+	if(setsockopt(socketfd, SOL_SOCKET, SO_ZEROCOPY, &optionValue, sizeof(optionValue)) == -1){
+		LOG(ERROR)<<"Unable to set SO_ZEROCOPY "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function raises SO_RCVBUF to at least bufferSize bytes, so that a whole window of DATA fits
+ * in the socket. The kernel caps the size at net.core.rmem_max.
+*/
+bool growSocketReceiveBuffer(int socketfd, int bufferSize){
+	int currentSize = 0;
+	socklen_t optionLen = sizeof(currentSize);
+	if(getsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &currentSize, &optionLen) == 0 && currentSize >= bufferSize){
+		return true;
+	}
+	if(setsockopt(socketfd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize)) == -1){
+		LOG(ERROR)<<"Unable to set SO_RCVBUF "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function makes the datagrams sent to a multicast group leave through the interface of interfaceIP,
+ * reach no further than TFTP_MULTICAST_TTL hops and loop back to the receivers of the same host
+*/
+bool setMulticastSender(int socketfd, const char* interfaceIP, int ttl){
+	struct in_addr interfaceAddress;
+	if(inet_pton(AF_INET, interfaceIP, &interfaceAddress) != 1){
+		LOG(ERROR)<<"Invalid multicast interface "<<interfaceIP;
+		return false;
+	}
+	unsigned char hops = (unsigned char)ttl;
+	unsigned char loop = 1;
+	if(setsockopt(socketfd, IPPROTO_IP, IP_MULTICAST_IF, &interfaceAddress, sizeof(interfaceAddress)) == -1 ||
+		setsockopt(socketfd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) == -1 ||
+		setsockopt(socketfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == -1){
+		LOG(ERROR)<<"Unable to set multicast send options "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function creates a socket bound to the port of a multicast group and joins the group on the interface of interfaceIP.
+ * Several receivers of the same host may bind the group.
+*/
+int createMulticastReceiver(struct sockaddr_in& groupAddress, const char* interfaceIP){
+	int socketfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(socketfd == -1){
+		LOG(ERROR)<<"Unable to create multicast socket "<<strerror(errno);
+		return -1;
+	}
+	int reuse = 1;
+	if(setsockopt(socketfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) == -1){
+		LOG(ERROR)<<"Unable to set SO_REUSEADDR "<<strerror(errno);
+		close(socketfd);
+		return -1;
+	}
+	struct sockaddr_in bindAddress = groupAddress;
+	if(bind(socketfd, (struct sockaddr*)&bindAddress, sizeof(bindAddress)) == -1){
+		LOG(ERROR)<<"Unable to bind multicast group port "<<ntohs(groupAddress.sin_port)<<" "<<strerror(errno);
+		close(socketfd);
+		return -1;
+	}
+	struct ip_mreq membership;
+	membership.imr_multiaddr = groupAddress.sin_addr;
+	if(inet_pton(AF_INET, interfaceIP, &membership.imr_interface) != 1 ||
+		setsockopt(socketfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) == -1){
+		LOG(ERROR)<<"Unable to join multicast group "<<inet_ntoa(groupAddress.sin_addr)<<" "<<strerror(errno);
+		close(socketfd);
+		return -1;
+	}
+	return socketfd;
+}
+
+/**
+ * @brief function makes the kernel stamp every datagram received on the socket with SO_TIMESTAMPNS,
+ * so that the RTT samples do not include the time a datagram waited in the socket
+*/
+bool enableReceiveTimestamps(int socketfd){
+	int optionValue = 1;
+	if(setsockopt(socketfd, SOL_SOCKET, SO_TIMESTAMPNS, &optionValue, sizeof(optionValue)) == -1){
+		LOG(ERROR)<<"Unable to set SO_TIMESTAMPNS "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief function converts a kernel receive timestamp to the time elapsed since, 0 when it is in the future
+*/
+static int64_t getTimestampAgeUs(const struct timespec& stamp){
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	int64_t ageUs = (int64_t)(now.tv_sec - stamp.tv_sec) * 1000000 + (now.tv_nsec - stamp.tv_nsec) / 1000;
+	return std::max(ageUs, (int64_t)0);
+}
+
+/**
+ * @brief function returns the time since the kernel received the datagram of msg, from its SCM_TIMESTAMPNS.
+ * 0 when the message carries no timestamp.
+*/
+int64_t getReceiveAgeUs(struct msghdr* msg){
+	for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+		if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS){
+			struct timespec stamp;
+			memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+			return getTimestampAgeUs(stamp);
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief function returns the time since the kernel received the last datagram read from the socket, 0 when unknown
+*/
+int64_t getLastReceiveAgeUs(int socketfd){
+	struct timespec stamp;
+	if(ioctl(socketfd, SIOCGSTAMPNS, &stamp) == -1){
+		return 0;
+	}
+	return getTimestampAgeUs(stamp);
+}
+
+/**
+ * @brief function reads the MSG_ZEROCOPY completion notifications queued on the socket error queue.
+ * Returns the number of notifications read.
+*/
+int drainZeroCopyCompletions(int socketfd){
+	int numRead = 0;
+	uint8_t control[128];
+	struct msghdr msg;
+	while(true){
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if(recvmsg(socketfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1){
+			break;
+		}
+		for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+			struct sock_extended_err* extendedError = (struct sock_extended_err*)CMSG_DATA(cmsg);
+			if(extendedError->ee_origin == SO_EE_ORIGIN_ZEROCOPY){
+				numRead++;
+			}
+		}
+	}
+	return numRead;
+}
+
+/**
+ * @brief function sends a packet made of a header and a payload stored elsewhere with one sendmsg,
+ * neither is copied in user space. address is NULL for a connected socket.
+*/
+int sendDataThroughUDP(int socketfd, uint8_t* header, size_t headerLen, const uint8_t* payload, size_t payloadLen, struct sockaddr_in* address, int flags){
+	struct iovec iov[2];
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	iov[0].iov_base = header;
+	iov[0].iov_len = headerLen;
+	iov[1].iov_base = (void*)payload;
+	iov[1].iov_len = payloadLen;
+	if(address != NULL){
+		msg.msg_name = address;
+		msg.msg_namelen = sizeof(*address);
+	}
+	msg.msg_iov = iov;
+	msg.msg_iovlen = (payloadLen > 0) ? 2 : 1;
+	ssize_t sendLen = sendmsg(socketfd, &msg, flags);
+	if(sendLen == -1 && (flags & MSG_ZEROCOPY) && errno == ENOBUFS){
+		// Pinned page limit reached, the payload is copied instead
+		sendLen = sendmsg(socketfd, &msg, flags & ~MSG_ZEROCOPY);
+	}
+	if(sendLen == -1){
+		LOG(ERROR)<<"Data not send, "<<strerror(errno);
+		return -1;
+	}
+	return (int)sendLen;
+}
+
 /**
  * @brief send a uint8_t buffer to a client using udp
 */
@@ -161,9 +439,26 @@ int getBufferThroughUDP(uint8_t* recvBuffer, size_t bufferLen, int socketfd, str
 
 
 /**
- * @brief function to handle receiveing ACK from a TFTP Client
+ * @brief function retrieves the options of an OACK, a malformed OACK is answered with an option negotiation ERROR
+*/
+static bool parseOACK(uint8_t* recvBuffer, int recvLen, int socketfd, struct sockaddr_in& recvAddress, TftpOptions& oack, bool& recvError){
+	if(parseOACKPacket(recvBuffer, recvLen, oack)){
+		LOG(DEBUG)<<"Valid OACK Received blksize: "<<oack.blockSize;
+		return true;
+	}
+	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
+	int packetSize = makeErrorPacket(sendBuffer, sizeof(sendBuffer), TFTP_ERROR_OPTION_NEGOTIATION, "invalid option acknowledgment");
+	sendBufferThroughUDP(sendBuffer, packetSize, socketfd, recvAddress);
+	recvError = true;
+	return false;
+}
+
+/**
+ * @brief function to handle receiveing ACK from a TFTP Client. With oack set an OACK answering the
+ * request is accepted in place of ACK 0 and its options are stored in oack. With ackedBlockNum set
+ * the ACK of any block is accepted and its block number stored, the caller checks it against its window.
 */
-bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, bool& recvError, bool ignoreAddress){
+bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, bool& recvError, bool ignoreAddress, TftpOptions* oack, uint16_t* ackedBlockNum){
 	uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
 	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
 	int packetSize;
@@ -212,7 +507,10 @@ bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expect
 		// retriving block number
 		recvBlockNum = (uint16_t)(((recvBuffer[3] & 0xFF) << 8) | (recvBuffer[2] & 0XFF));
 		recvBlockNum = ntohs(recvBlockNum);
-		if(recvBlockNum != expectedBlockNum){
+		if(ackedBlockNum != NULL){
+			*ackedBlockNum = recvBlockNum;
+		}
+		else if(recvBlockNum != expectedBlockNum){
 			LOG(ERROR)<<"invalid block number";
 			return false;
 		}
@@ -224,6 +522,16 @@ bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expect
 		}
 		return true;
 	}
+	else if(opcode == TFTP_OPCODE_OACK && oack != NULL && expectedBlockNum == 0){
+		if(!parseOACK(recvBuffer, ret, clientSocket, recvAddress, *oack, recvError)){
+			return false;
+		}
+		if(ignoreAddress){
+			LOG(INFO)<<"Address ignore is set true. Updated Address";
+			clientAddress = recvAddress;
+		}
+		return true;
+	}
 	else if(opcode == TFTP_OPCODE_ERROR){
 		recvError = true;
 		uint16_t errorCode = 0;
@@ -244,19 +552,26 @@ bool getACK(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expect
 }
 
 /**
- * @brief receives TFTP data packet from specified client socket
+ * @brief receives TFTP data packet from specified client socket, holding up to bufferSize bytes of data.
+ * With oack set an OACK answering the request is accepted in place of DATA 1: its options are stored
+ * in oack and dataLen is set to -1. outOfOrder, when not NULL, tells a DATA of another block from a timeout.
+ * With outOfOrderBlockNum set the payload of a DATA of another block is stored as well, together with its block number.
 */
-bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, uint8_t* recvDataBuffer, size_t bufferSize, int& dataLen, bool& recvError, bool ignoreAddress){
-	uint8_t recvBuffer[TFTP_MAX_PACKET_SIZE];
+bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expectedBlockNum, uint8_t* recvDataBuffer, size_t bufferSize, int& dataLen, bool& recvError, bool ignoreAddress, TftpOptions* oack, bool* outOfOrder, uint16_t* outOfOrderBlockNum){
+	// One byte more than the largest DATA accepted, so that a longer datagram is not taken for a full block
+	std::vector<uint8_t> recvBuffer(TFTP_BLOCK_PACKET_SIZE(std::max(bufferSize, (size_t)TFTP_MAX_DATA_SIZE)) + 1);
 	uint8_t sendBuffer[TFTP_MAX_PACKET_SIZE];
 	int packetSize = 0;
 	recvError = false;
+	if(outOfOrder != NULL){
+		*outOfOrder = false;
+	}
 	if(recvDataBuffer!=NULL){
 		memset(recvDataBuffer,0,bufferSize);
 		dataLen = 0;
 		int ret = 0;
 		struct sockaddr_in recvAddress;
-		ret = getBufferThroughUDP(recvBuffer, sizeof(recvBuffer), clientSocket, recvAddress);
+		ret = getBufferThroughUDP(recvBuffer.data(), recvBuffer.size(), clientSocket, recvAddress);
 		LOG(DEBUG)<<"receive buffer length "<<ret;
 		if(ret == -1){
 			LOG(ERROR)<<"receive error";
@@ -301,15 +616,24 @@ bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expec
 			recvBlockNum = ntohs(recvBlockNum);
 			if(recvBlockNum != expectedBlockNum){
 				LOG(ERROR)<<"invalid block number"<<", received:"<<recvBlockNum<<", expected:"<<expectedBlockNum;
+				if(outOfOrder != NULL){
+					*outOfOrder = true;
+				}
+				if(outOfOrderBlockNum != NULL && ret - 4 <= (int)bufferSize){
+					*outOfOrderBlockNum = recvBlockNum;
+					dataLen = ret - 4;
+					memcpy(recvDataBuffer, recvBuffer.data() + 4, dataLen);
+				}
 				return false;
 			}
 			dataLen = ret - 4;
-			if(dataLen > TFTP_MAX_DATA_SIZE){
+			if(dataLen > (int)bufferSize){
 				LOG(ERROR)<<"invalid data size";
+				dataLen = 0;
 				return false;
 			}
 			if(dataLen > 0){
-				memcpy(recvDataBuffer, recvBuffer + 4, dataLen);
+				memcpy(recvDataBuffer, recvBuffer.data() + 4, dataLen);
 			}
 			LOG(DEBUG)<<"Valid Data Received block number: "<<recvBlockNum<<", Length: "<<dataLen;
 			if(ignoreAddress){
@@ -318,6 +642,17 @@ bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expec
 			}
 			return true;
 		}
+		else if(opcode == TFTP_OPCODE_OACK && oack != NULL && expectedBlockNum == 1){
+			if(!parseOACK(recvBuffer.data(), ret, clientSocket, recvAddress, *oack, recvError)){
+				return false;
+			}
+			dataLen = -1;
+			if(ignoreAddress){
+				LOG(INFO)<<"Address ignore is set true. Updated Address";
+				clientAddress = recvAddress;
+			}
+			return true;
+		}
 		else if(opcode == TFTP_OPCODE_ERROR){
 			recvError = true;
 			uint16_t errorCode = 0;
@@ -325,7 +660,8 @@ bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expec
 			errorCode = (uint16_t)(((recvBuffer[3] & 0xFF) << 8) | (recvBuffer[2] & 0XFF));
 			errorCode = ntohs(errorCode);
 			char errMsg[TFTP_MAX_PACKET_SIZE];
-			strcpy(errMsg, (char*)recvBuffer+4);
+			memset(errMsg, 0, sizeof(errMsg));
+			strncpy(errMsg, (char*)recvBuffer.data()+4, sizeof(errMsg) - 1);
 			LOG(ERROR)<<"Received Error from client opcode:"<<opcode<<", error code:"<<errorCode<<", error message:"<<errMsg;
 			return false;
 		}
@@ -341,4 +677,321 @@ bool getData(int clientSocket, struct sockaddr_in& clientAddress, uint16_t expec
 	}
 	LOG(ERROR)<<"Open condition";
 	return false;
-}
\ No newline at end of file
+}
+/**
+ * @brief constructor for UDPRecvBatch Class
+*/
+UDPRecvBatch::UDPRecvBatch(int batchSize, int packetSize){
+	this->batchSize = std::max(1, std::min(batchSize, TFTP_MAX_BATCH_SIZE));
+	this->packetSize = std::max(packetSize, TFTP_MAX_PACKET_SIZE);
+	calls = 0;
+	packets = 0;
+	buffers.resize((size_t)this->batchSize * this->packetSize);
+	headers.resize(this->batchSize);
+	iovecs.resize(this->batchSize);
+	addresses.resize(this->batchSize);
+	controls.resize((size_t)this->batchSize * TFTP_TIMESTAMP_CONTROL_SIZE);
+}
+
+/**
+ * @brief function reads up to batchSize datagrams from the socket with a single recvmmsg call
+*/
+int UDPRecvBatch::receive(int socketfd, int flags){
+	for(int i = 0; i < batchSize; ++i){
+		iovecs[i].iov_base = &buffers[(size_t)i * packetSize];
+		iovecs[i].iov_len = packetSize;
+		memset(&headers[i], 0, sizeof(headers[i]));
+		headers[i].msg_hdr.msg_name = &addresses[i];
+		headers[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		headers[i].msg_hdr.msg_iov = &iovecs[i];
+		headers[i].msg_hdr.msg_iovlen = 1;
+		headers[i].msg_hdr.msg_control = &controls[(size_t)i * TFTP_TIMESTAMP_CONTROL_SIZE];
+		headers[i].msg_hdr.msg_controllen = TFTP_TIMESTAMP_CONTROL_SIZE;
+	}
+	calls++;
+	int numReceived = recvmmsg(socketfd, headers.data(), batchSize, flags, NULL);
+	if(numReceived > 0){
+		packets += numReceived;
+	}
+	return numReceived;
+}
+
+int UDPRecvBatch::getBatchSize(){
+	return batchSize;
+}
+
+uint8_t* UDPRecvBatch::getPacket(int index){
+	return &buffers[(size_t)index * packetSize];
+}
+
+int UDPRecvBatch::getPacketLen(int index){
+	return (int)headers[index].msg_len;
+}
+
+struct sockaddr_in& UDPRecvBatch::getAddress(int index){
+	return addresses[index];
+}
+
+int64_t UDPRecvBatch::getReceiveAgeUs(int index){
+	return ::getReceiveAgeUs(&headers[index].msg_hdr);
+}
+
+/**
+ * @brief function returns the average number of datagrams read per recvmmsg call
+*/
+double UDPRecvBatch::getAverageFill(){
+	return calls ? (double)packets / calls : 0.0;
+}
+
+/**
+ * @brief constructor for UDPSendBatch Class
+*/
+UDPSendBatch::UDPSendBatch(int batchSize, int packetSize){
+	this->batchSize = std::max(1, std::min(batchSize, TFTP_MAX_BATCH_SIZE));
+	this->packetSize = std::max(packetSize, TFTP_MAX_PACKET_SIZE);
+	count = 0;
+	calls = 0;
+	packets = 0;
+	buffers.resize((size_t)this->batchSize * this->packetSize);
+	sockets.resize(this->batchSize);
+	headers.resize(this->batchSize);
+	iovecs.resize((size_t)this->batchSize * 2);
+	addresses.resize(this->batchSize);
+	flags.resize(this->batchSize);
+	payloadOwners.resize(this->batchSize);
+}
+
+/**
+ * @brief function copies a packet to the send queue, the queue is flushed first when it is full
+*/
+bool UDPSendBatch::queue(int socketfd, uint8_t* packet, size_t packetLen, struct sockaddr_in& address){
+	return queuePacket(socketfd, packet, packetLen, &address);
+}
+
+bool UDPSendBatch::queue(int socketfd, uint8_t* packet, size_t packetLen){
+	return queuePacket(socketfd, packet, packetLen, NULL);
+}
+
+bool UDPSendBatch::queuePacket(int socketfd, uint8_t* packet, size_t packetLen, struct sockaddr_in* address){
+	if(packet == NULL || packetLen == 0 || packetLen > (size_t)packetSize || socketfd < 0){
+		LOG(ERROR)<<"Input parameter error";
+		return false;
+	}
+	int entry = nextEntry(socketfd, address, 0);
+	uint8_t* buffer = &buffers[(size_t)entry * packetSize];
+	memcpy(buffer, packet, packetLen);
+	iovecs[2 * entry].iov_base = buffer;
+	iovecs[2 * entry].iov_len = packetLen;
+	headers[entry].msg_hdr.msg_iovlen = 1;
+	return true;
+}
+
+bool UDPSendBatch::queueData(int socketfd, uint8_t* header, size_t headerLen, const uint8_t* payload, size_t payloadLen,
+	struct sockaddr_in* address, std::shared_ptr<const void> payloadOwner, int flags){
+	if((header == NULL && headerLen > 0) || headerLen > (size_t)packetSize || socketfd < 0 ||
+		(payload == NULL && payloadLen > 0) || headerLen + payloadLen == 0){
+		LOG(ERROR)<<"Input parameter error";
+		return false;
+	}
+	int entry = nextEntry(socketfd, address, flags);
+	int numIovecs = 0;
+	if(headerLen > 0){
+		uint8_t* buffer = &buffers[(size_t)entry * packetSize];
+		memcpy(buffer, header, headerLen);
+		iovecs[2 * entry].iov_base = buffer;
+		iovecs[2 * entry].iov_len = headerLen;
+		numIovecs++;
+	}
+	if(payloadLen > 0){
+		iovecs[2 * entry + numIovecs].iov_base = (void*)payload;
+		iovecs[2 * entry + numIovecs].iov_len = payloadLen;
+		numIovecs++;
+	}
+	headers[entry].msg_hdr.msg_iovlen = numIovecs;
+	payloadOwners[entry] = std::move(payloadOwner);
+	return true;
+}
+
+/**
+ * @brief function claims the next queue entry and fills its destination, the queue is flushed first when it is full
+*/
+int UDPSendBatch::nextEntry(int socketfd, struct sockaddr_in* address, int sendFlags){
+	if(count == batchSize){
+		flush();
+	}
+	int entry = count++;
+	sockets[entry] = socketfd;
+	flags[entry] = sendFlags;
+	memset(&headers[entry], 0, sizeof(headers[entry]));
+	if(address != NULL){
+		addresses[entry] = *address;
+		headers[entry].msg_hdr.msg_name = &addresses[entry];
+		headers[entry].msg_hdr.msg_namelen = sizeof(addresses[entry]);
+	}
+	headers[entry].msg_hdr.msg_iov = &iovecs[2 * entry];
+	return entry;
+}
+
+/**
+ * @brief function sends the queued packets, consecutive packets of the same socket and flags share one sendmmsg call.
+ * A packet that cannot be sent is dropped, the TFTP retransmission recovers it.
+*/
+int UDPSendBatch::flush(){
+	int numSent = 0;
+	int start = 0;
+	while(start < count){
+		int end = start + 1;
+		while(end < count && sockets[end] == sockets[start] && flags[end] == flags[start]){
+			end++;
+		}
+		calls++;
+		int ret = sendmmsg(sockets[start], &headers[start], end - start, flags[start]);
+		if(ret == -1 && (flags[start] & MSG_ZEROCOPY) && errno == ENOBUFS){
+			// Pinned page limit reached, the payloads are copied instead
+			ret = sendmmsg(sockets[start], &headers[start], end - start, flags[start] & ~MSG_ZEROCOPY);
+		}
+		if(ret == -1){
+			LOG(ERROR)<<"Data not send, "<<strerror(errno);
+			ret = 1;
+		}
+		else{
+			numSent += ret;
+			packets += ret;
+		}
+		start += ret;
+	}
+	for(int i = 0; i < count; ++i){
+		payloadOwners[i].reset();
+	}
+	count = 0;
+	return numSent;
+}
+
+bool UDPSendBatch::isEmpty(){
+	return count == 0;
+}
+
+/**
+ * @brief function returns the average number of packets sent per sendmmsg call
+*/
+double UDPSendBatch::getAverageFill(){
+	return calls ? (double)packets / calls : 0.0;
+}
+
+/**
+ * @brief constructor for UDPSocketPool Class, the pool is empty until init
+*/
+UDPSocketPool::UDPSocketPool(){
+	fallbacks = 0;
+}
+
+UDPSocketPool::~UDPSocketPool(){
+	for(auto& pooled : socketPorts){
+		close(pooled.first);
+	}
+}
+
+/**
+ * @brief function binds a non-blocking socket to every free port of [firstPort, lastPort]
+*/
+int UDPSocketPool::init(const char* socketIP, int firstPort, int lastPort){
+	std::lock_guard<std::mutex> lock(poolMutex);
+	this->socketIP.assign(socketIP);
+	int numBound = 0;
+	for(int port = firstPort; port <= lastPort; ++port){
+		int socketfd = createUDPSocket(socketIP, port);
+		if(socketfd == -1){
+			continue;
+		}
+		if(!setSocketNonBlocking(socketfd)){
+			close(socketfd);
+			continue;
+		}
+		socketPorts[socketfd] = port;
+		freeSockets.push_back(socketfd);
+		numBound++;
+	}
+	return numBound;
+}
+
+int UDPSocketPool::acquire(){
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if(!freeSockets.empty()){
+			// The socket released longest ago, late retransmissions to its previous client had the most time to stop
+			int socketfd = freeSockets.front();
+			freeSockets.pop_front();
+			return socketfd;
+		}
+		fallbacks++;
+	}
+	// Port 0 lets the kernel pick a free ephemeral port
+	int socketfd = createUDPSocket(socketIP.empty() ? "0.0.0.0" : socketIP.c_str(), 0);
+	if(socketfd == -1){
+		return -1;
+	}
+	if(!setSocketNonBlocking(socketfd)){
+		close(socketfd);
+		return -1;
+	}
+	return socketfd;
+}
+
+/**
+ * @brief function disconnects the socket from the previous client, drops its stale datagrams and returns it to the pool
+*/
+void UDPSocketPool::release(int socketfd){
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if(socketPorts.find(socketfd) == socketPorts.end()){
+			close(socketfd);
+			return;
+		}
+	}
+	if(!disconnectUDPSocket(socketfd)){
+		discard(socketfd);
+		return;
+	}
+	drainUDPSocket(socketfd);
+	drainZeroCopyCompletions(socketfd);
+	std::lock_guard<std::mutex> lock(poolMutex);
+	freeSockets.push_back(socketfd);
+	return;
+}
+
+void UDPSocketPool::discard(int socketfd){
+	int port;
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		auto it = socketPorts.find(socketfd);
+		if(it == socketPorts.end()){
+			close(socketfd);
+			return;
+		}
+		port = it->second;
+		socketPorts.erase(it);
+	}
+	close(socketfd);
+	int newSocketfd = createUDPSocket(socketIP.c_str(), port);
+	if(newSocketfd == -1 || !setSocketNonBlocking(newSocketfd)){
+		if(newSocketfd != -1){
+			close(newSocketfd);
+		}
+		LOG(ERROR)<<"Transfer socket pool shrunk, port "<<port<<" not rebound";
+		return;
+	}
+	std::lock_guard<std::mutex> lock(poolMutex);
+	socketPorts[newSocketfd] = port;
+	freeSockets.push_back(newSocketfd);
+	return;
+}
+
+size_t UDPSocketPool::size(){
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return socketPorts.size();
+}
+
+size_t UDPSocketPool::available(){
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return freeSockets.size();
+}
@@ -12,9 +12,20 @@
 */ 
 
 #include "tftp_stark.hpp"
+#include "tftp_packets.hpp"
+#include <sys/mman.h>
+#include <sys/statvfs.h>
+#include <algorithm>
+#include <chrono>
 
 STARK::STARK(){
-	//
+	mapsCreated = 0;
+	mapsShared = 0;
+	commitStopping = false;
+	commitIntervalMs = 0;
+	rootFD = -1;
+	uploadsCommitted = 0;
+	groupCommits = 0;
 }
 
 /**
@@ -60,6 +71,10 @@ bool STARK::isFileAvailable(std::string fileName){
  */
 bool STARK::isFileDeletable(std::string fileName, TftpErrorCode& errorCode){
 	errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+	if(isUploadName(fileName)){
+		LOG(ERROR)<<"upload in progress can not be deleted";
+		return false;
+	}
 	if(!fileName.empty()){
 		std::string filePath = root_dir + fileName;
 		if(isFileAvailable(fileName)){
@@ -68,6 +83,7 @@ bool STARK::isFileDeletable(std::string fileName, TftpErrorCode& errorCode){
 					LOG(DEBUG)<<"File in map but no reader or no writer, file is deletable";
 					if(std::remove(filePath.c_str()) == 0){
 						LOG(INFO)<<"File "<<filePath<<" Deleted from server";
+						invalidateCachedFile(fileName);
 						return true;
 					}else{
 						LOG(ERROR)<<"Error deleting file"<<strerror(errno);
@@ -84,6 +100,7 @@ bool STARK::isFileDeletable(std::string fileName, TftpErrorCode& errorCode){
 				LOG(DEBUG)<<"File is deletable, not found in map";
 				if(std::remove(filePath.c_str()) == 0){
 					LOG(INFO)<<"File "<<filePath<<" Deleted from server";
+					invalidateCachedFile(fileName);
 					return true;
 				}else{
 					LOG(ERROR)<<"Error deleting file"<<strerror(errno);
@@ -106,6 +123,116 @@ bool STARK::isFileDeletable(std::string fileName, TftpErrorCode& errorCode){
 
 
 
+/**
+ * @brief function registers a new reader of the file, fails if the file is opened in write mode
+*/
+bool STARK::addReader(std::string fileName, TftpErrorCode& errorCode){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	if (fileData.find(fileName) != fileData.end()){
+		if(fileData[fileName].second == false){
+			int readerCnt = fileData[fileName].first;
+			LOG(INFO)<<"file opened in read mode and reader cnt incremented"<<readerCnt+1;
+			fileData[fileName].first = readerCnt + 1; 
+			return true;
+		}
+		else{
+			LOG(ERROR)<<"file already opened in write mode. Wait until freed";	
+			errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+			return false;
+		}
+	}
+	else{
+		fileData.insert({fileName, std::make_pair(1,false)});
+		LOG(INFO)<<"file opened in read mode and inserted in the map";
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief function registers the writer of the file, fails if the file has readers or another writer
+*/
+bool STARK::addWriter(std::string fileName, TftpErrorCode& errorCode){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	if (fileData.find(fileName) == fileData.end()){
+		fileData.insert({fileName, std::make_pair(0,true)});
+		LOG(INFO)<<"file opened in write mode and inserted into map";
+		return true;
+	}
+	else{
+		if(fileData[fileName].first == 0 && fileData[fileName].second == false){
+			fileData[fileName].second = true;
+			LOG(INFO)<<"file opened in write mode and already present in map";
+			return true;
+		}
+		else{
+			if(fileData[fileName].first != 0){
+				LOG(ERROR)<<"file already in read process.";
+			}
+			else{
+				LOG(ERROR)<<"=====CAUTION==== file already in write process.";
+			}
+			errorCode = TFTP_ERROR_NOT_DEFINED;
+			return false;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief function unregisters a reader of the file
+*/
+bool STARK::removeReader(std::string fileName){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	if (fileData.find(fileName) != fileData.end()){
+		int readCnt = fileData[fileName].first;
+		if(readCnt > 0){
+			readCnt--;
+			fileData[fileName].first = readCnt;
+			if(readCnt == 0){
+				// Sessions and queued packets still holding the mapping keep it until they are done
+				fileMaps.erase(fileName);
+			}
+			LOG(DEBUG)<<"file closed successfully";
+			return true;
+		}
+		else{
+			LOG(FATAL)<<"file open but read cnt already zero";
+			return false;
+		}	
+	}
+	else{
+		LOG(FATAL)<<"read file open but not in list";
+		return false;
+	}
+	return false;
+}
+
+/**
+ * @brief function unregisters the writer of the file
+*/
+bool STARK::removeWriter(std::string fileName){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	if (fileData.find(fileName) != fileData.end()){
+		bool writeStatus = fileData[fileName].second;
+		if(writeStatus == true){
+			writeStatus = false;
+			fileData[fileName].second = writeStatus;
+			LOG(DEBUG)<<"file closed successfully";
+			return true;
+		}
+		else{
+			LOG(FATAL)<<"wrte file open but write status already false";
+			return false;
+		}	
+	}
+	else{
+		LOG(FATAL)<<"file open but not in list";
+		return false;
+	}
+	return false;
+}
+
 /**
  * @brief function to check if a file is having read permission
  * opens the file in read more if the permission exists and return the file object
@@ -118,26 +245,11 @@ std::ifstream STARK::isFileReadable(std::string fileName, TftpErrorCode& errorCo
 		LOG(DEBUG)<<"file name:"<<filePath;
 		std::ifstream fd(filePath.c_str(),  std::ios::binary);
 		if(fd.is_open()){
-			std::lock_guard<std::mutex> lock(mutexObj);
-			if (fileData.find(fileName) != fileData.end()){
-				if(fileData[fileName].second == false){
-					int readerCnt = fileData[fileName].first;
-					LOG(INFO)<<"file opened in read mode and reader cnt incremented"<<readerCnt+1;
-					fileData[fileName].first = readerCnt + 1; 
-					return fd;
-				}
-				else{
-					LOG(ERROR)<<"file already opened in write mode. Wait until freed";	
-					errorCode = TFTP_ERROR_ACCESS_VIOLATION;
-					fd.close();
-					return std::ifstream();
-				}
-			}
-			else{
-				fileData.insert({fileName, std::make_pair(1,false)});
-				LOG(INFO)<<"file opened in read mode and inserted in the map";
+			if(addReader(fileName, errorCode)){
 				return fd;
 			}
+			fd.close();
+			return std::ifstream();
 		}
 		else{
 			fd.close();
@@ -171,30 +283,11 @@ std::ofstream STARK::isFileWritable(std::string fileName, TftpErrorCode& errorCo
 		else{
 			std::ofstream fileWrite(filePath.c_str(), std::ios::binary);
 			if(fileWrite.is_open()){
-				std::lock_guard<std::mutex> lock(mutexObj);
-				if (fileData.find(fileName) == fileData.end()){
-					fileData.insert({fileName, std::make_pair(0,true)});
-					LOG(INFO)<<"file opened in write mode and inserted into map";
+				if(addWriter(fileName, errorCode)){
 					return fileWrite;
 				}
-				else{
-					if(fileData[fileName].first == 0 && fileData[fileName].second == false){
-						fileData[fileName].second = true;
-						LOG(INFO)<<"file opened in write mode and already present in map";
-						return fileWrite;
-					}
-					else{
-						if(fileData[fileName].first != 0){
-							LOG(ERROR)<<"file already in read process.";
-						}
-						else{
-							LOG(ERROR)<<"=====CAUTION==== file already in write process.";
-						}
-						errorCode = TFTP_ERROR_NOT_DEFINED;
-						fileWrite.close();
-						return std::ofstream();
-					}
-				}
+				fileWrite.close();
+				return std::ofstream();
 			}
 			else{
 				fileWrite.close();
@@ -211,6 +304,37 @@ std::ofstream STARK::isFileWritable(std::string fileName, TftpErrorCode& errorCo
 	return std::ofstream();
 }
 
+/**
+ * @brief function opens a file of the root directory that already exists in append mode, fileSize is set to its size.
+ * An interrupted download is resumed into it.
+*/
+std::ofstream STARK::isFileAppendable(std::string fileName, uint64_t& fileSize, TftpErrorCode& errorCode){
+	errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+	fileSize = 0;
+	if(fileName.empty()){
+		LOG(ERROR)<<"file name is NULL";
+		return std::ofstream();
+	}
+	std::string filePath = root_dir + fileName;
+	struct stat fileStat;
+	if(stat(filePath.c_str(), &fileStat) == -1){
+		LOG(ERROR)<<"file not found "<<strerror(errno);
+		errorCode = TFTP_ERROR_FILE_NOT_FOUND;
+		return std::ofstream();
+	}
+	std::ofstream fileWrite(filePath.c_str(), std::ios::binary | std::ios::app);
+	if(!fileWrite.is_open()){
+		LOG(ERROR)<<"unable to open file in append mode";
+		return std::ofstream();
+	}
+	if(!addWriter(fileName, errorCode)){
+		fileWrite.close();
+		return std::ofstream();
+	}
+	fileSize = (uint64_t)fileStat.st_size;
+	return fileWrite;
+}
+
 /**
  * @brief function to close a readable file (ifstream file)
 */
@@ -219,24 +343,7 @@ bool STARK::closeReadableFile(std::string fileName, std::ifstream& fd){
 
 	if(!fileName.empty() && fd.is_open()){
 		fd.close();
-		std::lock_guard<std::mutex> lock(mutexObj);
-		if (fileData.find(fileName) != fileData.end()){
-			int readCnt = fileData[fileName].first;
-			if(readCnt > 0){
-				readCnt--;
-				fileData[fileName].first = readCnt;
-                LOG(DEBUG)<<"file closed successfully";
-                return true;
-			}
-			else{
-				LOG(FATAL)<<"file open but read cnt already zero";
-				return false;
-			}	
-		}
-		else{
-			LOG(FATAL)<<"read file open but not in list";
-			return false;
-		}
+		return removeReader(fileName);
 	} 
 	else{
 		LOG(ERROR)<<"file name is NULL  or file as already closed name:" <<fileName;
@@ -252,28 +359,927 @@ bool STARK::closeReadableFile(std::string fileName, std::ifstream& fd){
 bool STARK::closeWritableFile(std::string fileName, std::ofstream& fd){
 	if(!fileName.empty() && fd.is_open()){
 		fd.close();
+		return removeWriter(fileName);
+	} 
+	else{
+		LOG(ERROR)<<"file name is NULL  or file as already closed name:" <<fileName;
+		return false;
+	}
+    return true;
+}
+
+/**
+ * @brief function to check if a file is having read permission
+ * opens the file in read mode if the permission exists and returns the file descriptor, -1 on failure
+*/
+int STARK::openReadableFile(std::string fileName, TftpErrorCode& errorCode){
+	errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+	if(fileName.empty()){
+		LOG(ERROR)<<"file name is NULL";
+		return -1;
+	}
+	if(isUploadName(fileName)){
+		LOG(ERROR)<<"upload in progress can not be read";
+		return -1;
+	}
+	LOG(INFO)<<"stark processing read for file name:"<<fileName;
+	std::string filePath = root_dir + fileName;
+	int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1){
+		LOG(ERROR)<<"file not found";
+		errorCode = TFTP_ERROR_FILE_NOT_FOUND;
+		return -1;
+	}
+	if(!addReader(fileName, errorCode)){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief function returns the content of a file opened with openReadableFile. A cached copy is
+ * returned when the file is unchanged since it was cached, a cacheable file is loaded in memory
+ * and cached, any other file is mapped when mapUncached is set. All the readers of the file share
+ * the returned content until the last one closes the file. Returns NULL when no content is available.
+*/
+std::shared_ptr<FileMapping> STARK::mapReadableFile(std::string fileName, int fd, const struct stat& fileStat, bool mapUncached){
+	uint64_t fileSize = (uint64_t)fileStat.st_size;
+	bool cacheable;
+	{
 		std::lock_guard<std::mutex> lock(mutexObj);
-		if (fileData.find(fileName) != fileData.end()){
-			bool writeStatus = fileData[fileName].second;
-			if(writeStatus == true){
-				writeStatus = false;
-				fileData[fileName].second = writeStatus;
-                LOG(DEBUG)<<"file closed successfully";
-                return true;
-			}
-			else{
-				LOG(FATAL)<<"wrte file open but write status already false";
-				return false;
-			}	
+		auto fileIt = fileData.find(fileName);
+		if(fileIt == fileData.end() || fileIt->second.first == 0){
+			LOG(ERROR)<<"file "<<fileName<<" mapped without being opened for reading";
+			return std::shared_ptr<FileMapping>();
 		}
-		else{
-			LOG(FATAL)<<"file open but not in list";
+		auto mapIt = fileMaps.find(fileName);
+		if(mapIt != fileMaps.end() && mapIt->second->getSize() == fileSize){
+			mapsShared++;
+			return mapIt->second;
+		}
+		std::shared_ptr<FileMapping> cached = fileCache.lookup(fileName, fileStat);
+		if(cached){
+			fileMaps[fileName] = cached;
+			return cached;
+		}
+		cacheable = fileCache.isCacheable(fileSize);
+		if(!cacheable && !mapUncached){
+			return std::shared_ptr<FileMapping>();
+		}
+	}
+	// The file is read or mapped without holding the lock, readers of other files are not delayed
+	std::shared_ptr<FileMapping> content = cacheable ? FileMapping::load(fd, fileSize) : FileMapping::create(fd, fileSize);
+	if(!content){
+		return content;
+	}
+	std::lock_guard<std::mutex> lock(mutexObj);
+	auto mapIt = fileMaps.find(fileName);
+	if(mapIt != fileMaps.end() && mapIt->second->getSize() == fileSize){
+		// Another reader of the file got there first
+		mapsShared++;
+		return mapIt->second;
+	}
+	if(cacheable){
+		fileCache.insert(fileName, fileStat, content);
+	}
+	// A size change means the file was modified outside of the server, the readers opened since then get a new mapping
+	fileMaps[fileName] = content;
+	mapsCreated++;
+	return content;
+}
+
+void STARK::setCacheLimits(uint64_t budgetBytes, uint64_t maxFileBytes){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	fileCache.setLimits(budgetBytes, maxFileBytes);
+	return;
+}
+
+void STARK::getCacheStats(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& invalidations, uint64_t& usedBytes){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	hits = fileCache.hits;
+	misses = fileCache.misses;
+	evictions = fileCache.evictions;
+	invalidations = fileCache.invalidations;
+	usedBytes = fileCache.getUsedBytes();
+	return;
+}
+
+/**
+ * @brief function returns the packet image of a hot cached file. The whole file is copied into the image outside
+ * of the lock, the other sessions keep opening and closing files meanwhile.
+*/
+std::shared_ptr<PacketImage> STARK::getPacketImage(std::string fileName, const std::shared_ptr<FileMapping>& content, int blockSize){
+	bool buildDue = false;
+	{
+		std::lock_guard<std::mutex> lock(mutexObj);
+		std::shared_ptr<PacketImage> packetImage = fileCache.findPacketImage(fileName, content, blockSize, buildDue);
+		if(!buildDue){
+			return packetImage;
+		}
+	}
+	std::shared_ptr<PacketImage> packetImage = PacketImage::build(content->getData(), content->getSize(), blockSize);
+	std::lock_guard<std::mutex> lock(mutexObj);
+	return fileCache.addPacketImage(fileName, content, blockSize, packetImage);
+}
+
+uint64_t STARK::getImagesBuilt(){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	return fileCache.imagesBuilt;
+}
+
+/**
+ * @brief function drops the cached copy of a file written or deleted through STARK
+*/
+void STARK::invalidateCachedFile(std::string fileName){
+	std::lock_guard<std::mutex> lock(mutexObj);
+	fileCache.invalidate(fileName);
+	return;
+}
+
+/**
+ * @brief function to check if a file is having write permission
+ * creates the hidden upload file if the permission exists and returns its file descriptor, -1 on failure.
+ * The upload is visible under its name once commitWritableFile moves it into place.
+*/
+int STARK::openWritableFile(std::string fileName, TftpErrorCode& errorCode){
+	errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+	if(fileName.empty()){
+		LOG(ERROR)<<"file name is NULL";
+		return -1;
+	}
+	if(isUploadName(fileName)){
+		LOG(ERROR)<<"file name reserved for uploads in progress";
+		return -1;
+	}
+	LOG(INFO)<<"file name:"<<fileName;
+	std::string filePath = root_dir + fileName;
+	if(access(filePath.c_str(), F_OK) == 0){
+		LOG(ERROR)<<"file already exists";
+		errorCode = TFTP_ERROR_FILE_ALREADY_EXISTS;
+		return -1;
+	}
+	// The writer entry keeps a second upload of the same name away from the upload file
+	if(!addWriter(fileName, errorCode)){
+		return -1;
+	}
+	std::string uploadPath = getUploadPath(fileName);
+	int fd = open(uploadPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd == -1){
+		LOG(ERROR)<<"unable to open file in write mode";
+		errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+		removeWriter(fileName);
+		return -1;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutexObj);
+		uploadPaths[fileName] = uploadPath;
+	}
+	invalidateCachedFile(fileName);
+	return fd;
+}
+
+/**
+ * @brief function allocates the extents of a file that will hold size bytes, before any of them is written.
+ * Fails with TFTP_ERROR_DISK_FULL when the file system has not enough free space. The file size is left unchanged,
+ * and file systems without fallocate support only get the free space check.
+*/
+bool STARK::reserveFileSpace(int fd, uint64_t size, TftpErrorCode& errorCode){
+	errorCode = TFTP_ERROR_DISK_FULL;
+	if(fd == -1 || size == 0){
+		return true;
+	}
+	struct statvfs fsStat;
+	if(fstatvfs(fd, &fsStat) == 0 && (uint64_t)fsStat.f_bavail * fsStat.f_frsize < size){
+		LOG(ERROR)<<"not enough free space for "<<size<<" bytes";
+		return false;
+	}
+	if(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == -1){
+		if(errno == ENOSPC || errno == EDQUOT){
+			LOG(ERROR)<<"unable to allocate "<<size<<" bytes "<<strerror(errno);
 			return false;
 		}
-	} 
-	else{
+		LOG(DEBUG)<<"fallocate not supported "<<strerror(errno);
+	}
+	return true;
+}
+
+/**
+ * @brief function allocates the extents of the file fileName of the root directory, see reserveFileSpace(int, ...)
+*/
+bool STARK::reserveFileSpace(std::string fileName, uint64_t size, TftpErrorCode& errorCode){
+	errorCode = TFTP_ERROR_ACCESS_VIOLATION;
+	std::string filePath = root_dir + fileName;
+	int fd = open(filePath.c_str(), O_WRONLY | O_CLOEXEC);
+	if(fd == -1){
+		LOG(ERROR)<<"unable to open "<<fileName<<" "<<strerror(errno);
+		return false;
+	}
+	bool ret = reserveFileSpace(fd, size, errorCode);
+	close(fd);
+	return ret;
+}
+
+/**
+ * @brief function to close a readable file descriptor
+*/
+bool STARK::closeReadableFile(std::string fileName, int fd){
+	if(!fileName.empty() && fd != -1){
+		close(fd);
+		return removeReader(fileName);
+	}
+	LOG(ERROR)<<"file name is NULL  or file as already closed name:" <<fileName;
+	return false;
+}
+
+/**
+ * @brief function to close a writable file descriptor, the upload file of an incomplete upload is removed
+*/
+bool STARK::closeWritableFile(std::string fileName, int fd){
+	if(!fileName.empty() && fd != -1){
+		close(fd);
+		std::string uploadPath;
+		{
+			std::lock_guard<std::mutex> lock(mutexObj);
+			auto uploadIt = uploadPaths.find(fileName);
+			if(uploadIt != uploadPaths.end()){
+				uploadPath = uploadIt->second;
+				uploadPaths.erase(uploadIt);
+			}
+		}
+		if(!uploadPath.empty()){
+			LOG(INFO)<<"incomplete upload of "<<fileName<<" removed";
+			unlink(uploadPath.c_str());
+		}
+		invalidateCachedFile(fileName);
+		return removeWriter(fileName);
+	}
+	LOG(ERROR)<<"file name is NULL  or file as already closed name:" <<fileName;
+	return false;
+}
+
+/**
+ * @brief function closes a complete upload and moves it into place, readers see either no file or the whole file.
+ * With group commits the upload is queued instead: the commit thread syncs its data first and renames it after,
+ * so the file shows up under its name only once durable. onDurable reports when that happened.
+*/
+bool STARK::commitWritableFile(std::string fileName, int fd, std::function<void(bool)> onDurable){
+	if(fileName.empty() || fd == -1){
 		LOG(ERROR)<<"file name is NULL  or file as already closed name:" <<fileName;
+		if(onDurable){
+			onDurable(false);
+		}
 		return false;
 	}
-    return true;
-}
\ No newline at end of file
+	close(fd);
+	std::string uploadPath;
+	{
+		std::lock_guard<std::mutex> lock(mutexObj);
+		auto uploadIt = uploadPaths.find(fileName);
+		if(uploadIt != uploadPaths.end()){
+			uploadPath = uploadIt->second;
+			uploadPaths.erase(uploadIt);
+		}
+	}
+	if(uploadPath.empty()){
+		LOG(ERROR)<<"no upload in progress for "<<fileName;
+		removeWriter(fileName);
+		if(onDurable){
+			onDurable(false);
+		}
+		return false;
+	}
+	{
+		// The writer entry keeps the name reserved until the group commit renames the upload
+		std::lock_guard<std::mutex> lock(commitMutex);
+		if(rootFD != -1 && !commitStopping){
+			commitsPending.push_back({fileName, uploadPath, onDurable});
+			commitCond.notify_all();
+			return true;
+		}
+	}
+	bool ret = moveUploadIntoPlace(fileName, uploadPath);
+	if(onDurable){
+		onDurable(ret);
+	}
+	return ret;
+}
+
+/**
+ * @brief function renames the upload file into place and drops the writer entry of the upload.
+ * A file created outside of the server meanwhile is not replaced.
+*/
+bool STARK::moveUploadIntoPlace(const std::string& fileName, const std::string& uploadPath){
+	std::string filePath = root_dir + fileName;
+	int ret = renameat2(AT_FDCWD, uploadPath.c_str(), AT_FDCWD, filePath.c_str(), RENAME_NOREPLACE);
+	if(ret == -1 && (errno == EINVAL || errno == ENOSYS)){
+		// File system without RENAME_NOREPLACE, link fails as well when the name exists
+		ret = link(uploadPath.c_str(), filePath.c_str());
+		if(ret == 0){
+			unlink(uploadPath.c_str());
+		}
+	}
+	if(ret == -1){
+		LOG(ERROR)<<"unable to move upload of "<<fileName<<" into place: "<<strerror(errno);
+		unlink(uploadPath.c_str());
+		removeWriter(fileName);
+		return false;
+	}
+	invalidateCachedFile(fileName);
+	{
+		std::lock_guard<std::mutex> lock(commitMutex);
+		uploadsCommitted++;
+	}
+	return removeWriter(fileName);
+}
+
+/**
+ * @brief function checks if the last component of the name is the one of an upload file
+*/
+bool STARK::isUploadName(const std::string& fileName){
+	size_t baseStart = fileName.find_last_of('/');
+	baseStart = (baseStart == std::string::npos) ? 0 : baseStart + 1;
+	return fileName.compare(baseStart, strlen(TFTP_UPLOAD_PREFIX), TFTP_UPLOAD_PREFIX) == 0;
+}
+
+/**
+ * @brief function returns the upload file path of a file, in the same directory so that the rename is atomic
+*/
+std::string STARK::getUploadPath(const std::string& fileName){
+	size_t baseStart = fileName.find_last_of('/');
+	baseStart = (baseStart == std::string::npos) ? 0 : baseStart + 1;
+	return root_dir + fileName.substr(0, baseStart) + TFTP_UPLOAD_PREFIX + fileName.substr(baseStart);
+}
+
+/**
+ * @brief function removes the upload files left in the root directory by a server that did not complete them
+*/
+int STARK::removeStaleUploads(){
+	int numRemoved = 0;
+	std::error_code error;
+	for(const auto& entry : std::experimental::filesystem::directory_iterator(root_dir, error)){
+		std::string name = entry.path().filename().string();
+		if(isUploadName(name) && unlink(entry.path().c_str()) == 0){
+			numRemoved++;
+		}
+	}
+	if(error){
+		LOG(ERROR)<<"unable to list "<<root_dir<<": "<<error.message();
+	}
+	return numRemoved;
+}
+
+/**
+ * @brief function starts the thread committing the completed uploads. The first upload after a commit starts
+ * a window of intervalMs, the data of every upload completed within the window is made durable by a single syncfs,
+ * then the uploads are renamed into place and their directories synced.
+*/
+bool STARK::startGroupCommit(int intervalMs){
+	rootFD = open(root_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(rootFD == -1){
+		LOG(ERROR)<<"unable to open "<<root_dir<<" for group commits: "<<strerror(errno);
+		return false;
+	}
+	commitIntervalMs = intervalMs;
+	commitStopping = false;
+	commitThread = std::thread(&STARK::groupCommitLoop, this);
+	return true;
+}
+
+void STARK::stopGroupCommit(){
+	{
+		std::lock_guard<std::mutex> lock(commitMutex);
+		commitStopping = true;
+	}
+	commitCond.notify_all();
+	if(commitThread.joinable()){
+		commitThread.join();
+	}
+	if(rootFD != -1){
+		close(rootFD);
+		rootFD = -1;
+	}
+	return;
+}
+
+void STARK::groupCommitLoop(){
+	std::unique_lock<std::mutex> lock(commitMutex);
+	while(true){
+		commitCond.wait(lock, [this]{ return commitStopping || !commitsPending.empty(); });
+		if(!commitStopping){
+			// The uploads completed within the window join this commit
+			commitCond.wait_for(lock, std::chrono::milliseconds(commitIntervalMs), [this]{ return commitStopping; });
+		}
+		if(!commitsPending.empty()){
+			std::vector<PendingCommit> batch;
+			batch.swap(commitsPending);
+			lock.unlock();
+			bool synced = (syncfs(rootFD) == 0);
+			if(!synced){
+				LOG(ERROR)<<"group commit of "<<batch.size()<<" uploads failed: "<<strerror(errno);
+			}
+			std::vector<bool> results;
+			std::vector<std::string> dirPaths;
+			for(const auto& upload : batch){
+				// An upload whose data may not be on disk is dropped, not renamed
+				if(!synced){
+					unlink(upload.uploadPath.c_str());
+					removeWriter(upload.fileName);
+					results.push_back(false);
+					continue;
+				}
+				results.push_back(moveUploadIntoPlace(upload.fileName, upload.uploadPath));
+				if(results.back()){
+					size_t baseStart = upload.fileName.find_last_of('/');
+					baseStart = (baseStart == std::string::npos) ? 0 : baseStart + 1;
+					dirPaths.push_back(root_dir + upload.fileName.substr(0, baseStart));
+				}
+			}
+			// The renames are durable once the directories holding them are
+			std::sort(dirPaths.begin(), dirPaths.end());
+			dirPaths.erase(std::unique(dirPaths.begin(), dirPaths.end()), dirPaths.end());
+			for(const auto& dirPath : dirPaths){
+				int dirFD = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+				if(dirFD == -1 || fsync(dirFD) == -1){
+					LOG(ERROR)<<"unable to sync directory "<<dirPath<<": "<<strerror(errno);
+				}
+				if(dirFD != -1){
+					close(dirFD);
+				}
+			}
+			for(size_t i = 0; i < batch.size(); ++i){
+				if(batch[i].onDurable){
+					batch[i].onDurable(results[i]);
+				}
+			}
+			lock.lock();
+			groupCommits++;
+		}
+		if(commitStopping && commitsPending.empty()){
+			break;
+		}
+	}
+	return;
+}
+
+/**
+ * @brief function maps fileSize bytes of the file for reading
+*/
+std::shared_ptr<FileMapping> FileMapping::create(int fileFD, uint64_t fileSize){
+	if(fileFD == -1 || fileSize == 0 || fileSize > (uint64_t)SIZE_MAX){
+		return std::shared_ptr<FileMapping>();
+	}
+	void* data = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_SHARED, fileFD, 0);
+	if(data == MAP_FAILED){
+		LOG(ERROR)<<"Unable to map file: "<<strerror(errno);
+		return std::shared_ptr<FileMapping>();
+	}
+	// The blocks are sent in order, the kernel can read ahead aggressively
+	madvise(data, (size_t)fileSize, MADV_SEQUENTIAL);
+	return std::shared_ptr<FileMapping>(new FileMapping(data, fileSize, false));
+}
+
+/**
+ * @brief function reads fileSize bytes of the file into anonymous memory, the copy is not affected by later changes of the file
+*/
+std::shared_ptr<FileMapping> FileMapping::load(int fileFD, uint64_t fileSize){
+	if(fileFD == -1 || fileSize == 0 || fileSize > (uint64_t)SIZE_MAX){
+		return std::shared_ptr<FileMapping>();
+	}
+	void* data = mmap(NULL, (size_t)fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(data == MAP_FAILED){
+		LOG(ERROR)<<"Unable to allocate file copy: "<<strerror(errno);
+		return std::shared_ptr<FileMapping>();
+	}
+	uint64_t bytesRead = 0;
+	while(bytesRead < fileSize){
+		ssize_t ret = pread(fileFD, (uint8_t*)data + bytesRead, (size_t)(fileSize - bytesRead), (off_t)bytesRead);
+		if(ret <= 0){
+			if(ret == -1 && errno == EINTR){
+				continue;
+			}
+			LOG(ERROR)<<"Unable to load file, read "<<bytesRead<<" of "<<fileSize<<" bytes "<<strerror(errno);
+			munmap(data, (size_t)fileSize);
+			return std::shared_ptr<FileMapping>();
+		}
+		bytesRead += (uint64_t)ret;
+	}
+	mprotect(data, (size_t)fileSize, PROT_READ);
+	return std::shared_ptr<FileMapping>(new FileMapping(data, fileSize, true));
+}
+
+FileMapping::FileMapping(void* data, uint64_t size, bool resident){
+	this->data = data;
+	this->size = size;
+	this->resident = resident;
+}
+
+FileMapping::~FileMapping(){
+	munmap(data, (size_t)size);
+}
+
+const uint8_t* FileMapping::getData(){
+	return (const uint8_t*)data;
+}
+
+uint64_t FileMapping::getSize(){
+	return size;
+}
+
+bool FileMapping::isResident(){
+	return resident;
+}
+
+/**
+ * @brief function returns a view of length bytes at offset, the block N of a transfer is the view at N*blksize
+*/
+const uint8_t* FileMapping::getView(uint64_t offset, int length){
+	if(length < 0 || offset > size || (uint64_t)length > size - offset){
+		return NULL;
+	}
+	return (const uint8_t*)data + offset;
+}
+
+/**
+ * @brief constructor for FileCache Class, the cache is disabled until setLimits
+*/
+FileCache::FileCache(){
+	budgetBytes = 0;
+	maxFileBytes = 0;
+	usedBytes = 0;
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+	invalidations = 0;
+	imagesBuilt = 0;
+}
+
+/**
+ * @brief function sets the byte budget of the cache and the size of the largest cached file, evicting entries over the new budget
+*/
+void FileCache::setLimits(uint64_t budgetBytes, uint64_t maxFileBytes){
+	this->budgetBytes = budgetBytes;
+	this->maxFileBytes = std::min(maxFileBytes, budgetBytes);
+	while(usedBytes > budgetBytes && !lruList.empty()){
+		erase(std::prev(lruList.end()));
+		evictions++;
+	}
+	return;
+}
+
+bool FileCache::isCacheable(uint64_t fileSize){
+	return fileSize > 0 && fileSize <= maxFileBytes;
+}
+
+/**
+ * @brief function returns the cached content of the file, a stale entry (file replaced or modified since it was cached) is dropped
+*/
+std::shared_ptr<FileMapping> FileCache::lookup(const std::string& fileName, const struct stat& fileStat){
+	if(budgetBytes == 0){
+		return std::shared_ptr<FileMapping>();
+	}
+	auto it = entries.find(fileName);
+	if(it == entries.end()){
+		misses++;
+		return std::shared_ptr<FileMapping>();
+	}
+	auto entryIt = it->second;
+	if(entryIt->device != fileStat.st_dev || entryIt->inode != fileStat.st_ino || entryIt->size != (uint64_t)fileStat.st_size ||
+		entryIt->mtime.tv_sec != fileStat.st_mtim.tv_sec || entryIt->mtime.tv_nsec != fileStat.st_mtim.tv_nsec){
+		LOG(DEBUG)<<"cached copy of "<<fileName<<" is stale";
+		erase(entryIt);
+		invalidations++;
+		misses++;
+		return std::shared_ptr<FileMapping>();
+	}
+	lruList.splice(lruList.begin(), lruList, entryIt);
+	entryIt->hits++;
+	hits++;
+	return entryIt->content;
+}
+
+/**
+ * @brief function caches the content of the file, the least recently used files are evicted to make room
+*/
+void FileCache::insert(const std::string& fileName, const struct stat& fileStat, std::shared_ptr<FileMapping> content){
+	if(!content || !isCacheable(content->getSize())){
+		return;
+	}
+	auto it = entries.find(fileName);
+	if(it != entries.end()){
+		erase(it->second);
+	}
+	makeRoom(content->getSize(), lruList.end());
+	CacheEntry entry;
+	entry.fileName = fileName;
+	entry.device = fileStat.st_dev;
+	entry.inode = fileStat.st_ino;
+	entry.size = content->getSize();
+	entry.mtime = fileStat.st_mtim;
+	entry.content = std::move(content);
+	entry.bytes = entry.size;
+	entry.hits = 0;
+	usedBytes += entry.bytes;
+	lruList.push_front(std::move(entry));
+	entries[fileName] = lruList.begin();
+	return;
+}
+
+/**
+ * @brief function returns the packet image of a cached file for blockSize. The image is built on the
+ * first hit of the file, files downloaded once never get one. Building it evicts other files if needed.
+*/
+static uint64_t getImageBytes(uint64_t fileSize, int blockSize){
+	return (fileSize / blockSize + 1) * (TFTP_MAX_HEADER_SIZE + (uint64_t)blockSize);
+}
+
+std::shared_ptr<PacketImage> FileCache::findPacketImage(const std::string& fileName, const std::shared_ptr<FileMapping>& content, int blockSize, bool& buildDue){
+	buildDue = false;
+	auto it = entries.find(fileName);
+	if(it == entries.end() || it->second->content != content || it->second->hits == 0){
+		return std::shared_ptr<PacketImage>();
+	}
+	auto entryIt = it->second;
+	for(auto& packetImage : entryIt->packetImages){
+		if(packetImage->getBlockSize() == blockSize){
+			return packetImage;
+		}
+	}
+	if(std::find(entryIt->pendingImages.begin(), entryIt->pendingImages.end(), blockSize) != entryIt->pendingImages.end()){
+		return std::shared_ptr<PacketImage>();
+	}
+	uint64_t imageBytes = getImageBytes(entryIt->size, blockSize);
+	if(entryIt->bytes + imageBytes > budgetBytes || !makeRoom(imageBytes, entryIt)){
+		return std::shared_ptr<PacketImage>();
+	}
+	entryIt->pendingImages.push_back(blockSize);
+	entryIt->bytes += imageBytes;
+	usedBytes += imageBytes;
+	buildDue = true;
+	return std::shared_ptr<PacketImage>();
+}
+
+std::shared_ptr<PacketImage> FileCache::addPacketImage(const std::string& fileName, const std::shared_ptr<FileMapping>& content, int blockSize, std::shared_ptr<PacketImage> packetImage){
+	auto it = entries.find(fileName);
+	if(it == entries.end() || it->second->content != content){
+		// Invalidated or evicted while the image was built, the reservation went with the entry
+		return std::shared_ptr<PacketImage>();
+	}
+	auto entryIt = it->second;
+	auto pendingIt = std::find(entryIt->pendingImages.begin(), entryIt->pendingImages.end(), blockSize);
+	if(pendingIt == entryIt->pendingImages.end()){
+		return std::shared_ptr<PacketImage>();
+	}
+	entryIt->pendingImages.erase(pendingIt);
+	uint64_t imageBytes = getImageBytes(entryIt->size, blockSize);
+	entryIt->bytes -= imageBytes;
+	usedBytes -= imageBytes;
+	if(!packetImage){
+		return packetImage;
+	}
+	entryIt->packetImages.push_back(packetImage);
+	entryIt->bytes += packetImage->getBytes();
+	usedBytes += packetImage->getBytes();
+	imagesBuilt++;
+	return packetImage;
+}
+
+/**
+ * @brief function evicts least recently used entries other than keepIt until bytes more fit in the budget
+*/
+bool FileCache::makeRoom(uint64_t bytes, std::list<CacheEntry>::iterator keepIt){
+	auto victimIt = lruList.end();
+	while(usedBytes + bytes > budgetBytes && victimIt != lruList.begin()){
+		--victimIt;
+		if(victimIt == keepIt){
+			continue;
+		}
+		auto evictIt = victimIt++;
+		erase(evictIt);
+		evictions++;
+	}
+	return usedBytes + bytes <= budgetBytes;
+}
+
+void FileCache::invalidate(const std::string& fileName){
+	auto it = entries.find(fileName);
+	if(it != entries.end()){
+		erase(it->second);
+		invalidations++;
+	}
+	return;
+}
+
+/**
+ * @brief function removes an entry, its memory is released once the sessions still sending from it are done
+*/
+void FileCache::erase(std::list<CacheEntry>::iterator entryIt){
+	usedBytes -= entryIt->bytes;
+	entries.erase(entryIt->fileName);
+	lruList.erase(entryIt);
+	return;
+}
+
+uint64_t FileCache::getUsedBytes(){
+	return usedBytes;
+}
+
+size_t FileCache::size(){
+	return entries.size();
+}
+
+/**
+ * @brief constructor for PacketImage Class, one slot of TFTP_MAX_HEADER_SIZE + blockSize bytes per block
+*/
+PacketImage::PacketImage(uint64_t dataSize, int blockSize){
+	this->dataSize = dataSize;
+	this->blockSize = blockSize;
+	numBlocks = dataSize / blockSize + 1;
+}
+
+/**
+ * @brief function builds the DATA datagrams of every block of data, the final block is shorter than blockSize
+*/
+std::shared_ptr<PacketImage> PacketImage::build(const uint8_t* data, uint64_t dataSize, int blockSize){
+	if(data == NULL || blockSize <= 0){
+		return std::shared_ptr<PacketImage>();
+	}
+	std::shared_ptr<PacketImage> packetImage(new PacketImage(dataSize, blockSize));
+	size_t slotSize = TFTP_MAX_HEADER_SIZE + (size_t)blockSize;
+	packetImage->buffer.resize((size_t)packetImage->numBlocks * slotSize);
+	for(uint64_t blockIndex = 0; blockIndex < packetImage->numBlocks; ++blockIndex){
+		uint8_t* packet = &packetImage->buffer[(size_t)blockIndex * slotSize];
+		uint64_t offset = blockIndex * blockSize;
+		uint64_t dataLen = std::min((uint64_t)blockSize, dataSize - offset);
+		// Block numbers wrap around to 0. A session with rollover 1 sends the blocks after 65535 from the mapping,
+		// their header no longer matches its lastPacket
+		makeDataHeader(packet, slotSize, (uint16_t)(blockIndex + 1));
+		memcpy(packet + TFTP_MAX_HEADER_SIZE, data + offset, (size_t)dataLen);
+	}
+	return packetImage;
+}
+
+const uint8_t* PacketImage::getPacket(uint64_t blockIndex, int& packetLen){
+	if(blockIndex >= numBlocks){
+		return NULL;
+	}
+	uint64_t offset = blockIndex * blockSize;
+	packetLen = TFTP_MAX_HEADER_SIZE + (int)std::min((uint64_t)blockSize, dataSize - offset);
+	return &buffer[(size_t)blockIndex * (TFTP_MAX_HEADER_SIZE + (size_t)blockSize)];
+}
+
+int PacketImage::getBlockSize(){
+	return blockSize;
+}
+
+uint64_t PacketImage::getBytes(){
+	return buffer.size();
+}
+
+/**
+ * @brief function allocates a write-behind buffer of bufferBytes, rounded down to whole chunks and holding at least two.
+ * The chunks are page aligned, as O_DIRECT requires.
+*/
+std::shared_ptr<WriteBehind> WriteBehind::create(size_t bufferBytes){
+	int numChunks = (int)std::max(bufferBytes / TFTP_WRITE_CHUNK_SIZE, (size_t)2);
+	void* buffer = mmap(NULL, (size_t)numChunks * TFTP_WRITE_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(buffer == MAP_FAILED){
+		LOG(ERROR)<<"Unable to allocate write-behind buffer: "<<strerror(errno);
+		return std::shared_ptr<WriteBehind>();
+	}
+	return std::shared_ptr<WriteBehind>(new WriteBehind((uint8_t*)buffer, numChunks));
+}
+
+WriteBehind::WriteBehind(uint8_t* buffer, int numChunks){
+	this->buffer = buffer;
+	chunks.resize(numChunks);
+	for(int i = 0; i < numChunks; ++i){
+		chunks[i].data = buffer + (size_t)i * TFTP_WRITE_CHUNK_SIZE;
+		chunks[i].len = 0;
+		chunks[i].offset = 0;
+		chunks[i].writing = false;
+		chunks[i].written = false;
+	}
+	head = 0;
+	used = 0;
+	directIO = false;
+	chunksWritten = 0;
+}
+
+WriteBehind::~WriteBehind(){
+	munmap(buffer, chunks.size() * TFTP_WRITE_CHUNK_SIZE);
+}
+
+bool WriteBehind::enableDirectIO(int fileFD){
+	int flags = fcntl(fileFD, F_GETFL);
+	if(flags == -1 || fcntl(fileFD, F_SETFL, flags | O_DIRECT) == -1){
+		LOG(DEBUG)<<"direct I/O not available, "<<strerror(errno);
+		return false;
+	}
+	directIO = true;
+	return true;
+}
+
+/**
+ * @brief function copies a block into the chunks, starting a new chunk when the last one is full or being written
+*/
+bool WriteBehind::append(const uint8_t* data, size_t dataLen, uint64_t offset){
+	int numChunks = (int)chunks.size();
+	WriteChunk* tail = (used > 0) ? &chunks[(head + used - 1) % numChunks] : NULL;
+	size_t room = (size_t)(numChunks - used) * TFTP_WRITE_CHUNK_SIZE;
+	if(tail != NULL && !tail->writing && !tail->written){
+		room += TFTP_WRITE_CHUNK_SIZE - tail->len;
+	}
+	if(room < dataLen){
+		return false;
+	}
+	size_t copied = 0;
+	while(copied < dataLen){
+		if(tail == NULL || tail->writing || tail->written || tail->len == TFTP_WRITE_CHUNK_SIZE){
+			tail = &chunks[(head + used) % numChunks];
+			tail->len = 0;
+			tail->offset = offset + copied;
+			used++;
+		}
+		size_t copyLen = std::min(TFTP_WRITE_CHUNK_SIZE - tail->len, dataLen - copied);
+		memcpy(tail->data + tail->len, data + copied, copyLen);
+		tail->len += copyLen;
+		copied += copyLen;
+	}
+	return true;
+}
+
+int WriteBehind::nextChunk(bool partial){
+	int numChunks = (int)chunks.size();
+	for(int i = 0; i < used; ++i){
+		int chunkIndex = (head + i) % numChunks;
+		WriteChunk& chunk = chunks[chunkIndex];
+		if(!chunk.writing && !chunk.written && (chunk.len == TFTP_WRITE_CHUNK_SIZE || (partial && chunk.len > 0))){
+			return chunkIndex;
+		}
+	}
+	return -1;
+}
+
+WriteChunk* WriteBehind::getChunk(int chunkIndex){
+	return &chunks[chunkIndex];
+}
+
+/**
+ * @brief function marks the chunk in flight. O_DIRECT is turned off before a chunk it can not write, the final short one.
+*/
+void WriteBehind::startWrite(int fileFD, int chunkIndex){
+	WriteChunk& chunk = chunks[chunkIndex];
+	chunk.writing = true;
+	if(directIO && (chunk.len % TFTP_WRITE_ALIGN != 0 || chunk.offset % TFTP_WRITE_ALIGN != 0)){
+		int flags = fcntl(fileFD, F_GETFL);
+		if(flags != -1){
+			fcntl(fileFD, F_SETFL, flags & ~O_DIRECT);
+		}
+		directIO = false;
+	}
+	return;
+}
+
+/**
+ * @brief function releases a written chunk, the chunks at the head of the ring are reused once written
+*/
+void WriteBehind::chunkWritten(int chunkIndex){
+	chunks[chunkIndex].writing = false;
+	chunks[chunkIndex].written = true;
+	chunksWritten++;
+	while(used > 0 && chunks[head].written){
+		chunks[head].written = false;
+		chunks[head].len = 0;
+		head = (head + 1) % (int)chunks.size();
+		used--;
+	}
+	return;
+}
+
+bool WriteBehind::flush(int fileFD, bool partial){
+	int chunkIndex;
+	while((chunkIndex = nextChunk(partial)) != -1){
+		WriteChunk& chunk = chunks[chunkIndex];
+		startWrite(fileFD, chunkIndex);
+		size_t bytesWritten = 0;
+		while(bytesWritten < chunk.len){
+			ssize_t ret = pwrite(fileFD, chunk.data + bytesWritten, chunk.len - bytesWritten, (off_t)(chunk.offset + bytesWritten));
+			if(ret <= 0){
+				if(ret == -1 && errno == EINTR){
+					continue;
+				}
+				LOG(ERROR)<<"file write error, wrote "<<bytesWritten<<" of "<<chunk.len<<" bytes at "<<chunk.offset<<" "<<strerror(errno);
+				chunk.writing = false;
+				return false;
+			}
+			bytesWritten += (size_t)ret;
+		}
+		chunkWritten(chunkIndex);
+	}
+	return true;
+}
+
+bool WriteBehind::isEmpty(){
+	return used == 0;
+}
@@ -0,0 +1,387 @@
+/**
+ * @file tftp_timer.cpp
+ * @brief TFTP Timer Wheel.
+ *
+ * This file contains definations of function for the TimerNode, TimerWheel, RttEstimator and CongestionWindow Classes
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#include "tftp_timer.hpp"
+
+/**
+ * @brief constructor for TimerNode Class
+*/
+TimerNode::TimerNode(){
+	owner = NULL;
+	expiry = 0;
+	prev = NULL;
+	next = NULL;
+	wheel = NULL;
+}
+
+TimerNode::TimerNode(const TimerNode& other){
+	owner = other.owner;
+	expiry = 0;
+	prev = NULL;
+	next = NULL;
+	wheel = NULL;
+}
+
+TimerNode::~TimerNode(){
+	if(wheel != NULL){
+		wheel->cancel(this);
+	}
+}
+
+bool TimerNode::isScheduled(){
+	return wheel != NULL;
+}
+
+uint64_t TimerNode::getExpiry(){
+	return expiry;
+}
+
+/**
+ * @brief constructor for TimerWheel Class, every slot is an empty circular list
+*/
+TimerWheel::TimerWheel(uint64_t nowMs){
+	current = nowMs;
+	count = 0;
+	for(int level = 0; level < TFTP_TIMER_LEVELS; ++level){
+		for(int slot = 0; slot < TFTP_TIMER_SLOTS; ++slot){
+			slots[level][slot].prev = &slots[level][slot];
+			slots[level][slot].next = &slots[level][slot];
+		}
+	}
+}
+
+TimerWheel::~TimerWheel(){
+	for(int level = 0; level < TFTP_TIMER_LEVELS; ++level){
+		for(int slot = 0; slot < TFTP_TIMER_SLOTS; ++slot){
+			TimerNode* head = &slots[level][slot];
+			while(head->next != head){
+				unlink(head->next);
+			}
+		}
+	}
+}
+
+/**
+ * @brief function places the timer in the slot of the lowest level whose span covers its delay
+*/
+void TimerWheel::link(TimerNode* timer){
+	uint64_t delay = timer->expiry - current;
+	int level = 0;
+	while(level < TFTP_TIMER_LEVELS - 1 && delay >= (1ULL << ((level + 1) * TFTP_TIMER_SLOT_BITS))){
+		level++;
+	}
+	int slot = (int)((timer->expiry >> (level * TFTP_TIMER_SLOT_BITS)) & (TFTP_TIMER_SLOTS - 1));
+	TimerNode* head = &slots[level][slot];
+	timer->prev = head->prev;
+	timer->next = head;
+	head->prev->next = timer;
+	head->prev = timer;
+	timer->wheel = this;
+	count++;
+	return;
+}
+
+void TimerWheel::unlink(TimerNode* timer){
+	timer->prev->next = timer->next;
+	timer->next->prev = timer->prev;
+	timer->prev = NULL;
+	timer->next = NULL;
+	timer->wheel = NULL;
+	count--;
+	return;
+}
+
+/**
+ * @brief function arms the timer at expiryMs, an armed timer is moved. Expiries in the past fire on the next advance.
+*/
+void TimerWheel::schedule(TimerNode* timer, uint64_t expiryMs){
+	if(timer->wheel != NULL){
+		timer->wheel->unlink(timer);
+	}
+	if(expiryMs < current){
+		expiryMs = current;
+	}
+	else if(expiryMs - current > TFTP_TIMER_MAX_DELAY){
+		// Fires early, the owner checks its own deadline and schedules the timer again
+		expiryMs = current + TFTP_TIMER_MAX_DELAY;
+	}
+	timer->expiry = expiryMs;
+	link(timer);
+	return;
+}
+
+void TimerWheel::cancel(TimerNode* timer){
+	if(timer->wheel == this){
+		unlink(timer);
+	}
+	return;
+}
+
+/**
+ * @brief function moves the timers of the current slot of a level down to the lower levels
+*/
+void TimerWheel::cascade(int level){
+	int slot = (int)((current >> (level * TFTP_TIMER_SLOT_BITS)) & (TFTP_TIMER_SLOTS - 1));
+	TimerNode* head = &slots[level][slot];
+	while(head->next != head){
+		TimerNode* timer = head->next;
+		unlink(timer);
+		link(timer);
+	}
+	return;
+}
+
+/**
+ * @brief function expires every timer due at or before nowMs, the expired timers are unscheduled
+ * and appended to expired. Returns the number of expired timers.
+*/
+int TimerWheel::advance(uint64_t nowMs, std::vector<TimerNode*>& expired){
+	int numExpired = 0;
+	while(current <= nowMs){
+		if(count == 0){
+			current = nowMs + 1;
+			break;
+		}
+		int slot = (int)(current & (TFTP_TIMER_SLOTS - 1));
+		if(slot == 0){
+			// Crossing a level 1 boundary, and possibly the higher ones
+			for(int level = 1; level < TFTP_TIMER_LEVELS; ++level){
+				cascade(level);
+				if(((current >> (level * TFTP_TIMER_SLOT_BITS)) & (TFTP_TIMER_SLOTS - 1)) != 0){
+					break;
+				}
+			}
+		}
+		TimerNode* head = &slots[0][slot];
+		while(head->next != head){
+			TimerNode* timer = head->next;
+			unlink(timer);
+			expired.push_back(timer);
+			numExpired++;
+		}
+		current++;
+	}
+	return numExpired;
+}
+
+/**
+ * @brief function returns the milliseconds until the next level 0 expiry, or until the next
+ * cascade when level 0 is empty. Returns -1 when no timer is scheduled.
+*/
+int TimerWheel::getTimeoutMs(uint64_t nowMs){
+	if(count == 0){
+		return -1;
+	}
+	uint64_t wakeMs = (current | (TFTP_TIMER_SLOTS - 1)) + 1; // next level 1 boundary
+	for(uint64_t tick = current; tick < current + TFTP_TIMER_SLOTS; ++tick){
+		TimerNode* head = &slots[0][tick & (TFTP_TIMER_SLOTS - 1)];
+		if(head->next != head){
+			wakeMs = tick;
+			break;
+		}
+	}
+	if(wakeMs <= nowMs){
+		return 0;
+	}
+	return (int)std::min(wakeMs - nowMs, (uint64_t)INT32_MAX);
+}
+
+size_t TimerWheel::size(){
+	return count;
+}
+
+uint64_t TimerWheel::nowMs(){
+	return toMs(std::chrono::steady_clock::now());
+}
+
+/**
+ * @brief function converts a steady clock time point to wheel milliseconds, rounded up so that a timer never fires before it
+*/
+uint64_t TimerWheel::toMs(std::chrono::steady_clock::time_point timePoint){
+	return (uint64_t)std::chrono::ceil<std::chrono::milliseconds>(timePoint.time_since_epoch()).count();
+}
+
+/**
+ * @brief constructor for RttEstimator Class
+*/
+RttEstimator::RttEstimator(){
+	samples = 0;
+	srttUs = -1;
+	rttvarUs = 0;
+	minUs = (int64_t)TFTP_RTO_MIN_MS * 1000;
+	maxUs = (int64_t)TFTP_RTO_MAX_MS * 1000;
+	rtoUs = std::min(std::max((int64_t)TFTP_RTO_INITIAL_MS * 1000, minUs), maxUs);
+	timing = false;
+	timedMark = 0;
+}
+
+/**
+ * @brief function sets the bounds of the RTO, the current RTO is clamped to them
+*/
+void RttEstimator::setLimits(int minMs, int maxMs){
+	minUs = (int64_t)std::max(1, minMs) * 1000;
+	maxUs = std::max(minUs, (int64_t)maxMs * 1000);
+	rtoUs = std::min(std::max(rtoUs, minUs), maxUs);
+}
+
+void RttEstimator::startTiming(uint64_t mark, std::chrono::steady_clock::time_point sendTime){
+	if(timing){
+		return;
+	}
+	timing = true;
+	timedMark = mark;
+	timedSince = sendTime;
+}
+
+void RttEstimator::cancelTiming(){
+	timing = false;
+}
+
+bool RttEstimator::isTiming(){
+	return timing;
+}
+
+uint64_t RttEstimator::getTimedMark(){
+	return timedMark;
+}
+
+void RttEstimator::stopTiming(std::chrono::steady_clock::time_point recvTime){
+	if(!timing){
+		return;
+	}
+	timing = false;
+	sample(std::chrono::duration_cast<std::chrono::microseconds>(recvTime - timedSince).count());
+}
+
+/**
+ * @brief function updates the smoothed RTT and its deviation with one measurement and recomputes the RTO
+*/
+void RttEstimator::sample(int64_t rttUs){
+	rttUs = std::max(rttUs, (int64_t)0);
+	if(srttUs < 0){
+		srttUs = rttUs;
+		rttvarUs = rttUs / 2;
+	}
+	else{
+		int64_t deviation = (srttUs > rttUs) ? srttUs - rttUs : rttUs - srttUs;
+		rttvarUs = (3 * rttvarUs + deviation) / 4;
+		srttUs = (7 * srttUs + rttUs) / 8;
+	}
+	samples++;
+	rtoUs = srttUs + std::max((int64_t)TFTP_RTO_GRANULARITY_US, 4 * rttvarUs);
+	rtoUs = std::min(std::max(rtoUs, minUs), maxUs);
+}
+
+bool RttEstimator::backoff(){
+	timing = false;
+	if(rtoUs >= maxUs){
+		return false;
+	}
+	rtoUs = std::min(rtoUs * 2, maxUs);
+	return true;
+}
+
+/**
+ * @brief function returns the RTO in milliseconds, rounded up
+*/
+int RttEstimator::getTimeoutMs(){
+	return (int)((rtoUs + 999) / 1000);
+}
+
+/**
+ * @brief function returns the smoothed RTT in milliseconds, rounded up and held between TFTP_ACK_DELAY_MIN_MS and
+ * TFTP_ACK_DELAY_MAX_MS. TFTP_ACK_DELAY_MAX_MS before the first sample.
+*/
+int RttEstimator::getAckDelayMs(){
+	if(srttUs < 0){
+		return TFTP_ACK_DELAY_MAX_MS;
+	}
+	return (int)std::min(std::max((srttUs + 999) / 1000, (int64_t)TFTP_ACK_DELAY_MIN_MS), (int64_t)TFTP_ACK_DELAY_MAX_MS);
+}
+
+int64_t RttEstimator::getSmoothedUs(){
+	return srttUs;
+}
+
+/**
+ * @brief constructor for CongestionWindow Class
+*/
+CongestionWindow::CongestionWindow(){
+	losses = 0;
+	timeouts = 0;
+	init(1);
+}
+
+/**
+ * @brief function starts the window of a transfer of maxWindow blocks per ACK
+*/
+void CongestionWindow::init(int maxWindow){
+	this->maxWindow = std::max(1, maxWindow);
+	window = std::min(TFTP_CWND_INITIAL, this->maxWindow);
+	threshold = this->maxWindow;
+	ackedInWindow = 0;
+	recoveryMark = 0;
+	wholeWindows = false;
+}
+
+int CongestionWindow::getWindow(){
+	return wholeWindows ? maxWindow : window;
+}
+
+/**
+ * @brief function grows the window with the blocks of an ACK, the window is not grown while a loss is recovered
+*/
+void CongestionWindow::onAck(int newlyAcked, uint64_t ackedMark){
+	if(ackedMark < recoveryMark){
+		return;
+	}
+	if(window < threshold){
+		window = std::min(window + newlyAcked, threshold);
+		return;
+	}
+	ackedInWindow += newlyAcked;
+	while(ackedInWindow >= window){
+		ackedInWindow -= window;
+		window++;
+	}
+	window = std::min(window, maxWindow);
+}
+
+void CongestionWindow::onLoss(uint64_t ackedMark, uint64_t sentMark){
+	if(ackedMark < recoveryMark){
+		return;
+	}
+	losses++;
+	recoveryMark = sentMark;
+	cut();
+}
+
+void CongestionWindow::onTimeout(uint64_t sentMark){
+	timeouts++;
+	recoveryMark = sentMark;
+	cut();
+}
+
+void CongestionWindow::onStall(){
+	wholeWindows = true;
+}
+
+/**
+ * @brief function halves the window, whole windows sent after a stall end with the loss
+*/
+void CongestionWindow::cut(){
+	wholeWindows = false;
+	window = std::max(window / 2, 1);
+	threshold = window;
+	ackedInWindow = 0;
+}
@@ -0,0 +1,1085 @@
+/**
+ * @file tftp_uring.cpp
+ * @brief TFTP Server io_uring Backend.
+ *
+ * This file contains definations of function for the io_uring backend of the event engine.
+ * The ring is driven through the raw io_uring system calls.
+ *
+ * @date October 17, 2026
+ * @author S U Swakath
+ * Contact suswakath@gmail.com
+ *
+ * MIT License
+*/
+
+#include "tftp_uring.hpp"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Completion types, stored in the top byte of the SQE user_data
+#define URING_OP_LISTEN_RECV  1ULL
+#define URING_OP_RECV         2ULL
+#define URING_OP_READ         3ULL
+#define URING_OP_WRITE        4ULL
+#define URING_OP_DATA_SEND    5ULL // send linked to a file read/write, or DATA send completing the I/O of the session
+#define URING_OP_SEND         6ULL
+#define URING_OP_CONTROL      7ULL
+#define URING_OP_FILES_UPDATE 8ULL
+#define URING_OP_WAKE         9ULL
+#define URING_OP_TICK         10ULL
+#define URING_OP_CANCEL       11ULL
+#define URING_OP_READ_AHEAD   12ULL
+#define URING_OP_WRITE_BEHIND 13ULL // write of a write-behind chunk, its index is the user_data extra
+
+#define URING_USER_DATA(op, index) (((op) << 56) | (uint64_t)(uint32_t)(index))
+#define URING_USER_DATA_EXTRA(op, index, extra) (URING_USER_DATA(op, index) | ((uint64_t)((extra) & 0xFFFFFF) << 32))
+#define URING_USER_OP(userData) ((userData) >> 56)
+#define URING_USER_INDEX(userData) ((int)((userData) & 0xFFFFFFFFULL))
+#define URING_USER_EXTRA(userData) ((int)(((userData) >> 32) & 0xFFFFFFULL))
+
+/**
+ * @brief constructor for IoUring Class
+*/
+IoUring::IoUring(){
+	enterCalls = 0;
+	ringFD = -1;
+	features = 0;
+	sqRingPtr = MAP_FAILED;
+	sqRingSize = 0;
+	cqRingPtr = MAP_FAILED;
+	cqRingSize = 0;
+	sqes = (struct io_uring_sqe*)MAP_FAILED;
+	sqesSize = 0;
+	sqeTail = 0;
+}
+
+IoUring::~IoUring(){
+	exit();
+}
+
+/**
+ * @brief function creates the ring and maps its submission/completion queues
+*/
+bool IoUring::init(unsigned entries){
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CLAMP;
+	ringFD = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if(ringFD == -1){
+		LOG(ERROR)<<"io_uring_setup failed: "<<strerror(errno);
+		return false;
+	}
+
+	features = params.features;
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if(singleMmap){
+		sqRingSize = std::max(sqRingSize, cqRingSize);
+		cqRingSize = sqRingSize;
+	}
+	sqRingPtr = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING);
+	if(sqRingPtr == MAP_FAILED){
+		LOG(ERROR)<<"Unable to map io_uring submission queue: "<<strerror(errno);
+		exit();
+		return false;
+	}
+	if(singleMmap){
+		cqRingPtr = sqRingPtr;
+	}
+	else{
+		cqRingPtr = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_CQ_RING);
+		if(cqRingPtr == MAP_FAILED){
+			LOG(ERROR)<<"Unable to map io_uring completion queue: "<<strerror(errno);
+			exit();
+			return false;
+		}
+	}
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = (struct io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED){
+		LOG(ERROR)<<"Unable to map io_uring SQEs: "<<strerror(errno);
+		exit();
+		return false;
+	}
+
+	uint8_t* sqRing = (uint8_t*)sqRingPtr;
+	sqHead = (unsigned*)(sqRing + params.sq_off.head);
+	sqTail = (unsigned*)(sqRing + params.sq_off.tail);
+	sqArray = (unsigned*)(sqRing + params.sq_off.array);
+	sqMask = *(unsigned*)(sqRing + params.sq_off.ring_mask);
+	sqEntries = params.sq_entries;
+	sqeTail = *sqTail;
+
+	uint8_t* cqRing = (uint8_t*)cqRingPtr;
+	cqHead = (unsigned*)(cqRing + params.cq_off.head);
+	cqTail = (unsigned*)(cqRing + params.cq_off.tail);
+	cqMask = *(unsigned*)(cqRing + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+	return true;
+}
+
+/**
+ * @brief function unmaps the queues and closes the ring, in flight requests are cancelled by the kernel
+*/
+void IoUring::exit(){
+	if(sqes != MAP_FAILED){
+		munmap(sqes, sqesSize);
+		sqes = (struct io_uring_sqe*)MAP_FAILED;
+	}
+	if(cqRingPtr != MAP_FAILED && cqRingPtr != sqRingPtr){
+		munmap(cqRingPtr, cqRingSize);
+	}
+	cqRingPtr = MAP_FAILED;
+	if(sqRingPtr != MAP_FAILED){
+		munmap(sqRingPtr, sqRingSize);
+		sqRingPtr = MAP_FAILED;
+	}
+	if(ringFD != -1){
+		close(ringFD);
+		ringFD = -1;
+	}
+	return;
+}
+
+struct io_uring_sqe* IoUring::getSqe(){
+	unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	if(sqeTail - head >= sqEntries){
+		return NULL;
+	}
+	unsigned index = sqeTail & sqMask;
+	struct io_uring_sqe* sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqArray[index] = index;
+	sqeTail++;
+	return sqe;
+}
+
+/**
+ * @brief function makes room for count SQEs, so that a linked chain is never split across submissions
+*/
+bool IoUring::reserve(unsigned count){
+	if(sqEntries - (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) >= count){
+		return true;
+	}
+	if(submit(false) == -1){
+		LOG(ERROR)<<"io_uring submit failed: "<<strerror(errno);
+	}
+	return sqEntries - (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE)) >= count;
+}
+
+int IoUring::submit(bool wait, int timeoutMs){
+	__atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+	unsigned toSubmit = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+	if(toSubmit == 0 && !wait){
+		return 0;
+	}
+	enterCalls++;
+	if(wait && timeoutMs >= 0 && supportsTimedWait()){
+		struct __kernel_timespec timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = (long long)(timeoutMs % 1000) * 1000000LL;
+		struct io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.ts = (uint64_t)(uintptr_t)&timeout;
+		int ret = (int)syscall(__NR_io_uring_enter, ringFD, toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		if(ret == -1 && errno == ETIME){
+			return 0;
+		}
+		return ret;
+	}
+	return (int)syscall(__NR_io_uring_enter, ringFD, toSubmit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+/**
+ * @brief function returns true when io_uring_enter accepts a wait timeout (IORING_FEAT_EXT_ARG)
+*/
+bool IoUring::supportsTimedWait(){
+	return (features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+struct io_uring_cqe* IoUring::peekCqe(){
+	unsigned head = *cqHead;
+	if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)){
+		return NULL;
+	}
+	return &cqes[head & cqMask];
+}
+
+void IoUring::cqeSeen(){
+	__atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+bool IoUring::registerBuffers(struct iovec* iovecs, unsigned count){
+	if(syscall(__NR_io_uring_register, ringFD, IORING_REGISTER_BUFFERS, iovecs, count) == -1){
+		LOG(ERROR)<<"Unable to register io_uring buffers: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+bool IoUring::registerFiles(int* fds, unsigned count){
+	if(syscall(__NR_io_uring_register, ringFD, IORING_REGISTER_FILES, fds, count) == -1){
+		LOG(ERROR)<<"Unable to register io_uring files: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+bool IoUring::updateFiles(unsigned offset, int* fds, unsigned count){
+	struct io_uring_files_update update;
+	memset(&update, 0, sizeof(update));
+	update.offset = offset;
+	update.fds = (uint64_t)(uintptr_t)fds;
+	if(syscall(__NR_io_uring_register, ringFD, IORING_REGISTER_FILES_UPDATE, &update, count) != (long)count){
+		LOG(ERROR)<<"Unable to update io_uring files: "<<strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief constructor for UringLoop Class
+*/
+UringLoop::UringLoop(int loopId, int listenSocket) : EventLoop(loopId, listenSocket, TFTP_MAX_PACKET_SIZE){
+	numSlots = TftpConfig::getInstance().uringSessions;
+	bufferRegion = (uint8_t*)MAP_FAILED;
+	bufferRegionSize = 0;
+	slotPacketSize = TFTP_BLOCK_PACKET_SIZE(std::min(TftpConfig::getInstance().maxBlockSize, TFTP_URING_MAX_BLOCK_SIZE));
+	wakeFD = -1;
+	wakeCounter = 0;
+	tickTimeout.tv_sec = 0;
+	tickTimeout.tv_nsec = TFTP_ENGINE_TICK_MS * 1000000LL;
+	blocksTransferred = 0;
+	acksHeld = 0;
+}
+
+UringLoop::~UringLoop(){
+	// Tearing down the ring first cancels the receives still armed on the transfer sockets
+	ring.exit();
+	closeAllSessions();
+	// Sockets of the sessions still open were released above, only the closing slots are left
+	for(auto& slot : slots){
+		if(slot.inUse && slot.session == NULL){
+			UDPSocketPool::getInstance().release(slot.socketFD);
+		}
+	}
+	if(bufferRegion != MAP_FAILED){
+		munmap(bufferRegion, bufferRegionSize);
+	}
+	if(wakeFD != -1){
+		close(wakeFD);
+	}
+}
+
+/**
+ * @brief function creates the ring, registers the slot buffers and the sparse file table
+*/
+bool UringLoop::init(){
+	if(!ring.init((unsigned)TftpConfig::getInstance().uringEntries)){
+		return false;
+	}
+
+	// Slot i owns the packet buffers [2i] (send) and [2i + 1] (receive) of the region
+	bufferRegionSize = (size_t)numSlots * 2 * slotPacketSize;
+	bufferRegion = (uint8_t*)mmap(NULL, bufferRegionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(bufferRegion == MAP_FAILED){
+		LOG(ERROR)<<"Unable to allocate io_uring buffers: "<<strerror(errno);
+		return false;
+	}
+	struct iovec region;
+	region.iov_base = bufferRegion;
+	region.iov_len = bufferRegionSize;
+	if(!ring.registerBuffers(&region, 1)){
+		return false;
+	}
+
+	// Fixed file 2i is the transfer socket of slot i and 2i + 1 its file, registered per session
+	std::vector<int> fileTable((size_t)numSlots * 2, -1);
+	if(!ring.registerFiles(fileTable.data(), (unsigned)fileTable.size())){
+		return false;
+	}
+
+	slots.resize(numSlots);
+	for(int i = numSlots - 1; i >= 0; --i){
+		UringSlot& slot = slots[i];
+		// Value-initialized, the plain fields are zeroed and the shared_ptr members left empty
+		slot = UringSlot();
+		slot.socketFD = -1;
+		slot.sendBuffer = bufferRegion + (size_t)i * 2 * slotPacketSize;
+		slot.recvBuffer = slot.sendBuffer + slotPacketSize;
+		freeSlots.push_back(i);
+	}
+	controlPackets.resize(TFTP_URING_CONTROL_PACKETS);
+	for(int i = TFTP_URING_CONTROL_PACKETS - 1; i >= 0; --i){
+		freeControlPackets.push_back(i);
+	}
+
+	wakeFD = eventfd(0, EFD_CLOEXEC);
+	if(wakeFD == -1){
+		LOG(ERROR)<<"Unable to create eventfd: "<<strerror(errno);
+		return false;
+	}
+	listenBuffers.resize(TFTP_URING_LISTEN_DEPTH);
+	for(int i = 0; i < TFTP_URING_LISTEN_DEPTH; ++i){
+		if(!armListen(i)){
+			return false;
+		}
+	}
+	if(!armWakeup()){
+		return false;
+	}
+	if(!ring.supportsTimedWait() && !armTick()){
+		return false;
+	}
+	running = true;
+	return true;
+}
+
+/**
+ * @brief event loop thread function, one io_uring_enter submits the SQEs queued while handling
+ * the previous completions and waits for the next ones
+*/
+void UringLoop::run(){
+	LOG(INFO)<<"io_uring event loop "<<loopId<<" started";
+	while(running){
+		bool wait = (ring.peekCqe() == NULL);
+		if(ring.submit(wait, getWaitMs()) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+			LOG(ERROR)<<"io_uring enter error: "<<strerror(errno);
+			break;
+		}
+		struct io_uring_cqe* cqe;
+		while((cqe = ring.peekCqe()) != NULL){
+			uint64_t userData = cqe->user_data;
+			int res = cqe->res;
+			ring.cqeSeen();
+			handleCompletion(userData, res);
+		}
+		handleCompletions();
+		checkTimeouts();
+		// ERROR replies sent on the default server socket are batched with sendmmsg
+		flushSends();
+	}
+	memset(log_message,0,sizeof(log_message));
+	sprintf(log_message, "io_uring event loop %d stopped with %zu active sessions, %llu enter calls for %llu blocks, %llu ACKs held",
+		loopId, sessions.size(), (unsigned long long)ring.enterCalls, (unsigned long long)blocksTransferred, (unsigned long long)acksHeld);
+	LOG(INFO)<<log_message;
+	logBatchStats();
+	return;
+}
+
+void UringLoop::wakeup(){
+	uint64_t counter = 1;
+	if(wakeFD != -1 && write(wakeFD, &counter, sizeof(counter)) == -1){
+		LOG(ERROR)<<"Unable to wake event loop: "<<strerror(errno);
+	}
+	return;
+}
+
+bool UringLoop::armListen(int index){
+	UringListenBuffer& listenBuffer = listenBuffers[index];
+	listenBuffer.iov.iov_base = listenBuffer.buffer;
+	listenBuffer.iov.iov_len = sizeof(listenBuffer.buffer);
+	memset(&listenBuffer.msg, 0, sizeof(listenBuffer.msg));
+	listenBuffer.msg.msg_name = &listenBuffer.address;
+	listenBuffer.msg.msg_namelen = sizeof(listenBuffer.address);
+	listenBuffer.msg.msg_iov = &listenBuffer.iov;
+	listenBuffer.msg.msg_iovlen = 1;
+	struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+	if(sqe == NULL){
+		LOG(ERROR)<<"io_uring submission queue full, server socket receive not armed";
+		return false;
+	}
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = listenSocket;
+	sqe->addr = (uint64_t)(uintptr_t)&listenBuffer.msg;
+	sqe->len = 1;
+	sqe->user_data = URING_USER_DATA(URING_OP_LISTEN_RECV, index);
+	return true;
+}
+
+bool UringLoop::armWakeup(){
+	struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+	if(sqe == NULL){
+		return false;
+	}
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = wakeFD;
+	sqe->addr = (uint64_t)(uintptr_t)&wakeCounter;
+	sqe->len = sizeof(wakeCounter);
+	sqe->user_data = URING_USER_DATA(URING_OP_WAKE, 0);
+	return true;
+}
+
+/**
+ * @brief function arms the timeout request bounding the wait of the loop to one engine tick,
+ * used only when io_uring_enter cannot wait with a timeout
+*/
+bool UringLoop::armTick(){
+	struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+	if(sqe == NULL){
+		return false;
+	}
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)&tickTimeout;
+	sqe->len = 1;
+	sqe->user_data = URING_USER_DATA(URING_OP_TICK, 0);
+	return true;
+}
+
+bool UringLoop::armRecv(int slotIndex){
+	UringSlot& slot = slots[slotIndex];
+	slot.recvIov.iov_base = slot.recvBuffer;
+	slot.recvIov.iov_len = slotPacketSize;
+	memset(&slot.recvMsg, 0, sizeof(slot.recvMsg));
+	if(!slot.session->connected){
+		slot.recvMsg.msg_name = &slot.recvAddress;
+		slot.recvMsg.msg_namelen = sizeof(slot.recvAddress);
+	}
+	slot.recvMsg.msg_iov = &slot.recvIov;
+	slot.recvMsg.msg_iovlen = 1;
+	slot.recvMsg.msg_control = slot.recvControl;
+	slot.recvMsg.msg_controllen = sizeof(slot.recvControl);
+	struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+	if(sqe == NULL){
+		LOG(ERROR)<<"io_uring submission queue full, transfer socket receive not armed";
+		return false;
+	}
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = slot.socketFD;
+	sqe->addr = (uint64_t)(uintptr_t)&slot.recvMsg;
+	sqe->len = 1;
+	sqe->user_data = URING_USER_DATA(URING_OP_RECV, slotIndex);
+	slot.recvArmed = true;
+	slot.pendingOps++;
+	return true;
+}
+
+bool UringLoop::prepareSession(ClientHandler* session){
+	if(freeSlots.empty()){
+		return false;
+	}
+	int slotIndex = freeSlots.back();
+	freeSlots.pop_back();
+	UringSlot& slot = slots[slotIndex];
+	slot.session = session;
+	slot.socketFD = session->clientSocket;
+	slot.inUse = true;
+	slot.closing = false;
+	slot.recvArmed = false;
+	slot.recvBusy = false;
+	slot.socketShutdown = false;
+	slot.filesRegistered = false;
+	slot.pendingOps = 0;
+	slot.ioOpsLeft = 0;
+	slot.ioFailed = false;
+	slot.chunkWrites = 0;
+	slot.finalFlush = false;
+	slot.commitPending = false;
+	slot.ackHeld = false;
+	slot.sendAddress = session->clientAddress;
+	slot.sendIov.iov_base = slot.sendBuffer;
+	slot.sendIov.iov_len = 0;
+	memset(&slot.sendMsg, 0, sizeof(slot.sendMsg));
+	slot.sendMsg.msg_name = &slot.sendAddress;
+	slot.sendMsg.msg_namelen = sizeof(slot.sendAddress);
+	slot.sendMsg.msg_iov = &slot.sendIov;
+	slot.sendMsg.msg_iovlen = 1;
+	session->ioSlot = slotIndex;
+	// lastPacket lives in the registered send buffer so that READ_FIXED fills the DATA payload in place
+	session->setIO(this, slot.sendBuffer);
+	return true;
+}
+
+bool UringLoop::watchSession(int socketFD){
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end() || it->second->ioSlot == -1){
+		return false;
+	}
+	if(it->second->connected){
+		// The kernel addresses the sends of a connected socket
+		UringSlot& slot = slots[it->second->ioSlot];
+		slot.sendMsg.msg_name = NULL;
+		slot.sendMsg.msg_namelen = 0;
+	}
+	return armRecv(it->second->ioSlot);
+}
+
+/**
+ * @brief function closes the session, the slot and its socket are released once its requests completed
+*/
+void UringLoop::closeSession(int socketFD){
+	auto it = sessions.find(socketFD);
+	if(it == sessions.end()){
+		return;
+	}
+	int slotIndex = it->second->ioSlot;
+	it->second->finishTransfer();
+	LOG(INFO)<<"Session closed: fileName["<<it->second->requestFileName<<"] success["<<it->second->transferSuccess<<"]";
+	sessions.erase(it);
+	if(slotIndex == -1){
+		UDPSocketPool::getInstance().release(socketFD);
+		return;
+	}
+	UringSlot& slot = slots[slotIndex];
+	slot.session = NULL;
+	slot.closing = true;
+	if(slot.recvArmed){
+		struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+		if(sqe != NULL){
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = URING_USER_DATA(URING_OP_RECV, slotIndex);
+			sqe->user_data = URING_USER_DATA(URING_OP_CANCEL, slotIndex);
+		}
+		else{
+			// The receive completes with an error once the socket is shut down
+			shutdown(slot.socketFD, SHUT_RDWR);
+			slot.socketShutdown = true;
+		}
+	}
+	tryRelease(slotIndex);
+	return;
+}
+
+/**
+ * @brief function frees a closing slot when no request refers to it anymore
+*/
+void UringLoop::tryRelease(int slotIndex){
+	UringSlot& slot = slots[slotIndex];
+	if(!slot.closing || slot.pendingOps > 0 || slot.commitPending){
+		return;
+	}
+	if(slot.filesRegistered){
+		// The file table holds references on the socket and the file until the entries are cleared
+		slot.filesRegistered = false;
+		slot.fileUpdate[0] = -1;
+		slot.fileUpdate[1] = -1;
+		struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+		if(sqe != NULL){
+			sqe->opcode = IORING_OP_FILES_UPDATE;
+			sqe->fd = -1;
+			sqe->addr = (uint64_t)(uintptr_t)slot.fileUpdate;
+			sqe->len = 2;
+			sqe->off = (uint64_t)slotIndex * 2;
+			sqe->user_data = URING_USER_DATA(URING_OP_FILES_UPDATE, slotIndex);
+			slot.pendingOps++;
+			return;
+		}
+		ring.updateFiles((unsigned)slotIndex * 2, slot.fileUpdate, 2);
+	}
+	if(slot.socketShutdown){
+		// A shut down socket can not receive again, the pool binds a new one to its port
+		UDPSocketPool::getInstance().discard(slot.socketFD);
+	}
+	else{
+		UDPSocketPool::getInstance().release(slot.socketFD);
+	}
+	slot.socketFD = -1;
+	slot.sendOwner.reset();
+	slot.writeBehind.reset();
+	slot.inUse = false;
+	slot.closing = false;
+	freeSlots.push_back(slotIndex);
+	return;
+}
+
+/**
+ * @brief function installs the transfer socket and the file of the slot in the fixed file table
+*/
+bool UringLoop::registerSessionFiles(int slotIndex){
+	UringSlot& slot = slots[slotIndex];
+	if(slot.filesRegistered){
+		return true;
+	}
+	int fds[2] = {slot.socketFD, slot.session->fileFD};
+	if(!ring.updateFiles((unsigned)slotIndex * 2, fds, 2)){
+		return false;
+	}
+	slot.filesRegistered = true;
+	return true;
+}
+
+bool UringLoop::queueSend(int slotIndex, struct msghdr* msg, uint64_t userData, int socketFD, uint8_t sqeFlags){
+	struct io_uring_sqe* sqe = ring.getSqe();
+	if(sqe == NULL){
+		return false;
+	}
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->flags = sqeFlags;
+	sqe->fd = socketFD;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->user_data = userData;
+	if(slotIndex != -1){
+		slots[slotIndex].pendingOps++;
+	}
+	return true;
+}
+
+/**
+ * @brief function queues a packet of the session. lastPacket is sent from the slot buffer,
+ * other packets are copied to a control packet
+*/
+bool UringLoop::sendPacket(ClientHandler* session, uint8_t* packet, int packetLen){
+	int slotIndex = session->ioSlot;
+	if(slotIndex == -1 || packetLen <= 0 || packetLen > slotPacketSize){
+		return SyncSessionIO::getInstance().sendPacket(session, packet, packetLen);
+	}
+	UringSlot& slot = slots[slotIndex];
+	if(packet == slot.sendBuffer){
+		slot.sendIov.iov_base = slot.sendBuffer;
+		slot.sendIov.iov_len = packetLen;
+		if(ring.reserve(1) && queueSend(slotIndex, &slot.sendMsg, URING_USER_DATA(URING_OP_SEND, slotIndex), slot.socketFD, 0)){
+			return true;
+		}
+		return SyncSessionIO::getInstance().sendPacket(session, packet, packetLen);
+	}
+	if(packetLen > TFTP_MAX_PACKET_SIZE || freeControlPackets.empty() || !ring.reserve(1)){
+		return SyncSessionIO::getInstance().sendPacket(session, packet, packetLen);
+	}
+	int controlIndex = freeControlPackets.back();
+	UringControlPacket& control = controlPackets[controlIndex];
+	memcpy(control.buffer, packet, packetLen);
+	control.address = session->clientAddress;
+	control.iov.iov_base = control.buffer;
+	control.iov.iov_len = packetLen;
+	memset(&control.msg, 0, sizeof(control.msg));
+	if(!session->connected){
+		control.msg.msg_name = &control.address;
+		control.msg.msg_namelen = sizeof(control.address);
+	}
+	control.msg.msg_iov = &control.iov;
+	control.msg.msg_iovlen = 1;
+	control.slot = slotIndex;
+	if(!queueSend(slotIndex, &control.msg, URING_USER_DATA(URING_OP_CONTROL, controlIndex), slot.socketFD, 0)){
+		return SyncSessionIO::getInstance().sendPacket(session, packet, packetLen);
+	}
+	freeControlPackets.pop_back();
+	return true;
+}
+
+/**
+ * @brief function queues READ_FIXED of the DATA payload linked to the send of the packet,
+ * blocks of a cached file are copied from the cache instead. Every DATA send is the I/O of the
+ * session: the slot holds a single DATA, the next block of a window waits for its completion.
+*/
+bool UringLoop::readAndSend(ClientHandler* session, uint64_t offset, int dataLen){
+	int slotIndex = session->ioSlot;
+	blocksTransferred++;
+	if(slotIndex == -1){
+		return SyncSessionIO::getInstance().readAndSend(session, offset, dataLen);
+	}
+	UringSlot& slot = slots[slotIndex];
+	if(dataLen == 0){
+		return queueDataSend(slotIndex, session->lastPacket, session->lastPacketLen);
+	}
+	const uint8_t* imagePacket = session->getImagePacket(offset, dataLen);
+	if(imagePacket != NULL && queueDataSend(slotIndex, imagePacket, session->lastPacketLen)){
+		slot.sendOwner = session->packetImage;
+		return true;
+	}
+	if(session->fileMap){
+		// Cached file, the block is copied from memory and no file read is queued
+		const uint8_t* payload = session->fileMap->getView(offset, dataLen);
+		if(payload == NULL){
+			LOG(ERROR)<<"block at "<<offset<<" outside of the cached file";
+			return false;
+		}
+		memcpy(session->lastPacket + TFTP_MAX_HEADER_SIZE, payload, dataLen);
+		return queueDataSend(slotIndex, session->lastPacket, session->lastPacketLen);
+	}
+	if(!registerSessionFiles(slotIndex) || !ring.reserve(2)){
+		return SyncSessionIO::getInstance().readAndSend(session, offset, dataLen);
+	}
+	struct io_uring_sqe* sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->fd = slotIndex * 2 + 1;
+	sqe->addr = (uint64_t)(uintptr_t)(slot.sendBuffer + TFTP_MAX_HEADER_SIZE);
+	sqe->len = (unsigned)dataLen;
+	sqe->off = offset;
+	sqe->buf_index = 0;
+	sqe->user_data = URING_USER_DATA(URING_OP_READ, slotIndex);
+	slot.pendingOps++;
+	slot.sendIov.iov_base = slot.sendBuffer;
+	slot.sendIov.iov_len = session->lastPacketLen;
+	queueSend(slotIndex, &slot.sendMsg, URING_USER_DATA(URING_OP_DATA_SEND, slotIndex), slotIndex * 2, IOSQE_FIXED_FILE);
+	slot.ioLen = dataLen;
+	slot.ioOpsLeft = 2;
+	slot.ioFailed = false;
+	session->ioPending = true;
+	return true;
+}
+
+/**
+ * @brief function queues the send of a DATA packet held in the slot buffer or in a packet image,
+ * the session is told about its completion through handleIOComplete()
+*/
+bool UringLoop::queueDataSend(int slotIndex, const uint8_t* packet, int packetLen){
+	UringSlot& slot = slots[slotIndex];
+	ClientHandler* session = slot.session;
+	if(!ring.reserve(1)){
+		return SyncSessionIO::getInstance().sendPacket(session, (uint8_t*)packet, packetLen);
+	}
+	slot.sendIov.iov_base = (void*)packet;
+	slot.sendIov.iov_len = packetLen;
+	if(!queueSend(slotIndex, &slot.sendMsg, URING_USER_DATA(URING_OP_DATA_SEND, slotIndex), slot.socketFD, 0)){
+		return SyncSessionIO::getInstance().sendPacket(session, (uint8_t*)packet, packetLen);
+	}
+	slot.ioOpsLeft = 1;
+	slot.ioFailed = false;
+	session->ioPending = true;
+	return true;
+}
+
+/**
+ * @brief function queues a FADVISE(WILLNEED) of the range. It is not linked to any send, the READ_FIXED
+ * of the blocks find them in the page cache once it completes.
+*/
+void UringLoop::readAhead(ClientHandler* session, uint64_t offset, uint64_t length){
+	int slotIndex = session->ioSlot;
+	if(slotIndex == -1 || !registerSessionFiles(slotIndex) || !ring.reserve(1)){
+		SyncSessionIO::getInstance().readAhead(session, offset, length);
+		return;
+	}
+	struct io_uring_sqe* sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_FADVISE;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = slotIndex * 2 + 1;
+	sqe->off = offset;
+	sqe->len = (uint32_t)std::min(length, (uint64_t)UINT32_MAX);
+	sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+	sqe->user_data = URING_USER_DATA(URING_OP_READ_AHEAD, slotIndex);
+	slots[slotIndex].pendingOps++;
+	return;
+}
+
+int UringLoop::getMaxBlockSize(){
+	return slotPacketSize - TFTP_MAX_HEADER_SIZE;
+}
+
+/**
+ * @brief function queues WRITE_FIXED of the received block linked to the send of the ACK, when the ACK is due.
+ * The receive buffer stays busy until the write completes.
+*/
+bool UringLoop::writeAndSend(ClientHandler* session, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock){
+	int slotIndex = session->ioSlot;
+	blocksTransferred++;
+	if(session->writeBehind){
+		if(slotIndex != -1 && registerSessionFiles(slotIndex)){
+			return bufferAndSend(slotIndex, data, dataLen, offset, finalBlock);
+		}
+		return SyncSessionIO::getInstance().writeAndSend(session, data, dataLen, offset, finalBlock);
+	}
+	UringSlot& slot = slots[slotIndex];
+	bool inRecvBuffer = (data >= slot.recvBuffer && data + dataLen <= slot.recvBuffer + slotPacketSize);
+	// The final block is written synchronously, the upload is moved into place before its ACK
+	if(finalBlock || !inRecvBuffer || !registerSessionFiles(slotIndex) || !ring.reserve(2)){
+		return SyncSessionIO::getInstance().writeAndSend(session, data, dataLen, offset, finalBlock);
+	}
+	struct io_uring_sqe* sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->flags = IOSQE_FIXED_FILE | (session->ackDue ? IOSQE_IO_LINK : 0);
+	sqe->fd = slotIndex * 2 + 1;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = (unsigned)dataLen;
+	sqe->off = offset;
+	sqe->buf_index = 0;
+	sqe->user_data = URING_USER_DATA(URING_OP_WRITE, slotIndex);
+	slot.pendingOps++;
+	slot.ioOpsLeft = 1;
+	// Inside a window the block is written without an ACK
+	if(session->ackDue){
+		slot.sendIov.iov_base = slot.sendBuffer;
+		slot.sendIov.iov_len = session->lastPacketLen;
+		queueSend(slotIndex, &slot.sendMsg, URING_USER_DATA(URING_OP_DATA_SEND, slotIndex), slotIndex * 2, IOSQE_FIXED_FILE);
+		slot.ioOpsLeft = 2;
+	}
+	slot.ioLen = dataLen;
+	slot.ioFailed = false;
+	slot.recvBusy = true;
+	session->ioPending = true;
+	return true;
+}
+
+/**
+ * @brief function queues the block in the write-behind buffer of the session and ACKs it at once, the full chunks
+ * are written by the io_uring workers. Without room for the block its ACK is held and the block stays in the receive
+ * buffer until a chunk write completes. The final ACK waits for every chunk to be written.
+*/
+bool UringLoop::bufferAndSend(int slotIndex, uint8_t* data, int dataLen, uint64_t offset, bool finalBlock){
+	UringSlot& slot = slots[slotIndex];
+	ClientHandler* session = slot.session;
+	slot.writeBehind = session->writeBehind;
+	if(!slot.writeBehind->append(data, dataLen, offset)){
+		bool inRecvBuffer = (data >= slot.recvBuffer && data + dataLen <= slot.recvBuffer + slotPacketSize);
+		if(!inRecvBuffer || slot.chunkWrites == 0){
+			return SyncSessionIO::getInstance().writeAndSend(session, data, dataLen, offset, finalBlock);
+		}
+		slot.ackHeld = true;
+		slot.heldData = data;
+		slot.heldLen = dataLen;
+		slot.heldOffset = offset;
+		slot.heldFinal = finalBlock;
+		slot.recvBusy = true;
+		session->ioPending = true;
+		acksHeld++;
+		return true;
+	}
+	slot.finalFlush = finalBlock;
+	if(!queueChunkWrites(slotIndex)){
+		return false;
+	}
+	if(slot.finalFlush){
+		if(!slot.writeBehind->isEmpty()){
+			session->ioPending = true;
+			return true;
+		}
+		slot.finalFlush = false;
+		return commitAndSend(session);
+	}
+	return sendAck(session);
+}
+
+/**
+ * @brief function queues a WRITE of every chunk ready to be written. Without a free SQE the chunks wait for the
+ * next chunk completion, or are written synchronously when no write is in flight.
+*/
+bool UringLoop::queueChunkWrites(int slotIndex){
+	UringSlot& slot = slots[slotIndex];
+	WriteBehind* writeBehind = slot.writeBehind.get();
+	int chunkIndex;
+	while((chunkIndex = writeBehind->nextChunk(slot.finalFlush)) != -1){
+		struct io_uring_sqe* sqe = ring.reserve(1) ? ring.getSqe() : NULL;
+		if(sqe == NULL){
+			return slot.chunkWrites > 0 || writeBehind->flush(slot.session->fileFD, slot.finalFlush);
+		}
+		WriteChunk* chunk = writeBehind->getChunk(chunkIndex);
+		writeBehind->startWrite(slot.session->fileFD, chunkIndex);
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = slotIndex * 2 + 1;
+		sqe->addr = (uint64_t)(uintptr_t)chunk->data;
+		sqe->len = (unsigned)chunk->len;
+		sqe->off = chunk->offset;
+		sqe->user_data = URING_USER_DATA_EXTRA(URING_OP_WRITE_BEHIND, slotIndex, chunkIndex);
+		slot.pendingOps++;
+		slot.chunkWrites++;
+	}
+	return true;
+}
+
+/**
+ * @brief function hands the upload to STARK without waiting for its group commit, the final ACK is sent
+ * once the commit is reported
+*/
+bool UringLoop::commitAndSend(ClientHandler* session){
+	slots[session->ioSlot].commitPending = true;
+	session->ioPending = true;
+	session->commitUpload(makeCompletion(session->ioSlot));
+	return true;
+}
+
+void UringLoop::completeSession(const LoopCompletion& completion){
+	int slotIndex = completion.sessionId;
+	UringSlot& slot = slots[slotIndex];
+	slot.commitPending = false;
+	if(slot.closing){
+		tryRelease(slotIndex);
+		return;
+	}
+	slot.session->handleIOComplete(completion.success && sendAck(slot.session));
+	handleSessionState(slotIndex);
+	return;
+}
+
+/**
+ * @brief function completes a chunk write. A held ACK is sent once its block fits in the buffer, the final ACK
+ * once every chunk is written. A failed write ends the session with an ERROR.
+*/
+void UringLoop::handleChunkWritten(int slotIndex, int chunkIndex, int res){
+	UringSlot& slot = slots[slotIndex];
+	WriteChunk* chunk = slot.writeBehind->getChunk(chunkIndex);
+	bool success = (res >= 0 && (size_t)res == chunk->len);
+	if(!success && res != -ECANCELED){
+		LOG(ERROR)<<"write-behind chunk at "<<chunk->offset<<" not written, result "<<res;
+	}
+	slot.chunkWrites--;
+	slot.writeBehind->chunkWritten(chunkIndex);
+	if(slot.closing){
+		tryRelease(slotIndex);
+		return;
+	}
+	bool ackReady = false;
+	if(success && slot.ackHeld){
+		if(!slot.writeBehind->append(slot.heldData, slot.heldLen, slot.heldOffset)){
+			// The freed chunk is not at the head of the ring, another write is still in flight
+			return;
+		}
+		slot.ackHeld = false;
+		slot.recvBusy = false;
+		slot.finalFlush = slot.heldFinal;
+		ackReady = true;
+	}
+	if(success && !queueChunkWrites(slotIndex)){
+		success = false;
+	}
+	if(success && slot.finalFlush){
+		if(!slot.writeBehind->isEmpty()){
+			return;
+		}
+		slot.finalFlush = false;
+		commitAndSend(slot.session);
+		return;
+	}
+	if(!success){
+		slot.ackHeld = false;
+		slot.recvBusy = false;
+		slot.finalFlush = false;
+		slot.session->handleIOComplete(false);
+		handleSessionState(slotIndex);
+		return;
+	}
+	if(ackReady){
+		slot.session->handleIOComplete(sendAck(slot.session));
+		handleSessionState(slotIndex);
+	}
+	return;
+}
+
+/**
+ * @brief function dispatches one completion
+*/
+void UringLoop::handleCompletion(uint64_t userData, int res){
+	uint64_t op = URING_USER_OP(userData);
+	int index = URING_USER_INDEX(userData);
+	switch(op){
+		case URING_OP_LISTEN_RECV:
+			if(res >= 0){
+				handleRequest(listenBuffers[index].buffer, res, listenBuffers[index].address);
+			}
+			else if(res != -ECANCELED){
+				LOG(ERROR)<<"Error receiving data: "<<strerror(-res);
+			}
+			if(running){
+				armListen(index);
+			}
+			break;
+		case URING_OP_RECV:
+			slots[index].pendingOps--;
+			slots[index].recvArmed = false;
+			handleRecvComplete(index, res);
+			break;
+		case URING_OP_READ:
+		case URING_OP_WRITE:
+		case URING_OP_DATA_SEND:
+			slots[index].pendingOps--;
+			if(op == URING_OP_DATA_SEND ? res < 0 : res != slots[index].ioLen){
+				if(res != -ECANCELED){
+					LOG(ERROR)<<"io_uring "<<(op == URING_OP_DATA_SEND ? "send" : "file I/O")<<" error, result "<<res;
+				}
+				slots[index].ioFailed = true;
+			}
+			if(--slots[index].ioOpsLeft == 0){
+				handleDataIOComplete(index, !slots[index].ioFailed);
+			}
+			break;
+		case URING_OP_SEND:
+			slots[index].pendingOps--;
+			if(res < 0){
+				LOG(ERROR)<<"packet send error: "<<strerror(-res);
+			}
+			tryRelease(index);
+			break;
+		case URING_OP_CONTROL:{
+			int slotIndex = controlPackets[index].slot;
+			freeControlPackets.push_back(index);
+			if(res < 0){
+				LOG(ERROR)<<"packet send error: "<<strerror(-res);
+			}
+			slots[slotIndex].pendingOps--;
+			tryRelease(slotIndex);
+			break;
+		}
+		case URING_OP_READ_AHEAD:
+			slots[index].pendingOps--;
+			if(res < 0 && res != -ECANCELED){
+				LOG(DEBUG)<<"read-ahead not started: "<<strerror(-res);
+			}
+			tryRelease(index);
+			break;
+		case URING_OP_WRITE_BEHIND:
+			slots[index].pendingOps--;
+			handleChunkWritten(index, URING_USER_EXTRA(userData), res);
+			break;
+		case URING_OP_FILES_UPDATE:
+			slots[index].pendingOps--;
+			if(res < 0){
+				LOG(ERROR)<<"Unable to update io_uring files: "<<strerror(-res);
+			}
+			tryRelease(index);
+			break;
+		case URING_OP_WAKE:
+			if(running){
+				armWakeup();
+			}
+			break;
+		case URING_OP_TICK:
+			if(running){
+				armTick();
+			}
+			break;
+		default:
+			break;
+	}
+	return;
+}
+
+void UringLoop::handleRecvComplete(int slotIndex, int res){
+	UringSlot& slot = slots[slotIndex];
+	if(slot.closing){
+		tryRelease(slotIndex);
+		return;
+	}
+	if(res >= 0){
+		slot.session->handlePacket(slot.recvBuffer, res, slot.recvAddress, getReceiveAgeUs(&slot.recvMsg));
+	}
+	else{
+		slot.session->handleReceiveError(-res);
+	}
+	handleSessionState(slotIndex);
+	return;
+}
+
+void UringLoop::handleDataIOComplete(int slotIndex, bool success){
+	UringSlot& slot = slots[slotIndex];
+	slot.recvBusy = false;
+	if(slot.closing){
+		tryRelease(slotIndex);
+		return;
+	}
+	slot.session->handleIOComplete(success);
+	handleSessionState(slotIndex);
+	return;
+}
+
+/**
+ * @brief function closes a finished session or keeps a receive armed on its socket
+*/
+void UringLoop::handleSessionState(int slotIndex){
+	UringSlot& slot = slots[slotIndex];
+	if(slot.session->isDone()){
+		closeSession(slot.socketFD);
+		return;
+	}
+	if(!slot.recvArmed && !slot.recvBusy && !armRecv(slotIndex)){
+		closeSession(slot.socketFD);
+		return;
+	}
+	armSessionTimer(slot.session);
+	return;
+}